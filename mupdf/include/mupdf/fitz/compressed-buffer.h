@@ -40,6 +40,8 @@ struct fz_compression_params_s
 		} jpeg;
 		struct {
 			int smask_in_data;
+			/* SumatraPDF: decode JPX images on demand */
+			int has_colorspace; /* whether to override the embedded colorspace */
 		} jpx;
 		struct {
 			int columns;
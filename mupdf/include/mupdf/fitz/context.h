@@ -13,6 +13,7 @@ typedef struct fz_error_context_s fz_error_context;
 typedef struct fz_id_context_s fz_id_context;
 typedef struct fz_warn_context_s fz_warn_context;
 typedef struct fz_font_context_s fz_font_context;
+typedef struct fz_ft_thread_context_s fz_ft_thread_context;
 typedef struct fz_colorspace_context_s fz_colorspace_context;
 typedef struct fz_aa_context_s fz_aa_context;
 typedef struct fz_locks_context_s fz_locks_context;
@@ -109,6 +110,7 @@ struct fz_context_s
 	fz_error_context *error;
 	fz_warn_context *warn;
 	fz_font_context *font;
+	fz_ft_thread_context *ft_thread; /* SumatraPDF: not shared between cloned contexts */
 	fz_colorspace_context *colorspace;
 	fz_aa_context *aa;
 	fz_store *store;
@@ -235,7 +237,10 @@ struct fz_locks_context_s
 enum {
 	FZ_LOCK_ALLOC = 0,
 	FZ_LOCK_FILE, /* Unused now */
-	FZ_LOCK_FREETYPE,
+	/* SumatraPDF: one lock per store partition (see FZ_STORE_PARTITIONS),
+	 * so that store lookups don't have to take FZ_LOCK_ALLOC */
+	FZ_LOCK_STORE,
+	FZ_LOCK_FREETYPE = FZ_LOCK_STORE + 4,
 	FZ_LOCK_GLYPHCACHE,
 	FZ_LOCK_MAX
 };
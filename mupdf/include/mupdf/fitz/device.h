@@ -212,6 +212,8 @@ enum
 	FZ_DONT_INTERPOLATE_IMAGES = 4,
 	FZ_MAINTAIN_CONTAINER_STACK = 8,
 	FZ_NO_CACHE = 16,
+	/* SumatraPDF: allow interpreters to skip constructing paths */
+	FZ_IGNORE_PATH = 32,
 };
 
 /*
@@ -62,7 +62,10 @@ fz_device *fz_new_list_device(fz_context *ctx, fz_display_list *list);
 	area: Only the part of the contents of the display list
 	visible within this area will be considered when the list is
 	run through the device. This does not imply for tile objects
-	contained in the display list.
+	contained in the display list. For larger lists, a spatial
+	index is built on the first run, so that the time taken by runs
+	for a small area (such as a tile or a band) depends mostly on
+	the objects lying within that area.
 
 	cookie: Communication mechanism between caller and library
 	running the page. Intended for multi-threaded applications,
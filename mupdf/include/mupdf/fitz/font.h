@@ -38,6 +38,12 @@ struct fz_font_s
 	/* origin of font data */
 	fz_buffer *ft_buffer;
 	char *ft_filepath; /* kept for downstream consumers (such as SumatraPDF) */
+	/* SumatraPDF: font data for loading per-thread FT_Face instances */
+	unsigned char *ft_data;
+	int ft_size;
+	/* SumatraPDF: set if listed in the font context's shared fonts */
+	int is_shared;
+	unsigned char shared_digest[16];
 
 	fz_matrix t3matrix;
 	void *t3resources;
@@ -59,6 +65,10 @@ struct fz_font_s
 	/* substitute metrics */
 	int width_count;
 	int *width_table; /* in 1000 units */
+
+	/* SumatraPDF: per glyph advance cache for text extraction */
+	int advance_count;
+	float *advance_cache;
 };
 
 /* common CJK font collections */
@@ -67,6 +77,9 @@ enum { FZ_ADOBE_CNS_1, FZ_ADOBE_GB_1, FZ_ADOBE_JAPAN_1, FZ_ADOBE_KOREA_1 };
 void fz_new_font_context(fz_context *ctx);
 fz_font_context *fz_keep_font_context(fz_context *ctx);
 void fz_drop_font_context(fz_context *ctx);
+/* SumatraPDF: per-thread FreeType instances for cloned contexts */
+void fz_new_ft_thread_context(fz_context *ctx);
+void fz_drop_ft_thread_context(fz_context *ctx);
 
 typedef fz_font *(*fz_load_system_font_func)(fz_context *ctx, const char *name, int bold, int italic, int needs_exact_metrics);
 typedef fz_font *(*fz_load_system_cjk_font_func)(fz_context *ctx, const char *name, int ros, int serif);
@@ -80,6 +93,20 @@ fz_font *fz_new_type3_font(fz_context *ctx, const char *name, const fz_matrix *m
 fz_font *fz_new_font_from_memory(fz_context *ctx, const char *name, unsigned char *data, int len, int index, int use_glyph_bbox);
 fz_font *fz_new_font_from_buffer(fz_context *ctx, const char *name, fz_buffer *buffer, int index, int use_glyph_bbox);
 fz_font *fz_new_font_from_file(fz_context *ctx, const char *name, const char *path, int index, int use_glyph_bbox);
+/*
+	SumatraPDF: fz_new_shared_font_from_memory/fz_new_shared_font_from_buffer
+	return the same fz_font (and thus the same FT_Face and glyph cache entries)
+	for all documents loading an identical font program through the same
+	font context (i.e. all clones of a context). Data passed to
+	fz_new_shared_font_from_memory must never change (e.g. builtin fonts)
+	as it's identified by its address, whereas buffers are compared by
+	content. Callers must not modify a shared font after loading it.
+	For a font context that isn't shared with a clone (yet), these behave
+	like fz_new_font_from_memory/fz_new_font_from_buffer and don't hash
+	anything.
+*/
+fz_font *fz_new_shared_font_from_memory(fz_context *ctx, const char *name, unsigned char *data, int len, int index, int use_glyph_bbox);
+fz_font *fz_new_shared_font_from_buffer(fz_context *ctx, const char *name, fz_buffer *buffer, int index, int use_glyph_bbox);
 
 fz_font *fz_keep_font(fz_context *ctx, fz_font *font);
 void fz_drop_font(fz_context *ctx, fz_font *font);
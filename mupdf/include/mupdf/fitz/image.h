@@ -36,6 +36,20 @@ typedef struct fz_image_s fz_image;
 */
 fz_pixmap *fz_new_pixmap_from_image(fz_context *ctx, fz_image *image, int w, int h);
 
+/*
+	fz_new_pixmap_from_image_area: SumatraPDF: Like fz_new_pixmap_from_image,
+	but only decodes the part of the image that is actually needed.
+
+	area: On entry, the part of the image (in full resolution image
+	pixels) that is required. On exit, the part of the image that the
+	returned pixmap covers, which may be larger (up to the entire image).
+	The pixmap's x and y hold the offset of the covered area at the
+	pixmap's own resolution.
+
+	Returns a non NULL pixmap pointer. May throw exceptions.
+*/
+fz_pixmap *fz_new_pixmap_from_image_area(fz_context *ctx, fz_image *image, int w, int h, fz_irect *area);
+
 /*
 	fz_drop_image: Drop a reference to an image.
 
@@ -57,6 +71,8 @@ fz_image *fz_new_image_from_pixmap(fz_context *ctx, fz_pixmap *pixmap, fz_image
 fz_image *fz_new_image_from_data(fz_context *ctx, unsigned char *data, int len);
 fz_image *fz_new_image_from_buffer(fz_context *ctx, fz_buffer *buffer);
 fz_pixmap *fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h);
+/* SumatraPDF: allow decoding only part of an image */
+fz_pixmap *fz_image_get_pixmap_area(fz_context *ctx, fz_image *image, int w, int h, fz_irect *area);
 void fz_free_image(fz_context *ctx, fz_storable *image);
 fz_pixmap *fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int l2factor, int native_l2factor);
 fz_pixmap *fz_expand_indexed_pixmap(fz_context *ctx, fz_pixmap *src);
@@ -81,6 +97,10 @@ struct fz_image_s
 };
 
 fz_pixmap *fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *cs, int indexed);
+/* SumatraPDF: allow decoding JPX images at reduced resolution and/or only partially:
+   l2factor is the desired reduction (updated to the one actually applied) and area the
+   part of the full resolution image to decode (NULL for all of it) */
+fz_pixmap *fz_load_jpx_ex(fz_context *ctx, unsigned char *data, int size, fz_colorspace *cs, int indexed, int *l2factor, const fz_irect *area);
 fz_pixmap *fz_load_png(fz_context *ctx, unsigned char *data, int size);
 fz_pixmap *fz_load_tiff(fz_context *ctx, unsigned char *data, int size);
 fz_pixmap *fz_load_jxr(fz_context *ctx, unsigned char *data, int size);
@@ -89,6 +109,8 @@ void fz_load_jpeg_info(fz_context *ctx, unsigned char *data, int size, int *w, i
 void fz_load_png_info(fz_context *ctx, unsigned char *data, int size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace);
 void fz_load_tiff_info(fz_context *ctx, unsigned char *data, int size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace);
 void fz_load_jxr_info(fz_context *ctx, unsigned char *data, int size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace);
+/* SumatraPDF: allow decoding JPX images on demand */
+void fz_load_jpx_info(fz_context *ctx, unsigned char *data, int size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace, int indexed);
 
 int fz_load_tiff_subimage_count(fz_context *ctx, unsigned char *buf, int len);
 fz_pixmap *fz_load_tiff_subimage(fz_context *ctx, unsigned char *buf, int len, int subimage);
@@ -48,7 +48,9 @@ void fz_drop_storable(fz_context *, fz_storable *);
 	have a structure full of functions for each key 'type'; this
 	fz_store_type pointer is stored with each key, and tells the store
 	how to perform certain operations (like taking/dropping a reference,
-	comparing two keys, outputting details for debugging etc).
+	comparing two keys, outputting details for debugging etc). The
+	type also names the partition of the store that its items are
+	accounted to.
 
 	The store uses a hash table internally for speed where possible. In
 	order for this to work, we need a mechanism for turning a generic
@@ -84,10 +86,26 @@ struct fz_store_hash_s
 	} u;
 };
 
+/*
+	The store is split into partitions, one per broad kind of value, so
+	that e.g. a burst of large decoded images cannot push every cached
+	font out of the store. Each partition keeps its own LRU list, its
+	own (optional) byte budget and its own statistics; the overall
+	store limit still applies on top of that.
+*/
+enum {
+	FZ_STORE_OBJECTS = 0, /* PDF resources not listed below (colorspaces, shadings, functions, ...) */
+	FZ_STORE_FONTS,
+	FZ_STORE_IMAGES, /* images and their decoded pixmaps */
+	FZ_STORE_TILES, /* rendered pattern tiles */
+	FZ_STORE_PARTITIONS
+};
+
 typedef struct fz_store_type_s fz_store_type;
 
 struct fz_store_type_s
 {
+	int partition;
 	int (*make_hash_key)(fz_store_hash *, void *);
 	void *(*keep_key)(fz_context *,void *);
 	void (*drop_key)(fz_context *,void *);
@@ -115,6 +133,44 @@ void fz_drop_store_context(fz_context *ctx);
 */
 fz_store *fz_keep_store_context(fz_context *ctx);
 
+/*
+	fz_set_store_partition_max: Limit the size of one partition of the
+	store.
+
+	partition: One of FZ_STORE_OBJECTS, FZ_STORE_FONTS, etc.
+
+	max: The maximum size (in bytes) that items of this partition may
+	take up. Items are evicted from the partition itself to stay within
+	this budget. FZ_STORE_UNLIMITED means that only the limit of the
+	whole store applies.
+*/
+void fz_set_store_partition_max(fz_context *ctx, int partition, unsigned int max);
+
+typedef struct fz_store_stats_s fz_store_stats;
+
+struct fz_store_stats_s
+{
+	unsigned int size;
+	unsigned int max;
+	int items;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+};
+
+/*
+	fz_get_store_stats: Retrieve the occupancy and hit rate of a
+	partition of the store.
+
+	partition: One of FZ_STORE_OBJECTS, FZ_STORE_FONTS, etc. or -1 for
+	the totals over the whole store.
+
+	stats: Filled in with the current size and budget (in bytes), the
+	number of items and the number of lookup hits, lookup misses and
+	evicted items since the store was created.
+*/
+void fz_get_store_stats(fz_context *ctx, int partition, fz_store_stats *stats);
+
 /*
 	fz_store_item: Add an item to the store.
 
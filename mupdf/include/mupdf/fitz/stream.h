@@ -52,6 +52,30 @@ fz_stream *fz_open_file_w(fz_context *ctx, const wchar_t *filename);
 */
 fz_stream *fz_open_fd(fz_context *ctx, int file);
 
+/*
+	fz_open_fd_mapped: Map the file behind an open file descriptor
+	into memory and wrap the mapping in a stream.
+
+	SumatraPDF: Only use mappings for files which aren't going to be
+	modified while the stream is open: on Windows, a mapped file can't
+	be truncated or overwritten and elsewhere, accessing a truncated
+	mapping crashes (SIGBUS).
+
+	file: An open file descriptor for a regular file. The stream will
+	take ownership of the file descriptor (which is closed right away,
+	as the mapping remains valid without it). Throws if the file can't
+	be mapped (e.g. because it is empty or too large for the address
+	space).
+*/
+fz_stream *fz_open_fd_mapped(fz_context *ctx, int file);
+
+/*
+	fz_open_file_mapped: SumatraPDF: Open the named file and map it
+	into memory (see fz_open_fd_mapped), falling back to fz_open_file
+	if the file can't be mapped.
+*/
+fz_stream *fz_open_file_mapped(fz_context *ctx, const char *filename);
+
 /*
 	fz_open_memory: Open a block of memory as a stream.
 
@@ -79,6 +103,17 @@ fz_stream *fz_open_buffer(fz_context *ctx, fz_buffer *buf);
 /* SumatraPDF: allow to clone a stream */
 fz_stream *fz_clone_stream(fz_context *ctx, fz_stream *stm);
 
+/*
+	fz_stream_data: SumatraPDF: Access the data of a stream backed by
+	memory (a buffer, a memory block or a mapped file) without copying.
+
+	len: Receives the total length of the stream's data.
+
+	Returns a pointer to the beginning of the data (valid for as long
+	as the stream is kept) or NULL for all other streams.
+*/
+unsigned char *fz_stream_data(fz_stream *stm, int *len);
+
 /*
 	fz_open_leecher: Attach a filter to a stream that will store any
 	characters read from the stream into the supplied buffer.
@@ -196,6 +196,10 @@ struct pdf_unsaved_sig_s
 };
 
 
+/* SumatraPDF: cache decompressed object streams */
+typedef struct pdf_obj_stm_s pdf_obj_stm;
+#define PDF_OBJ_STM_CACHE_COUNT 16
+
 struct pdf_document_s
 {
 	fz_document super;
@@ -286,6 +290,11 @@ struct pdf_document_s
 	int num_type3_fonts;
 	int max_type3_fonts;
 	fz_font **type3_fonts;
+
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_obj_stm *obj_stm_cache[PDF_OBJ_STM_CACHE_COUNT];
+	unsigned int obj_stm_cache_size;
+	int obj_stm_cache_clock;
 };
 
 /*
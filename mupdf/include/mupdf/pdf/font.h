@@ -125,6 +125,7 @@ void pdf_install_load_system_font_funcs(fz_context *ctx);
 pdf_font_desc *pdf_new_font_desc(fz_context *ctx);
 pdf_font_desc *pdf_keep_font(fz_context *ctx, pdf_font_desc *fontdesc);
 void pdf_drop_font(fz_context *ctx, pdf_font_desc *font);
+void pdf_free_font_imp(fz_context *ctx, fz_storable *fontdesc);
 
 #ifndef NDEBUG
 void pdf_print_font(fz_context *ctx, pdf_font_desc *fontdesc);
@@ -135,7 +135,6 @@ struct xps_font_cache_s
 {
 	char *name;
 	fz_font *font;
-	xps_font_cache *next;
 };
 
 typedef struct xps_glyph_metrics_s xps_glyph_metrics;
@@ -162,19 +161,32 @@ void xps_set_color(xps_document *doc, fz_colorspace *colorspace, float *samples)
  */
 
 typedef struct xps_resource_s xps_resource;
+typedef struct xps_remote_resource_s xps_remote_resource;
 
 struct xps_resource_s
 {
 	char *name;
 	char *base_uri; /* only used in the head nodes */
 	fz_xml *base_xml; /* only used in the head nodes, to free the xml document */
+	xps_remote_resource *remote; /* SumatraPDF: only used in the head nodes, to release a cached remote dictionary */
 	fz_xml *data;
 	xps_resource *next;
 	xps_resource *parent; /* up to the previous dict in the stack */
 };
 
+/* SumatraPDF: remote resource dictionaries are parsed only once per document */
+struct xps_remote_resource_s
+{
+	int refs;
+	char *part_name;
+	char *base_uri;
+	fz_xml *xml;
+	xps_remote_resource *next;
+};
+
 xps_resource * xps_parse_resource_dictionary(xps_document *doc, char *base_uri, fz_xml *root);
 void xps_free_resource_dictionary(xps_document *doc, xps_resource *dict);
+void xps_free_remote_resources(xps_document *doc);
 void xps_resolve_resource_reference(xps_document *doc, xps_resource *dict, char **attp, fz_xml **tagp, char **urip);
 
 void xps_print_resource_dictionary(xps_resource *dict);
@@ -246,7 +258,10 @@ struct xps_document_s
 	char *part_uri; /* part uri for parsing metadata relations */
 
 	/* We cache font resources */
-	xps_font_cache *font_table;
+	fz_hash_table *font_table; /* SumatraPDF: of xps_font_cache, keyed by the MD5 of the lowercased name */
+
+	/* SumatraPDF: cache of parsed remote resource dictionaries */
+	xps_remote_resource *remote_resources;
 
 	/* Opacity attribute stack */
 	float opacity[64];
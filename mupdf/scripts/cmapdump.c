@@ -183,6 +183,14 @@ fz_font_context *fz_keep_font_context(fz_context *ctx)
 	return NULL;
 }
 
+void fz_new_ft_thread_context(fz_context *ctx)
+{
+}
+
+void fz_drop_ft_thread_context(fz_context *ctx)
+{
+}
+
 void fz_new_colorspace_context(fz_context *ctx)
 {
 }
@@ -54,6 +54,7 @@ fz_free_context(fz_context *ctx)
 	fz_drop_store_context(ctx);
 	fz_free_aa_context(ctx);
 	fz_drop_colorspace_context(ctx);
+	fz_drop_ft_thread_context(ctx);
 	fz_drop_font_context(ctx);
 	fz_drop_id_context(ctx);
 
@@ -195,6 +196,15 @@ fz_clone_context_internal(fz_context *ctx)
 	new_ctx->colorspace = fz_keep_colorspace_context(new_ctx);
 	new_ctx->font = ctx->font;
 	new_ctx->font = fz_keep_font_context(new_ctx);
+	/* SumatraPDF: cloned contexts render glyphs without FZ_LOCK_FREETYPE */
+	fz_try(new_ctx)
+	{
+		fz_new_ft_thread_context(new_ctx);
+	}
+	fz_catch(new_ctx)
+	{
+		new_ctx->ft_thread = NULL;
+	}
 	new_ctx->id = ctx->id;
 	new_ctx->id = fz_keep_id_context(new_ctx);
 	new_ctx->handler = ctx->handler;
@@ -584,7 +584,7 @@ fz_draw_fill_text(fz_device *devp, fz_text *text, const fz_matrix *ctm,
 				fz_matrix mat;
 				mat.a = pixmap->w; mat.b = mat.c = 0; mat.d = pixmap->h;
 				mat.e = x + pixmap->x; mat.f = y + pixmap->y;
-				fz_paint_image(state->dest, &state->scissor, state->shape, pixmap, &mat, alpha * 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES));
+				fz_paint_image(state->dest, &state->scissor, state->shape, pixmap, &mat, alpha * 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES), 1);
 			}
 			fz_drop_glyph(dev->ctx, glyph);
 		}
@@ -1058,6 +1058,68 @@ fz_transform_pixmap(fz_draw_device *dev, fz_pixmap *image, fz_matrix *ctm, int x
 	return NULL;
 }
 
+/* SumatraPDF: only decode the part of an image that is visible within clip
+   and update ctm (and the desired size dx/dy) to map to just that part.
+   ctm is grid fitted (if requested) before, so that subarea must not be
+   grid fitted again afterwards */
+static fz_pixmap *
+fz_new_pixmap_from_image_clipped(fz_context *ctx, fz_image *image, fz_matrix *ctm, const fz_irect *clip, int *dx, int *dy, int gridfit, int *subarea)
+{
+	fz_pixmap *pixmap;
+	fz_matrix inverse, m;
+	fz_rect rect;
+	fz_irect area;
+	int pad_x, pad_y;
+
+	*subarea = 0;
+	if (fz_is_infinite_irect(clip) || fz_try_invert_matrix(&inverse, ctm))
+		return fz_new_pixmap_from_image(ctx, image, *dx, *dy);
+
+	fz_rect_from_irect(&rect, clip);
+	fz_transform_rect(&rect, &inverse);
+	fz_intersect_rect(&rect, &fz_unit_rect);
+	if (fz_is_empty_rect(&rect))
+	{
+		/* nothing is visible, so decode as little as possible */
+		area.x0 = area.y0 = 0;
+		area.x1 = area.y1 = 1;
+	}
+	else
+	{
+		/* leave room for the scaler's filter to look at neighboring pixels */
+		pad_x = 2 + 2 * image->w / fz_maxi(*dx, 1);
+		pad_y = 2 + 2 * image->h / fz_maxi(*dy, 1);
+		area.x0 = fz_maxi((int)floorf(rect.x0 * image->w) - pad_x, 0);
+		area.y0 = fz_maxi((int)floorf(rect.y0 * image->h) - pad_y, 0);
+		area.x1 = fz_mini((int)ceilf(rect.x1 * image->w) + pad_x, image->w);
+		area.y1 = fz_mini((int)ceilf(rect.y1 * image->h) + pad_y, image->h);
+
+		/* decode all of an image that is mostly visible, so that it can be
+		 * reused from the cache when drawing neighboring tiles */
+		if ((float)(area.x1 - area.x0) * (area.y1 - area.y0) > (float)image->w * image->h / 2)
+			return fz_new_pixmap_from_image(ctx, image, *dx, *dy);
+	}
+
+	pixmap = fz_new_pixmap_from_image_area(ctx, image, *dx, *dy, &area);
+
+	if (area.x0 > 0 || area.y0 > 0 || area.x1 < image->w || area.y1 < image->h)
+	{
+		if (gridfit)
+			fz_gridfit_matrix(ctm);
+		m.a = (float)(area.x1 - area.x0) / image->w;
+		m.b = m.c = 0;
+		m.d = (float)(area.y1 - area.y0) / image->h;
+		m.e = (float)area.x0 / image->w;
+		m.f = (float)area.y0 / image->h;
+		fz_concat(ctm, &m, ctm);
+		*dx = sqrtf(ctm->a * ctm->a + ctm->b * ctm->b);
+		*dy = sqrtf(ctm->c * ctm->c + ctm->d * ctm->d);
+		*subarea = 1;
+	}
+
+	return pixmap;
+}
+
 static void
 fz_draw_fill_image(fz_device *devp, fz_image *image, const fz_matrix *ctm, float alpha)
 {
@@ -1073,6 +1135,8 @@ fz_draw_fill_image(fz_device *devp, fz_image *image, const fz_matrix *ctm, float
 	fz_colorspace *model = state->dest->colorspace;
 	fz_irect clip;
 	fz_matrix local_ctm = *ctm;
+	int gridfit = alpha == 1.0f && !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
+	int subarea;
 
 	fz_intersect_irect(fz_pixmap_bbox(ctx, state->dest, &clip), &state->scissor);
 
@@ -1090,7 +1154,7 @@ fz_draw_fill_image(fz_device *devp, fz_image *image, const fz_matrix *ctm, float
 	dx = sqrtf(local_ctm.a * local_ctm.a + local_ctm.b * local_ctm.b);
 	dy = sqrtf(local_ctm.c * local_ctm.c + local_ctm.d * local_ctm.d);
 
-	pixmap = fz_new_pixmap_from_image(ctx, image, dx, dy);
+	pixmap = fz_new_pixmap_from_image_clipped(ctx, image, &local_ctm, &clip, &dx, &dy, gridfit, &subarea);
 	orig_pixmap = pixmap;
 
 	/* convert images with more components (cmyk->rgb) before scaling */
@@ -1117,8 +1181,7 @@ fz_draw_fill_image(fz_device *devp, fz_image *image, const fz_matrix *ctm, float
 
 		if (dx < pixmap->w && dy < pixmap->h && !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES))
 		{
-			int gridfit = alpha == 1.0f && !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
-			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit, &clip);
+			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit && !subarea, &clip);
 			if (!scaled)
 			{
 				if (dx < 1)
@@ -1148,7 +1211,7 @@ fz_draw_fill_image(fz_device *devp, fz_image *image, const fz_matrix *ctm, float
 			}
 		}
 
-		fz_paint_image(state->dest, &state->scissor, state->shape, pixmap, &local_ctm, alpha * 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES));
+		fz_paint_image(state->dest, &state->scissor, state->shape, pixmap, &local_ctm, alpha * 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES), !subarea);
 
 		if (state->blendmode & FZ_BLEND_KNOCKOUT)
 			fz_knockout_end(dev);
@@ -1182,6 +1245,8 @@ fz_draw_fill_image_mask(fz_device *devp, fz_image *image, const fz_matrix *ctm,
 	fz_colorspace *model = state->dest->colorspace;
 	fz_irect clip;
 	fz_matrix local_ctm = *ctm;
+	int gridfit = alpha == 1.0f && !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
+	int subarea;
 
 	fz_pixmap_bbox(ctx, state->dest, &clip);
 	fz_intersect_irect(&clip, &state->scissor);
@@ -1191,7 +1256,7 @@ fz_draw_fill_image_mask(fz_device *devp, fz_image *image, const fz_matrix *ctm,
 
 	dx = sqrtf(local_ctm.a * local_ctm.a + local_ctm.b * local_ctm.b);
 	dy = sqrtf(local_ctm.c * local_ctm.c + local_ctm.d * local_ctm.d);
-	pixmap = fz_new_pixmap_from_image(ctx, image, dx, dy);
+	pixmap = fz_new_pixmap_from_image_clipped(ctx, image, &local_ctm, &clip, &dx, &dy, gridfit, &subarea);
 	orig_pixmap = pixmap;
 
 	fz_try(ctx)
@@ -1201,8 +1266,7 @@ fz_draw_fill_image_mask(fz_device *devp, fz_image *image, const fz_matrix *ctm,
 
 		if (dx < pixmap->w && dy < pixmap->h)
 		{
-			int gridfit = alpha == 1.0f && !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
-			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit, &clip);
+			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit && !subarea, &clip);
 			if (!scaled)
 			{
 				if (dx < 1)
@@ -1220,7 +1284,7 @@ fz_draw_fill_image_mask(fz_device *devp, fz_image *image, const fz_matrix *ctm,
 			colorbv[i] = colorfv[i] * 255;
 		colorbv[i] = alpha * 255;
 
-		fz_paint_image_with_color(state->dest, &state->scissor, state->shape, pixmap, &local_ctm, colorbv, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES));
+		fz_paint_image_with_color(state->dest, &state->scissor, state->shape, pixmap, &local_ctm, colorbv, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES), !subarea);
 
 		if (scaled)
 			fz_drop_pixmap(dev->ctx, scaled);
@@ -1256,6 +1320,8 @@ fz_draw_clip_image_mask(fz_device *devp, fz_image *image, const fz_rect *rect, c
 	fz_irect clip;
 	fz_matrix local_ctm = *ctm;
 	fz_rect urect;
+	int gridfit = !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
+	int subarea;
 
 	fz_pixmap_bbox(ctx, state->dest, &clip);
 	fz_intersect_irect(&clip, &state->scissor);
@@ -1294,7 +1360,7 @@ fz_draw_clip_image_mask(fz_device *devp, fz_image *image, const fz_rect *rect, c
 
 	fz_try(ctx)
 	{
-		pixmap = fz_new_pixmap_from_image(ctx, image, dx, dy);
+		pixmap = fz_new_pixmap_from_image_clipped(ctx, image, &local_ctm, &bbox, &dx, &dy, gridfit, &subarea);
 		orig_pixmap = pixmap;
 
 		state[1].mask = mask = fz_new_pixmap_with_bbox(dev->ctx, NULL, &bbox);
@@ -1313,8 +1379,7 @@ fz_draw_clip_image_mask(fz_device *devp, fz_image *image, const fz_rect *rect, c
 
 		if (dx < pixmap->w && dy < pixmap->h)
 		{
-			int gridfit = !(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3);
-			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit, &clip);
+			scaled = fz_transform_pixmap(dev, pixmap, &local_ctm, state->dest->x, state->dest->y, dx, dy, gridfit && !subarea, &clip);
 			if (!scaled)
 			{
 				if (dx < 1)
@@ -1326,7 +1391,7 @@ fz_draw_clip_image_mask(fz_device *devp, fz_image *image, const fz_rect *rect, c
 			if (scaled)
 				pixmap = scaled;
 		}
-		fz_paint_image(mask, &bbox, state->shape, pixmap, &local_ctm, 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES));
+		fz_paint_image(mask, &bbox, state->shape, pixmap, &local_ctm, 255, !(devp->hints & FZ_DONT_INTERPOLATE_IMAGES), !subarea);
 	}
 	fz_always(ctx)
 	{
@@ -1703,6 +1768,7 @@ fz_debug_tile(FILE *out, void *key_)
 
 static fz_store_type fz_tile_store_type =
 {
+	FZ_STORE_TILES,
 	fz_make_hash_tile_key,
 	fz_keep_tile_key,
 	fz_drop_tile_key,
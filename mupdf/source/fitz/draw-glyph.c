@@ -310,7 +310,14 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 	{
 		if (font->ft_face)
 		{
+			/* SumatraPDF: render without holding the glyph cache lock
+			 * so that several threads can rasterize in parallel
+			 * (see the comment for Type 3 glyphs below) */
+			fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
+			locked = 0;
 			val = fz_render_ft_glyph(ctx, font, gid, &subpix_ctm, key.aa);
+			fz_lock(ctx, FZ_LOCK_GLYPHCACHE);
+			locked = 1;
 		}
 		else if (font->t3procs)
 		{
@@ -340,22 +347,19 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 				/* If we throw an exception whilst caching,
 				 * just ignore the exception and carry on. */
 				caching = 1;
-				if (!font->ft_face)
+				/* We had to unlock. Someone else might
+				 * have rendered in the meantime */
+				entry = cache->entry[hash];
+				while (entry)
 				{
-					/* We had to unlock. Someone else might
-					 * have rendered in the meantime */
-					entry = cache->entry[hash];
-					while (entry)
+					if (memcmp(&entry->key, &key, sizeof(key)) == 0)
 					{
-						if (memcmp(&entry->key, &key, sizeof(key)) == 0)
-						{
-							fz_drop_glyph(ctx, val);
-							move_to_front(cache, entry);
-							val = fz_keep_glyph(ctx, entry->val);
-							goto unlock_and_return_val;
-						}
-						entry = entry->bucket_next;
+						fz_drop_glyph(ctx, val);
+						move_to_front(cache, entry);
+						val = fz_keep_glyph(ctx, entry->val);
+						goto unlock_and_return_val;
 					}
+					entry = entry->bucket_next;
 				}
 
 				entry = fz_malloc_struct(ctx, fz_glyph_cache_entry);
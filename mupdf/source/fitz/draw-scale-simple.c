@@ -1305,13 +1305,12 @@ fz_scale_pixmap_cached(fz_context *ctx, fz_pixmap *src, float x, float y, float
 	flip_y = (h < 0);
 	if (flip_y)
 	{
-		float tmp;
+		/* SumatraPDF: rows are output top-down (reading the source
+		 * bottom-up), so the sub pixel offset is from the top edge */
 		h = -h;
 		dst_y_int = floorf(y-h);
-		tmp = ceilf(y);
-		dst_h_int = (int)tmp;
-		y = tmp - y;
-		dst_h_int -= dst_y_int;
+		y -= h + (float)dst_y_int;
+		dst_h_int = (int)ceilf(y + h);
 	}
 	else
 	{
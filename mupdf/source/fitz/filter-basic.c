@@ -22,10 +22,27 @@ static int
 next_null(fz_stream *stm, int max)
 {
 	struct null_filter *state = stm->state;
-	int n;
+	unsigned char *data;
+	int n, len;
 
 	if (state->remain == 0)
 		return EOF;
+	/* SumatraPDF: point directly into streams backed by memory */
+	data = fz_stream_data(state->chain, &len);
+	if (data)
+	{
+		if (state->offset > len)
+			state->offset = len;
+		n = fz_mini(state->remain, len - state->offset);
+		stm->rp = data + state->offset;
+		stm->wp = stm->rp + n;
+		if (n == 0)
+			return EOF;
+		state->remain -= n;
+		state->offset += n;
+		stm->pos += n;
+		return *stm->rp++;
+	}
 	fz_seek(state->chain, state->offset, 0);
 	n = fz_available(state->chain, max);
 	if (n > state->remain)
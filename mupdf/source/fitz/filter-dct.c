@@ -228,7 +228,8 @@ close_dctd(fz_context *ctx, void *state_)
 		goto skip;
 	}
 
-	if (state->init)
+	/* SumatraPDF: images may be decoded only partially */
+	if (state->init && state->cinfo.output_scanline >= state->cinfo.output_height)
 		jpeg_finish_decompress(&state->cinfo);
 
 skip:
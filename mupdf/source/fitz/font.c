@@ -11,6 +11,7 @@
 #define SHEAR 0.36397f
 
 static void fz_drop_freetype(fz_context *ctx);
+static void fz_unlist_shared_font(fz_context *ctx, fz_font *font);
 
 static fz_font *
 fz_new_font(fz_context *ctx, const char *name, int use_glyph_bbox, int glyph_count)
@@ -34,6 +35,9 @@ fz_new_font(fz_context *ctx, const char *name, int use_glyph_bbox, int glyph_cou
 
 	font->ft_buffer = NULL;
 	font->ft_filepath = NULL;
+	font->ft_data = NULL;
+	font->ft_size = 0;
+	font->is_shared = 0;
 
 	font->t3matrix = fz_identity;
 	font->t3resources = NULL;
@@ -68,6 +72,9 @@ fz_new_font(fz_context *ctx, const char *name, int use_glyph_bbox, int glyph_cou
 	font->width_count = 0;
 	font->width_table = NULL;
 
+	font->advance_count = 0;
+	font->advance_cache = NULL;
+
 	return font;
 }
 
@@ -123,6 +130,9 @@ fz_drop_font(fz_context *ctx, fz_font *font)
 
 	fz_lock(ctx, FZ_LOCK_ALLOC);
 	drop = (font && --font->refs == 0);
+	/* SumatraPDF: unlist under the same lock, so that nobody can find the font anymore */
+	if (drop && font->is_shared)
+		fz_unlist_shared_font(ctx, font);
 	fz_unlock(ctx, FZ_LOCK_ALLOC);
 	if (!drop)
 		return;
@@ -155,6 +165,7 @@ fz_drop_font(fz_context *ctx, fz_font *font)
 	fz_free(ctx, font->ft_filepath);
 	fz_free(ctx, font->bbox_table);
 	fz_free(ctx, font->width_table);
+	fz_free(ctx, font->advance_cache);
 	fz_free(ctx, font);
 }
 
@@ -195,6 +206,8 @@ struct fz_font_context_s {
 	int ftlib_refs;
 	fz_load_system_font_func load_font;
 	fz_load_system_cjk_font_func load_cjk_font;
+	/* SumatraPDF: fonts shared between documents (weak references) */
+	fz_hash_table *shared_fonts;
 };
 
 #undef __FTERRORS_H__
@@ -215,6 +228,7 @@ void fz_new_font_context(fz_context *ctx)
 	ctx->font->ftlib = NULL;
 	ctx->font->ftlib_refs = 0;
 	ctx->font->load_font = NULL;
+	ctx->font->shared_fonts = fz_new_hash_table(ctx, 32, 16, FZ_LOCK_ALLOC);
 }
 
 fz_font_context *
@@ -237,7 +251,11 @@ void fz_drop_font_context(fz_context *ctx)
 	drop = --ctx->font->ctx_refs;
 	fz_unlock(ctx, FZ_LOCK_ALLOC);
 	if (drop == 0)
+	{
+		if (ctx->font->shared_fonts)
+			fz_free_hash(ctx, ctx->font->shared_fonts);
 		fz_free(ctx, ctx->font);
+	}
 }
 
 void fz_install_load_system_font_funcs(fz_context *ctx, fz_load_system_font_func f, fz_load_system_cjk_font_func f_cjk)
@@ -383,6 +401,153 @@ fz_check_font_dimensions(FT_Face face)
 	}
 }
 
+/*
+ * SumatraPDF: FT_Face objects can't be used from several threads at once,
+ * so rendering a glyph used to require FZ_LOCK_FREETYPE. Instead, each
+ * cloned context (i.e. each rendering thread) loads its own FT_Face
+ * instances from the shared font data into a private FT_Library. The fz_font
+ * remains the shared owner of that data (each private face keeps a
+ * reference to it) and rendered glyphs still end up in the shared glyph cache.
+ */
+
+#define FZ_FT_THREAD_FACES 32
+
+struct fz_ft_thread_context_s
+{
+	FT_Library ftlib;
+	int len;
+	struct {
+		fz_font *font;
+		FT_Face face; /* NULL if the face couldn't be loaded */
+	} faces[FZ_FT_THREAD_FACES]; /* most recently used first */
+};
+
+void fz_new_ft_thread_context(fz_context *ctx)
+{
+	ctx->ft_thread = fz_malloc_struct(ctx, fz_ft_thread_context);
+	ctx->ft_thread->ftlib = NULL;
+	ctx->ft_thread->len = 0;
+}
+
+static void
+fz_drop_ft_thread_face(fz_context *ctx, fz_font *font, FT_Face face)
+{
+	int fterr;
+
+	if (face)
+	{
+		fterr = FT_Done_Face(face);
+		if (fterr)
+			fz_warn(ctx, "freetype finalizing face: %s", ft_error_string(fterr));
+	}
+	fz_drop_font(ctx, font);
+}
+
+void fz_drop_ft_thread_context(fz_context *ctx)
+{
+	fz_ft_thread_context *ftt;
+	int fterr;
+
+	if (!ctx || !ctx->ft_thread)
+		return;
+	ftt = ctx->ft_thread;
+	while (ftt->len > 0)
+	{
+		ftt->len--;
+		fz_drop_ft_thread_face(ctx, ftt->faces[ftt->len].font, ftt->faces[ftt->len].face);
+	}
+	if (ftt->ftlib)
+	{
+		fterr = FT_Done_FreeType(ftt->ftlib);
+		if (fterr)
+			fz_warn(ctx, "freetype finalizing: %s", ft_error_string(fterr));
+	}
+	fz_free(ctx, ftt);
+	ctx->ft_thread = NULL;
+}
+
+static FT_Face
+fz_load_ft_thread_face(fz_context *ctx, fz_font *font)
+{
+	fz_ft_thread_context *ftt = ctx->ft_thread;
+	FT_Face face;
+	int fterr, i;
+
+	for (i = 0; i < ftt->len; i++)
+	{
+		if (ftt->faces[i].font == font)
+			break;
+	}
+	if (i < ftt->len)
+	{
+		face = ftt->faces[i].face;
+		memmove(&ftt->faces[1], &ftt->faces[0], i * sizeof(ftt->faces[0]));
+		ftt->faces[0].font = font;
+		ftt->faces[0].face = face;
+		return face;
+	}
+
+	if (!ftt->ftlib)
+	{
+		fterr = FT_Init_FreeType(&ftt->ftlib);
+		if (fterr)
+		{
+			fz_warn(ctx, "cannot init freetype: %s", ft_error_string(fterr));
+			/* fall back to the shared faces for good */
+			fz_free(ctx, ftt);
+			ctx->ft_thread = NULL;
+			return NULL;
+		}
+	}
+
+	if (font->ft_data)
+		fterr = FT_New_Memory_Face(ftt->ftlib, font->ft_data, font->ft_size, ((FT_Face)font->ft_face)->face_index, &face);
+	else
+		fterr = FT_New_Face(ftt->ftlib, font->ft_filepath, ((FT_Face)font->ft_face)->face_index, &face);
+	if (fterr)
+	{
+		fz_warn(ctx, "freetype: cannot load font: %s", ft_error_string(fterr));
+		face = NULL;
+	}
+	else
+		fz_check_font_dimensions(face);
+
+	if (ftt->len == FZ_FT_THREAD_FACES)
+	{
+		ftt->len--;
+		fz_drop_ft_thread_face(ctx, ftt->faces[ftt->len].font, ftt->faces[ftt->len].face);
+	}
+	memmove(&ftt->faces[1], &ftt->faces[0], ftt->len * sizeof(ftt->faces[0]));
+	ftt->faces[0].font = fz_keep_font(ctx, font);
+	ftt->faces[0].face = face;
+	ftt->len++;
+
+	return face;
+}
+
+/* Returns either this thread's private face or the shared one with the
+ * freetype lock held (until the matching fz_unlock_ft_face) */
+static FT_Face
+fz_lock_ft_face(fz_context *ctx, fz_font *font)
+{
+	FT_Face face = NULL;
+
+	if (ctx->ft_thread && (font->ft_data || font->ft_filepath))
+		face = fz_load_ft_thread_face(ctx, font);
+	if (face)
+		return face;
+
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	return font->ft_face;
+}
+
+static void
+fz_unlock_ft_face(fz_context *ctx, fz_font *font, FT_Face face)
+{
+	if (face == font->ft_face)
+		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+}
+
 fz_font *
 fz_new_font_from_file(fz_context *ctx, const char *name, const char *path, int index, int use_glyph_bbox)
 {
@@ -446,6 +611,8 @@ fz_new_font_from_memory(fz_context *ctx, const char *name, unsigned char *data,
 		(float) face->bbox.yMin / face->units_per_EM,
 		(float) face->bbox.xMax / face->units_per_EM,
 		(float) face->bbox.yMax / face->units_per_EM);
+	font->ft_data = data;
+	font->ft_size = len;
 
 	return font;
 }
@@ -458,8 +625,136 @@ fz_new_font_from_buffer(fz_context *ctx, const char *name, fz_buffer *buffer, in
 	return font;
 }
 
+static void
+fz_unlist_shared_font(fz_context *ctx, fz_font *font)
+{
+	fz_hash_remove(ctx, ctx->font->shared_fonts, font->shared_digest);
+}
+
+/* Fonts are identified by an MD5 digest over their data (or for static data
+ * its address) and all the arguments which could make two fz_fonts differ */
+static void
+fz_digest_shared_font(const char *name, unsigned char *data, int len, int hash_data, int index, int use_glyph_bbox, unsigned char digest[16])
+{
+	fz_md5 md5;
+	int args[4];
+
+	args[0] = hash_data;
+	args[1] = len;
+	args[2] = index;
+	args[3] = use_glyph_bbox;
+
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, (unsigned char *)args, sizeof(args));
+	if (hash_data)
+		fz_md5_update(&md5, data, len);
+	else
+		fz_md5_update(&md5, (unsigned char *)&data, sizeof(data));
+	fz_md5_update(&md5, (unsigned char *)name, strlen(name));
+	fz_md5_final(&md5, digest);
+}
+
+/* Only clones share a font context, so for a context which hasn't been
+ * cloned (such as SumatraPDF's one context per document) no other document
+ * could ever find a listed font and hashing its data would be wasted work */
+static int
+fz_font_context_is_shared(fz_context *ctx)
+{
+	int shared;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	shared = ctx->font->ctx_refs > 1;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return shared;
+}
+
+static fz_font *
+fz_find_shared_font(fz_context *ctx, unsigned char digest[16])
+{
+	fz_font *font;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	font = fz_hash_find(ctx, ctx->font->shared_fonts, digest);
+	if (font)
+		font->refs++;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return font;
+}
+
+/* Returns either font or an equivalent font that has been listed in the meantime */
+static fz_font *
+fz_insert_shared_font(fz_context *ctx, unsigned char digest[16], fz_font *font)
+{
+	fz_font *existing = NULL;
+
+	fz_var(existing);
+
+	memcpy(font->shared_digest, digest, 16);
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	fz_try(ctx)
+	{
+		existing = fz_hash_insert(ctx, ctx->font->shared_fonts, font->shared_digest, font);
+		if (existing)
+			existing->refs++;
+		else
+			font->is_shared = 1;
+	}
+	fz_always(ctx)
+	{
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+	}
+	fz_catch(ctx)
+	{
+		/* the font can still be used, it just isn't shared */
+		existing = NULL;
+	}
+
+	if (!existing)
+		return font;
+	fz_drop_font(ctx, font);
+	return existing;
+}
+
+fz_font *
+fz_new_shared_font_from_memory(fz_context *ctx, const char *name, unsigned char *data, int len, int index, int use_glyph_bbox)
+{
+	unsigned char digest[16];
+	fz_font *font;
+
+	if (!name || !fz_font_context_is_shared(ctx))
+		return fz_new_font_from_memory(ctx, name, data, len, index, use_glyph_bbox);
+
+	fz_digest_shared_font(name, data, len, 0, index, use_glyph_bbox, digest);
+	font = fz_find_shared_font(ctx, digest);
+	if (font)
+		return font;
+	font = fz_new_font_from_memory(ctx, name, data, len, index, use_glyph_bbox);
+	return fz_insert_shared_font(ctx, digest, font);
+}
+
+fz_font *
+fz_new_shared_font_from_buffer(fz_context *ctx, const char *name, fz_buffer *buffer, int index, int use_glyph_bbox)
+{
+	unsigned char digest[16];
+	fz_font *font;
+
+	if (!name || !fz_font_context_is_shared(ctx))
+		return fz_new_font_from_buffer(ctx, name, buffer, index, use_glyph_bbox);
+
+	fz_digest_shared_font(name, buffer->data, buffer->len, 1, index, use_glyph_bbox, digest);
+	font = fz_find_shared_font(ctx, digest);
+	if (font)
+		return font;
+	font = fz_new_font_from_buffer(ctx, name, buffer, index, use_glyph_bbox);
+	return fz_insert_shared_font(ctx, digest, font);
+}
+
+/* SumatraPDF: face must be locked through fz_lock_ft_face */
 static fz_matrix *
-fz_adjust_ft_glyph_width(fz_context *ctx, fz_font *font, int gid, fz_matrix *trm)
+fz_adjust_ft_glyph_width(fz_context *ctx, fz_font *font, FT_Face face, int gid, fz_matrix *trm)
 {
 	/* Fudge the font matrix to stretch the glyph if we've substituted the font. */
 	if (font->ft_substitute && font->width_table && gid < font->width_count)
@@ -469,19 +764,17 @@ fz_adjust_ft_glyph_width(fz_context *ctx, fz_font *font, int gid, fz_matrix *trm
 		int realw;
 		float scale;
 
-		fz_lock(ctx, FZ_LOCK_FREETYPE);
 		/* TODO: use FT_Get_Advance */
-		fterr = FT_Set_Char_Size(font->ft_face, 1000, 1000, 72, 72);
+		fterr = FT_Set_Char_Size(face, 1000, 1000, 72, 72);
 		if (fterr)
 			fz_warn(ctx, "freetype setting character size: %s", ft_error_string(fterr));
 
-		fterr = FT_Load_Glyph(font->ft_face, gid,
+		fterr = FT_Load_Glyph(face, gid,
 			FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP | FT_LOAD_IGNORE_TRANSFORM);
 		if (fterr)
 			fz_warn(ctx, "freetype failed to load glyph: %s", ft_error_string(fterr));
 
-		realw = ((FT_Face)font->ft_face)->glyph->metrics.horiAdvance;
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		realw = face->glyph->metrics.horiAdvance;
 		subw = font->width_table[gid];
 		if (realw)
 			scale = (float) subw / realw;
@@ -512,11 +805,10 @@ pixmap_from_ft_bitmap(fz_context *ctx, int left, int top, FT_Bitmap *bitmap)
 		return fz_new_pixmap_from_8bpp_data(ctx, left, top - bitmap->rows, bitmap->width, bitmap->rows, bitmap->buffer + (bitmap->rows-1)*bitmap->pitch, -bitmap->pitch);
 }
 
-/* Takes the freetype lock, and returns with it held */
+/* SumatraPDF: face must be locked through fz_lock_ft_face */
 static FT_GlyphSlot
-do_ft_render_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, int aa)
+do_ft_render_glyph(fz_context *ctx, fz_font *font, FT_Face face, int gid, const fz_matrix *trm, int aa)
 {
-	FT_Face face = font->ft_face;
 	FT_Matrix m;
 	FT_Vector v;
 	FT_Error fterr;
@@ -524,7 +816,7 @@ do_ft_render_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm
 
 	float strength = fz_matrix_expansion(trm) * 0.02f;
 
-	fz_adjust_ft_glyph_width(ctx, font, gid, &local_trm);
+	fz_adjust_ft_glyph_width(ctx, font, face, gid, &local_trm);
 
 	if (font->ft_italic)
 		fz_pre_shear(&local_trm, SHEAR, 0);
@@ -544,7 +836,6 @@ do_ft_render_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm
 	v.x = local_trm.e * 64;
 	v.y = local_trm.f * 64;
 
-	fz_lock(ctx, FZ_LOCK_FREETYPE);
 	fterr = FT_Set_Char_Size(face, 65536, 65536, 72, 72); /* should be 64, 64 */
 	if (fterr)
 		fz_warn(ctx, "freetype setting character size: %s", ft_error_string(fterr));
@@ -615,12 +906,13 @@ retry_unhinted:
 fz_pixmap *
 fz_render_ft_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, int aa)
 {
-	FT_GlyphSlot slot = do_ft_render_glyph(ctx, font, gid, trm, aa);
+	FT_Face face = fz_lock_ft_face(ctx, font);
+	FT_GlyphSlot slot = do_ft_render_glyph(ctx, font, face, gid, trm, aa);
 	fz_pixmap *pixmap;
 
 	if (slot == NULL)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		return NULL;
 	}
 
@@ -630,7 +922,7 @@ fz_render_ft_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const fz_matr
 	}
 	fz_always(ctx)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 	}
 	fz_catch(ctx)
 	{
@@ -640,16 +932,16 @@ fz_render_ft_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const fz_matr
 	return pixmap;
 }
 
-/* The glyph cache lock is always taken when this is called. */
 fz_glyph *
 fz_render_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, int aa)
 {
-	FT_GlyphSlot slot = do_ft_render_glyph(ctx, font, gid, trm, aa);
+	FT_Face face = fz_lock_ft_face(ctx, font);
+	FT_GlyphSlot slot = do_ft_render_glyph(ctx, font, face, gid, trm, aa);
 	fz_glyph *glyph;
 
 	if (slot == NULL)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		return NULL;
 	}
 
@@ -659,7 +951,7 @@ fz_render_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm
 	}
 	fz_always(ctx)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 	}
 	fz_catch(ctx)
 	{
@@ -669,11 +961,10 @@ fz_render_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm
 	return glyph;
 }
 
-/* Takes the freetype lock, and returns with it held */
+/* SumatraPDF: face must be locked through fz_lock_ft_face */
 static FT_Glyph
-do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, const fz_matrix *ctm, fz_stroke_state *state)
+do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, FT_Face face, int gid, const fz_matrix *trm, const fz_matrix *ctm, fz_stroke_state *state)
 {
-	FT_Face face = font->ft_face;
 	float expansion = fz_matrix_expansion(ctm);
 	int linewidth = state->linewidth * expansion * 64 / 2;
 	FT_Matrix m;
@@ -684,7 +975,7 @@ do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 	FT_Stroker_LineJoin line_join;
 	fz_matrix local_trm = *trm;
 
-	fz_adjust_ft_glyph_width(ctx, font, gid, &local_trm);
+	fz_adjust_ft_glyph_width(ctx, font, face, gid, &local_trm);
 
 	if (font->ft_italic)
 		fz_pre_shear(&local_trm, SHEAR, 0);
@@ -696,7 +987,6 @@ do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 	v.x = local_trm.e * 64;
 	v.y = local_trm.f * 64;
 
-	fz_lock(ctx, FZ_LOCK_FREETYPE);
 	fterr = FT_Set_Char_Size(face, 65536, 65536, 72, 72); /* should be 64, 64 */
 	if (fterr)
 	{
@@ -713,7 +1003,7 @@ do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 		return NULL;
 	}
 
-	fterr = FT_Stroker_New(ctx->font->ftlib, &stroker);
+	fterr = FT_Stroker_New(face->glyph->library, &stroker);
 	if (fterr)
 	{
 		fz_warn(ctx, "FT_Stroker_New: %s", ft_error_string(fterr));
@@ -769,13 +1059,14 @@ do_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 fz_pixmap *
 fz_render_ft_stroked_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, const fz_matrix *ctm, fz_stroke_state *state)
 {
-	FT_Glyph glyph = do_render_ft_stroked_glyph(ctx, font, gid, trm, ctm, state);
+	FT_Face face = fz_lock_ft_face(ctx, font);
+	FT_Glyph glyph = do_render_ft_stroked_glyph(ctx, font, face, gid, trm, ctm, state);
 	FT_BitmapGlyph bitmap = (FT_BitmapGlyph)glyph;
 	fz_pixmap *pixmap;
 
 	if (bitmap == NULL)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		return NULL;
 	}
 
@@ -786,7 +1077,7 @@ fz_render_ft_stroked_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const
 	fz_always(ctx)
 	{
 		FT_Done_Glyph(glyph);
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 	}
 	fz_catch(ctx)
 	{
@@ -799,13 +1090,14 @@ fz_render_ft_stroked_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, const
 fz_glyph *
 fz_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm, const fz_matrix *ctm, fz_stroke_state *state)
 {
-	FT_Glyph glyph = do_render_ft_stroked_glyph(ctx, font, gid, trm, ctm, state);
+	FT_Face face = fz_lock_ft_face(ctx, font);
+	FT_Glyph glyph = do_render_ft_stroked_glyph(ctx, font, face, gid, trm, ctm, state);
 	FT_BitmapGlyph bitmap = (FT_BitmapGlyph)glyph;
 	fz_glyph *result;
 
 	if (bitmap == NULL)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		return NULL;
 	}
 
@@ -816,7 +1108,7 @@ fz_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 	fz_always(ctx)
 	{
 		FT_Done_Glyph(glyph);
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 	}
 	fz_catch(ctx)
 	{
@@ -829,7 +1121,7 @@ fz_render_ft_stroked_glyph(fz_context *ctx, fz_font *font, int gid, const fz_mat
 static fz_rect *
 fz_bound_ft_glyph(fz_context *ctx, fz_font *font, int gid, fz_rect *bounds)
 {
-	FT_Face face = font->ft_face;
+	FT_Face face = fz_lock_ft_face(ctx, font);
 	FT_Error fterr;
 	FT_BBox cbox;
 	FT_Matrix m;
@@ -844,7 +1136,7 @@ fz_bound_ft_glyph(fz_context *ctx, fz_font *font, int gid, fz_rect *bounds)
 	const float strength = 0.02f;
 	fz_matrix local_trm = fz_identity;
 
-	fz_adjust_ft_glyph_width(ctx, font, gid, &local_trm);
+	fz_adjust_ft_glyph_width(ctx, font, face, gid, &local_trm);
 
 	if (font->ft_italic)
 		fz_pre_shear(&local_trm, SHEAR, 0);
@@ -865,7 +1157,6 @@ fz_bound_ft_glyph(fz_context *ctx, fz_font *font, int gid, fz_rect *bounds)
 		ft_flags = FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING;
 	}
 
-	fz_lock(ctx, FZ_LOCK_FREETYPE);
 	/* Set the char size to scale=face->units_per_EM to effectively give
 	 * us unscaled results. This avoids quantisation. We then apply the
 	 * scale ourselves below. */
@@ -878,7 +1169,7 @@ fz_bound_ft_glyph(fz_context *ctx, fz_font *font, int gid, fz_rect *bounds)
 	if (fterr)
 	{
 		fz_warn(ctx, "freetype load glyph (gid %d): %s", gid, ft_error_string(fterr));
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		bounds->x0 = bounds->x1 = local_trm.e;
 		bounds->y0 = bounds->y1 = local_trm.f;
 		return bounds;
@@ -891,7 +1182,7 @@ fz_bound_ft_glyph(fz_context *ctx, fz_font *font, int gid, fz_rect *bounds)
 	}
 
 	FT_Outline_Get_CBox(&face->glyph->outline, &cbox);
-	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+	fz_unlock_ft_face(ctx, font, face);
 	bounds->x0 = cbox.xMin * recip;
 	bounds->y0 = cbox.yMin * recip;
 	bounds->x1 = cbox.xMax * recip;
@@ -982,7 +1273,7 @@ fz_path *
 fz_outline_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *trm)
 {
 	struct closure cc;
-	FT_Face face = font->ft_face;
+	FT_Face face = fz_lock_ft_face(ctx, font);
 	int fterr;
 	fz_matrix local_trm = *trm;
 	int ft_flags;
@@ -991,13 +1282,11 @@ fz_outline_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *tr
 	const float recip = 1 / (float)scale;
 	const float strength = 0.02f;
 
-	fz_adjust_ft_glyph_width(ctx, font, gid, &local_trm);
+	fz_adjust_ft_glyph_width(ctx, font, face, gid, &local_trm);
 
 	if (font->ft_italic)
 		fz_pre_shear(&local_trm, SHEAR, 0);
 
-	fz_lock(ctx, FZ_LOCK_FREETYPE);
-
 	if (font->ft_hint)
 	{
 		ft_flags = FT_LOAD_NO_BITMAP | FT_LOAD_IGNORE_TRANSFORM;
@@ -1014,7 +1303,7 @@ fz_outline_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *tr
 	if (fterr)
 	{
 		fz_warn(ctx, "freetype load glyph (gid %d): %s", gid, ft_error_string(fterr));
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 		return NULL;
 	}
 
@@ -1036,7 +1325,7 @@ fz_outline_ft_glyph(fz_context *ctx, fz_font *font, int gid, const fz_matrix *tr
 	}
 	fz_always(ctx)
 	{
-		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_unlock_ft_face(ctx, font, face);
 	}
 	fz_catch(ctx)
 	{
@@ -1335,14 +1624,20 @@ int fz_glyph_cacheable(fz_context *ctx, fz_font *font, int gid)
 static float
 fz_advance_ft_glyph(fz_context *ctx, fz_font *font, int gid)
 {
+	FT_Face face;
 	FT_Fixed adv;
+	float advance;
 	int mask = FT_LOAD_NO_SCALE | FT_LOAD_IGNORE_TRANSFORM;
 
 	if (font->ft_substitute && font->width_table && gid < font->width_count)
 		return font->width_table[gid];
 
-	FT_Get_Advance(font->ft_face, gid, mask, &adv);
-	return (float) adv / ((FT_Face)font->ft_face)->units_per_EM;
+	/* SumatraPDF: FT_Get_Advance may have to load the glyph */
+	face = fz_lock_ft_face(ctx, font);
+	FT_Get_Advance(face, gid, mask, &adv);
+	advance = (float) adv / face->units_per_EM;
+	fz_unlock_ft_face(ctx, font, face);
+	return advance;
 }
 
 static float
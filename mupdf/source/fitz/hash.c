@@ -141,8 +141,9 @@ do_hash_insert(fz_context *ctx, fz_hash_table *table, const void *key, void *val
 	}
 }
 
-/* Entered with the lock taken, held throughout and at exit, UNLESS the lock
- * is the alloc lock in which case it may be momentarily dropped. */
+/* Entered with the lock taken, held throughout and at exit, UNLESS there
+ * is a lock in which case it may be momentarily dropped (so that the
+ * allocator can scavenge the store). */
 static void
 fz_resize_hash(fz_context *ctx, fz_hash_table *table, int newsize)
 {
@@ -158,21 +159,19 @@ fz_resize_hash(fz_context *ctx, fz_hash_table *table, int newsize)
 		return;
 	}
 
-	if (table->lock == FZ_LOCK_ALLOC)
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
+	/* SumatraPDF: also drop the store's partition locks */
+	if (table->lock >= 0)
+		fz_unlock(ctx, table->lock);
 	newents = fz_malloc_array_no_throw(ctx, newsize, sizeof(fz_hash_entry));
-	if (table->lock == FZ_LOCK_ALLOC)
-		fz_lock(ctx, FZ_LOCK_ALLOC);
 	if (table->lock >= 0)
 	{
+		fz_lock(ctx, table->lock);
 		if (table->size >= newsize)
 		{
 			/* Someone else fixed it before we could lock! */
-			if (table->lock == FZ_LOCK_ALLOC)
-				fz_unlock(ctx, table->lock);
+			fz_unlock(ctx, table->lock);
 			fz_free(ctx, newents);
-			if (table->lock == FZ_LOCK_ALLOC)
-				fz_lock(ctx, table->lock);
+			fz_lock(ctx, table->lock);
 			return;
 		}
 	}
@@ -191,11 +190,11 @@ fz_resize_hash(fz_context *ctx, fz_hash_table *table, int newsize)
 		}
 	}
 
-	if (table->lock == FZ_LOCK_ALLOC)
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
+	if (table->lock >= 0)
+		fz_unlock(ctx, table->lock);
 	fz_free(ctx, oldents);
-	if (table->lock == FZ_LOCK_ALLOC)
-		fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (table->lock >= 0)
+		fz_lock(ctx, table->lock);
 }
 
 void *
@@ -14,6 +14,25 @@ fz_new_pixmap_from_image(fz_context *ctx, fz_image *image, int w, int h)
 	return pix;
 }
 
+/* SumatraPDF: allow decoding only part of an image */
+fz_pixmap *
+fz_new_pixmap_from_image_area(fz_context *ctx, fz_image *image, int w, int h, fz_irect *area)
+{
+	fz_pixmap *pix;
+	assert(image && area);
+	if (image->get_pixmap != fz_image_get_pixmap)
+	{
+		area->x0 = area->y0 = 0;
+		area->x1 = image->w;
+		area->y1 = image->h;
+		return fz_new_pixmap_from_image(ctx, image, w, h);
+	}
+	pix = fz_image_get_pixmap_area(ctx, image, w, h, area);
+	if (!pix)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "image->get_pixmap failed - why? (%d x %d)", w, h);
+	return pix;
+}
+
 fz_image *
 fz_keep_image(fz_context *ctx, fz_image *image)
 {
@@ -32,13 +51,25 @@ struct fz_image_key_s {
 	int refs;
 	fz_image *image;
 	int l2factor;
+	fz_irect area; /* SumatraPDF: the part of the image covered (in full resolution pixels) */
 };
 
+/* SumatraPDF: pixmaps covering only part of an image */
+static int
+fz_is_partial_image_area(fz_image *image, const fz_irect *area)
+{
+	return area->x0 > 0 || area->y0 > 0 || area->x1 < image->w || area->y1 < image->h;
+}
+
 static int
 fz_make_hash_image_key(fz_store_hash *hash, void *key_)
 {
 	fz_image_key *key = (fz_image_key *)key_;
 
+	/* SumatraPDF: partial pixmaps are found through fz_cmp_image_key
+	 * so that they can satisfy requests for any contained area */
+	if (fz_is_partial_image_area(key->image, &key->area))
+		return 0;
 	hash->u.pi.ptr = key->image;
 	hash->u.pi.i = key->l2factor;
 	return 1;
@@ -80,7 +111,10 @@ fz_cmp_image_key(void *k0_, void *k1_)
 	fz_image_key *k0 = (fz_image_key *)k0_;
 	fz_image_key *k1 = (fz_image_key *)k1_;
 
-	return k0->image == k1->image && k0->l2factor == k1->l2factor;
+	/* SumatraPDF: match (returning 0) any stored key k0 whose area contains the requested one */
+	return !(k0->image == k1->image && k0->l2factor == k1->l2factor &&
+		k0->area.x0 <= k1->area.x0 && k0->area.y0 <= k1->area.y0 &&
+		k0->area.x1 >= k1->area.x1 && k0->area.y1 >= k1->area.y1);
 }
 
 #ifndef NDEBUG
@@ -89,12 +123,13 @@ fz_debug_image(FILE *out, void *key_)
 {
 	fz_image_key *key = (fz_image_key *)key_;
 
-	fprintf(out, "(image %d x %d sf=%d) ", key->image->w, key->image->h, key->l2factor);
+	fprintf(out, "(image %d x %d sf=%d area=%d %d %d %d) ", key->image->w, key->image->h, key->l2factor, key->area.x0, key->area.y0, key->area.x1, key->area.y1);
 }
 #endif
 
 static fz_store_type fz_image_store_type =
 {
+	FZ_STORE_IMAGES,
 	fz_make_hash_image_key,
 	fz_keep_image_key,
 	fz_drop_image_key,
@@ -206,13 +241,15 @@ decomp_image_banded(fz_context *ctx, fz_stream *stm, fz_image *image, int indexe
 	return tile;
 }
 
-
-fz_pixmap *
-fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int l2factor, int native_l2factor)
+/* SumatraPDF: area is the part of the image to decode (in full resolution pixels, aligned
+   to both 1 << l2factor and whole bytes of the native resolution samples) or NULL for all */
+static fz_pixmap *
+decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int l2factor, int native_l2factor, const fz_irect *area)
 {
 	fz_pixmap *tile = NULL;
 	int stride, len, i;
 	unsigned char *samples = NULL;
+	unsigned char *row = NULL;
 	int f = 1<<native_l2factor;
 	int w = (image->w + f-1) >> native_l2factor;
 	int h = (image->h + f-1) >> native_l2factor;
@@ -221,29 +258,70 @@ fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, in
 
 	fz_var(tile);
 	fz_var(samples);
+	fz_var(row);
 
 	/* cf. http://code.google.com/p/sumatrapdf/issues/detail?id=1333 */
 	if (is_banded)
 		indexed = -1 - indexed;
-	else if (l2factor - native_l2factor > 0 && image->w > (1 << 8))
+	else if (!area && l2factor - native_l2factor > 0 && image->w > (1 << 8))
 		return decomp_image_banded(ctx, stm, image, indexed, l2factor, native_l2factor);
 
 	fz_try(ctx)
 	{
-		tile = fz_new_pixmap(ctx, image->colorspace, w, h);
-		tile->interpolate = image->interpolate;
+		if (!area)
+		{
+			tile = fz_new_pixmap(ctx, image->colorspace, w, h);
+			tile->interpolate = image->interpolate;
 
-		stride = (w * image->n * image->bpc + 7) / 8;
+			stride = (w * image->n * image->bpc + 7) / 8;
 
-		samples = fz_malloc_array(ctx, h, stride);
+			samples = fz_malloc_array(ctx, h, stride);
 
-		len = fz_read(stm, samples, h * stride);
+			len = fz_read(stm, samples, h * stride);
 
-		/* Pad truncated images */
-		if (len < stride * h)
+			/* Pad truncated images */
+			if (len < stride * h)
+			{
+				fz_warn(ctx, "padding truncated image");
+				memset(samples + len, 0, stride * h - len);
+			}
+		}
+		else
 		{
-			fz_warn(ctx, "padding truncated image");
-			memset(samples + len, 0, stride * h - len);
+			/* SumatraPDF: stop reading after the last row of the area
+			 * and only keep the columns inside it */
+			int x0 = area->x0 >> native_l2factor, x1 = (area->x1 + f-1) >> native_l2factor;
+			int y0 = area->y0 >> native_l2factor, y1 = (area->y1 + f-1) >> native_l2factor;
+			int row_stride = (w * image->n * image->bpc + 7) / 8;
+			int skip = x0 * image->n * image->bpc / 8;
+			int padded = 0;
+
+			tile = fz_new_pixmap(ctx, image->colorspace, x1 - x0, y1 - y0);
+			tile->interpolate = image->interpolate;
+
+			stride = ((x1 - x0) * image->n * image->bpc + 7) / 8;
+
+			samples = fz_malloc_array(ctx, y1 - y0, stride);
+			row = fz_malloc(ctx, row_stride);
+
+			for (i = 0; i < y1; i++)
+			{
+				len = fz_read(stm, row, row_stride);
+				/* Pad truncated images */
+				if (len < row_stride)
+				{
+					if (!padded)
+						fz_warn(ctx, "padding truncated image");
+					padded = 1;
+					memset(row + len, 0, row_stride - len);
+				}
+				if (i >= y0)
+					memcpy(samples + (i - y0) * stride, row + skip, stride);
+			}
+			h = y1 - y0;
+
+			fz_free(ctx, row);
+			row = NULL;
 		}
 
 		/* Invert 1-bit image masks */
@@ -290,6 +368,7 @@ fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, in
 		if (tile)
 			fz_drop_pixmap(ctx, tile);
 		fz_free(ctx, samples);
+		fz_free(ctx, row);
 
 		fz_rethrow(ctx);
 	}
@@ -302,9 +381,32 @@ fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, in
 		fz_subsample_pixmap(ctx, tile, l2factor - native_l2factor);
 	}
 
+	/* SumatraPDF: remember the offset of a partial pixmap */
+	if (area)
+	{
+		tile->x = area->x0 >> l2factor;
+		tile->y = area->y0 >> l2factor;
+	}
+
 	return tile;
 }
 
+fz_pixmap *
+fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int l2factor, int native_l2factor)
+{
+	return decomp_image_from_stream(ctx, stm, image, indexed, l2factor, native_l2factor, NULL);
+}
+
+/* SumatraPDF: grow area to multiples of align and clip it to the image */
+static void
+fz_align_image_area(fz_irect *area, fz_image *image, int align)
+{
+	area->x0 = fz_maxi(area->x0, 0) / align * align;
+	area->y0 = fz_maxi(area->y0, 0) / align * align;
+	area->x1 = fz_mini((area->x1 + align - 1) / align * align, image->w);
+	area->y1 = fz_mini((area->y1 + align - 1) / align * align, image->h);
+}
+
 void
 fz_free_image(fz_context *ctx, fz_storable *image_)
 {
@@ -321,6 +423,12 @@ fz_free_image(fz_context *ctx, fz_storable *image_)
 
 fz_pixmap *
 fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
+{
+	return fz_image_get_pixmap_area(ctx, image, w, h, NULL);
+}
+
+fz_pixmap *
+fz_image_get_pixmap_area(fz_context *ctx, fz_image *image, int w, int h, fz_irect *area)
 {
 	fz_pixmap *tile;
 	fz_stream *stm;
@@ -329,6 +437,10 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 	int native_l2factor;
 	int indexed;
 	fz_image_key *keyp;
+	fz_colorspace *cs;
+	/* SumatraPDF: allow decoding only part of an image */
+	fz_irect full = { 0, 0, image->w, image->h };
+	int partial = 0;
 
 	/* Check for 'simple' images which are just pixmaps */
 	if (image->buffer == NULL)
@@ -336,6 +448,8 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 		tile = image->tile;
 		if (!tile)
 			return NULL;
+		if (area)
+			*area = full;
 		return fz_keep_pixmap(ctx, tile); /* That's all we can give you! */
 	}
 
@@ -354,15 +468,44 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 	else
 		for (l2factor=0; image->w>>(l2factor+1) >= w+2 && image->h>>(l2factor+1) >= h+2 && l2factor < 8; l2factor++);
 
+	/* SumatraPDF: PNG, TIFF and JXR images are always decoded entirely
+	 * and unblending /Matte requires the entire mask */
+	if (area)
+	{
+		fz_intersect_irect(area, &full);
+		partial = !fz_is_empty_irect(area) && fz_is_partial_image_area(image, area);
+		switch (image->buffer->params.type)
+		{
+		case FZ_IMAGE_PNG: case FZ_IMAGE_TIFF: case FZ_IMAGE_JXR:
+			partial = 0;
+			break;
+		}
+		if (image->usecolorkey && image->mask)
+			partial = 0;
+		if (!partial)
+			*area = full;
+	}
+
 	/* Can we find any suitable tiles in the cache? */
 	key.refs = 1;
 	key.image = image;
 	key.l2factor = l2factor;
+	key.area = partial ? *area : full;
 	do
 	{
 		tile = fz_find_item(ctx, fz_free_pixmap_imp, &key, &fz_image_store_type);
 		if (tile)
+		{
+			/* SumatraPDF: a stored pixmap may cover more than the requested area */
+			if (partial)
+			{
+				area->x0 = tile->x << key.l2factor;
+				area->y0 = tile->y << key.l2factor;
+				area->x1 = fz_mini((tile->x + tile->w) << key.l2factor, image->w);
+				area->y1 = fz_mini((tile->y + tile->h) << key.l2factor, image->h);
+			}
 			return tile;
+		}
 		key.l2factor--;
 	}
 	while (key.l2factor >= 0);
@@ -380,12 +523,47 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 	case FZ_IMAGE_JXR:
 		tile = fz_load_jxr(ctx, image->buffer->buffer->data, image->buffer->buffer->len);
 		break;
+	/* SumatraPDF: decode JPX images on demand at the required resolution */
+	case FZ_IMAGE_JPX:
+		native_l2factor = l2factor;
+		cs = image->buffer->params.u.jpx.has_colorspace ? image->colorspace : NULL;
+		indexed = fz_colorspace_is_indexed(cs);
+		if (partial)
+			fz_align_image_area(area, image, 1 << l2factor);
+		tile = fz_load_jpx_ex(ctx, image->buffer->buffer->data, image->buffer->buffer->len, cs, indexed, &native_l2factor, partial ? area : NULL);
+		/* FIXME: We can't handle decode arrays for indexed images currently */
+		if (!indexed && tile->colorspace && tile->colorspace->n == image->n)
+			fz_decode_tile(tile, image->decode);
+		/* apply any extra subsampling required */
+		if (l2factor - native_l2factor > 0)
+		{
+			fz_subsample_pixmap(ctx, tile, l2factor - native_l2factor);
+			tile->x >>= l2factor - native_l2factor;
+			tile->y >>= l2factor - native_l2factor;
+		}
+		if (partial)
+		{
+			area->x0 = tile->x << l2factor;
+			area->y0 = tile->y << l2factor;
+			area->x1 = fz_mini((tile->x + tile->w) << l2factor, image->w);
+			area->y1 = fz_mini((tile->y + tile->h) << l2factor, image->h);
+		}
+		break;
 	default:
 		native_l2factor = l2factor;
 		stm = fz_open_image_decomp_stream_from_buffer(ctx, image->buffer, &native_l2factor);
 
 		indexed = fz_colorspace_is_indexed(image->colorspace);
-		tile = fz_decomp_image_from_stream(ctx, stm, image, indexed, l2factor, native_l2factor);
+		/* SumatraPDF: the area must start at whole bytes of the native resolution samples */
+		if (partial)
+		{
+			int bits = image->n * image->bpc, ppb = 1;
+			while ((bits * ppb) % 8 != 0)
+				ppb <<= 1;
+			fz_align_image_area(area, image, fz_maxi(1 << l2factor, ppb << native_l2factor));
+			partial = fz_is_partial_image_area(image, area);
+		}
+		tile = decomp_image_from_stream(ctx, stm, image, indexed, l2factor, native_l2factor, partial ? area : NULL);
 
 		/* CMYK JPEGs in XPS documents have to be inverted */
 		if (image->invert_cmyk_jpeg &&
@@ -410,6 +588,7 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 		keyp->refs = 1;
 		keyp->image = fz_keep_image(ctx, image);
 		keyp->l2factor = l2factor;
+		keyp->area = partial ? *area : full;
 		existing_tile = fz_store_item(ctx, keyp, tile, fz_pixmap_size(ctx, tile), &fz_image_store_type);
 		if (existing_tile)
 		{
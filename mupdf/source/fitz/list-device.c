@@ -1,8 +1,12 @@
 #include "mupdf/fitz.h"
 
 typedef struct fz_display_node_s fz_display_node;
+typedef struct fz_display_index_s fz_display_index;
 
 #define STACK_SIZE 96
+#define INDEX_MIN_NODES 256
+#define INDEX_MAX_GRID 64
+#define INDEX_MAX_CELLS 64
 
 typedef enum fz_display_command_e
 {
@@ -52,6 +56,23 @@ struct fz_display_node_s
 	float color[FZ_MAX_COLORS];
 };
 
+/* A grid over the bounds of the list, so that runs for just a part of
+ * the page (such as a tile or a band) only have to visit those nodes
+ * which lie within that part. Nodes which change the clip stack, those
+ * within tiles and those that are too large are visited in every run. */
+struct fz_display_index_s
+{
+	int len;
+	fz_display_node **nodes;
+	fz_rect bounds;
+	int w, h;
+	float sx, sy;
+	int *cells; /* w * h + 1 offsets into items */
+	int *items; /* node numbers of all nodes intersecting each cell */
+	int always_len;
+	int *always; /* node numbers of all nodes to visit regardless */
+};
+
 struct fz_display_list_s
 {
 	fz_storable storable;
@@ -65,6 +86,8 @@ struct fz_display_list_s
 		fz_rect rect;
 	} stack[STACK_SIZE];
 	int tiled;
+
+	fz_display_index *index;
 };
 
 enum { ISOLATED = 1, KNOCKOUT = 2 };
@@ -612,6 +635,271 @@ fz_new_list_device(fz_context *ctx, fz_display_list *list)
 	return dev;
 }
 
+static int
+fz_is_leaf_node(fz_display_node *node)
+{
+	/* Nodes which, if culled, are simply skipped */
+	switch (node->cmd)
+	{
+	case FZ_CMD_FILL_PATH:
+	case FZ_CMD_STROKE_PATH:
+	case FZ_CMD_FILL_TEXT:
+	case FZ_CMD_STROKE_TEXT:
+	case FZ_CMD_IGNORE_TEXT:
+	case FZ_CMD_FILL_SHADE:
+	case FZ_CMD_FILL_IMAGE:
+	case FZ_CMD_FILL_IMAGE_MASK:
+	case FZ_CMD_APPLY_TRANSFER_FUNCTION:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int
+fz_is_finite_rect(const fz_rect *r)
+{
+	/* also rejects NaN coordinates */
+	return r->x0 <= r->x1 && r->y0 <= r->y1;
+}
+
+static int
+fz_index_cells(fz_display_index *index, const fz_rect *r, int *x0, int *y0, int *x1, int *y1)
+{
+	*x0 = (int)fz_clamp((r->x0 - index->bounds.x0) * index->sx, 0, index->w - 1);
+	*y0 = (int)fz_clamp((r->y0 - index->bounds.y0) * index->sy, 0, index->h - 1);
+	*x1 = (int)fz_clamp((r->x1 - index->bounds.x0) * index->sx, 0, index->w - 1);
+	*y1 = (int)fz_clamp((r->y1 - index->bounds.y0) * index->sy, 0, index->h - 1);
+	return (*x1 - *x0 + 1) * (*y1 - *y0 + 1);
+}
+
+static void
+fz_free_display_index(fz_context *ctx, fz_display_index *index)
+{
+	if (!index)
+		return;
+	fz_free(ctx, index->nodes);
+	fz_free(ctx, index->cells);
+	fz_free(ctx, index->items);
+	fz_free(ctx, index->always);
+	fz_free(ctx, index);
+}
+
+/* Returns 0 for nodes that are always culled, 1 for nodes that are to
+ * be looked up in the grid and -1 for nodes that are always visited */
+static int
+fz_classify_node(fz_display_index *index, fz_display_node *node, int tile_depth)
+{
+	int x0, y0, x1, y1;
+
+	if (tile_depth > 0 || !fz_is_leaf_node(node))
+		return -1;
+	if (fz_is_empty_rect(&node->rect))
+		return 0;
+	if (!fz_is_finite_rect(&node->rect))
+		return -1;
+	if (fz_index_cells(index, &node->rect, &x0, &y0, &x1, &y1) > INDEX_MAX_CELLS)
+		return -1;
+	return 1;
+}
+
+static fz_display_index *
+fz_new_display_index(fz_context *ctx, fz_display_list *list)
+{
+	fz_display_index *index;
+	fz_display_node *node;
+	int i, x, y, x0, y0, x1, y1, n, tile_depth, total;
+
+	index = fz_malloc_struct(ctx, fz_display_index);
+	fz_try(ctx)
+	{
+		index->len = list->len;
+		index->nodes = fz_malloc_array(ctx, list->len, sizeof(fz_display_node *));
+		index->bounds = fz_empty_rect;
+		for (node = list->first, i = 0; node && i < list->len; node = node->next, i++)
+		{
+			index->nodes[i] = node;
+			if (fz_is_leaf_node(node) && fz_is_finite_rect(&node->rect))
+				fz_union_rect(&index->bounds, &node->rect);
+		}
+		if (fz_is_empty_rect(&index->bounds))
+			fz_throw(ctx, FZ_ERROR_GENERIC, "nothing to index");
+
+		index->w = index->h = fz_clampi((int)sqrtf(list->len / 16.0f), 1, INDEX_MAX_GRID);
+		index->sx = index->w / (index->bounds.x1 - index->bounds.x0);
+		index->sy = index->h / (index->bounds.y1 - index->bounds.y0);
+		index->cells = fz_calloc(ctx, index->w * index->h + 1, sizeof(int));
+
+		/* Count the nodes per cell... */
+		total = tile_depth = 0;
+		for (i = 0; i < list->len; i++)
+		{
+			node = index->nodes[i];
+			if (node->cmd == FZ_CMD_END_TILE)
+				tile_depth--;
+			n = fz_classify_node(index, node, tile_depth);
+			if (node->cmd == FZ_CMD_BEGIN_TILE)
+				tile_depth++;
+			if (n < 0)
+			{
+				index->always_len++;
+				continue;
+			}
+			if (n == 0)
+				continue;
+			fz_index_cells(index, &node->rect, &x0, &y0, &x1, &y1);
+			for (y = y0; y <= y1; y++)
+				for (x = x0; x <= x1; x++)
+					index->cells[y * index->w + x + 1]++;
+			total += (x1 - x0 + 1) * (y1 - y0 + 1);
+		}
+		for (i = 0; i < index->w * index->h; i++)
+			index->cells[i + 1] += index->cells[i];
+		index->items = fz_malloc_array(ctx, total + 1, sizeof(int));
+		index->always = fz_malloc_array(ctx, index->always_len + 1, sizeof(int));
+
+		/* ...and then fill them in (in order, as cells[i] is moved on
+		 * to where cell i+1 starts, and back again at the end) */
+		index->always_len = tile_depth = 0;
+		for (i = 0; i < list->len; i++)
+		{
+			node = index->nodes[i];
+			if (node->cmd == FZ_CMD_END_TILE)
+				tile_depth--;
+			n = fz_classify_node(index, node, tile_depth);
+			if (node->cmd == FZ_CMD_BEGIN_TILE)
+				tile_depth++;
+			if (n < 0)
+			{
+				index->always[index->always_len++] = i;
+				continue;
+			}
+			if (n == 0)
+				continue;
+			fz_index_cells(index, &node->rect, &x0, &y0, &x1, &y1);
+			for (y = y0; y <= y1; y++)
+				for (x = x0; x <= x1; x++)
+					index->items[index->cells[y * index->w + x]++] = i;
+		}
+		for (i = index->w * index->h; i > 0; i--)
+			index->cells[i] = index->cells[i - 1];
+		index->cells[0] = 0;
+	}
+	fz_catch(ctx)
+	{
+		fz_free_display_index(ctx, index);
+		fz_rethrow(ctx);
+	}
+
+	return index;
+}
+
+/* The index is built on first use instead of while recording, as the
+ * rects of clip nodes are only final once the list is complete. */
+static fz_display_index *
+fz_index_display_list(fz_context *ctx, fz_display_list *list)
+{
+	fz_display_index *index, *unused;
+
+	if (list->len < INDEX_MIN_NODES)
+		return NULL;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	index = list->index;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	if (index && index->len == list->len)
+		return index;
+
+	fz_try(ctx)
+	{
+		index = fz_new_display_index(ctx, list);
+	}
+	fz_catch(ctx)
+	{
+		/* Not having an index only makes rendering slower */
+		return NULL;
+	}
+
+	/* Another thread might have indexed the list in the meantime */
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (!list->index || list->index->len != index->len)
+	{
+		unused = list->index;
+		list->index = index;
+	}
+	else
+	{
+		unused = index;
+		index = list->index;
+	}
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	fz_free_display_index(ctx, unused);
+
+	return index;
+}
+
+/* Mark all nodes which might intersect scissor, or return NULL if the
+ * whole list has to be run anyway */
+static unsigned int *
+fz_visit_display_index(fz_context *ctx, fz_display_index *index, const fz_matrix *ctm, const fz_rect *scissor)
+{
+	unsigned int *visit;
+	fz_matrix inverse;
+	fz_rect area;
+	int i, j, x, y, x0, y0, x1, y1;
+
+	/* Only for rectilinear transforms, rects are transformed exactly */
+	if (!index || fz_is_infinite_rect(scissor) ||
+		!((ctm->b == 0 && ctm->c == 0) || (ctm->a == 0 && ctm->d == 0)) ||
+		fz_try_invert_matrix(&inverse, ctm))
+		return NULL;
+
+	area = *scissor;
+	fz_transform_rect(&area, &inverse);
+	/* Allow for rounding errors */
+	area.x0 -= 1; area.y0 -= 1;
+	area.x1 += 1; area.y1 += 1;
+	if (fz_index_cells(index, &area, &x0, &y0, &x1, &y1) > index->w * index->h / 2)
+		return NULL;
+
+	visit = fz_calloc_no_throw(ctx, (index->len + 31) / 32, sizeof(unsigned int));
+	if (!visit)
+		return NULL;
+	for (i = 0; i < index->always_len; i++)
+		visit[index->always[i] >> 5] |= 1u << (index->always[i] & 31);
+	if (area.x1 >= index->bounds.x0 && area.x0 <= index->bounds.x1 &&
+		area.y1 >= index->bounds.y0 && area.y0 <= index->bounds.y1)
+	{
+		for (y = y0; y <= y1; y++)
+		{
+			for (x = x0; x <= x1; x++)
+			{
+				for (j = index->cells[y * index->w + x]; j < index->cells[y * index->w + x + 1]; j++)
+					visit[index->items[j] >> 5] |= 1u << (index->items[j] & 31);
+			}
+		}
+	}
+
+	return visit;
+}
+
+static int
+fz_next_visit(unsigned int *visit, int i, int len)
+{
+	while (i < len)
+	{
+		unsigned int bits = visit[i >> 5] >> (i & 31);
+		if (bits)
+		{
+			for (; !(bits & 1); bits >>= 1)
+				i++;
+			return i;
+		}
+		i = (i | 31) + 1;
+	}
+	return len;
+}
+
 static void
 fz_free_display_list(fz_context *ctx, fz_storable *list_)
 {
@@ -627,6 +915,7 @@ fz_free_display_list(fz_context *ctx, fz_storable *list_)
 		fz_free_display_node(ctx, node);
 		node = next;
 	}
+	fz_free_display_index(ctx, list->index);
 	fz_free(ctx, list);
 }
 
@@ -640,6 +929,7 @@ fz_new_display_list(fz_context *ctx)
 	list->len = 0;
 	list->top = 0;
 	list->tiled = 0;
+	list->index = NULL;
 	return list;
 }
 
@@ -689,6 +979,8 @@ void
 fz_run_display_list(fz_display_list *list, fz_device *dev, const fz_matrix *top_ctm, const fz_rect *scissor, fz_cookie *cookie)
 {
 	fz_display_node *node;
+	fz_display_index *index;
+	unsigned int *visit;
 	fz_matrix ctm;
 	int clipped = 0;
 	int tiled = 0;
@@ -704,20 +996,34 @@ fz_run_display_list(fz_display_list *list, fz_device *dev, const fz_matrix *top_
 		cookie->progress = 0;
 	}
 
+	index = fz_index_display_list(ctx, list);
+	visit = fz_visit_display_index(ctx, index, top_ctm, scissor);
+
 	for (node = list->first; node; node = node->next)
 	{
 		int empty;
+		fz_rect node_rect;
 
-		fz_rect node_rect = node->rect;
-		fz_transform_rect(&node_rect, top_ctm);
+		/* Jump over all nodes which would be culled anyway */
+		if (visit)
+		{
+			progress = fz_next_visit(visit, progress, index->len);
+			if (progress == index->len)
+				break;
+			node = index->nodes[progress];
+		}
 
 		/* Check the cookie for aborting */
 		if (cookie)
 		{
 			if (cookie->abort)
 				break;
-			cookie->progress = progress++;
+			cookie->progress = progress;
 		}
+		progress++;
+
+		node_rect = node->rect;
+		fz_transform_rect(&node_rect, top_ctm);
 
 		/* cull objects to draw using a quick visibility test */
 
@@ -876,4 +1182,6 @@ visible:
 			fz_warn(ctx, "Ignoring error during interpretation");
 		}
 	}
+
+	fz_free(ctx, visit);
 }
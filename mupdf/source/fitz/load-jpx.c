@@ -57,8 +57,11 @@ static OPJ_OFF_T fz_opj_stream_skip(OPJ_OFF_T skip, void * p_user_data)
 
 	if (skip > sb->size - sb->pos)
 		skip = sb->size - sb->pos;
+	/* SumatraPDF: OpenJPEG expects the number of skipped bytes (or -1 at the end) */
+	if (skip <= 0)
+		return (OPJ_OFF_T)-1;
 	sb->pos += skip;
-	return sb->pos;
+	return skip;
 }
 
 static OPJ_BOOL fz_opj_stream_seek(OPJ_OFF_T seek_pos, void * p_user_data)
@@ -79,27 +82,70 @@ static inline unsigned int read_value(const unsigned char *data, int bytes)
 	return value;
 }
 
-fz_pixmap *
-fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed)
+/* SumatraPDF: extract image resolution (TODO: make openjpeg do this) */
+static void
+jpx_read_resolution(fz_context *ctx, unsigned char *data, int size, int *xres, int *yres)
+{
+	unsigned char *base = data;
+	int rest = size, ix = 0, level = 0;
+
+	/* bare J2K streams don't contain any resolution information */
+	if (size < 2 || (data[0] == 0xFF && data[1] == 0x4F))
+		return;
+
+	while (ix < rest - 8)
+	{
+		int lbox = read_value(base + ix, 4);
+		unsigned int tbox = read_value(base + ix + 4, 4);
+		if (lbox < 8 || lbox > rest - ix)
+		{
+			fz_warn(ctx, "impossibly small or large JP2 box (%x, %d)", tbox, lbox);
+			break;
+		}
+		if (level == 0 && tbox == 0x6A703268 /* jp2h */ || level == 1 && tbox == 0x72657320 /* res  */)
+		{
+			base += ix + 8;
+			rest = lbox - 8;
+			ix = 0;
+			level++;
+		}
+		else if (level == 2 && tbox == 0x72657363 /* resc */ && lbox == 18 && rest - ix >= 18)
+		{
+			int vrn = read_value((base += ix + 8), 2);
+			int vrd = read_value(base + 2, 2);
+			int hrn = read_value(base + 4, 2);
+			int hrd = read_value(base + 6, 2);
+			int vre = (char)base[8], hre = (char)base[9];
+			*xres = (int)((float)hrn / hrd * pow(10, hre - 2) * 2.54f);
+			*yres = (int)((float)vrn / vrd * pow(10, vre - 2) * 2.54f);
+			if (*xres <= 0 || *yres <= 0)
+			{
+				fz_warn(ctx, "invalid image resolution (%d, %d)", *xres, *yres);
+				*xres = *yres = 96;
+			}
+			break;
+		}
+		else
+		{
+			ix += lbox;
+		}
+	}
+}
+
+/* SumatraPDF: allow decoding JPX images at reduced resolution and/or only partially */
+static opj_codec_t *
+jpx_open(fz_context *ctx, stream_block *sb, int indexed, int reduce, opj_stream_t **streamp, opj_image_t **jpxp)
 {
-	fz_pixmap *img;
-	fz_colorspace *origcs;
 	opj_dparameters_t params;
 	opj_codec_t *codec;
-	opj_image_t *jpx;
 	opj_stream_t *stream;
-	fz_colorspace *colorspace;
-	unsigned char *p;
 	OPJ_CODEC_FORMAT format;
-	int a, n, w, h, depth, sgnd;
-	int x, y, k, v;
-	stream_block sb;
 
-	if (size < 2)
+	if (sb->size < 2)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "not enough data to determine image format");
 
 	/* Check for SOC marker -- if found we have a bare J2K stream */
-	if (data[0] == 0xFF && data[1] == 0x4F)
+	if (sb->data[0] == 0xFF && sb->data[1] == 0x4F)
 		format = OPJ_CODEC_J2K;
 	else
 		format = OPJ_CODEC_JP2;
@@ -107,6 +153,7 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 	opj_set_default_decoder_parameters(&params);
 	if (indexed)
 		params.flags |= OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG;
+	params.cp_reduce = reduce;
 
 	codec = opj_create_decompress(format);
 	opj_set_info_handler(codec, fz_opj_info_callback, ctx);
@@ -119,35 +166,127 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 	}
 
 	stream = opj_stream_default_create(OPJ_TRUE);
-	sb.data = data;
-	sb.pos = 0;
-	sb.size = size;
+	sb->pos = 0;
 
 	opj_stream_set_read_function(stream, fz_opj_stream_read);
 	opj_stream_set_skip_function(stream, fz_opj_stream_skip);
 	opj_stream_set_seek_function(stream, fz_opj_stream_seek);
-	opj_stream_set_user_data(stream, &sb);
+	opj_stream_set_user_data(stream, sb);
 	/* Set the length to avoid an assert */
-	opj_stream_set_user_data_length(stream, size);
+	opj_stream_set_user_data_length(stream, sb->size);
 
-	if (!opj_read_header(stream, codec, &jpx))
+	if (!opj_read_header(stream, codec, jpxp))
 	{
 		opj_stream_destroy(stream);
 		opj_destroy_codec(codec);
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
 	}
 
+	*streamp = stream;
+	return codec;
+}
+
+/* the number of resolution levels that can be skipped according to the main header */
+static int
+jpx_max_reduce(opj_codec_t *codec)
+{
+	opj_codestream_info_v2_t *info = opj_get_cstr_info(codec);
+	int max_reduce = 0;
+	OPJ_UINT32 k;
+
+	if (!info)
+		return 0;
+	if (info->m_default_tile_info.tccp_info && info->nbcomps > 0)
+	{
+		max_reduce = 8;
+		for (k = 0; k < info->nbcomps; k++)
+			max_reduce = fz_mini(max_reduce, (int)info->m_default_tile_info.tccp_info[k].numresolutions - 1);
+	}
+	opj_destroy_cstr_info(&info);
+	return fz_maxi(max_reduce, 0);
+}
+
+fz_pixmap *
+fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed)
+{
+	return fz_load_jpx_ex(ctx, data, size, defcs, indexed, NULL, NULL);
+}
+
+fz_pixmap *
+fz_load_jpx_ex(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed, int *l2factor, const fz_irect *area)
+{
+	fz_pixmap *img;
+	fz_colorspace *origcs;
+	opj_codec_t *codec;
+	opj_image_t *jpx;
+	opj_stream_t *stream;
+	fz_colorspace *colorspace;
+	unsigned char *p;
+	int a, n, w, h, depth, sgnd;
+	int x, y, k, v;
+	int reduce, x0, y0, cx0, cy0, f;
+	stream_block sb;
+
+	sb.data = data;
+	sb.size = size;
+
+	reduce = l2factor ? *l2factor : 0;
+	codec = jpx_open(ctx, &sb, indexed, 0, &stream, &jpx);
+
+	/* the reduction factor has to be known before reading the header */
+	if (reduce > 0)
+	{
+		reduce = fz_mini(reduce, jpx_max_reduce(codec));
+		if (reduce > 0)
+		{
+			opj_stream_destroy(stream);
+			opj_destroy_codec(codec);
+			opj_image_destroy(jpx);
+			codec = jpx_open(ctx, &sb, indexed, reduce, &stream, &jpx);
+		}
+	}
+
+	/* remember the origin of the full image for positioning a partial one */
+	f = 1 << reduce;
+	x0 = jpx->x0;
+	y0 = jpx->y0;
+	cx0 = jpx->comps[0].x0;
+	cy0 = jpx->comps[0].y0;
+
+	if (area)
+	{
+		if (area->x0 >= area->x1 || area->y0 >= area->y1 ||
+			!opj_set_decode_area(codec, jpx, x0 + fz_maxi(area->x0, 0), y0 + fz_maxi(area->y0, 0),
+				fz_mini(x0 + area->x1, jpx->x1), fz_mini(y0 + area->y1, jpx->y1)))
+		{
+			opj_stream_destroy(stream);
+			opj_destroy_codec(codec);
+			opj_image_destroy(jpx);
+			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid JPX decode area");
+		}
+	}
+
 	if (!opj_decode(codec, stream, jpx))
 	{
 		opj_stream_destroy(stream);
 		opj_destroy_codec(codec);
 		opj_image_destroy(jpx);
+		/* tiles may have fewer resolution levels than the main header claims */
+		if (reduce > 0)
+		{
+			fz_warn(ctx, "Failed to decode JPX image at reduced resolution");
+			*l2factor = 0;
+			return fz_load_jpx_ex(ctx, data, size, defcs, indexed, l2factor, area);
+		}
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to decode JPX image");
 	}
 
 	opj_stream_destroy(stream);
 	opj_destroy_codec(codec);
 
+	if (l2factor)
+		*l2factor = reduce;
+
 	/* jpx should never be NULL here, but check anyway */
 	if (!jpx)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "opj_decode failed");
@@ -215,6 +354,8 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 	fz_try(ctx)
 	{
 		img = fz_new_pixmap(ctx, colorspace, w, h);
+		img->x = (int)(jpx->comps[0].x0 + f - 1) / f - (cx0 + f - 1) / f;
+		img->y = (int)(jpx->comps[0].y0 + f - 1) / f - (cy0 + f - 1) / f;
 	}
 	fz_catch(ctx)
 	{
@@ -248,6 +389,8 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 		if (n == 4)
 		{
 			fz_pixmap *tmp = fz_new_pixmap(ctx, fz_device_rgb(ctx), w, h);
+			tmp->x = img->x;
+			tmp->y = img->y;
 			fz_convert_pixmap(ctx, tmp, img);
 			fz_drop_pixmap(ctx, img);
 			img = tmp;
@@ -256,48 +399,45 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 	}
 
 	/* SumatraPDF: extract image resolution (TODO: make openjpeg do this) */
-	if (format == OPJ_CODEC_JP2)
+	jpx_read_resolution(ctx, data, size, &img->xres, &img->yres);
+
+	return img;
+}
+
+/* SumatraPDF: allow decoding JPX images on demand */
+void
+fz_load_jpx_info(fz_context *ctx, unsigned char *data, int size, int *wp, int *hp, int *xresp, int *yresp, fz_colorspace **cspacep, int indexed)
+{
+	opj_codec_t *codec;
+	opj_image_t *jpx;
+	opj_stream_t *stream;
+	stream_block sb;
+	int n;
+
+	sb.data = data;
+	sb.size = size;
+
+	codec = jpx_open(ctx, &sb, indexed, 0, &stream, &jpx);
+	n = jpx->numcomps;
+	*wp = jpx->comps[0].w;
+	*hp = jpx->comps[0].h;
+	opj_stream_destroy(stream);
+	opj_destroy_codec(codec);
+	opj_image_destroy(jpx);
+
+	/* the actual colorspace is only known after decoding (palettes and channel definitions
+	   might change it), so this is a best guess following the rules of fz_load_jpx_ex */
+	if (n == 2)
+		n = 1;
+	else if (n > 4)
+		n = 4;
+	switch (n)
 	{
-		unsigned char *base = data;
-		int rest = size, ix = 0, level = 0;
-		while (ix < rest - 8)
-		{
-			int lbox = read_value(base + ix, 4);
-			unsigned int tbox = read_value(base + ix + 4, 4);
-			if (lbox < 8 || lbox > rest - ix)
-			{
-				fz_warn(ctx, "impossibly small or large JP2 box (%x, %d)", tbox, lbox);
-				break;
-			}
-			if (level == 0 && tbox == 0x6A703268 /* jp2h */ || level == 1 && tbox == 0x72657320 /* res  */)
-			{
-				base += ix + 8;
-				rest = lbox - 8;
-				ix = 0;
-				level++;
-			}
-			else if (level == 2 && tbox == 0x72657363 /* resc */ && lbox == 18 && rest - ix >= 18)
-			{
-				int vrn = read_value((base += ix + 8), 2);
-				int vrd = read_value(base + 2, 2);
-				int hrn = read_value(base + 4, 2);
-				int hrd = read_value(base + 6, 2);
-				int vre = (char)base[8], hre = (char)base[9];
-				img->xres = (int)((float)hrn / hrd * pow(10, hre - 2) * 2.54f);
-				img->yres = (int)((float)vrn / vrd * pow(10, vre - 2) * 2.54f);
-				if (img->xres <= 0 || img->yres <= 0)
-				{
-					fz_warn(ctx, "invalid image resolution (%d, %d)", img->xres, img->yres);
-					img->xres = img->yres = 96;
-				}
-				break;
-			}
-			else
-			{
-				ix += lbox;
-			}
-		}
+	case 1: *cspacep = fz_device_gray(ctx); break;
+	case 3: *cspacep = fz_device_rgb(ctx); break;
+	default: *cspacep = fz_device_cmyk(ctx); break;
 	}
 
-	return img;
+	*xresp = *yresp = 96;
+	jpx_read_resolution(ctx, data, size, xresp, yresp);
 }
@@ -17,16 +17,15 @@ do_scavenging_malloc(fz_context *ctx, unsigned int size)
 	void *p;
 	int phase = 0;
 
-	fz_lock(ctx, FZ_LOCK_ALLOC);
+	/* SumatraPDF: the store is scavenged without holding FZ_LOCK_ALLOC,
+	 * as evicting items requires taking the locks of its partitions */
 	do {
+		fz_lock(ctx, FZ_LOCK_ALLOC);
 		p = ctx->alloc->malloc(ctx->alloc->user, size);
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
 		if (p != NULL)
-		{
-			fz_unlock(ctx, FZ_LOCK_ALLOC);
 			return p;
-		}
 	} while (fz_store_scavenge(ctx, size, &phase));
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
 
 	return NULL;
 }
@@ -37,16 +36,13 @@ do_scavenging_realloc(fz_context *ctx, void *p, unsigned int size)
 	void *q;
 	int phase = 0;
 
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 	do {
+		fz_lock(ctx, FZ_LOCK_ALLOC);
 		q = ctx->alloc->realloc(ctx->alloc->user, p, size);
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
 		if (q != NULL)
-		{
-			fz_unlock(ctx, FZ_LOCK_ALLOC);
 			return q;
-		}
 	} while (fz_store_scavenge(ctx, size, &phase));
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
 
 	return NULL;
 }
@@ -703,6 +703,59 @@ fz_add_text_char(fz_context *ctx, fz_text_device *dev, fz_text_style *style, int
 	}
 }
 
+/* SumatraPDF: cache advances as FT_Get_Advance may have to load the glyph */
+static float
+fz_text_ft_advance(fz_context *ctx, fz_font *font, int gid)
+{
+	FT_Face face = font->ft_face;
+	FT_Fixed ftadv = 0;
+	int mask = FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING | FT_LOAD_IGNORE_TRANSFORM;
+	float adv;
+	int err;
+
+	/* TODO: freetype returns broken vertical metrics */
+	/* if (text->wmode) mask |= FT_LOAD_VERTICAL_LAYOUT; */
+
+	if (!font->advance_cache && face->num_glyphs > 0)
+	{
+		/* allocate outside of the lock, as allocating may scavenge the store */
+		int i, count = face->num_glyphs;
+		float *cache = fz_malloc_array_no_throw(ctx, count, sizeof(float));
+		if (cache)
+		{
+			for (i = 0; i < count; i++)
+				cache[i] = FLT_MAX;
+		}
+		fz_lock(ctx, FZ_LOCK_FREETYPE);
+		if (!font->advance_cache)
+		{
+			font->advance_cache = cache;
+			font->advance_count = cache ? count : 0;
+			cache = NULL;
+		}
+		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_free(ctx, cache);
+	}
+
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	if (gid >= 0 && gid < font->advance_count && font->advance_cache[gid] != FLT_MAX)
+	{
+		adv = font->advance_cache[gid];
+		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		return adv;
+	}
+	err = FT_Set_Char_Size(face, 64, 64, 72, 72);
+	if (err)
+		fz_warn(ctx, "freetype set character size: %s", ft_error_string(err));
+	FT_Get_Advance(face, gid, mask, &ftadv);
+	adv = ftadv / 65536.0f;
+	if (gid >= 0 && gid < font->advance_count)
+		font->advance_cache[gid] = adv;
+	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+
+	return adv;
+}
+
 static void
 fz_text_extract(fz_context *ctx, fz_text_device *dev, fz_text *text, const fz_matrix *ctm, fz_text_style *style)
 {
@@ -751,19 +804,7 @@ fz_text_extract(fz_context *ctx, fz_text_device *dev, fz_text *text, const fz_ma
 		/* Calculate bounding box and new pen position based on font metrics */
 		if (font->ft_face)
 		{
-			FT_Fixed ftadv = 0;
-			int mask = FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING | FT_LOAD_IGNORE_TRANSFORM;
-
-			/* TODO: freetype returns broken vertical metrics */
-			/* if (text->wmode) mask |= FT_LOAD_VERTICAL_LAYOUT; */
-
-			fz_lock(ctx, FZ_LOCK_FREETYPE);
-			err = FT_Set_Char_Size(font->ft_face, 64, 64, 72, 72);
-			if (err)
-				fz_warn(ctx, "freetype set character size: %s", ft_error_string(err));
-			FT_Get_Advance(font->ft_face, text->items[i].gid, mask, &ftadv);
-			adv = ftadv / 65536.0f;
-			fz_unlock(ctx, FZ_LOCK_FREETYPE);
+			adv = fz_text_ft_advance(ctx, font, text->items[i].gid);
 		}
 		/* SumatraPDF: TODO: this check might no longer be needed */
 		else if (text->items[i].gid < 256)
@@ -1284,7 +1325,8 @@ fz_new_text_device(fz_context *ctx, fz_text_sheet *sheet, fz_text_page *page)
 	tdev->lastchar = ' ';
 
 	dev = fz_new_device(ctx, tdev);
-	dev->hints = FZ_IGNORE_IMAGE | FZ_IGNORE_SHADE;
+	/* SumatraPDF: paths don't contribute any text */
+	dev->hints = FZ_IGNORE_IMAGE | FZ_IGNORE_SHADE | FZ_IGNORE_PATH;
 	dev->begin_page = fz_text_begin_page;
 	dev->end_page = fz_text_end_page;
 	dev->free_user = fz_text_free_user;
@@ -1,6 +1,31 @@
 #include "mupdf/fitz.h"
 
+/* SumatraPDF: reference counts of storables are changed atomically, so
+ * that lookups only have to take the lock of the item's partition */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define atomic_inc(ctx, p) _InterlockedIncrement((volatile long *)(p))
+#define atomic_dec(ctx, p) _InterlockedDecrement((volatile long *)(p))
+#elif defined(__GNUC__)
+#define atomic_inc(ctx, p) __sync_add_and_fetch((p), 1)
+#define atomic_dec(ctx, p) __sync_sub_and_fetch((p), 1)
+#else
+/* FZ_LOCK_ALLOC may be taken while holding a partition's lock */
+static int
+atomic_change(fz_context *ctx, int *p, int delta)
+{
+	int refs;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	refs = (*p += delta);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	return refs;
+}
+#define atomic_inc(ctx, p) atomic_change((ctx), (p), 1)
+#define atomic_dec(ctx, p) atomic_change((ctx), (p), -1)
+#endif
+
 typedef struct fz_item_s fz_item;
+typedef struct fz_store_partition_s fz_store_partition;
 
 struct fz_item_s
 {
@@ -11,14 +36,19 @@ struct fz_item_s
 	fz_item *prev;
 	fz_store *store;
 	fz_store_type *type;
+	/* Lookups set this instead of moving the item to the head of its
+	 * list; eviction then gives the item a second chance. */
+	int used;
 };
 
-struct fz_store_s
+/* Everything in a partition is guarded by its own lock, which is never
+ * held while taking the lock of another partition. */
+struct fz_store_partition_s
 {
-	int refs;
+	int lock;
 
-	/* Every item in the store is kept in a doubly linked list, ordered
-	 * by usage (so LRU entries are at the end). */
+	/* Every item in the store is kept in the doubly linked list of its
+	 * partition, ordered by usage (so LRU entries are at the end). */
 	fz_item *head;
 	fz_item *tail;
 
@@ -26,7 +56,27 @@ struct fz_store_s
 	 * entries (those whose keys are indirect objects). */
 	fz_hash_table *hash;
 
-	/* We keep track of the size of the store, and keep it below max. */
+	/* An optional budget just for this partition. */
+	unsigned int max;
+	unsigned int size;
+
+	int items;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+};
+
+/* The partition locks must be the ones between FZ_LOCK_STORE and FZ_LOCK_FREETYPE */
+typedef char fz_store_partition_locks_check[FZ_LOCK_FREETYPE - FZ_LOCK_STORE == FZ_STORE_PARTITIONS ? 1 : -1];
+
+struct fz_store_s
+{
+	int refs;
+
+	fz_store_partition part[FZ_STORE_PARTITIONS];
+
+	/* We keep track of the size of the store, and keep it below max.
+	 * size is guarded by FZ_LOCK_ALLOC. */
 	unsigned int max;
 	unsigned int size;
 };
@@ -35,19 +85,25 @@ void
 fz_new_store_context(fz_context *ctx, unsigned int max)
 {
 	fz_store *store;
+	int i;
 	store = fz_malloc_struct(ctx, fz_store);
 	fz_try(ctx)
 	{
-		store->hash = fz_new_hash_table(ctx, 4096, sizeof(fz_store_hash), FZ_LOCK_ALLOC);
+		for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+		{
+			store->part[i].lock = FZ_LOCK_STORE + i;
+			store->part[i].hash = fz_new_hash_table(ctx, i == FZ_STORE_OBJECTS ? 4096 : 1024, sizeof(fz_store_hash), store->part[i].lock);
+		}
 	}
 	fz_catch(ctx)
 	{
+		for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+			if (store->part[i].hash)
+				fz_free_hash(ctx, store->part[i].hash);
 		fz_free(ctx, store);
 		fz_rethrow(ctx);
 	}
 	store->refs = 1;
-	store->head = NULL;
-	store->tail = NULL;
 	store->size = 0;
 	store->max = max;
 	ctx->store = store;
@@ -58,178 +114,307 @@ fz_keep_storable(fz_context *ctx, fz_storable *s)
 {
 	if (s == NULL)
 		return NULL;
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 	if (s->refs > 0)
-		s->refs++;
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
+		atomic_inc(ctx, &s->refs);
 	return s;
 }
 
 void
 fz_drop_storable(fz_context *ctx, fz_storable *s)
 {
-	int do_free = 0;
-
 	if (s == NULL)
 		return;
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 	if (s->refs < 0)
 	{
 		/* It's a static object. Dropping does nothing. */
 	}
-	else if (--s->refs == 0)
+	else if (atomic_dec(ctx, &s->refs) == 0)
 	{
 		/* If we are dropping the last reference to an object, then
 		 * it cannot possibly be in the store (as the store always
 		 * keeps a ref to everything in it, and doesn't drop via
 		 * this method. So we can simply drop the storable object
 		 * itself without any operations on the fz_store. */
-		do_free = 1;
+		s->free(ctx, s);
 	}
+}
+
+/* Returns non-zero if the value has to be freed */
+static int
+drop_val(fz_context *ctx, fz_storable *val)
+{
+	return val->refs > 0 && atomic_dec(ctx, &val->refs) == 0;
+}
+
+static void
+change_store_size(fz_context *ctx, unsigned int add, unsigned int sub)
+{
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	ctx->store->size += add;
+	ctx->store->size -= sub;
 	fz_unlock(ctx, FZ_LOCK_ALLOC);
-	if (do_free)
-		s->free(ctx, s);
 }
 
+static unsigned int
+get_store_size(fz_context *ctx)
+{
+	unsigned int size;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	size = ctx->store->size;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	return size;
+}
+
+/* Entered with the partition's lock taken, which is dropped while
+ * freeing the item. */
 static void
 evict(fz_context *ctx, fz_item *item)
 {
 	fz_store *store = ctx->store;
+	fz_store_partition *part = &store->part[item->type->partition];
 	int drop;
 
-	store->size -= item->size;
+	part->size -= item->size;
+	part->items--;
+	part->evictions++;
 	/* Unlink from the linked list */
 	if (item->next)
 		item->next->prev = item->prev;
 	else
-		store->tail = item->prev;
+		part->tail = item->prev;
 	if (item->prev)
 		item->prev->next = item->next;
 	else
-		store->head = item->next;
-	/* Drop a reference to the value (freeing if required) */
-	drop = (item->val->refs > 0 && --item->val->refs == 0);
+		part->head = item->next;
 	/* Remove from the hash table */
 	if (item->type->make_hash_key)
 	{
 		fz_store_hash hash = { NULL };
 		hash.free = item->val->free;
 		if (item->type->make_hash_key(&hash, item->key))
-			fz_hash_remove(ctx, store->hash, &hash);
+			fz_hash_remove(ctx, part->hash, &hash);
 	}
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	/* Drop a reference to the value (freeing if required). Once we no
+	 * longer hold a reference, another thread might free the value. */
+	drop = drop_val(ctx, item->val);
+	change_store_size(ctx, 0, item->size);
+	fz_unlock(ctx, part->lock);
 	if (drop)
 		item->val->free(ctx, item->val);
 	/* Always drops the key and free the item */
 	item->type->drop_key(ctx, item->key);
 	fz_free(ctx, item);
-	fz_lock(ctx, FZ_LOCK_ALLOC);
+	fz_lock(ctx, part->lock);
 }
 
-static int
-ensure_space(fz_context *ctx, unsigned int tofree)
+static void
+touch(fz_store_partition *part, fz_item *item)
 {
-	fz_item *item, *prev;
-	unsigned int count;
-	fz_store *store = ctx->store;
+	if (item->next != item)
+	{
+		/* Already in the list - unlink it */
+		if (item->next)
+			item->next->prev = item->prev;
+		else
+			part->tail = item->prev;
+		if (item->prev)
+			item->prev->next = item->next;
+		else
+			part->head = item->next;
+	}
+	/* Now relink it at the start of the LRU chain */
+	item->next = part->head;
+	if (item->next)
+		item->next->prev = item;
+	else
+		part->tail = item;
+	part->head = item;
+	item->prev = NULL;
+}
 
-	fz_assert_lock_held(ctx, FZ_LOCK_ALLOC);
+static unsigned int
+evictable(fz_store_partition *part, unsigned int tofree)
+{
+	fz_item *item;
+	unsigned int count = 0;
 
-	/* First check that we *can* free tofree; if not, we'd rather not
-	 * cache this. */
-	count = 0;
-	for (item = store->tail; item; item = item->prev)
-	{
+	for (item = part->tail; item && count < tofree; item = item->prev)
 		if (item->val->refs == 1)
-		{
 			count += item->size;
-			if (count >= tofree)
-				break;
+
+	return count;
+}
+
+/* Entered with the partition's lock taken, which may be dropped
+ * momentarily. */
+static unsigned int
+evict_lru(fz_context *ctx, fz_store_partition *part, unsigned int tofree)
+{
+	fz_item *item, *prev;
+	unsigned int count = 0;
+
+	for (item = part->tail; item; item = prev)
+	{
+		prev = item->prev;
+		/* Only the store holds a reference to values with refs == 1,
+		 * so these can only gain a reference through a lookup, which
+		 * takes the partition lock that we hold. */
+		if (item->val->refs != 1)
+			continue;
+		if (item->used)
+		{
+			/* Used since we last came by; move it to the head of
+			 * the list instead. Should we walk on that far, it'll
+			 * be evicted after all. */
+			item->used = 0;
+			touch(part, item);
+			continue;
 		}
+		/* Free this item. Evict has to drop the lock to
+		 * manage that, which could cause prev to be removed
+		 * in the meantime. To avoid that we bump its reference
+		 * count here. This may cause another simultaneous
+		 * evict process to fail to make enough space as prev is
+		 * pinned - but that will only happen if we're near to
+		 * the limit anyway, and it will only cause something to
+		 * not be cached. */
+		count += item->size;
+		if (prev)
+			atomic_inc(ctx, &prev->val->refs);
+		evict(ctx, item); /* Drops then retakes lock */
+		/* So the store has 1 reference to prev, as do we, so
+		 * no other evict process can have thrown prev away in
+		 * the meantime. So we are safe to just decrement its
+		 * reference count here. */
+		if (prev)
+			atomic_dec(ctx, &prev->val->refs);
+
+		if (count >= tofree)
+			break;
 	}
 
+	return count;
+}
+
+static unsigned int
+partition_evictable(fz_context *ctx, fz_store_partition *part, unsigned int tofree)
+{
+	unsigned int count;
+	fz_lock(ctx, part->lock);
+	count = evictable(part, tofree);
+	fz_unlock(ctx, part->lock);
+	return count;
+}
+
+static unsigned int
+partition_evict_lru(fz_context *ctx, fz_store_partition *part, unsigned int tofree)
+{
+	unsigned int count;
+	fz_lock(ctx, part->lock);
+	count = evict_lru(ctx, part, tofree);
+	fz_unlock(ctx, part->lock);
+	return count;
+}
+
+/* Entered without holding any of the store's locks */
+static unsigned int
+ensure_space(fz_context *ctx, int partition, unsigned int tofree, int others)
+{
+	fz_store *store = ctx->store;
+	unsigned int count;
+	unsigned int sizes[FZ_STORE_PARTITIONS];
+	int tried, i, j;
+
+	/* First check that we *can* free tofree; if not, we'd rather not
+	 * cache this. As the partitions are locked one after the other,
+	 * this is only an estimate while other threads use the store. */
+	count = partition_evictable(ctx, &store->part[partition], tofree);
+	for (i = 0; others && i < FZ_STORE_PARTITIONS && count < tofree; i++)
+		if (i != partition)
+			count += partition_evictable(ctx, &store->part[i], tofree - count);
+
 	/* If we ran out of items to search, then we can never free enough */
-	if (item == NULL)
-	{
+	if (count < tofree)
 		return 0;
-	}
 
-	/* Actually free the items */
-	count = 0;
-	for (item = store->tail; item; item = prev)
+	/* Actually free the items. Items of the same partition go first, so
+	 * that a kind of item mostly displaces items of the same kind, then
+	 * items of the largest other partitions. */
+	count = partition_evict_lru(ctx, &store->part[partition], tofree);
+	if (!others || count >= tofree)
+		return count;
+	for (i = 0; i < FZ_STORE_PARTITIONS; i++)
 	{
-		prev = item->prev;
-		if (item->val->refs == 1)
-		{
-			/* Free this item. Evict has to drop the lock to
-			 * manage that, which could cause prev to be removed
-			 * in the meantime. To avoid that we bump its reference
-			 * count here. This may cause another simultaneous
-			 * evict process to fail to make enough space as prev is
-			 * pinned - but that will only happen if we're near to
-			 * the limit anyway, and it will only cause something to
-			 * not be cached. */
-			count += item->size;
-			if (prev)
-				prev->val->refs++;
-			evict(ctx, item); /* Drops then retakes lock */
-			/* So the store has 1 reference to prev, as do we, so
-			 * no other evict process can have thrown prev away in
-			 * the meantime. So we are safe to just decrement its
-			 * reference count here. */
-			if (prev)
-				--prev->val->refs;
-
-			if (count >= tofree)
-				return count;
-		}
+		fz_lock(ctx, store->part[i].lock);
+		sizes[i] = store->part[i].size;
+		fz_unlock(ctx, store->part[i].lock);
+	}
+	tried = 1 << partition;
+	while (count < tofree)
+	{
+		j = -1;
+		for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+			if (!(tried & (1 << i)) && (j < 0 || sizes[i] > sizes[j]))
+				j = i;
+		if (j < 0)
+			break;
+		tried |= 1 << j;
+		count += partition_evict_lru(ctx, &store->part[j], tofree - count);
 	}
 
 	return count;
 }
 
-static void
-touch(fz_store *store, fz_item *item)
+static int
+make_room(fz_context *ctx, int partition, unsigned int size, unsigned int max, int others)
 {
-	if (item->next != item)
+	while (size > max)
 	{
-		/* Already in the list - unlink it */
-		if (item->next)
-			item->next->prev = item->prev;
-		else
-			store->tail = item->prev;
-		if (item->prev)
-			item->prev->next = item->next;
-		else
-			store->head = item->next;
+		unsigned int saved = ensure_space(ctx, partition, size - max, others);
+		if (saved == 0)
+			return 0;
+		size -= saved;
 	}
-	/* Now relink it at the start of the LRU chain */
-	item->next = store->head;
-	if (item->next)
-		item->next->prev = item;
-	else
-		store->tail = item;
-	store->head = item;
-	item->prev = NULL;
+	return 1;
+}
+
+/* Entered with the partition's lock taken, which is dropped */
+static void *
+use_existing(fz_context *ctx, fz_store_partition *part, fz_item *existing, fz_item *item)
+{
+	fz_storable *val = existing->val;
+
+	/* Take a new reference to the existing one, and drop our current one. */
+	existing->used = 1;
+	if (val->refs > 0)
+		atomic_inc(ctx, &val->refs);
+	fz_unlock(ctx, part->lock);
+	item->type->drop_key(ctx, item->key);
+	fz_free(ctx, item);
+	return val;
 }
 
 void *
 fz_store_item(fz_context *ctx, void *key, void *val_, unsigned int itemsize, fz_store_type *type)
 {
 	fz_item *item = NULL;
-	unsigned int size;
 	fz_storable *val = (fz_storable *)val_;
 	fz_store *store = ctx->store;
+	fz_store_partition *part;
 	fz_store_hash hash = { NULL };
+	fz_item *existing = NULL;
+	unsigned int size, max;
 	int use_hash = 0;
-	unsigned pos;
+	int fits = 1;
 
 	if (!store)
 		return NULL;
 
 	fz_var(item);
 
-	if (store->max != FZ_STORE_UNLIMITED && store->max < itemsize)
+	part = &store->part[type->partition];
+	if ((store->max != FZ_STORE_UNLIMITED && store->max < itemsize) ||
+		(part->max != FZ_STORE_UNLIMITED && part->max < itemsize))
 	{
 		/* Our item would take up more room than we can ever
 		 * possibly have in the store. Just give up now. */
@@ -255,12 +440,10 @@ fz_store_item(fz_context *ctx, void *key, void *val_, unsigned int itemsize, fz_
 	}
 
 	type->keep_key(ctx, key);
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 
 	/* Fill out the item. To start with, we always set item->next == item
-	 * and item->prev == item. This is so that we can spot items that have
-	 * been put into the hash table without having made it into the linked
-	 * list yet. */
+	 * and item->prev == item. This is so that touch can tell that the
+	 * item hasn't made it into the linked list yet. */
 	item->key = key;
 	item->val = val;
 	item->size = itemsize;
@@ -268,80 +451,63 @@ fz_store_item(fz_context *ctx, void *key, void *val_, unsigned int itemsize, fz_
 	item->prev = item;
 	item->type = type;
 
-	/* If we can index it fast, put it into the hash table. This serves
-	 * to check whether we have one there already. */
+	/* If we can index it fast, check whether we have one there already. */
+	fz_lock(ctx, part->lock);
 	if (use_hash)
+		existing = fz_hash_find(ctx, part->hash, &hash);
+	if (existing)
+		return use_existing(ctx, part, existing, item);
+	size = part->size;
+	max = part->max;
+	fz_unlock(ctx, part->lock);
+
+	/* Check for space within the item's partition, then within the
+	 * whole store (unless either is infinite). Evicting items from other
+	 * partitions requires their locks, so we don't hold ours meanwhile.
+	 * Should other threads fill the store in the meantime, we'll live
+	 * with being over budget. */
+	if (max != FZ_STORE_UNLIMITED)
+		fits = make_room(ctx, type->partition, size + itemsize, max, 0);
+	if (fits && store->max != FZ_STORE_UNLIMITED)
+		fits = make_room(ctx, type->partition, get_store_size(ctx) + itemsize, store->max, 1);
+	if (!fits)
 	{
-		fz_item *existing;
+		type->drop_key(ctx, key);
+		fz_free(ctx, item);
+		return NULL;
+	}
 
+	fz_lock(ctx, part->lock);
+	if (use_hash)
+	{
 		fz_try(ctx)
 		{
 			/* May drop and retake the lock */
-			existing = fz_hash_insert_with_pos(ctx, store->hash, &hash, item, &pos);
+			existing = fz_hash_insert(ctx, part->hash, &hash, item);
 		}
 		fz_catch(ctx)
 		{
 			/* Any error here means that item never made it into the
 			 * hash - so no one else can have a reference. */
-			fz_unlock(ctx, FZ_LOCK_ALLOC);
-			fz_free(ctx, item);
+			fz_unlock(ctx, part->lock);
 			type->drop_key(ctx, key);
+			fz_free(ctx, item);
 			return NULL;
 		}
+		/* Someone else might have stored one while we made room */
 		if (existing)
-		{
-			/* There was one there already! Take a new reference
-			 * to the existing one, and drop our current one. */
-			touch(store, existing);
-			if (existing->val->refs > 0)
-				existing->val->refs++;
-			fz_unlock(ctx, FZ_LOCK_ALLOC);
-			fz_free(ctx, item);
-			type->drop_key(ctx, key);
-			return existing->val;
-		}
+			return use_existing(ctx, part, existing, item);
 	}
 	/* Now bump the ref */
 	if (val->refs > 0)
-		val->refs++;
-	/* If we haven't got an infinite store, check for space within it */
-	if (store->max != FZ_STORE_UNLIMITED)
-	{
-		size = store->size + itemsize;
-		while (size > store->max)
-		{
-			/* ensure_space may drop, then retake the lock */
-			int saved = ensure_space(ctx, size - store->max);
-			if (saved == 0)
-			{
-				/* Failed to free any space. */
-				/* If we are using the hash table, then we've already
-				 * inserted item - remove it. */
-				if (use_hash)
-				{
-					/* If someone else has already picked up a reference
-					 * to item, then we cannot remove it. Leave it in the
-					 * store, and we'll live with being over budget. We
-					 * know this is the case, if it's in the linked list. */
-					if (item->next != item)
-						break;
-					fz_hash_remove_fast(ctx, store->hash, &hash, pos);
-				}
-				fz_unlock(ctx, FZ_LOCK_ALLOC);
-				fz_free(ctx, item);
-				type->drop_key(ctx, key);
-				if (val->refs > 0)
-					val->refs--;
-				return NULL;
-			}
-			size -= saved;
-		}
-	}
-	store->size += itemsize;
+		atomic_inc(ctx, &val->refs);
+	part->size += itemsize;
+	part->items++;
+	change_store_size(ctx, itemsize, 0);
 
 	/* Regardless of whether it's indexed, it goes into the linked list */
-	touch(store, item);
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	touch(part, item);
+	fz_unlock(ctx, part->lock);
 
 	return NULL;
 }
@@ -351,6 +517,8 @@ fz_find_item(fz_context *ctx, fz_store_free_fn *free, void *key, fz_store_type *
 {
 	fz_item *item;
 	fz_store *store = ctx->store;
+	fz_store_partition *part;
+	fz_storable *val;
 	fz_store_hash hash = { NULL };
 	int use_hash = 0;
 
@@ -360,22 +528,26 @@ fz_find_item(fz_context *ctx, fz_store_free_fn *free, void *key, fz_store_type *
 	if (!key)
 		return NULL;
 
+	part = &store->part[type->partition];
+
 	if (type->make_hash_key)
 	{
 		hash.free = free;
 		use_hash = type->make_hash_key(&hash, key);
 	}
 
-	fz_lock(ctx, FZ_LOCK_ALLOC);
+	/* Only the partition's lock is needed, so that lookups neither wait
+	 * for allocations nor for lookups in other partitions. */
+	fz_lock(ctx, part->lock);
 	if (use_hash)
 	{
 		/* We can find objects keyed on indirected objects quickly */
-		item = fz_hash_find(ctx, store->hash, &hash);
+		item = fz_hash_find(ctx, part->hash, &hash);
 	}
 	else
 	{
 		/* Others we have to hunt for slowly */
-		for (item = store->head; item; item = item->next)
+		for (item = part->head; item; item = item->next)
 		{
 			if (item->val->free == free && !type->cmp_key(item->key, key))
 				break;
@@ -383,18 +555,18 @@ fz_find_item(fz_context *ctx, fz_store_free_fn *free, void *key, fz_store_type *
 	}
 	if (item)
 	{
-		/* LRU the block. This also serves to ensure that any item
-		 * picked up from the hash before it has made it into the
-		 * linked list does not get whipped out again due to the
-		 * store being full. */
-		touch(store, item);
+		/* LRU the block (without reshuffling the list) */
+		item->used = 1;
+		part->hits++;
 		/* And bump the refcount before returning */
-		if (item->val->refs > 0)
-			item->val->refs++;
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
-		return (void *)item->val;
+		val = item->val;
+		if (val->refs > 0)
+			atomic_inc(ctx, &val->refs);
+		fz_unlock(ctx, part->lock);
+		return (void *)val;
 	}
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	part->misses++;
+	fz_unlock(ctx, part->lock);
 
 	return NULL;
 }
@@ -404,73 +576,128 @@ fz_remove_item(fz_context *ctx, fz_store_free_fn *free, void *key, fz_store_type
 {
 	fz_item *item;
 	fz_store *store = ctx->store;
+	fz_store_partition *part;
 	int drop;
 	fz_store_hash hash = { NULL };
 	int use_hash = 0;
 
+	if (!store)
+		return;
+
+	part = &store->part[type->partition];
+
 	if (type->make_hash_key)
 	{
 		hash.free = free;
 		use_hash = type->make_hash_key(&hash, key);
 	}
 
-	fz_lock(ctx, FZ_LOCK_ALLOC);
+	fz_lock(ctx, part->lock);
 	if (use_hash)
 	{
 		/* We can find objects keyed on indirect objects quickly */
-		item = fz_hash_find(ctx, store->hash, &hash);
+		item = fz_hash_find(ctx, part->hash, &hash);
 		if (item)
-			fz_hash_remove(ctx, store->hash, &hash);
+			fz_hash_remove(ctx, part->hash, &hash);
 	}
 	else
 	{
 		/* Others we have to hunt for slowly */
-		for (item = store->head; item; item = item->next)
+		for (item = part->head; item; item = item->next)
 			if (item->val->free == free && !type->cmp_key(item->key, key))
 				break;
 	}
 	if (item)
 	{
-		/* Momentarily things can be in the hash table without being
-		 * in the list. Don't attempt to unlink these. We indicate
-		 * such items by setting item->next == item. */
-		if (item->next != item)
-		{
-			if (item->next)
-				item->next->prev = item->prev;
-			else
-				store->tail = item->prev;
-			if (item->prev)
-				item->prev->next = item->next;
-			else
-				store->head = item->next;
-		}
-		drop = (item->val->refs > 0 && --item->val->refs == 0);
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		/* Items are linked in while still holding the lock under
+		 * which they were put into the hash table */
+		if (item->next)
+			item->next->prev = item->prev;
+		else
+			part->tail = item->prev;
+		if (item->prev)
+			item->prev->next = item->next;
+		else
+			part->head = item->next;
+		part->size -= item->size;
+		part->items--;
+		change_store_size(ctx, 0, item->size);
+		drop = drop_val(ctx, item->val);
+		fz_unlock(ctx, part->lock);
 		if (drop)
 			item->val->free(ctx, item->val);
 		type->drop_key(ctx, item->key);
 		fz_free(ctx, item);
 	}
 	else
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		fz_unlock(ctx, part->lock);
 }
 
 void
 fz_empty_store(fz_context *ctx)
 {
 	fz_store *store = ctx->store;
+	int i;
 
 	if (store == NULL)
 		return;
 
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 	/* Run through all the items in the store */
-	while (store->head)
+	for (i = 0; i < FZ_STORE_PARTITIONS; i++)
 	{
-		evict(ctx, store->head); /* Drops then retakes lock */
+		fz_lock(ctx, store->part[i].lock);
+		while (store->part[i].head)
+		{
+			evict(ctx, store->part[i].head); /* Drops then retakes lock */
+		}
+		fz_unlock(ctx, store->part[i].lock);
+	}
+}
+
+void
+fz_set_store_partition_max(fz_context *ctx, int partition, unsigned int max)
+{
+	fz_store_partition *part;
+
+	if (ctx == NULL || ctx->store == NULL || partition < 0 || partition >= FZ_STORE_PARTITIONS)
+		return;
+	part = &ctx->store->part[partition];
+	fz_lock(ctx, part->lock);
+	part->max = max;
+	fz_unlock(ctx, part->lock);
+}
+
+void
+fz_get_store_stats(fz_context *ctx, int partition, fz_store_stats *stats)
+{
+	fz_store *store;
+	fz_store_partition *part;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	if (ctx == NULL || ctx->store == NULL || partition >= FZ_STORE_PARTITIONS)
+		return;
+	store = ctx->store;
+
+	for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+	{
+		if (partition >= 0 && partition != i)
+			continue;
+		part = &store->part[i];
+		fz_lock(ctx, part->lock);
+		stats->size += part->size;
+		stats->max = part->max;
+		stats->items += part->items;
+		stats->hits += part->hits;
+		stats->misses += part->misses;
+		stats->evictions += part->evictions;
+		fz_unlock(ctx, part->lock);
+	}
+	if (partition < 0)
+	{
+		stats->size = get_store_size(ctx);
+		stats->max = store->max;
 	}
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
 }
 
 fz_store *
@@ -487,7 +714,7 @@ fz_keep_store_context(fz_context *ctx)
 void
 fz_drop_store_context(fz_context *ctx)
 {
-	int refs;
+	int refs, i;
 	if (ctx == NULL || ctx->store == NULL)
 		return;
 	fz_lock(ctx, FZ_LOCK_ALLOC);
@@ -497,7 +724,8 @@ fz_drop_store_context(fz_context *ctx)
 		return;
 
 	fz_empty_store(ctx);
-	fz_free_hash(ctx, ctx->store->hash);
+	for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+		fz_free_hash(ctx, ctx->store->part[i].hash);
 	fz_free(ctx, ctx->store);
 	ctx->store = NULL;
 }
@@ -511,31 +739,42 @@ print_item(FILE *out, void *item_)
 	fflush(out);
 }
 
+/* SumatraPDF: takes the partition locks itself, so this must be
+ * called without holding any of the store's locks */
 void
 fz_print_store_locked(fz_context *ctx, FILE *out)
 {
 	fz_item *item, *next;
 	fz_store *store = ctx->store;
+	int i;
 
 	fprintf(out, "-- resource store contents --\n");
 	fflush(out);
 
-	for (item = store->head; item; item = next)
+	for (i = 0; i < FZ_STORE_PARTITIONS; i++)
 	{
-		next = item->next;
-		if (next)
-			next->val->refs++;
-		fprintf(out, "store[*][refs=%d][size=%d] ", item->val->refs, item->size);
-		fz_unlock(ctx, FZ_LOCK_ALLOC);
-		item->type->debug(out, item->key);
-		fprintf(out, " = %p\n", item->val);
-		fflush(out);
-		fz_lock(ctx, FZ_LOCK_ALLOC);
-		if (next)
-			next->val->refs--;
+		fz_store_partition *part = &store->part[i];
+		fz_lock(ctx, part->lock);
+		fprintf(out, "-- partition %d: %d items, size=%u max=%u hits=%u misses=%u evictions=%u --\n",
+			i, part->items, part->size, part->max, part->hits, part->misses, part->evictions);
+		for (item = part->head; item; item = next)
+		{
+			next = item->next;
+			if (next)
+				atomic_inc(ctx, &next->val->refs);
+			fprintf(out, "store[%d][refs=%d][size=%d] ", i, item->val->refs, item->size);
+			fz_unlock(ctx, part->lock);
+			item->type->debug(out, item->key);
+			fprintf(out, " = %p\n", item->val);
+			fflush(out);
+			fz_lock(ctx, part->lock);
+			if (next)
+				atomic_dec(ctx, &next->val->refs);
+		}
+		fprintf(out, "-- partition %d hash contents --\n", i);
+		fz_print_hash_details(ctx, out, part->hash, print_item);
+		fz_unlock(ctx, part->lock);
 	}
-	fprintf(out, "-- resource store hash contents --\n");
-	fz_print_hash_details(ctx, out, store->hash, print_item);
 	fprintf(out, "-- end --\n");
 	fflush(out);
 }
@@ -543,9 +782,7 @@ fz_print_store_locked(fz_context *ctx, FILE *out)
 void
 fz_print_store(fz_context *ctx, FILE *out)
 {
-	fz_lock(ctx, FZ_LOCK_ALLOC);
 	fz_print_store_locked(ctx, out);
-	fz_unlock(ctx, FZ_LOCK_ALLOC);
 }
 #endif
 
@@ -557,33 +794,42 @@ scavenge(fz_context *ctx, unsigned int tofree)
 	fz_store *store = ctx->store;
 	unsigned int count = 0;
 	fz_item *item, *prev;
+	int i;
 
-	/* Free the items */
-	for (item = store->tail; item; item = prev)
+	/* Free the items, starting with the partitions whose items are
+	 * the biggest and the cheapest to recreate */
+	for (i = FZ_STORE_PARTITIONS - 1; i >= 0 && count < tofree; i--)
 	{
-		prev = item->prev;
-		if (item->val->refs == 1)
+		fz_store_partition *part = &store->part[i];
+		fz_lock(ctx, part->lock);
+		for (item = part->tail; item; item = prev)
 		{
-			/* Free this item */
-			count += item->size;
-			evict(ctx, item); /* Drops then retakes lock */
+			prev = item->prev;
+			if (item->val->refs == 1)
+			{
+				/* Free this item */
+				count += item->size;
+				evict(ctx, item); /* Drops then retakes lock */
 
-			if (count >= tofree)
-				break;
+				if (count >= tofree)
+					break;
 
-			/* Have to restart search again, as prev may no longer
-			 * be valid due to release of lock in evict. */
-			prev = store->tail;
+				/* Have to restart search again, as prev may no longer
+				 * be valid due to release of lock in evict. */
+				prev = part->tail;
+			}
 		}
+		fz_unlock(ctx, part->lock);
 	}
 	/* Success is managing to evict any blocks */
 	return count != 0;
 }
 
+/* SumatraPDF: called without holding FZ_LOCK_ALLOC */
 int fz_store_scavenge(fz_context *ctx, unsigned int size, int *phase)
 {
 	fz_store *store;
-	unsigned int max;
+	unsigned int max, store_size;
 
 	if (ctx == NULL)
 		return 0;
@@ -592,7 +838,7 @@ int fz_store_scavenge(fz_context *ctx, unsigned int size, int *phase)
 		return 0;
 
 #ifdef DEBUG_SCAVENGING
-	printf("Scavenging: store=%d size=%d phase=%d\n", store->size, size, *phase);
+	printf("Scavenging: store=%d size=%d phase=%d\n", get_store_size(ctx), size, *phase);
 	fz_print_store_locked(ctx, stderr);
 	Memento_stats();
 #endif
@@ -600,27 +846,29 @@ int fz_store_scavenge(fz_context *ctx, unsigned int size, int *phase)
 	{
 		unsigned int tofree;
 
+		store_size = get_store_size(ctx);
+
 		/* Calculate 'max' as the maximum size of the store for this phase */
 		if (*phase >= 16)
 			max = 0;
 		else if (store->max != FZ_STORE_UNLIMITED)
 			max = store->max / 16 * (16 - *phase);
 		else
-			max = store->size / (16 - *phase) * (15 - *phase);
+			max = store_size / (16 - *phase) * (15 - *phase);
 		(*phase)++;
 
 		/* Slightly baroque calculations to avoid overflow */
-		if (size > UINT_MAX - store->size)
+		if (size > UINT_MAX - store_size)
 			tofree = UINT_MAX - max;
-		else if (size + store->size > max)
+		else if (size + store_size > max)
 			continue;
 		else
-			tofree = size + store->size - max;
+			tofree = size + store_size - max;
 
 		if (scavenge(ctx, tofree))
 		{
 #ifdef DEBUG_SCAVENGING
-			printf("scavenged: store=%d\n", store->size);
+			printf("scavenged: store=%d\n", get_store_size(ctx));
 			fz_print_store(ctx, stderr);
 			Memento_stats();
 #endif
@@ -1,5 +1,13 @@
 #include "mupdf/fitz.h"
 
+/* SumatraPDF: memory mapped file streams */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 void fz_rebind_stream(fz_stream *stm, fz_context *ctx)
 {
 	if (stm == NULL || stm->ctx == ctx)
@@ -151,8 +159,9 @@ fz_open_fd(fz_context *ctx, int fd)
 	return stm;
 }
 
-fz_stream *
-fz_open_file(fz_context *ctx, const char *name)
+/* SumatraPDF: shared between fz_open_file and fz_open_file_mapped */
+static int
+open_file_fd(fz_context *ctx, const char *name)
 {
 #ifdef _WIN32
 	char *s = (char*)name;
@@ -178,7 +187,13 @@ fz_open_file(fz_context *ctx, const char *name)
 #endif
 	if (fd == -1)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open %s", name);
-	return fz_open_fd(ctx, fd);
+	return fd;
+}
+
+fz_stream *
+fz_open_file(fz_context *ctx, const char *name)
+{
+	return fz_open_fd(ctx, open_file_fd(ctx, name));
 }
 
 #ifdef _WIN32
@@ -273,3 +288,177 @@ fz_open_memory(fz_context *ctx, unsigned char *data, int len)
 
 	return stm;
 }
+
+/* SumatraPDF: memory mapped file stream */
+
+typedef struct fz_file_mapping_s
+{
+	int refs;
+	unsigned char *data;
+	int len;
+} fz_file_mapping;
+
+static void unmap_data(unsigned char *data, int len)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap(data, len);
+#endif
+}
+
+/* Returns NULL (instead of throwing) if the file can't be mapped */
+static fz_file_mapping *
+map_fd(fz_context *ctx, int fd)
+{
+	fz_file_mapping *map = NULL;
+	unsigned char *data;
+	int len;
+#ifdef _WIN32
+	HANDLE hfile = (HANDLE)_get_osfhandle(fd);
+	HANDLE hmap;
+	LARGE_INTEGER size;
+
+	if (hfile == INVALID_HANDLE_VALUE || GetFileType(hfile) != FILE_TYPE_DISK)
+		return NULL;
+	if (!GetFileSizeEx(hfile, &size) || size.QuadPart <= 0 || size.QuadPart > INT_MAX)
+		return NULL;
+	hmap = CreateFileMapping(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hmap)
+		return NULL;
+	data = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+	/* the view keeps its own reference to the mapping object */
+	CloseHandle(hmap);
+	if (!data)
+		return NULL;
+	len = (int)size.QuadPart;
+#else
+	struct stat info;
+
+	if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+		return NULL;
+	if (info.st_size <= 0 || info.st_size > INT_MAX)
+		return NULL;
+	data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+	len = (int)info.st_size;
+#endif
+
+	fz_try(ctx)
+	{
+		map = fz_malloc_struct(ctx, fz_file_mapping);
+	}
+	fz_catch(ctx)
+	{
+		unmap_data(data, len);
+		fz_rethrow(ctx);
+	}
+	map->refs = 1;
+	map->data = data;
+	map->len = len;
+
+	return map;
+}
+
+static void close_mapped(fz_context *ctx, void *state_)
+{
+	fz_file_mapping *map = state_;
+	int drop;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	drop = --map->refs == 0;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	if (drop)
+	{
+		unmap_data(map->data, map->len);
+		fz_free(ctx, map);
+	}
+}
+
+static fz_stream *open_mapping(fz_context *ctx, fz_file_mapping *map);
+
+/* clones share the mapping instead of copying the data */
+static fz_stream *reopen_mapped(fz_context *ctx, fz_stream *stm)
+{
+	fz_file_mapping *map = stm->state;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	map->refs++;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return open_mapping(ctx, map);
+}
+
+static fz_stream *
+open_mapping(fz_context *ctx, fz_file_mapping *map)
+{
+	fz_stream *stm = fz_new_stream(ctx, map, next_buffer, close_mapped, NULL);
+	stm->seek = seek_buffer;
+	stm->reopen = reopen_mapped;
+
+	stm->rp = map->data;
+	stm->wp = map->data + map->len;
+
+	stm->pos = map->len;
+
+	return stm;
+}
+
+fz_stream *
+fz_open_fd_mapped(fz_context *ctx, int fd)
+{
+	fz_file_mapping *map = NULL;
+
+	fz_try(ctx)
+	{
+		map = map_fd(ctx, fd);
+	}
+	fz_always(ctx)
+	{
+		/* the mapping stays valid after the descriptor has been closed */
+		close(fd);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow(ctx);
+	}
+	if (!map)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot map file into memory");
+
+	return open_mapping(ctx, map);
+}
+
+/* Prefer a memory mapping and fall back to buffered reading */
+fz_stream *
+fz_open_file_mapped(fz_context *ctx, const char *name)
+{
+	int fd = open_file_fd(ctx, name);
+	fz_file_mapping *map = NULL;
+
+	fz_try(ctx)
+	{
+		map = map_fd(ctx, fd);
+	}
+	fz_catch(ctx)
+	{
+		map = NULL;
+	}
+	if (!map)
+		return fz_open_fd(ctx, fd);
+
+	close(fd);
+	return open_mapping(ctx, map);
+}
+
+/* SumatraPDF: allow direct access to streams backed by memory */
+unsigned char *
+fz_stream_data(fz_stream *stm, int *len)
+{
+	if (!stm || stm->next != next_buffer)
+		return NULL;
+	/* for buffers and mappings, wp is the end of the data and pos its length */
+	if (len)
+		*len = stm->pos;
+	return stm->wp - stm->pos;
+}
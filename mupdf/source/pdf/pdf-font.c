@@ -195,7 +195,9 @@ pdf_load_builtin_font(fz_context *ctx, pdf_font_desc *fontdesc, char *fontname,
 		if (!data)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "cannot find builtin font: '%s'", fontname);
 
-		fontdesc->font = fz_new_font_from_memory(ctx, fontname, data, len, 0, 1);
+		/* SumatraPDF: share builtin fonts between documents (under their clean
+		   name, so that e.g. "Helvetica,Bold" and "Helvetica-Bold" share a face) */
+		fontdesc->font = fz_new_shared_font_from_memory(ctx, clean_name, data, len, 0, 1);
 	}
 
 	if (!strcmp(clean_name, "Symbol") || !strcmp(clean_name, "ZapfDingbats"))
@@ -318,7 +320,8 @@ pdf_load_embedded_font(pdf_document *doc, pdf_font_desc *fontdesc, char *fontnam
 
 	fz_try(ctx)
 	{
-		fontdesc->font = fz_new_font_from_buffer(ctx, fontname, buf, 0, 1);
+		/* SumatraPDF: share identical font programs between documents */
+		fontdesc->font = fz_new_shared_font_from_buffer(ctx, fontname, buf, 0, 1);
 	}
 	fz_always(ctx)
 	{
@@ -328,7 +331,8 @@ pdf_load_embedded_font(pdf_document *doc, pdf_font_desc *fontdesc, char *fontnam
 	{
 		fz_rethrow_message(ctx, "cannot load embedded font (%d %d R)", pdf_to_num(stmref), pdf_to_gen(stmref));
 	}
-	fontdesc->size += buf->len;
+	/* SumatraPDF: buf might have been dropped already */
+	fontdesc->size += fontdesc->font->ft_size;
 
 	fontdesc->is_embedded = 1;
 }
@@ -349,7 +353,7 @@ pdf_drop_font(fz_context *ctx, pdf_font_desc *fontdesc)
 	fz_drop_storable(ctx, &fontdesc->storable);
 }
 
-static void
+void
 pdf_free_font_imp(fz_context *ctx, fz_storable *fontdesc_)
 {
 	pdf_font_desc *fontdesc = (pdf_font_desc *)fontdesc_;
@@ -442,8 +446,11 @@ pdf_load_bullet_font(fz_context *ctx)
 		gid = FT_Get_Name_Index(fontdesc->font->ft_face, "bullet");
 		for (i = 0; i < 256; i++)
 			fontdesc->cid_to_gid[i] = gid;
+		fz_lock(ctx, FZ_LOCK_FREETYPE);
 		FT_Set_Char_Size(fontdesc->font->ft_face, 1000, 1000, 72, 72);
-		pdf_set_default_hmtx(ctx, fontdesc, ft_width(ctx, fontdesc, 0));
+		i = ft_width(ctx, fontdesc, 0);
+		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		pdf_set_default_hmtx(ctx, fontdesc, i);
 	}
 	fz_catch(ctx)
 	{
@@ -579,6 +586,13 @@ pdf_load_simple_font_by_name(pdf_document *doc, pdf_obj *dict, char *basefont)
 			}
 		}
 
+		/* SumatraPDF: a shared face might be in use by other documents */
+		if (fontdesc->font->is_shared)
+		{
+			fz_lock(ctx, FZ_LOCK_FREETYPE);
+			has_lock = 1;
+		}
+
 		if (cmap)
 		{
 			fterr = FT_Set_Charmap(face, cmap);
@@ -635,8 +649,11 @@ pdf_load_simple_font_by_name(pdf_document *doc, pdf_obj *dict, char *basefont)
 		for (i = 0; i < 256; i++)
 			etable[i] = ft_char_index(face, i);
 
-		fz_lock(ctx, FZ_LOCK_FREETYPE);
-		has_lock = 1;
+		if (!has_lock)
+		{
+			fz_lock(ctx, FZ_LOCK_FREETYPE);
+			has_lock = 1;
+		}
 
 		/* built-in and substitute fonts may be a different type than what the document expects */
 		subtype = pdf_to_name(pdf_dict_gets(dict, "Subtype"));
@@ -823,8 +840,18 @@ pdf_load_simple_font_by_name(pdf_document *doc, pdf_obj *dict, char *basefont)
 				if (!wid && i >= pdf_array_len(widths))
 				{
 					fz_warn(ctx, "font width missing for glyph %d (%d %d R)", i + first, pdf_to_num(dict), pdf_to_gen(dict));
+					if (fontdesc->font->is_shared)
+					{
+						fz_lock(ctx, FZ_LOCK_FREETYPE);
+						has_lock = 1;
+					}
 					FT_Set_Char_Size(face, 1000, 1000, 72, 72);
 					wid = ft_width(ctx, fontdesc, i + first);
+					if (has_lock)
+					{
+						fz_unlock(ctx, FZ_LOCK_FREETYPE);
+						has_lock = 0;
+					}
 				}
 				pdf_add_hmtx(ctx, fontdesc, i + first, i + first, wid);
 			}
@@ -902,6 +929,7 @@ hail_mary_debug_key(FILE *out, void *key_)
 
 static fz_store_type hail_mary_store_type =
 {
+	FZ_STORE_FONTS,
 	hail_mary_make_hash_key,
 	hail_mary_keep_key,
 	hail_mary_drop_key,
@@ -220,11 +220,19 @@ pdf_load_jpx(pdf_document *doc, pdf_obj *dict, int forcemask)
 	fz_context *ctx = doc->ctx;
 	int indexed = 0;
 	fz_image *mask = NULL;
+	/* SumatraPDF: decode JPX images on demand */
+	fz_compressed_buffer *bc = NULL;
+	fz_image *image;
+	fz_colorspace *jpxcs = NULL;
+	float decode[FZ_MAX_COLORS * 2];
+	int has_decode = 0;
+	int w, h, xres, yres;
 
 	fz_var(img);
 	fz_var(buf);
 	fz_var(colorspace);
 	fz_var(mask);
+	fz_var(bc);
 
 	buf = pdf_load_stream(doc, pdf_to_num(dict), pdf_to_gen(dict));
 
@@ -238,7 +246,19 @@ pdf_load_jpx(pdf_document *doc, pdf_obj *dict, int forcemask)
 			indexed = fz_colorspace_is_indexed(colorspace);
 		}
 
-		img = fz_load_jpx(ctx, buf->data, buf->len, colorspace, indexed);
+		/* SumatraPDF: only read the header for now so that fz_image_get_pixmap
+		 * can decode the image at the required resolution (soft masks are
+		 * still decoded at once, as they have to be converted) */
+		if (forcemask)
+			img = fz_load_jpx(ctx, buf->data, buf->len, colorspace, indexed);
+		else
+		{
+			fz_load_jpx_info(ctx, buf->data, buf->len, &w, &h, &xres, &yres, &jpxcs, indexed);
+			bc = fz_malloc_struct(ctx, fz_compressed_buffer);
+			bc->buffer = fz_keep_buffer(ctx, buf);
+			bc->params.type = FZ_IMAGE_JPX;
+			bc->params.u.jpx.has_colorspace = colorspace != NULL;
+		}
 
 		obj = pdf_dict_getsa(dict, "SMask", "Mask");
 		if (pdf_is_dict(obj))
@@ -252,27 +272,51 @@ pdf_load_jpx(pdf_document *doc, pdf_obj *dict, int forcemask)
 		obj = pdf_dict_getsa(dict, "Decode", "D");
 		if (obj && !indexed)
 		{
-			float decode[FZ_MAX_COLORS * 2];
 			int i;
 
-			for (i = 0; i < img->n * 2; i++)
+			for (i = 0; i < FZ_MAX_COLORS * 2; i++)
 				decode[i] = pdf_to_real(pdf_array_get(obj, i));
 
-			fz_decode_tile(img, decode);
+			if (img)
+				fz_decode_tile(img, decode);
+			else
+				has_decode = 1;
 		}
 	}
 	fz_always(ctx)
 	{
-		fz_drop_colorspace(ctx, colorspace);
 		fz_drop_buffer(ctx, buf);
 	}
 	fz_catch(ctx)
 	{
+		fz_drop_colorspace(ctx, colorspace);
+		fz_free_compressed_buffer(ctx, bc);
+		fz_drop_image(ctx, mask);
 		fz_drop_pixmap(ctx, img);
 		fz_rethrow(ctx);
 	}
 
-	return fz_new_image_from_pixmap(ctx, img, mask);
+	if (img)
+	{
+		fz_drop_colorspace(ctx, colorspace);
+		return fz_new_image_from_pixmap(ctx, img, mask);
+	}
+
+	/* SumatraPDF: decode JPX images on demand */
+	if (!colorspace)
+		colorspace = fz_keep_colorspace(ctx, jpxcs);
+	fz_try(ctx)
+	{
+		/* fz_new_image takes ownership of bc (even on failure) */
+		image = fz_new_image(ctx, w, h, 8, colorspace, xres, yres, 0, 0, has_decode ? decode : NULL, NULL, bc, mask);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_colorspace(ctx, colorspace);
+		fz_drop_image(ctx, mask);
+		fz_rethrow(ctx);
+	}
+	return image;
 }
 
 static int
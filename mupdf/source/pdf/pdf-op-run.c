@@ -876,6 +876,17 @@ pdf_show_image(pdf_csi *csi, pdf_run_state *pr, fz_image *image)
 		pdf_end_group(csi, pr, &softmask);
 }
 
+/* SumatraPDF: paths filled with patterns or soft-masked may still contain text */
+static int
+pdf_ignore_path(pdf_run_state *pr)
+{
+	pdf_gstate *gstate = pr->gstate + pr->gtop;
+
+	return (pr->dev->hints & FZ_IGNORE_PATH) &&
+		gstate->fill.kind != PDF_MAT_PATTERN && gstate->stroke.kind != PDF_MAT_PATTERN &&
+		!gstate->softmask;
+}
+
 static void
 pdf_show_path(pdf_csi *csi, pdf_run_state *pr, int doclose, int dofill, int dostroke, int even_odd)
 {
@@ -886,6 +897,20 @@ pdf_show_path(pdf_csi *csi, pdf_run_state *pr, int doclose, int dofill, int dost
 	softmask_save softmask = { NULL };
 	int knockout_group = 0;
 
+	/* SumatraPDF: neither clip nor paint paths the device ignores */
+	if (pdf_ignore_path(pr))
+	{
+		/* the path was constructed under a different graphics state */
+		if (pr->path->cmd_len > 0)
+		{
+			path = pr->path;
+			pr->path = fz_new_path(ctx);
+			fz_free_path(ctx, path);
+		}
+		pr->clip = 0;
+		return;
+	}
+
 	if (dostroke) {
 		if (pr->dev->flags & (FZ_DEVFLAG_STROKECOLOR_UNDEFINED | FZ_DEVFLAG_LINEJOIN_UNDEFINED | FZ_DEVFLAG_LINEWIDTH_UNDEFINED))
 			pr->dev->flags |= FZ_DEVFLAG_UNCACHEABLE;
@@ -1776,13 +1801,16 @@ run_xobject(pdf_csi *csi, void *state, pdf_obj *resources, pdf_xobject *xobj, co
 		pdf_gsave(pr); /* Save here so the clippath doesn't persist */
 
 		/* clip to the bounds */
-		fz_moveto(ctx, pr->path, xobj->bbox.x0, xobj->bbox.y0);
-		fz_lineto(ctx, pr->path, xobj->bbox.x1, xobj->bbox.y0);
-		fz_lineto(ctx, pr->path, xobj->bbox.x1, xobj->bbox.y1);
-		fz_lineto(ctx, pr->path, xobj->bbox.x0, xobj->bbox.y1);
-		fz_closepath(ctx, pr->path);
-		pr->clip = 1;
-		pdf_show_path(csi, pr, 0, 0, 0, 0);
+		if (!pdf_ignore_path(pr))
+		{
+			fz_moveto(ctx, pr->path, xobj->bbox.x0, xobj->bbox.y0);
+			fz_lineto(ctx, pr->path, xobj->bbox.x1, xobj->bbox.y0);
+			fz_lineto(ctx, pr->path, xobj->bbox.x1, xobj->bbox.y1);
+			fz_lineto(ctx, pr->path, xobj->bbox.x0, xobj->bbox.y1);
+			fz_closepath(ctx, pr->path);
+			pr->clip = 1;
+			pdf_show_path(csi, pr, 0, 0, 0, 0);
+		}
 
 		/* run contents */
 
@@ -1866,6 +1894,9 @@ static void pdf_run_BI(pdf_csi *csi, void *state)
 {
 	pdf_run_state *pr = (pdf_run_state *)state;
 
+	/* SumatraPDF: ignore inline images same as image XObjects */
+	if (pr->dev->hints & FZ_IGNORE_IMAGE)
+		return;
 	pdf_show_image(csi, pr, csi->img);
 }
 
@@ -2390,6 +2421,8 @@ static void pdf_run_c(pdf_csi *csi, void *state)
 	pdf_run_state *pr = (pdf_run_state *)state;
 	float a, b, c, d, e, f;
 
+	if (pdf_ignore_path(pr))
+		return;
 	a = csi->stack[0];
 	b = csi->stack[1];
 	c = csi->stack[2];
@@ -2504,6 +2537,8 @@ static void pdf_run_h(pdf_csi *csi, void *state)
 {
 	pdf_run_state *pr = (pdf_run_state *)state;
 
+	if (pdf_ignore_path(pr))
+		return;
 	fz_closepath(csi->doc->ctx, pr->path);
 }
 
@@ -2535,6 +2570,8 @@ static void pdf_run_l(pdf_csi *csi, void *state)
 	pdf_run_state *pr = (pdf_run_state *)state;
 	float a, b;
 
+	if (pdf_ignore_path(pr))
+		return;
 	a = csi->stack[0];
 	b = csi->stack[1];
 	fz_lineto(csi->doc->ctx, pr->path, a, b);
@@ -2545,6 +2582,8 @@ static void pdf_run_m(pdf_csi *csi, void *state)
 	pdf_run_state *pr = (pdf_run_state *)state;
 	float a, b;
 
+	if (pdf_ignore_path(pr))
+		return;
 	a = csi->stack[0];
 	b = csi->stack[1];
 	fz_moveto(csi->doc->ctx, pr->path, a, b);
@@ -2570,6 +2609,8 @@ static void pdf_run_re(pdf_csi *csi, void *state)
 	fz_context *ctx = csi->doc->ctx;
 	float x, y, w, h;
 
+	if (pdf_ignore_path(pr))
+		return;
 	x = csi->stack[0];
 	y = csi->stack[1];
 	w = csi->stack[2];
@@ -2643,6 +2684,8 @@ static void pdf_run_v(pdf_csi *csi, void *state)
 	pdf_run_state *pr = (pdf_run_state *)state;
 	float a, b, c, d;
 
+	if (pdf_ignore_path(pr))
+		return;
 	a = csi->stack[0];
 	b = csi->stack[1];
 	c = csi->stack[2];
@@ -2666,6 +2709,8 @@ static void pdf_run_y(pdf_csi *csi, void *state)
 	pdf_run_state *pr = (pdf_run_state *)state;
 	float a, b, c, d;
 
+	if (pdf_ignore_path(pr))
+		return;
 	a = csi->stack[0];
 	b = csi->stack[1];
 	c = csi->stack[2];
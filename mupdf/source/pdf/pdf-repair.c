@@ -274,6 +274,9 @@ pdf_repair_xref(pdf_document *doc, pdf_lexbuf *buf)
 	/* Can't support incremental update after repair */
 	doc->freeze_updates = 1;
 
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_empty_obj_stm_cache(doc);
+
 	fz_seek(doc->file, 0, 0);
 
 	fz_try(ctx)
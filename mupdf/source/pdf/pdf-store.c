@@ -47,6 +47,7 @@ pdf_debug_key(FILE *out, void *key_)
 
 static fz_store_type pdf_obj_store_type =
 {
+	FZ_STORE_OBJECTS,
 	pdf_make_hash_key,
 	pdf_keep_key,
 	pdf_drop_key,
@@ -56,22 +57,58 @@ static fz_store_type pdf_obj_store_type =
 #endif
 };
 
+static fz_store_type pdf_font_store_type =
+{
+	FZ_STORE_FONTS,
+	pdf_make_hash_key,
+	pdf_keep_key,
+	pdf_drop_key,
+	pdf_cmp_key,
+#ifndef NDEBUG
+	pdf_debug_key
+#endif
+};
+
+static fz_store_type pdf_image_store_type =
+{
+	FZ_STORE_IMAGES,
+	pdf_make_hash_key,
+	pdf_keep_key,
+	pdf_drop_key,
+	pdf_cmp_key,
+#ifndef NDEBUG
+	pdf_debug_key
+#endif
+};
+
+/* All values share the same kind of key, so the store partition is
+ * picked by the type of the value (as given by its free function) */
+static fz_store_type *
+pdf_store_type(fz_store_free_fn *free)
+{
+	if (free == pdf_free_font_imp)
+		return &pdf_font_store_type;
+	if (free == fz_free_image)
+		return &pdf_image_store_type;
+	return &pdf_obj_store_type;
+}
+
 void
 pdf_store_item(fz_context *ctx, pdf_obj *key, void *val, unsigned int itemsize)
 {
 	void *existing;
-	existing = fz_store_item(ctx, key, val, itemsize, &pdf_obj_store_type);
+	existing = fz_store_item(ctx, key, val, itemsize, pdf_store_type(((fz_storable *)val)->free));
 	assert(existing == NULL);
 }
 
 void *
 pdf_find_item(fz_context *ctx, fz_store_free_fn *free, pdf_obj *key)
 {
-	return fz_find_item(ctx, free, key, &pdf_obj_store_type);
+	return fz_find_item(ctx, free, key, pdf_store_type(free));
 }
 
 void
 pdf_remove_item(fz_context *ctx, fz_store_free_fn *free, pdf_obj *key)
 {
-	fz_remove_item(ctx, free, key, &pdf_obj_store_type);
+	fz_remove_item(ctx, free, key, pdf_store_type(free));
 }
@@ -566,21 +566,174 @@ static void sweepobj(pdf_document *doc, pdf_write_options *opts, pdf_obj *obj)
  * Scan for and remove duplicate objects (slow)
  */
 
+/*
+ * Hash objects consistently with pdf_objcmp, so that only objects
+ * with equal hashes need to be compared for removing duplicates.
+ * Indirect references are hashed by number and not followed.
+ */
+
+static unsigned int hashobj(pdf_obj *obj)
+{
+	unsigned int h;
+	char *s;
+	int i, n;
+
+	if (!obj)
+		return 0;
+	if (pdf_is_indirect(obj))
+		return 1 + 31 * (pdf_to_num(obj) * 31 + pdf_to_gen(obj));
+	if (pdf_is_null(obj))
+		return 2;
+	if (pdf_is_bool(obj))
+		return 3 + pdf_to_bool(obj);
+	if (pdf_is_int(obj))
+		return 5 + 31 * pdf_to_int(obj);
+	if (pdf_is_real(obj))
+	{
+		float f = pdf_to_real(obj);
+		unsigned int bits = 0;
+		/* 0.0 and -0.0 compare equal */
+		if (f != 0)
+			memcpy(&bits, &f, sizeof(bits));
+		return 7 + 31 * bits;
+	}
+	if (pdf_is_string(obj))
+	{
+		s = pdf_to_str_buf(obj);
+		n = pdf_to_str_len(obj);
+		for (h = 11, i = 0; i < n; i++)
+			h = h * 31 + (unsigned char)s[i];
+		return h;
+	}
+	if (pdf_is_name(obj))
+	{
+		for (h = 13, s = pdf_to_name(obj); *s; s++)
+			h = h * 31 + (unsigned char)*s;
+		return h;
+	}
+	if (pdf_is_array(obj))
+	{
+		n = pdf_array_len(obj);
+		for (h = 17 + n, i = 0; i < n; i++)
+			h = h * 31 + hashobj(pdf_array_get(obj, i));
+		return h;
+	}
+	if (pdf_is_dict(obj))
+	{
+		n = pdf_dict_len(obj);
+		for (h = 19 + n, i = 0; i < n; i++)
+		{
+			h = h * 31 + hashobj(pdf_dict_get_key(obj, i));
+			h = h * 31 + hashobj(pdf_dict_get_val(obj, i));
+		}
+		return h;
+	}
+	return 0;
+}
+
+static void digeststream(pdf_document *doc, int num, unsigned char digest[16])
+{
+	fz_context *ctx = doc->ctx;
+	fz_buffer *buf = pdf_load_raw_renumbered_stream(doc, num, 0, num, 0);
+	unsigned char *data;
+	int len = fz_buffer_storage(ctx, buf, &data);
+	fz_md5 md5;
+
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, data, len);
+	fz_md5_final(&md5, digest);
+	fz_drop_buffer(ctx, buf);
+}
+
+static int samestreamdata(pdf_document *doc, int num, int other, unsigned char (*digests)[16], char *digested)
+{
+	fz_context *ctx = doc->ctx;
+	fz_buffer *sa = NULL;
+	fz_buffer *sb = NULL;
+	int same = 0;
+
+	/* Stream contents are loaded and digested at most once */
+	if (!digested[num])
+	{
+		digeststream(doc, num, digests[num]);
+		digested[num] = 1;
+	}
+	if (!digested[other])
+	{
+		digeststream(doc, other, digests[other]);
+		digested[other] = 1;
+	}
+	if (memcmp(digests[num], digests[other], 16) != 0)
+		return 0;
+
+	/* Only merge streams whose data actually matches */
+	fz_var(sa);
+	fz_var(sb);
+
+	fz_try(ctx)
+	{
+		unsigned char *dataa, *datab;
+		int lena, lenb;
+		sa = pdf_load_raw_renumbered_stream(doc, num, 0, num, 0);
+		sb = pdf_load_raw_renumbered_stream(doc, other, 0, other, 0);
+		lena = fz_buffer_storage(ctx, sa, &dataa);
+		lenb = fz_buffer_storage(ctx, sb, &datab);
+		if (lena == lenb && memcmp(dataa, datab, lena) == 0)
+			same = 1;
+	}
+	fz_always(ctx)
+	{
+		fz_drop_buffer(ctx, sa);
+		fz_drop_buffer(ctx, sb);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow(ctx);
+	}
+
+	return same;
+}
+
 static void removeduplicateobjs(pdf_document *doc, pdf_write_options *opts)
 {
 	int num, other;
 	fz_context *ctx = doc->ctx;
 	int xref_len = pdf_xref_len(doc);
+	int nbuckets = 1;
+	int *buckets = NULL;
+	int *chain = NULL;
+	unsigned int *hashes = NULL;
+	unsigned char (*digests)[16] = NULL;
+	char *digested = NULL;
 
-	for (num = 1; num < xref_len; num++)
+	/*
+	 * Objects are bucketed by their hash, so that each object is only
+	 * compared against the preceding objects in the same bucket.
+	 */
+	while (nbuckets < xref_len)
+		nbuckets <<= 1;
+
+	fz_var(buckets);
+	fz_var(chain);
+	fz_var(hashes);
+	fz_var(digests);
+	fz_var(digested);
+
+	fz_try(ctx)
 	{
-		/* Only compare an object to objects preceding it */
-		for (other = 1; other < num; other++)
+		buckets = fz_calloc(ctx, nbuckets, sizeof(int));
+		chain = fz_calloc(ctx, xref_len, sizeof(int));
+		hashes = fz_calloc(ctx, xref_len, sizeof(unsigned int));
+		digests = fz_calloc(ctx, xref_len, 16);
+		digested = fz_calloc(ctx, xref_len, 1);
+
+		for (num = 1; num < xref_len; num++)
 		{
 			pdf_obj *a, *b;
-			int differ, newnum, streama, streamb;
+			int differ, newnum, stream;
+			int *bucket;
 
-			if (num == other || !opts->use_list[num] || !opts->use_list[other])
+			if (!opts->use_list[num])
 				continue;
 
 			/*
@@ -591,11 +744,8 @@ static void removeduplicateobjs(pdf_document *doc, pdf_write_options *opts)
 			 */
 			fz_try(ctx)
 			{
-				streama = pdf_is_stream(doc, num, 0);
-				streamb = pdf_is_stream(doc, other, 0);
-				differ = streama || streamb;
-				if (streama && streamb && opts->do_garbage >= 4)
-					differ = 0;
+				stream = pdf_is_stream(doc, num, 0);
+				differ = stream && opts->do_garbage < 4;
 			}
 			fz_catch(ctx)
 			{
@@ -606,46 +756,36 @@ static void removeduplicateobjs(pdf_document *doc, pdf_write_options *opts)
 				continue;
 
 			a = pdf_get_xref_entry(doc, num)->obj;
-			b = pdf_get_xref_entry(doc, other)->obj;
-
 			a = pdf_resolve_indirect(a);
-			b = pdf_resolve_indirect(b);
 
-			if (pdf_objcmp(a, b))
-				continue;
+			/* Streams are never merged with non-stream objects */
+			hashes[num] = (hashobj(a) << 1) | stream;
+			bucket = &buckets[hashes[num] & (nbuckets - 1)];
 
-			if (streama && streamb)
+			for (other = *bucket; other; other = chain[other])
 			{
-				/* Check to see if streams match too. */
-				fz_buffer *sa = NULL;
-				fz_buffer *sb = NULL;
+				if (hashes[other] != hashes[num])
+					continue;
 
-				fz_var(sa);
-				fz_var(sb);
+				b = pdf_get_xref_entry(doc, other)->obj;
+				b = pdf_resolve_indirect(b);
 
-				differ = 1;
-				fz_try(ctx)
-				{
-					unsigned char *dataa, *datab;
-					int lena, lenb;
-					sa = pdf_load_raw_renumbered_stream(doc, num, 0, num, 0);
-					sb = pdf_load_raw_renumbered_stream(doc, other, 0, other, 0);
-					lena = fz_buffer_storage(ctx, sa, &dataa);
-					lenb = fz_buffer_storage(ctx, sb, &datab);
-					if (lena == lenb && memcmp(dataa, datab, lena) == 0)
-						differ = 0;
-				}
-				fz_always(ctx)
-				{
-					fz_drop_buffer(ctx, sa);
-					fz_drop_buffer(ctx, sb);
-				}
-				fz_catch(ctx)
-				{
-					fz_rethrow(ctx);
-				}
-				if (differ)
+				if (pdf_objcmp(a, b))
+					continue;
+
+				/* Check to see if streams match too. */
+				if (stream && !samestreamdata(doc, num, other, digests, digested))
 					continue;
+
+				/* One duplicate was found, do not look for another */
+				break;
+			}
+
+			if (!other)
+			{
+				chain[num] = *bucket;
+				*bucket = num;
+				continue;
 			}
 
 			/* Keep the lowest numbered object */
@@ -654,11 +794,20 @@ static void removeduplicateobjs(pdf_document *doc, pdf_write_options *opts)
 			opts->renumber_map[other] = newnum;
 			opts->rev_renumber_map[newnum] = num; /* Either will do */
 			opts->use_list[fz_maxi(num, other)] = 0;
-
-			/* One duplicate was found, do not look for another */
-			break;
 		}
 	}
+	fz_always(ctx)
+	{
+		fz_free(ctx, buckets);
+		fz_free(ctx, chain);
+		fz_free(ctx, hashes);
+		fz_free(ctx, digests);
+		fz_free(ctx, digested);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow(ctx);
+	}
 }
 
 /*
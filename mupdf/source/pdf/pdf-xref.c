@@ -1221,6 +1221,9 @@ pdf_close_document(pdf_document *doc)
 
 	pdf_free_xref_sections(doc);
 
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_empty_obj_stm_cache(doc);
+
 	if (doc->focus_obj)
 		pdf_drop_obj(doc->focus_obj);
 	if (doc->file)
@@ -1288,23 +1291,120 @@ pdf_print_xref(pdf_document *doc)
  * compressed object streams
  */
 
-static void
-pdf_load_obj_stm(pdf_document *doc, int num, int gen, pdf_lexbuf *buf)
-{
-	fz_stream *stm = NULL;
-	pdf_obj *objstm = NULL;
-	int *numbuf = NULL;
-	int *ofsbuf = NULL;
+/* SumatraPDF: pdf_clear_xref_to_mark drops most objects after a page has
+ * been run, so keep the decompressed data and offset tables of recently
+ * used object streams around instead of inflating them again for every
+ * single object that has to be reloaded */
+#define PDF_OBJ_STM_CACHE_MAX_SIZE (8 << 20)
 
-	pdf_obj *obj;
+struct pdf_obj_stm_s
+{
+	int num;
 	int first;
 	int count;
+	int *numbuf;
+	int *ofsbuf;
+	fz_buffer *buf;
+	unsigned int size;
+	int last_used;
+};
+
+static void
+pdf_drop_obj_stm(fz_context *ctx, pdf_obj_stm *os)
+{
+	if (!os)
+		return;
+	fz_drop_buffer(ctx, os->buf);
+	fz_free(ctx, os->ofsbuf);
+	fz_free(ctx, os->numbuf);
+	fz_free(ctx, os);
+}
+
+static void
+pdf_evict_obj_stm(pdf_document *doc, int idx)
+{
+	pdf_obj_stm *os = doc->obj_stm_cache[idx];
+	if (os)
+	{
+		doc->obj_stm_cache_size -= os->size;
+		pdf_drop_obj_stm(doc->ctx, os);
+		doc->obj_stm_cache[idx] = NULL;
+	}
+}
+
+static void
+pdf_forget_obj_stm(pdf_document *doc, int num)
+{
+	int i;
+
+	for (i = 0; i < PDF_OBJ_STM_CACHE_COUNT; i++)
+		if (doc->obj_stm_cache[i] && doc->obj_stm_cache[i]->num == num)
+			pdf_evict_obj_stm(doc, i);
+}
+
+void
+pdf_empty_obj_stm_cache(pdf_document *doc)
+{
 	int i;
+
+	for (i = 0; i < PDF_OBJ_STM_CACHE_COUNT; i++)
+		pdf_evict_obj_stm(doc, i);
+}
+
+static pdf_obj_stm *
+pdf_find_obj_stm(pdf_document *doc, int num)
+{
+	int i;
+
+	for (i = 0; i < PDF_OBJ_STM_CACHE_COUNT; i++)
+		if (doc->obj_stm_cache[i] && doc->obj_stm_cache[i]->num == num)
+			return doc->obj_stm_cache[i];
+	return NULL;
+}
+
+/* returns 0 if the object stream is too large to be cached (in which case the caller still owns it) */
+static int
+pdf_insert_obj_stm(pdf_document *doc, pdf_obj_stm *os)
+{
+	int i, free_slot, lru_slot;
+
+	if (os->size > PDF_OBJ_STM_CACHE_MAX_SIZE)
+		return 0;
+
+	for (;;)
+	{
+		free_slot = lru_slot = -1;
+		for (i = 0; i < PDF_OBJ_STM_CACHE_COUNT; i++)
+		{
+			if (!doc->obj_stm_cache[i])
+			{
+				if (free_slot < 0)
+					free_slot = i;
+			}
+			else if (lru_slot < 0 || doc->obj_stm_cache[i]->last_used < doc->obj_stm_cache[lru_slot]->last_used)
+				lru_slot = i;
+		}
+		if (free_slot >= 0 && doc->obj_stm_cache_size + os->size <= PDF_OBJ_STM_CACHE_MAX_SIZE)
+			break;
+		pdf_evict_obj_stm(doc, lru_slot);
+	}
+
+	doc->obj_stm_cache[free_slot] = os;
+	doc->obj_stm_cache_size += os->size;
+	return 1;
+}
+
+static pdf_obj_stm *
+pdf_load_obj_stm_data(pdf_document *doc, int num, int gen, pdf_lexbuf *buf)
+{
+	fz_stream *stm = NULL;
+	pdf_obj *objstm = NULL;
+	pdf_obj_stm *os = NULL;
 	pdf_token tok;
+	int i;
 	fz_context *ctx = doc->ctx;
 
-	fz_var(numbuf);
-	fz_var(ofsbuf);
+	fz_var(os);
 	fz_var(objstm);
 	fz_var(stm);
 
@@ -1312,78 +1412,120 @@ pdf_load_obj_stm(pdf_document *doc, int num, int gen, pdf_lexbuf *buf)
 	{
 		objstm = pdf_load_object(doc, num, gen);
 
-		count = pdf_to_int(pdf_dict_gets(objstm, "N"));
-		first = pdf_to_int(pdf_dict_gets(objstm, "First"));
+		os = fz_malloc_struct(ctx, pdf_obj_stm);
+		os->num = num;
+		os->count = pdf_to_int(pdf_dict_gets(objstm, "N"));
+		os->first = pdf_to_int(pdf_dict_gets(objstm, "First"));
 
-		if (count < 0)
+		if (os->count < 0)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "negative number of objects in object stream");
-		if (first < 0)
+		if (os->first < 0)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "first object in object stream resides outside stream");
 
-		numbuf = fz_calloc(ctx, count, sizeof(int));
-		ofsbuf = fz_calloc(ctx, count, sizeof(int));
+		os->numbuf = fz_calloc(ctx, os->count, sizeof(int));
+		os->ofsbuf = fz_calloc(ctx, os->count, sizeof(int));
+
+		os->buf = pdf_load_stream(doc, num, gen);
+		fz_trim_buffer(ctx, os->buf);
 
-		stm = pdf_open_stream(doc, num, gen);
-		for (i = 0; i < count; i++)
+		stm = fz_open_buffer(ctx, os->buf);
+		for (i = 0; i < os->count; i++)
 		{
 			tok = pdf_lex(stm, buf);
 			if (tok != PDF_TOK_INT)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "corrupt object stream (%d %d R)", num, gen);
-			numbuf[i] = buf->i;
+			os->numbuf[i] = buf->i;
 
 			tok = pdf_lex(stm, buf);
 			if (tok != PDF_TOK_INT)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "corrupt object stream (%d %d R)", num, gen);
-			ofsbuf[i] = buf->i;
+			os->ofsbuf[i] = buf->i;
 		}
 
-		fz_seek(stm, first, SEEK_SET);
+		os->size = sizeof(pdf_obj_stm) + os->buf->cap + 2 * os->count * sizeof(int);
+	}
+	fz_always(ctx)
+	{
+		fz_close(stm);
+		pdf_drop_obj(objstm);
+	}
+	fz_catch(ctx)
+	{
+		pdf_drop_obj_stm(ctx, os);
+		fz_rethrow(ctx);
+	}
+
+	return os;
+}
+
+static void
+pdf_load_obj_stm(pdf_document *doc, int num, int gen, pdf_lexbuf *buf, int target)
+{
+	fz_stream *stm = NULL;
+	pdf_obj_stm *os = NULL;
+	int cached = 1;
+	int loaded = 0;
+
+	pdf_obj *obj;
+	int i;
+	fz_context *ctx = doc->ctx;
 
-		for (i = 0; i < count; i++)
+	fz_var(os);
+	fz_var(cached);
+	fz_var(stm);
+
+	fz_try(ctx)
+	{
+		os = pdf_find_obj_stm(doc, num);
+		if (!os)
 		{
-			int xref_len = pdf_xref_len(doc);
-			pdf_xref_entry *entry;
-			fz_seek(stm, first + ofsbuf[i], SEEK_SET);
+			os = pdf_load_obj_stm_data(doc, num, gen, buf);
+			cached = pdf_insert_obj_stm(doc, os);
+			loaded = 1;
+		}
+		os->last_used = ++doc->obj_stm_cache_clock;
 
-			obj = pdf_parse_stm_obj(doc, stm, buf);
+		stm = fz_open_buffer(ctx, os->buf);
+
+		/* after inflating the stream, all of its objects are parsed at once (so that
+		 * the stream doesn't have to be inflated again for each of them, should it be
+		 * evicted from the cache in the meantime); objects which are reloaded later on
+		 * (e.g. after pdf_clear_xref_to_mark) are parsed one by one from the cache */
+		for (i = 0; i < os->count; i++)
+		{
+			pdf_xref_entry *entry;
+			int xref_len = pdf_xref_len(doc);
 
-			if (numbuf[i] < 1 || numbuf[i] >= xref_len)
+			if (!loaded && os->numbuf[i] != target)
+				continue;
+			if (os->numbuf[i] < 1 || os->numbuf[i] >= xref_len)
 			{
-				pdf_drop_obj(obj);
-				fz_throw(ctx, FZ_ERROR_GENERIC, "object id (%d 0 R) out of range (0..%d)", numbuf[i], xref_len - 1);
+				fz_warn(ctx, "object id (%d 0 R) out of range (0..%d)", os->numbuf[i], xref_len - 1);
+				continue;
 			}
 
-			entry = pdf_get_xref_entry(doc, numbuf[i]);
+			fz_seek(stm, os->first + os->ofsbuf[i], SEEK_SET);
 
-			pdf_set_obj_parent(obj, numbuf[i]);
+			obj = pdf_parse_stm_obj(doc, stm, buf);
 
-			if (entry->type == 'o' && entry->ofs == num)
-			{
-				/* If we already have an entry for this object,
-				 * we'd like to drop it and use the new one -
-				 * but this means that anyone currently holding
-				 * a pointer to the old one will be left with a
-				 * stale pointer. Instead, we drop the new one
-				 * and trust that the old one is correct. */
-				if (entry->obj) {
-					if (pdf_objcmp(entry->obj, obj))
-						fz_warn(ctx, "Encountered new definition for object %d - keeping the original one", numbuf[i]);
-					pdf_drop_obj(obj);
-				} else
-					entry->obj = obj;
-			}
+			entry = pdf_get_xref_entry(doc, os->numbuf[i]);
+
+			pdf_set_obj_parent(obj, os->numbuf[i]);
+
+			/* if an object is defined more than once, the first definition wins */
+			if (entry->type == 'o' && entry->ofs == num && !entry->obj)
+				entry->obj = obj;
 			else
-			{
 				pdf_drop_obj(obj);
-			}
+			if (!loaded)
+				break;
 		}
 	}
 	fz_always(ctx)
 	{
 		fz_close(stm);
-		fz_free(ctx, ofsbuf);
-		fz_free(ctx, numbuf);
-		pdf_drop_obj(objstm);
+		if (!cached)
+			pdf_drop_obj_stm(ctx, os);
 	}
 	fz_catch(ctx)
 	{
@@ -1699,7 +1841,7 @@ object_updated:
 		{
 			fz_try(ctx)
 			{
-				pdf_load_obj_stm(doc, x->ofs, 0, &doc->lexbuf.base);
+				pdf_load_obj_stm(doc, x->ofs, 0, &doc->lexbuf.base, num);
 			}
 			fz_catch(ctx)
 			{
@@ -1825,6 +1967,9 @@ pdf_delete_object(pdf_document *doc, int num)
 
 	x = pdf_get_incremental_xref_entry(doc, num);
 
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_forget_obj_stm(doc, num);
+
 	fz_drop_buffer(doc->ctx, x->stm_buf);
 	pdf_drop_obj(x->obj);
 
@@ -1849,6 +1994,9 @@ pdf_update_object(pdf_document *doc, int num, pdf_obj *newobj)
 
 	x = pdf_get_incremental_xref_entry(doc, num);
 
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_forget_obj_stm(doc, num);
+
 	pdf_drop_obj(x->obj);
 
 	x->type = 'n';
@@ -1871,6 +2019,9 @@ pdf_update_stream(pdf_document *doc, int num, fz_buffer *newbuf)
 
 	x = pdf_get_xref_entry(doc, num);
 
+	/* SumatraPDF: cache decompressed object streams */
+	pdf_forget_obj_stm(doc, num);
+
 	fz_drop_buffer(doc->ctx, x->stm_buf);
 	x->stm_buf = fz_keep_buffer(doc->ctx, newbuf);
 }
@@ -0,0 +1,179 @@
+/*
+ * SumatraPDF: checks that fz_new_shared_font_from_memory/_from_buffer
+ * hand out a single fz_font (and FT_Face) for all documents loaded through
+ * clones of a context and that nothing is shared without clones.
+ */
+
+#include "mupdf/pdf.h"
+
+static int failures = 0;
+
+#define check(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/* the test is single-threaded, but contexts can only be cloned with locks */
+static void lock_nop(void *user, int lock) { }
+static void unlock_nop(void *user, int lock) { }
+
+static fz_locks_context nop_locks = { NULL, lock_nop, unlock_nop };
+
+/* creates a document with a single Type1 font which is either a builtin font
+ * (if program is NULL) or has program embedded as its font file */
+static pdf_font_desc *
+load_test_font(fz_context *ctx, pdf_document **docp, const char *basefont, fz_buffer *program)
+{
+	pdf_document *doc = NULL;
+	pdf_obj *dict = NULL, *file = NULL, *desc = NULL, *ref = NULL;
+	pdf_font_desc *font = NULL;
+
+	fz_var(doc);
+	fz_var(dict);
+	fz_var(file);
+	fz_var(desc);
+	fz_var(ref);
+	fz_var(font);
+
+	fz_try(ctx)
+	{
+		doc = pdf_create_document(ctx);
+		dict = pdf_new_dict(doc, 4);
+		pdf_dict_puts_drop(dict, "Type", pdf_new_name(doc, "Font"));
+		pdf_dict_puts_drop(dict, "Subtype", pdf_new_name(doc, "Type1"));
+		pdf_dict_puts_drop(dict, "BaseFont", pdf_new_name(doc, basefont));
+		if (program)
+		{
+			file = pdf_new_dict(doc, 1);
+			pdf_dict_puts_drop(file, "Subtype", pdf_new_name(doc, "Type1C"));
+			ref = pdf_new_ref(doc, file);
+			pdf_update_stream(doc, pdf_to_num(ref), program);
+			desc = pdf_new_dict(doc, 3);
+			pdf_dict_puts_drop(desc, "FontName", pdf_new_name(doc, basefont));
+			pdf_dict_puts_drop(desc, "Flags", pdf_new_int(doc, 32));
+			pdf_dict_puts(desc, "FontFile3", ref);
+			pdf_drop_obj(ref);
+			ref = pdf_new_ref(doc, desc);
+			pdf_dict_puts(dict, "FontDescriptor", ref);
+			pdf_drop_obj(ref);
+		}
+		/* fonts are cached per document by indirect reference */
+		ref = pdf_new_ref(doc, dict);
+		font = pdf_load_font(doc, NULL, ref, 0);
+	}
+	fz_always(ctx)
+	{
+		pdf_drop_obj(ref);
+		pdf_drop_obj(desc);
+		pdf_drop_obj(file);
+		pdf_drop_obj(dict);
+	}
+	fz_catch(ctx)
+	{
+		fprintf(stderr, "cannot load font '%s': %s\n", basefont, fz_caught_message(ctx));
+	}
+
+	*docp = doc;
+	return font;
+}
+
+#define DOCS 6
+
+static void
+load_test_fonts(fz_context *ctx, fz_context *clone, pdf_document **docs, pdf_font_desc **fonts, fz_buffer *program)
+{
+	/* all of these map to the same builtin font */
+	static const char *names[] = { "Helvetica,Bold", "Helvetica-Bold", "Arial,Bold" };
+	int i;
+
+	for (i = 0; i < DOCS; i++)
+	{
+		fz_context *doc_ctx = i % 2 ? clone : ctx;
+		if (i < DOCS / 2)
+			fonts[i] = load_test_font(doc_ctx, &docs[i], names[i], NULL);
+		else
+			fonts[i] = load_test_font(doc_ctx, &docs[i], "EmbeddedFont", program);
+		check(fonts[i] != NULL);
+	}
+}
+
+static void
+drop_test_fonts(pdf_document **docs, pdf_font_desc **fonts)
+{
+	int i;
+
+	for (i = 0; i < DOCS; i++)
+	{
+		if (fonts[i])
+			pdf_drop_font(docs[i]->ctx, fonts[i]);
+		if (docs[i])
+			pdf_close_document(docs[i]);
+	}
+}
+
+static fz_font *
+font_of(pdf_font_desc *fontdesc)
+{
+	return fontdesc ? fontdesc->font : NULL;
+}
+
+int main(int argc, char **argv)
+{
+	fz_context *ctx, *clone;
+	fz_buffer *program;
+	pdf_document *docs[DOCS];
+	pdf_font_desc *fonts[DOCS];
+	unsigned char *data;
+	unsigned int len;
+	int i;
+
+	ctx = fz_new_context(NULL, &nop_locks, FZ_STORE_DEFAULT);
+	if (!ctx)
+	{
+		fprintf(stderr, "cannot initialise context\n");
+		return 1;
+	}
+
+	/* embed a copy of a builtin font program */
+	data = pdf_lookup_builtin_font("Helvetica", &len);
+	program = fz_new_buffer(ctx, len);
+	memcpy(program->data, data, len);
+	program->len = len;
+
+	/* without clones, every document gets its own font (and no hashing) */
+	load_test_fonts(ctx, ctx, docs, fonts, program);
+	for (i = 1; i < DOCS; i++)
+	{
+		check(font_of(fonts[i]) != font_of(fonts[i - 1]));
+		check(!fonts[i] || !fonts[i]->font->is_shared);
+	}
+	drop_test_fonts(docs, fonts);
+
+	/* clones share a single font per font program */
+	clone = fz_clone_context(ctx);
+	check(clone != NULL);
+	if (clone)
+	{
+		load_test_fonts(ctx, clone, docs, fonts, program);
+		for (i = 1; i < DOCS; i++)
+		{
+			if (i == DOCS / 2)
+				check(font_of(fonts[i]) != font_of(fonts[i - 1]));
+			else
+				check(font_of(fonts[i]) == font_of(fonts[i - 1]));
+			check(!fonts[i] || fonts[i]->font->is_shared);
+		}
+		drop_test_fonts(docs, fonts);
+
+		fz_free_context(clone);
+	}
+
+	fz_drop_buffer(ctx, program);
+	fz_free_context(ctx);
+
+	if (failures)
+	{
+		fprintf(stderr, "fontsharetest: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("fontsharetest: all checks passed\n");
+	return 0;
+}
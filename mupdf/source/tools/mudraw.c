@@ -16,6 +16,24 @@
 #include <sys/time.h>
 #endif
 
+/* SumatraPDF: render bands in parallel on several threads */
+#ifdef _WIN32
+typedef HANDLE mu_thread;
+typedef CRITICAL_SECTION mu_mutex;
+#define mu_init_mutex(m) InitializeCriticalSection(m)
+#define mu_destroy_mutex(m) DeleteCriticalSection(m)
+#define mu_lock_mutex(m) EnterCriticalSection(m)
+#define mu_unlock_mutex(m) LeaveCriticalSection(m)
+#else
+#include <pthread.h>
+typedef pthread_t mu_thread;
+typedef pthread_mutex_t mu_mutex;
+#define mu_init_mutex(m) pthread_mutex_init(m, NULL)
+#define mu_destroy_mutex(m) pthread_mutex_destroy(m)
+#define mu_lock_mutex(m) pthread_mutex_lock(m)
+#define mu_unlock_mutex(m) pthread_mutex_unlock(m)
+#endif
+
 enum { TEXT_PLAIN = 1, TEXT_HTML = 2, TEXT_XML = 3 };
 
 enum { OUT_PNG, OUT_PPM, OUT_PNM, OUT_PAM, OUT_PGM, OUT_PBM, OUT_SVG, OUT_PWG, OUT_PCL, OUT_PDF, OUT_TGA, OUT_BMP };
@@ -144,8 +162,28 @@ static struct {
 	int minpage, maxpage;
 	char *minfilename;
 	char *maxfilename;
+	/* time spent per stage */
+	int load, pageload, interpret, render, encode;
 } timing;
 
+typedef struct worker_s
+{
+	fz_context *ctx;
+	fz_display_list *list;
+	fz_matrix ctm;
+	fz_rect tbounds;
+	fz_pixmap *pix;
+	int savealpha;
+	int errors;
+	fz_cookie cookie;
+	mu_thread thread;
+} worker_t;
+
+static int threads = 0;
+static int mapfiles = 0;
+static worker_t *workers = NULL;
+static mu_mutex mutexes[FZ_LOCK_MAX];
+
 static void usage(void)
 {
 	fprintf(stderr,
@@ -161,12 +199,14 @@ static void usage(void)
 		"\t-c -\tcolorspace {mono,gray,grayalpha,rgb,rgba,cmyk,cmykalpha}\n"
 		"\t-b -\tnumber of bits of antialiasing (0 to 8)\n"
 		"\t-B -\tmaximum bandheight (pgm, ppm, pam output only)\n"
+		"\t-T -\tnumber of threads for rendering bands in parallel\n"
 		"\t-g\trender in grayscale (equivalent to: -c gray)\n"
 		"\t-m\tshow timing information\n"
 		"\t-M\tshow memory use summary\n"
 		"\t-t\tshow text (-tt for xml, -ttt for more verbose xml)\n"
 		"\t-x\tshow display list\n"
 		"\t-d\tdisable use of display list\n"
+		"\t-n\tmemory map input files (don't modify them while drawing)\n"
 		"\t-5\tshow md5 checksums\n"
 		"\t-R -\trotate clockwise by given number of degrees\n"
 		"\t-G -\tgamma correct output\n"
@@ -191,6 +231,118 @@ static int gettime(void)
 	return (now.tv_sec - first.tv_sec) * 1000 + (now.tv_usec - first.tv_usec) / 1000;
 }
 
+static void mudraw_lock(void *user, int lock)
+{
+	mu_lock_mutex(&mutexes[lock]);
+}
+
+static void mudraw_unlock(void *user, int lock)
+{
+	mu_unlock_mutex(&mutexes[lock]);
+}
+
+static void renderband(fz_context *ctx, fz_display_list *list, fz_pixmap *pix, const fz_matrix *ctm, const fz_rect *tbounds, int savealpha, fz_cookie *cookie)
+{
+	fz_device *dev;
+
+	if (savealpha)
+		fz_clear_pixmap(ctx, pix);
+	else
+		fz_clear_pixmap_with_value(ctx, pix, 255);
+
+	dev = fz_new_draw_device(ctx, pix);
+	fz_try(ctx)
+	{
+		if (alphabits == 0)
+			fz_enable_device_hints(dev, FZ_DONT_INTERPOLATE_IMAGES);
+		fz_run_display_list(list, dev, ctm, tbounds, cookie);
+	}
+	fz_always(ctx)
+	{
+		fz_free_device(dev);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow(ctx);
+	}
+
+	if (invert)
+		fz_invert_pixmap(ctx, pix);
+	if (gamma_value != 1)
+		fz_gamma_pixmap(ctx, pix, gamma_value);
+
+	if (savealpha)
+		fz_unmultiply_pixmap(ctx, pix);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_thread(void *arg)
+#else
+static void *worker_thread(void *arg)
+#endif
+{
+	worker_t *me = arg;
+
+	fz_try(me->ctx)
+	{
+		renderband(me->ctx, me->list, me->pix, &me->ctm, &me->tbounds, me->savealpha, &me->cookie);
+	}
+	fz_catch(me->ctx)
+	{
+		me->errors++;
+	}
+	return 0;
+}
+
+/* Renders up to count bands (starting at the band for ctm) on all workers at once */
+static void renderbands(fz_context *ctx, fz_display_list *list, int count, const fz_matrix *ctm, const fz_rect *tbounds, int drawheight, int savealpha)
+{
+	int i, errors = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		worker_t *me = &workers[i];
+		me->list = list;
+		me->ctm = *ctm;
+		me->ctm.f -= i * drawheight;
+		me->tbounds = *tbounds;
+		me->savealpha = savealpha;
+		me->errors = 0;
+		memset(&me->cookie, 0, sizeof(me->cookie));
+#ifdef _WIN32
+		me->thread = CreateThread(NULL, 0, worker_thread, me, 0, NULL);
+		if (!me->thread)
+#else
+		if (pthread_create(&me->thread, NULL, worker_thread, me) != 0)
+#endif
+		{
+			/* render on this thread instead */
+			worker_thread(me);
+			me->thread = 0;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		worker_t *me = &workers[i];
+		if (me->thread)
+		{
+#ifdef _WIN32
+			WaitForSingleObject(me->thread, INFINITE);
+			CloseHandle(me->thread);
+#else
+			pthread_join(me->thread, NULL);
+#endif
+		}
+		errors += me->errors;
+		if (me->cookie.errors)
+			errored = 1;
+	}
+
+	if (errors)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot render %d band(s)", errors);
+}
+
 static int isrange(char *s)
 {
 	while (*s)
@@ -350,7 +502,7 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 	fz_page *page;
 	fz_display_list *list = NULL;
 	fz_device *dev = NULL;
-	int start;
+	int start, mark, loaded, interpreted, rendered = 0, encoded = 0;
 	fz_cookie cookie = { 0 };
 
 	fz_var(list);
@@ -370,6 +522,12 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 		fz_rethrow_message(ctx, "cannot load page %d in file '%s'", pagenum, filename);
 	}
 
+	if (showtime)
+	{
+		mark = gettime();
+		loaded = mark - start;
+	}
+
 	if (uselist)
 	{
 		fz_try(ctx)
@@ -391,6 +549,9 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 		}
 	}
 
+	if (showtime)
+		interpreted = gettime() - mark;
+
 	if (showxml)
 	{
 		fz_try(ctx)
@@ -643,20 +804,40 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 			char filename_buf[512];
 			int totalheight = ibounds.y1 - ibounds.y0;
 			int drawheight = totalheight;
+			int band_height = bandheight;
+			int nworkers = 0;
 
-			if (bandheight != 0)
+			/* Split the page into one band per thread, if the output allows it */
+			if (threads > 1 && list && !band_height && !showmd5 && (!output || output_format == OUT_PAM || output_format == OUT_PGM || output_format == OUT_PPM || output_format == OUT_PNM || output_format == OUT_PNG))
+				band_height = (totalheight + threads - 1) / threads;
+
+			if (band_height != 0)
 			{
 				/* Banded rendering; we'll only render to a
 				 * given height at a time. */
-				drawheight = bandheight;
-				if (totalheight > bandheight)
-					band_ibounds.y1 = band_ibounds.y0 + bandheight;
-				bands = (totalheight + bandheight-1)/bandheight;
-				tbounds.y1 = tbounds.y0 + bandheight + 2;
+				drawheight = band_height;
+				if (totalheight > band_height)
+					band_ibounds.y1 = band_ibounds.y0 + band_height;
+				bands = (totalheight + band_height-1)/band_height;
+				tbounds.y1 = tbounds.y0 + band_height + 2;
 			}
 
-			pix = fz_new_pixmap_with_bbox(ctx, colorspace, &band_ibounds);
-			fz_pixmap_set_resolution(pix, resolution);
+			if (threads > 1 && list && bands > 1)
+			{
+				int i;
+				nworkers = fz_mini(threads, bands);
+				for (i = 0; i < nworkers; i++)
+				{
+					workers[i].pix = fz_new_pixmap_with_bbox(ctx, colorspace, &band_ibounds);
+					fz_pixmap_set_resolution(workers[i].pix, resolution);
+				}
+				pix = workers[0].pix;
+			}
+			else
+			{
+				pix = fz_new_pixmap_with_bbox(ctx, colorspace, &band_ibounds);
+				fz_pixmap_set_resolution(pix, resolution);
+			}
 
 			if (output)
 			{
@@ -678,28 +859,46 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 
 			for (band = 0; band < bands; band++)
 			{
-				if (savealpha)
-					fz_clear_pixmap(ctx, pix);
-				else
-					fz_clear_pixmap_with_value(ctx, pix, 255);
+				if (showtime)
+					mark = gettime();
 
-				dev = fz_new_draw_device(ctx, pix);
-				if (alphabits == 0)
-					fz_enable_device_hints(dev, FZ_DONT_INTERPOLATE_IMAGES);
-				if (list)
-					fz_run_display_list(list, dev, &ctm, &tbounds, &cookie);
+				if (nworkers)
+				{
+					if (band % nworkers == 0)
+						renderbands(ctx, list, fz_mini(nworkers, bands - band), &ctm, &tbounds, drawheight, savealpha);
+					pix = workers[band % nworkers].pix;
+				}
+				else if (list)
+					renderband(ctx, list, pix, &ctm, &tbounds, savealpha, &cookie);
 				else
+				{
+					if (savealpha)
+						fz_clear_pixmap(ctx, pix);
+					else
+						fz_clear_pixmap_with_value(ctx, pix, 255);
+
+					dev = fz_new_draw_device(ctx, pix);
+					if (alphabits == 0)
+						fz_enable_device_hints(dev, FZ_DONT_INTERPOLATE_IMAGES);
 					fz_run_page(doc, page, dev, &ctm, &cookie);
-				fz_free_device(dev);
-				dev = NULL;
+					fz_free_device(dev);
+					dev = NULL;
+
+					if (invert)
+						fz_invert_pixmap(ctx, pix);
+					if (gamma_value != 1)
+						fz_gamma_pixmap(ctx, pix, gamma_value);
 
-				if (invert)
-					fz_invert_pixmap(ctx, pix);
-				if (gamma_value != 1)
-					fz_gamma_pixmap(ctx, pix, gamma_value);
+					if (savealpha)
+						fz_unmultiply_pixmap(ctx, pix);
+				}
 
-				if (savealpha)
-					fz_unmultiply_pixmap(ctx, pix);
+				if (showtime)
+				{
+					int now = gettime();
+					rendered += now - mark;
+					mark = now;
+				}
 
 				if (output)
 				{
@@ -751,6 +950,8 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 						fz_write_tga(ctx, pix, filename_buf, savealpha);
 					}
 				}
+				if (showtime)
+					encoded += gettime() - mark;
 				ctm.f -= drawheight;
 			}
 
@@ -775,6 +976,16 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 
 			fz_free_device(dev);
 			dev = NULL;
+			if (workers && workers[0].pix)
+			{
+				int i;
+				for (i = 0; i < threads; i++)
+				{
+					fz_drop_pixmap(ctx, workers[i].pix);
+					workers[i].pix = NULL;
+				}
+				pix = NULL;
+			}
 			fz_drop_pixmap(ctx, pix);
 			if (output_file)
 				fz_close_output(output_file);
@@ -811,8 +1022,17 @@ static void drawpage(fz_context *ctx, fz_document *doc, int pagenum)
 		}
 		timing.total += diff;
 		timing.count ++;
+		timing.pageload += loaded;
+		if (list)
+			timing.interpret += interpreted;
+		timing.render += rendered;
+		timing.encode += encoded;
 
 		printf(" %dms", diff);
+		if (list)
+			printf(" (loading %dms, interpretation %dms, rendering %dms, encoding %dms)", loaded, interpreted, rendered, encoded);
+		else
+			printf(" (loading %dms, interpretation and rendering %dms, encoding %dms)", loaded, rendered, encoded);
 	}
 
 	if (showmd5 || showtime)
@@ -967,10 +1187,12 @@ int main(int argc, char **argv)
 	int c;
 	fz_context *ctx;
 	fz_alloc_context alloc_ctx = { NULL, trace_malloc, trace_realloc, trace_free };
+	fz_locks_context locks_ctx = { NULL, mudraw_lock, mudraw_unlock };
+	int start;
 
 	fz_var(doc);
 
-	while ((c = fz_getopt(argc, argv, "lo:F:p:r:R:b:c:dgmtx5G:Iw:h:fiMB:")) != -1)
+	while ((c = fz_getopt(argc, argv, "lo:F:p:r:R:b:c:dgmntx5G:Iw:h:fiMB:T:")) != -1)
 	{
 		switch (c)
 		{
@@ -981,6 +1203,7 @@ int main(int argc, char **argv)
 		case 'R': rotation = atof(fz_optarg); break;
 		case 'b': alphabits = atoi(fz_optarg); break;
 		case 'B': bandheight = atoi(fz_optarg); break;
+		case 'T': threads = atoi(fz_optarg); break;
 		case 'l': showoutline++; break;
 		case 'm': showtime++; break;
 		case 'M': showmemory++; break;
@@ -989,6 +1212,7 @@ int main(int argc, char **argv)
 		case '5': showmd5++; break;
 		case 'g': out_cs = CS_GRAY; break;
 		case 'd': uselist = 0; break;
+		case 'n': mapfiles = 1; break;
 		case 'c': out_cs = parse_colorspace(fz_optarg); break;
 		case 'G': gamma_value = atof(fz_optarg); break;
 		case 'w': width = atof(fz_optarg); break;
@@ -1009,7 +1233,14 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
-	ctx = fz_new_context((showmemory == 0 ? NULL : &alloc_ctx), NULL, FZ_STORE_DEFAULT);
+	if (threads > 1)
+	{
+		int i;
+		for (i = 0; i < FZ_LOCK_MAX; i++)
+			mu_init_mutex(&mutexes[i]);
+	}
+
+	ctx = fz_new_context((showmemory == 0 ? NULL : &alloc_ctx), (threads > 1 ? &locks_ctx : NULL), FZ_STORE_DEFAULT);
 	if (!ctx)
 	{
 		fprintf(stderr, "cannot initialise context\n");
@@ -1018,6 +1249,22 @@ int main(int argc, char **argv)
 
 	fz_set_aa_level(ctx, alphabits);
 
+	if (threads > 1)
+	{
+		int i;
+		/* each worker renders with its own clone of the main context */
+		workers = fz_calloc(ctx, threads, sizeof(worker_t));
+		for (i = 0; i < threads; i++)
+		{
+			workers[i].ctx = fz_clone_context(ctx);
+			if (!workers[i].ctx)
+			{
+				fprintf(stderr, "cannot initialise context for thread %d\n", i);
+				exit(1);
+			}
+		}
+	}
+
 	/* SumatraPDF: use locally installed fonts */
 	pdf_install_load_system_font_funcs(ctx);
 
@@ -1137,6 +1384,11 @@ int main(int argc, char **argv)
 	timing.maxpage = 0;
 	timing.minfilename = "";
 	timing.maxfilename = "";
+	timing.load = 0;
+	timing.pageload = 0;
+	timing.interpret = 0;
+	timing.render = 0;
+	timing.encode = 0;
 
 	if (showxml || showtext)
 		out = fz_new_output_with_file(ctx, stdout);
@@ -1172,9 +1424,29 @@ int main(int argc, char **argv)
 				filename = argv[fz_optind++];
 				files++;
 
+				if (showtime)
+					start = gettime();
+
 				fz_try(ctx)
 				{
-					doc = fz_open_document(ctx, filename);
+					if (mapfiles)
+					{
+						fz_stream *file = fz_open_file_mapped(ctx, filename);
+						fz_try(ctx)
+						{
+							doc = fz_open_document_with_stream(ctx, filename, file);
+						}
+						fz_always(ctx)
+						{
+							fz_close(file);
+						}
+						fz_catch(ctx)
+						{
+							fz_rethrow(ctx);
+						}
+					}
+					else
+						doc = fz_open_document(ctx, filename);
 				}
 				fz_catch(ctx)
 				{
@@ -1187,6 +1459,13 @@ int main(int argc, char **argv)
 						fz_throw(ctx, FZ_ERROR_GENERIC, "cannot authenticate password: %s", filename);
 				}
 
+				if (showtime)
+				{
+					int diff = gettime() - start;
+					timing.load += diff;
+					printf("file %s loaded in %dms\n", filename, diff);
+				}
+
 				if (showxml || showtext == TEXT_XML)
 					fz_printf(out, "<document name=\"%s\">\n", filename);
 
@@ -1266,10 +1545,41 @@ int main(int argc, char **argv)
 			printf("fastest page %d: %dms (%s)\n", timing.minpage, timing.min, timing.minfilename);
 			printf("slowest page %d: %dms (%s)\n", timing.maxpage, timing.max, timing.maxfilename);
 		}
+		printf("stages: document loading %dms, page loading %dms, interpretation %dms, rendering %dms, encoding %dms\n",
+			timing.load, timing.pageload, timing.interpret, timing.render, timing.encode);
+	}
+
+	if (showtime)
+	{
+		static const char *names[FZ_STORE_PARTITIONS] = { "objects", "fonts", "images", "tiles" };
+		fz_store_stats stats;
+		int i;
+
+		for (i = 0; i < FZ_STORE_PARTITIONS; i++)
+		{
+			fz_get_store_stats(ctx, i, &stats);
+			printf("store %s: %d items, %ukB, %u hits, %u misses, %u evictions\n",
+				names[i], stats.items, stats.size >> 10, stats.hits, stats.misses, stats.evictions);
+		}
+	}
+
+	if (workers)
+	{
+		int i;
+		for (i = 0; i < threads; i++)
+			fz_free_context(workers[i].ctx);
+		fz_free(ctx, workers);
 	}
 
 	fz_free_context(ctx);
 
+	if (threads > 1)
+	{
+		int i;
+		for (i = 0; i < FZ_LOCK_MAX; i++)
+			mu_destroy_mutex(&mutexes[i]);
+	}
+
 	if (showmemory)
 	{
 		printf("Total memory use = %d bytes\n", memtrace_total);
@@ -11,12 +11,20 @@
 
 #include "mupdf/pdf.h"
 
+#ifdef _WIN32
+#include <windows.h> /* for struct timeval */
+#else
+#include <sys/time.h>
+#endif
+
 typedef struct globals_s
 {
 	pdf_document *doc;
 	fz_context *ctx;
 } globals;
 
+static int showtime = 0;
+
 static void usage(void)
 {
 	fprintf(stderr,
@@ -31,10 +39,25 @@ static void usage(void)
 		"\t-i\ttoggle decompression of image streams\n"
 		"\t-f\ttoggle decompression of font streams\n"
 		"\t-a\tascii hex encode binary streams\n"
+		"\t-m\tshow timing information\n"
 		"\tpages\tcomma separated list of ranges\n");
 	exit(1);
 }
 
+static int gettime(void)
+{
+	static struct timeval first;
+	static int once = 1;
+	struct timeval now;
+	if (once)
+	{
+		gettimeofday(&first, NULL);
+		once = 0;
+	}
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - first.tv_sec) * 1000 + (now.tv_usec - first.tv_usec) / 1000;
+}
+
 static int
 string_in_names_list(pdf_obj *p, pdf_obj *names_list)
 {
@@ -222,11 +245,15 @@ static void retainpages(globals *glo, int argc, char **argv)
 void pdfclean_clean(fz_context *ctx, char *infile, char *outfile, char *password, fz_write_options *opts, char *argv[], int argc)
 {
 	globals glo = { 0 };
+	int start = 0, loaded = 0;
 
 	glo.ctx = ctx;
 
 	fz_try(ctx)
 	{
+		if (showtime)
+			start = gettime();
+
 		glo.doc = pdf_open_document_no_run(ctx, infile);
 		if (pdf_needs_password(glo.doc))
 			if (!pdf_authenticate_password(glo.doc, password))
@@ -236,7 +263,18 @@ void pdfclean_clean(fz_context *ctx, char *infile, char *outfile, char *password
 		if (argc)
 			retainpages(&glo, argc, argv);
 
+		if (showtime)
+			loaded = gettime();
+
 		pdf_write_document(glo.doc, outfile, opts);
+
+		/* Compare e.g. -gg with -ggg for the cost of merging duplicate objects */
+		if (showtime)
+		{
+			int end = gettime();
+			printf("%s: %d objects, loading %dms, writing (garbage level %d) %dms\n",
+				infile, pdf_xref_len(glo.doc), loaded - start, opts->do_garbage, end - loaded);
+		}
 	}
 	fz_always(ctx)
 	{
@@ -268,7 +306,7 @@ int pdfclean_main(int argc, char **argv)
 	opts.errors = &errors;
 	opts.do_clean = 0;
 
-	while ((c = fz_getopt(argc, argv, "adfgilp:s")) != -1)
+	while ((c = fz_getopt(argc, argv, "adfgilmp:s")) != -1)
 	{
 		switch (c)
 		{
@@ -280,6 +318,7 @@ int pdfclean_main(int argc, char **argv)
 		case 'l': opts.do_linear ++; break;
 		case 'a': opts.do_ascii ++; break;
 		case 's': opts.do_clean ++; break;
+		case 'm': showtime ++; break;
 		default: usage(); break;
 		}
 	}
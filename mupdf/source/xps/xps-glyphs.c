@@ -69,24 +69,71 @@ xps_measure_font_glyph(xps_document *doc, fz_font *font, int gid, xps_glyph_metr
 	mtx->vorg = face->ascender / (float) face->units_per_EM;
 }
 
+/* SumatraPDF: font names are compared case-insensitively, so hash their lowercase form */
+static void
+xps_hash_font_name(char *name, unsigned char digest[16])
+{
+	char lower[1024];
+	fz_md5 md5;
+	int i;
+
+	for (i = 0; name[i] && i < (int)sizeof lower - 1; i++)
+		lower[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] + 32 : name[i];
+	lower[i] = 0;
+
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, (unsigned char *)lower, i);
+	fz_md5_final(&md5, digest);
+}
+
 static fz_font *
 xps_lookup_font(xps_document *doc, char *name)
 {
+	unsigned char key[16];
 	xps_font_cache *cache;
-	for (cache = doc->font_table; cache; cache = cache->next)
-		if (!xps_strcasecmp(cache->name, name))
-			return fz_keep_font(doc->ctx, cache->font);
+
+	if (!doc->font_table)
+		return NULL;
+
+	xps_hash_font_name(name, key);
+	cache = fz_hash_find(doc->ctx, doc->font_table, key);
+	if (cache && !xps_strcasecmp(cache->name, name))
+		return fz_keep_font(doc->ctx, cache->font);
 	return NULL;
 }
 
 static void
 xps_insert_font(xps_document *doc, char *name, fz_font *font)
 {
-	xps_font_cache *cache = fz_malloc_struct(doc->ctx, xps_font_cache);
-	cache->name = fz_strdup(doc->ctx, name);
-	cache->font = fz_keep_font(doc->ctx, font);
-	cache->next = doc->font_table;
-	doc->font_table = cache;
+	unsigned char key[16];
+	xps_font_cache *cache, *existing;
+	fz_context *ctx = doc->ctx;
+
+	if (!doc->font_table)
+		doc->font_table = fz_new_hash_table(ctx, 16, sizeof key, -1);
+
+	cache = fz_malloc_struct(ctx, xps_font_cache);
+	fz_try(ctx)
+	{
+		cache->name = fz_strdup(ctx, name);
+		xps_hash_font_name(name, key);
+		existing = fz_hash_insert(ctx, doc->font_table, key, cache);
+	}
+	fz_catch(ctx)
+	{
+		fz_free(ctx, cache->name);
+		fz_free(ctx, cache);
+		fz_rethrow(ctx);
+	}
+
+	/* on the (unlikely) collision of two names, keep the font loaded first */
+	if (existing)
+	{
+		fz_free(ctx, cache->name);
+		fz_free(ctx, cache);
+		return;
+	}
+	cache->font = fz_keep_font(ctx, font);
 }
 
 /*
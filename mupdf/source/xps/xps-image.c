@@ -127,6 +127,7 @@ xps_debug_image(FILE *out, void *key)
 
 static fz_store_type xps_image_store_type =
 {
+	FZ_STORE_IMAGES,
 	NULL,
 	fz_keep_storable,
 	fz_drop_storable,
@@ -51,19 +51,49 @@ xps_resolve_resource_reference(xps_document *doc, xps_resource *dict,
 	}
 }
 
-static xps_resource *
-xps_parse_remote_resource_dictionary(xps_document *doc, char *base_uri, char *source_att)
+/* SumatraPDF: parse every remote resource dictionary only once per document */
+static void
+xps_drop_remote_resource(xps_document *doc, xps_remote_resource *remote)
+{
+	if (--remote->refs > 0)
+		return;
+	fz_free_xml(doc->ctx, remote->xml);
+	fz_free(doc->ctx, remote->base_uri);
+	fz_free(doc->ctx, remote->part_name);
+	fz_free(doc->ctx, remote);
+}
+
+void
+xps_free_remote_resources(xps_document *doc)
+{
+	xps_remote_resource *remote, *next;
+	for (remote = doc->remote_resources; remote; remote = next)
+	{
+		next = remote->next;
+		xps_drop_remote_resource(doc, remote);
+	}
+	doc->remote_resources = NULL;
+}
+
+static xps_remote_resource *
+xps_load_remote_resource(xps_document *doc, char *part_name)
 {
-	char part_name[1024];
 	char part_uri[1024];
-	xps_resource *dict;
+	xps_remote_resource *remote;
 	xps_part *part;
 	fz_xml *xml;
 	char *s;
 	fz_context *ctx = doc->ctx;
 
-	/* External resource dictionaries MUST NOT reference other resource dictionaries */
-	xps_resolve_url(part_name, base_uri, source_att, sizeof part_name);
+	for (remote = doc->remote_resources; remote; remote = remote->next)
+	{
+		if (!xps_strcasecmp(remote->part_name, part_name))
+		{
+			remote->refs++;
+			return remote;
+		}
+	}
+
 	part = xps_read_part(doc, part_name);
 	fz_try(ctx)
 	{
@@ -93,9 +123,63 @@ xps_parse_remote_resource_dictionary(xps_document *doc, char *base_uri, char *so
 	if (s)
 		s[1] = 0;
 
-	dict = xps_parse_resource_dictionary(doc, part_uri, xml);
+	remote = NULL;
+	fz_var(remote);
+	fz_try(ctx)
+	{
+		remote = fz_malloc_struct(ctx, xps_remote_resource);
+		remote->xml = xml;
+		remote->part_name = fz_strdup(ctx, part_name);
+		remote->base_uri = fz_strdup(ctx, part_uri);
+	}
+	fz_catch(ctx)
+	{
+		if (remote)
+		{
+			fz_free(ctx, remote->part_name);
+			fz_free(ctx, remote);
+		}
+		fz_free_xml(ctx, xml);
+		fz_rethrow(ctx);
+	}
+
+	/* one reference for the document's cache and one for the caller */
+	remote->refs = 2;
+	remote->next = doc->remote_resources;
+	doc->remote_resources = remote;
+
+	return remote;
+}
+
+static xps_resource *
+xps_parse_remote_resource_dictionary(xps_document *doc, char *base_uri, char *source_att)
+{
+	char part_name[1024];
+	xps_remote_resource *remote;
+	xps_resource *dict;
+	fz_context *ctx = doc->ctx;
+
+	/* External resource dictionaries MUST NOT reference other resource dictionaries */
+	xps_resolve_url(part_name, base_uri, source_att, sizeof part_name);
+	remote = xps_load_remote_resource(doc, part_name);
+	if (!remote)
+		return NULL;
+
+	/* the node list is built anew for every use since its head is linked into the current stack */
+	fz_try(ctx)
+	{
+		dict = xps_parse_resource_dictionary(doc, remote->base_uri, remote->xml);
+	}
+	fz_catch(ctx)
+	{
+		xps_drop_remote_resource(doc, remote);
+		fz_rethrow(ctx);
+	}
+
 	if (dict)
-		dict->base_xml = xml; /* pass on ownership */
+		dict->remote = remote; /* pass on the reference */
+	else
+		xps_drop_remote_resource(doc, remote);
 
 	return dict;
 }
@@ -124,6 +208,7 @@ xps_parse_resource_dictionary(xps_document *doc, char *base_uri, fz_xml *root)
 			entry->name = key;
 			entry->base_uri = NULL;
 			entry->base_xml = NULL;
+			entry->remote = NULL;
 			entry->data = node;
 			entry->next = head;
 			entry->parent = NULL;
@@ -146,6 +231,8 @@ xps_free_resource_dictionary(xps_document *doc, xps_resource *dict)
 		next = dict->next;
 		if (dict->base_xml)
 			fz_free_xml(doc->ctx, dict->base_xml);
+		if (dict->remote)
+			xps_drop_remote_resource(doc, dict->remote);
 		if (dict->base_uri)
 			fz_free(doc->ctx, dict->base_uri);
 		fz_free(doc->ctx, dict);
@@ -643,7 +643,7 @@ xps_open_document(fz_context *ctx, const char *filename)
 void
 xps_close_document(xps_document *doc)
 {
-	xps_font_cache *font, *next;
+	xps_font_cache *font;
 	int i;
 
 	if (!doc)
@@ -656,16 +656,22 @@ xps_close_document(xps_document *doc)
 		fz_free(doc->ctx, doc->zip_table[i].name);
 	fz_free(doc->ctx, doc->zip_table);
 
-	font = doc->font_table;
-	while (font)
+	if (doc->font_table)
 	{
-		next = font->next;
-		fz_drop_font(doc->ctx, font->font);
-		fz_free(doc->ctx, font->name);
-		fz_free(doc->ctx, font);
-		font = next;
+		for (i = 0; i < fz_hash_len(doc->ctx, doc->font_table); i++)
+		{
+			font = fz_hash_get_val(doc->ctx, doc->font_table, i);
+			if (!font)
+				continue;
+			fz_drop_font(doc->ctx, font->font);
+			fz_free(doc->ctx, font->name);
+			fz_free(doc->ctx, font);
+		}
+		fz_free_hash(doc->ctx, doc->font_table);
 	}
 
+	xps_free_remote_resources(doc);
+
 	/* cf. http://code.google.com/p/sumatrapdf/issues/detail?id=2094 */
 	fz_empty_store(doc->ctx);
 
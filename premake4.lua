@@ -116,6 +116,7 @@ solution "all_tests"
       --"src/ParseCommandLine.*",
       --"src/StressTesting.*",
       "src/AppUtil*",
+      "src/PdfSyncIndex*",
       "src/UnitTests.cpp",
       "src/mui/SvgPath*",
       "tools/tests/UnitMain.cpp"
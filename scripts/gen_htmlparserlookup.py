@@ -3,6 +3,9 @@
 This script generates fairly fast C code for the following function:
 Given a string, see if it belongs to a known set of strings. If it does,
 return a value corresponding to that string.
+
+For the lookups done for every tag and CSS property, a minimal perfect hash
+is used, so that a lookup costs hashing the name and a single comparison.
 """
 
 import util2
@@ -24,6 +27,9 @@ Template_Defines = """\
 #define STR2i(s) (STR1i(s) | (lower((s)[1]) << 8))
 #define STR3i(s) (STR2i(s) | (lower((s)[2]) << 16))
 #define STR4i(s) (STR3i(s) | (lower((s)[3]) << 24))
+
+// FNV-1a step (with a seed as offset basis) for the perfect hash functions
+#define PHASH(h, c) (((h) ^ (uint8_t)(c)) * 16777619)
 """
 
 Template_Find_Function = """\
@@ -56,6 +62,34 @@ bool %s(%s item)
 }
 """
 
+Template_Perfect_Hash_Function = """\
+static const %(gtype)s g%(name)sG[%(m)d] = {
+	%(g)s
+};
+static const char *g%(name)sNames[%(n)d] = {
+	%(names)s
+};
+static const uint8_t g%(name)sLens[%(n)d] = {
+	%(lens)s
+};
+static const %(type)s g%(name)sValues[%(n)d] = {
+	%(values)s
+};
+
+%(type)s Find%(name)s(const char *name, size_t len)
+{
+	uint32_t h1 = %(seed1)s, h2 = %(seed2)s;
+	for (size_t i = 0; i < len; i++) {
+		h1 = PHASH(h1, lower(name[i]));
+		h2 = PHASH(h2, lower(name[i]));
+	}
+	unsigned int idx = (g%(name)sG[h1 %% %(m)d] + g%(name)sG[h2 %% %(m)d]) %% %(n)d;
+	if (len == g%(name)sLens[idx] && str::EqNI(name, g%(name)sNames[idx], len))
+		return g%(name)sValues[idx];
+	return %(default)s;
+}
+"""
+
 # given e.g. "br" returns "Tag_Br"
 def getEnumName(name, prefix):
 	parts = name.replace("-", ":").split(":")
@@ -108,6 +142,75 @@ def createFastFinder(list, type, default, caseInsensitive, funcName=None):
 		assert not [c for c in output if c > '\x7f'], "lower() only supports ASCII letters"
 	return unTab(output)
 
+def phash(name, seed):
+	h = seed
+	for c in name:
+		h = ((h ^ ord(c)) * 16777619) & 0xFFFFFFFF
+	return h
+
+# finds two hash functions (seeds) and a table g so that for the i-th name
+# (g[h1(name) % m] + g[h2(name) % m]) % n == i (cf. the CHM algorithm in
+# "An optimal algorithm for generating minimal perfect hash functions" by
+# Czech, Havas and Majewski): every name is an edge between the vertices
+# h1(name) % m and h2(name) % m and values for g can be assigned as long
+# as the resulting graph is acyclic (which is likely for m > 2 * n)
+def findPerfectHash(names):
+	n, m = len(names), 2 * len(names) + 1
+	for attempt in range(1, 100000):
+		seed1 = (attempt * 0x9E3779B1) & 0xFFFFFFFF
+		seed2 = (attempt * 0x85EBCA77 + 0xC2B2AE3D) & 0xFFFFFFFF
+		edges = [(phash(name, seed1) % m, phash(name, seed2) % m) for name in names]
+		if [1 for (v1, v2) in edges if v1 == v2]:
+			continue
+		adjacent = [[] for i in range(m)]
+		for (i, (v1, v2)) in enumerate(edges):
+			adjacent[v1].append((v2, i))
+			adjacent[v2].append((v1, i))
+		g, acyclic = [None] * m, True
+		for root in range(m):
+			if g[root] is not None:
+				continue
+			g[root] = 0
+			stack = [(root, None)]
+			while stack and acyclic:
+				(v, viaEdge) = stack.pop()
+				for (w, i) in adjacent[v]:
+					if i == viaEdge:
+						continue
+					if g[w] is not None:
+						acyclic = False
+						break
+					g[w] = (i - g[v]) % n
+					stack.append((w, i))
+			if not acyclic:
+				break
+		if acyclic:
+			return (seed1, seed2, [v or 0 for v in g])
+	assert False, "no perfect hash found"
+
+# creates a lookup function that uses a minimal perfect hash for finding
+# the only candidate which then has to be compared with the name
+def createPerfectHashFinder(list, type, default, funcName=None):
+	list = sorted(list, key=lambda a: a[0])
+	names = [name.lower() for (name, value) in list]
+	assert not [c for c in "".join(names) if c > '\x7f'], "lower() only supports ASCII letters"
+	assert max([len(name) for name in names]) < 256
+	(seed1, seed2, g) = findPerfectHash(names)
+	n, m = len(names), len(g)
+	for (i, name) in enumerate(names):
+		assert (g[phash(name, seed1) % m] + g[phash(name, seed2) % m]) % n == i
+
+	values = {
+		"type": type, "name": funcName or type, "default": default, "n": n, "m": m,
+		"seed1": "0x%08X" % seed1, "seed2": "0x%08X" % seed2,
+		"gtype": "uint8_t" if n <= 256 else "uint16_t",
+		"g": ",\n	".join([", ".join(part) for part in util2.group([str(v) for v in g], 16)]),
+		"names": ",\n	".join([", ".join(part) for part in util2.group(['"%s"' % name for (name, value) in list], 8)]),
+		"lens": ",\n	".join([", ".join(part) for part in util2.group([str(len(name)) for name in names], 16)]),
+		"values": ",\n	".join([", ".join(part) for part in util2.group([value for (name, value) in list], 5)]),
+	}
+	return unTab(Template_Perfect_Hash_Function % values)
+
 # creates an enumeration that can be used as a result for the lookup function
 # (which would allow to "internalize" a string)
 def createTypeEnum(list, type, default):
@@ -232,13 +335,13 @@ def main():
 	enum_cssprop = createTypeEnum(cssProps, "CssProp", "Css_Unknown")
 
 	code_defines = Template_Defines
-	code_htmltag = createFastFinder(tags, "HtmlTag", "Tag_NotFound", True)
+	code_htmltag = createPerfectHashFinder(tags, "HtmlTag", "Tag_NotFound")
 	code_htmlattr = createFastFinder(attrs, "HtmlAttr", "Attr_NotFound", True)
 	code_selfclosing = createFastSelector(tags, List_Self_Closing_Tags.split(), "IsTagSelfClosing", "HtmlTag")
 	code_inlinetag = createFastSelector(tags, List_Inline_Tags.split(), "IsInlineTag", "HtmlTag")
-	code_alignattr = createFastFinder(aligns, "AlignAttr", "Align_NotFound", True)
+	code_alignattr = createPerfectHashFinder(aligns, "AlignAttr", "Align_NotFound")
 	code_htmlentity = Template_Entities_Comment + "\n" + createFastFinder(List_HTML_Entities, "uint32_t", "(uint32_t)-1", False, "HtmlEntityRune")
-	code_cssprop = createFastFinder(cssProps, "CssProp", "Css_Unknown", True)
+	code_cssprop = createPerfectHashFinder(cssProps, "CssProp", "Css_Unknown")
 	code_csscolor = createFastFinder(cssColors, "ARGB", "MKRGBA(0,0,0,0)", True, "CssColor")
 
 	content = Template_Lookup_Header % locals()
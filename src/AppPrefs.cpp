@@ -16,6 +16,7 @@
 #include "FileTransactions.h"
 #include "FileUtil.h"
 #include "FileWatcher.h"
+#include "PdfEngine.h"
 #include "SumatraPDF.h"
 #include "Translations.h"
 #include "UITask.h"
@@ -23,6 +24,11 @@
 
 #define PREFS_FILE_NAME     L"SumatraPDF-settings.txt"
 #define LEGACY_FILE_NAME    L"sumatrapdfprefs.dat"
+// binary copy of the settings (see SerializeStructBin) which is only used
+// for as long as the settings file hasn't been modified by anybody else
+#define SNAPSHOT_FILE_NAME  L"SumatraPDF-settings.bin"
+#define SNAPSHOT_MAGIC      "SPbs"
+#define SNAPSHOT_VERSION    ((2 << 8) | sizeof(size_t))
 
 GlobalPrefs *        gGlobalPrefs = NULL;
 
@@ -198,6 +204,58 @@ static int cmpFloat(const void *a, const void *b)
     return *(float *)a < *(float *)b ? -1 : *(float *)a > *(float *)b ? 1 : 0;
 }
 
+struct PrefsSnapshotHeader {
+    char magic[4];
+    UINT version;
+    // MD5 digest of the exact content of the settings file
+    unsigned char prefsDigest[16];
+};
+
+static void GetSnapshotHeader(const char *prefsData, size_t prefsLen, PrefsSnapshotHeader *hdr)
+{
+    ZeroMemory(hdr, sizeof(*hdr));
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, 4);
+    hdr->version = SNAPSHOT_VERSION;
+    CalcMD5Digest((const unsigned char *)prefsData, prefsLen, hdr->prefsDigest);
+}
+
+static GlobalPrefs *LoadSnapshot(const char *prefsData, size_t prefsLen)
+{
+    PrefsSnapshotHeader expected;
+    GetSnapshotHeader(prefsData, prefsLen, &expected);
+    ScopedMem<WCHAR> path(AppGenDataFilename(SNAPSHOT_FILE_NAME));
+    size_t len;
+    ScopedMem<char> data(file::ReadAll(path, &len));
+    if (!data || len < sizeof(PrefsSnapshotHeader) || !memeq(data, &expected, sizeof(expected)))
+        return NULL;
+    return (GlobalPrefs *)DeserializeStructBin(&gGlobalPrefsInfo, data + sizeof(expected), len - sizeof(expected));
+}
+
+static bool IsSnapshotCurrent(const char *prefsData, size_t prefsLen)
+{
+    PrefsSnapshotHeader expected, hdr;
+    GetSnapshotHeader(prefsData, prefsLen, &expected);
+    ScopedMem<WCHAR> path(AppGenDataFilename(SNAPSHOT_FILE_NAME));
+    return file::ReadAll(path, (char *)&hdr, sizeof(hdr)) && memeq(&hdr, &expected, sizeof(hdr));
+}
+
+// the snapshot is keyed on the settings as written by us, so that it isn't
+// used when another instance has modified the settings file in the meantime
+static void SaveSnapshot(const char *prefsData, size_t prefsLen, const char *data, size_t len)
+{
+    ScopedMem<WCHAR> path(AppGenDataFilename(SNAPSHOT_FILE_NAME));
+    PrefsSnapshotHeader hdr;
+    str::Str<char> snapshot(sizeof(hdr) + len);
+    if (data) {
+        GetSnapshotHeader(prefsData, prefsLen, &hdr);
+        snapshot.Append((const char *)&hdr, sizeof(hdr));
+        snapshot.Append(data, len);
+        if (file::WriteAll(path, snapshot.Get(), snapshot.Size()))
+            return;
+    }
+    file::Delete(path);
+}
+
 namespace prefs {
 
 WCHAR *GetSettingsPath()
@@ -211,8 +269,13 @@ bool Load()
     CrashIf(gGlobalPrefs);
 
     ScopedMem<WCHAR> path(GetSettingsPath());
-    ScopedMem<char> prefsData(file::ReadAll(path, NULL));
-    gGlobalPrefs = (GlobalPrefs *)DeserializeStruct(&gGlobalPrefsInfo, prefsData);
+    size_t prefsDataSize;
+    ScopedMem<char> prefsData(file::ReadAll(path, &prefsDataSize));
+    // parsing the text is skipped if it's exactly what was last saved along with the snapshot
+    if (prefsData)
+        gGlobalPrefs = LoadSnapshot(prefsData, prefsDataSize);
+    if (!gGlobalPrefs)
+        gGlobalPrefs = (GlobalPrefs *)DeserializeStruct(&gGlobalPrefsInfo, prefsData);
     CrashAlwaysIf(!gGlobalPrefs);
 
     if (!file::Exists(path)) {
@@ -322,6 +385,9 @@ bool Save()
 
     size_t prefsDataSize;
     ScopedMem<char> prefsData(SerializeStruct(&gGlobalPrefsInfo, gGlobalPrefs, prevPrefsData, &prefsDataSize));
+    // the snapshot must omit the same fields as the text
+    size_t snapshotSize;
+    ScopedMem<char> snapshotData(SerializeStructBin(&gGlobalPrefsInfo, gGlobalPrefs, &snapshotSize));
 
     if (!gGlobalPrefs->rememberStatePerDocument)
         gFileStateInfo.fieldCount = dimof(gFileStateFields);
@@ -331,14 +397,18 @@ bool Save()
         return false;
 
     // only save if anything's changed at all
-    if (prevPrefsDataSize == prefsDataSize && str::Eq(prefsData, prevPrefsData))
+    if (prevPrefsDataSize == prefsDataSize && str::Eq(prefsData, prevPrefsData)) {
+        if (!IsSnapshotCurrent(prefsData, prefsDataSize))
+            SaveSnapshot(prefsData, prefsDataSize, snapshotData, snapshotSize);
         return true;
+    }
 
     FileTransaction trans;
     bool ok = trans.WriteAll(path, prefsData, prefsDataSize) && trans.Commit();
     if (!ok)
         return false;
     gGlobalPrefs->lastPrefUpdate = file::GetModificationTime(path);
+    SaveSnapshot(prefsData, prefsDataSize, snapshotData, snapshotSize);
     return true;
 }
 
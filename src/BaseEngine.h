@@ -242,6 +242,10 @@ public:
                          RectD *pageRect=NULL, /* if NULL: defaults to the page's mediabox */
                          RenderTarget target=Target_View, AbortCookie **cookie_out=NULL) = 0;
     // for both rendering methods: *cookie_out must be deleted after the call returns
+    // returns an image of the first page which is cheaper to get than rendering it
+    // (e.g. a thumbnail embedded in the document) and at least large enough for
+    // being fitted into size without upscaling - or NULL if there's no such image
+    virtual RenderedBitmap *GetThumbnail(SizeI size) { return NULL; }
 
     // applies zoom and rotation to a point in user/page space converting
     // it into device/screen space - or in the inverse direction
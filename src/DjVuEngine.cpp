@@ -198,6 +198,25 @@ public:
 
 static DjVuContext gDjVuContext;
 
+// libdjvu is compiled without thread support (THREADMODEL=0), so pages are
+// decoded synchronously in ddjvu_page_create_by_pageno which (as all other
+// calls into ddjvuapi and minilisp) must be protected by gDjVuContext.lock.
+// This includes ddjvu_page_render which may report errors through the shared
+// message queue and reads data shared between pages (e.g. JB2 dictionaries).
+// Decoded pages are cached so that several tiles of the same page can be
+// rendered without decoding it again
+
+#define MAX_CACHED_PAGES 4
+
+struct DjVuCachedPage {
+    int pageNo;
+    ddjvu_page_t *page;
+    // one reference for being cached and one for every renderer
+    int refs;
+
+    DjVuCachedPage(int pageNo, ddjvu_page_t *page) : pageNo(pageNo), page(page), refs(1) { }
+};
+
 class DjVuEngineImpl : public DjVuEngine {
     friend DjVuEngine;
 
@@ -242,8 +261,12 @@ public:
     virtual float GetFileDPI() const { return 300.0f; }
     virtual const WCHAR *GetDefaultFileExt() const { return L".djvu"; }
 
-    // we currently don't load pages lazily, so there's nothing to do here
-    virtual bool BenchLoadPage(int pageNo) { return true; }
+    virtual bool BenchLoadPage(int pageNo) {
+        DjVuCachedPage *cp = GetPage(pageNo);
+        if (cp)
+            DropPage(cp);
+        return cp != NULL;
+    }
 
     virtual Vec<PageElement *> *GetElements(int pageNo);
     virtual PageElement *GetElementAtPos(int pageNo, PointD pt);
@@ -270,6 +293,14 @@ protected:
 
     Vec<ddjvu_fileinfo_t> fileInfo;
 
+    CRITICAL_SECTION pagesAccess;
+    // most recently used pages are at the end
+    Vec<DjVuCachedPage *> pageCache;
+
+    DjVuCachedPage *FindCachedPage(int pageNo);
+    DjVuCachedPage *GetPage(int pageNo, DjVuAbortCookie *cookie=NULL);
+    void DropPage(DjVuCachedPage *cp);
+    RenderedBitmap *RenderPageBitmap(int pageNo, float zoom, int rotation, RectD *pageRect, DjVuAbortCookie *cookie);
     void AddUserAnnots(RenderedBitmap *bmp, int pageNo, float zoom, int rotation, RectI screen);
     bool ExtractPageText(miniexp_t item, const WCHAR *lineSep,
                          str::Str<WCHAR>& extracted, Vec<RectI>& coords);
@@ -282,10 +313,17 @@ protected:
 DjVuEngineImpl::DjVuEngineImpl() : fileName(NULL), pageCount(0), mediaboxes(NULL),
     doc(NULL), outline(miniexp_nil), annos(NULL), hasPageLabels(false)
 {
+    InitializeCriticalSection(&pagesAccess);
 }
 
 DjVuEngineImpl::~DjVuEngineImpl()
 {
+    for (size_t i = 0; i < pageCache.Count(); i++) {
+        DropPage(pageCache.At(i));
+    }
+    pageCache.Reset();
+    DeleteCriticalSection(&pagesAccess);
+
     ScopedCritSec scope(&gDjVuContext.lock);
 
     free(mediaboxes);
@@ -516,26 +554,100 @@ void DjVuEngineImpl::AddUserAnnots(RenderedBitmap *bmp, int pageNo, float zoom,
     DeleteDC(hdc);
 }
 
+// returns a cached page (or NULL if it isn't cached yet)
+DjVuCachedPage *DjVuEngineImpl::FindCachedPage(int pageNo)
+{
+    ScopedCritSec scope(&pagesAccess);
+    for (size_t i = 0; i < pageCache.Count(); i++) {
+        DjVuCachedPage *cp = pageCache.At(i);
+        if (cp->pageNo == pageNo) {
+            pageCache.RemoveAt(i);
+            pageCache.Append(cp);
+            cp->refs++;
+            return cp;
+        }
+    }
+    return NULL;
+}
+
+// returns a decoded page (or NULL on failure or if cookie has been aborted)
+// which must be given back through DropPage
+DjVuCachedPage *DjVuEngineImpl::GetPage(int pageNo, DjVuAbortCookie *cookie)
+{
+    DjVuCachedPage *cp = FindCachedPage(pageNo);
+    if (cp)
+        return cp;
+    // decoding can't be interrupted, so check before starting it
+    if (cookie && cookie->abort)
+        return NULL;
+
+    ScopedCritSec ctxScope(&gDjVuContext.lock);
+    // another thread might have decoded the page while we waited for the lock
+    cp = FindCachedPage(pageNo);
+    if (cp)
+        return cp;
+    ddjvu_page_t *page = ddjvu_page_create_by_pageno(doc, pageNo-1);
+    if (!page)
+        return NULL;
+    while (!ddjvu_page_decoding_done(page))
+        gDjVuContext.SpinMessageLoop();
+    if (ddjvu_page_decoding_error(page)) {
+        ddjvu_page_release(page);
+        return NULL;
+    }
+
+    ScopedCritSec scope(&pagesAccess);
+    cp = new DjVuCachedPage(pageNo, page);
+    if (pageCache.Count() == MAX_CACHED_PAGES) {
+        DropPage(pageCache.At(0));
+        pageCache.RemoveAt(0);
+    }
+    pageCache.Append(cp);
+    cp->refs++;
+    return cp;
+}
+
+void DjVuEngineImpl::DropPage(DjVuCachedPage *cp)
+{
+    EnterCriticalSection(&pagesAccess);
+    bool isUnused = --cp->refs == 0;
+    LeaveCriticalSection(&pagesAccess);
+    // gDjVuContext.lock must not be acquired while holding pagesAccess
+    // (unless it's already held, as it is when called from GetPage)
+    if (!isUnused)
+        return;
+    ScopedCritSec ctxScope(&gDjVuContext.lock);
+    ddjvu_page_release(cp->page);
+    delete cp;
+}
+
 RenderedBitmap *DjVuEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation, RectD *pageRect, RenderTarget target, AbortCookie **cookie_out)
 {
-    ScopedCritSec scope(&gDjVuContext.lock);
+    DjVuAbortCookie *cookie = NULL;
+    if (cookie_out)
+        *cookie_out = cookie = new DjVuAbortCookie();
+    return RenderPageBitmap(pageNo, zoom, rotation, pageRect, cookie);
+}
 
+RenderedBitmap *DjVuEngineImpl::RenderPageBitmap(int pageNo, float zoom, int rotation, RectD *pageRect, DjVuAbortCookie *cookie)
+{
     RectD pageRc = pageRect ? *pageRect : PageMediabox(pageNo);
     RectI screen = Transform(pageRc, pageNo, zoom, rotation).Round();
     RectI full = Transform(PageMediabox(pageNo), pageNo, zoom, rotation).Round();
     screen = full.Intersect(screen);
 
-    ddjvu_page_t *page = ddjvu_page_create_by_pageno(doc, pageNo-1);
-    if (!page)
+    DjVuCachedPage *cp = GetPage(pageNo, cookie);
+    if (!cp)
         return NULL;
+    if (cookie && cookie->abort) {
+        DropPage(cp);
+        return NULL;
+    }
+    EnterCriticalSection(&gDjVuContext.lock);
+    ddjvu_page_t *page = cp->page;
     int rotation4 = (((-rotation / 90) % 4) + 4) % 4;
     ddjvu_page_set_rotation(page, (ddjvu_page_rotation_t)rotation4);
 
-    while (!ddjvu_page_decoding_done(page))
-        gDjVuContext.SpinMessageLoop();
-    if (ddjvu_page_decoding_error(page))
-        return NULL;
-
     bool isBitonal = DDJVU_PAGETYPE_BITONAL == ddjvu_page_get_type(page);
     ddjvu_format_t *fmt = ddjvu_format_create(isBitonal ? DDJVU_FORMAT_GREY8 : DDJVU_FORMAT_BGR24, 0, NULL);
     ddjvu_format_set_row_order(fmt, /* top_to_bottom */ TRUE);
@@ -560,7 +672,8 @@ RenderedBitmap *DjVuEngineImpl::RenderBitmap(int pageNo, float zoom, int rotatio
     }
 
     ddjvu_format_release(fmt);
-    ddjvu_page_release(page);
+    LeaveCriticalSection(&gDjVuContext.lock);
+    DropPage(cp);
 
     return bmp;
 }
@@ -587,7 +700,7 @@ bool DjVuEngineImpl::RenderPage(HDC hDC, RectI screenRect, int pageNo, float zoo
         RectI screenBand = Transform(pageBand, pageNo, zoom, rotation).Round();
         screenBand.Offset(screenRect.x - pt.x, screenRect.y - pt.y);
 
-        RenderedBitmap *bmp = RenderBitmap(pageNo, zoom, rotation, &pageBand, target, cookie_out);
+        RenderedBitmap *bmp = RenderPageBitmap(pageNo, zoom, rotation, &pageBand, cookie);
         if (bmp && bmp->GetBitmap())
             success = bmp->StretchDIBits(hDC, screenBand);
         else
@@ -606,19 +719,14 @@ bool DjVuEngineImpl::RenderPage(HDC hDC, RectI screenRect, int pageNo, float zoo
 
 RectD DjVuEngineImpl::PageContentBox(int pageNo, RenderTarget target)
 {
-    ScopedCritSec scope(&gDjVuContext.lock);
-
     RectD pageRc = PageMediabox(pageNo);
-    ddjvu_page_t *page = ddjvu_page_create_by_pageno(doc, pageNo-1);
-    if (!page)
+    DjVuCachedPage *cp = GetPage(pageNo);
+    if (!cp)
         return pageRc;
+    EnterCriticalSection(&gDjVuContext.lock);
+    ddjvu_page_t *page = cp->page;
     ddjvu_page_set_rotation(page, DDJVU_ROTATE_0);
 
-    while (!ddjvu_page_decoding_done(page))
-        gDjVuContext.SpinMessageLoop();
-    if (ddjvu_page_decoding_error(page))
-        return pageRc;
-
     // render the page in 8-bit grayscale up to 250x250 px in size
     ddjvu_format_t *fmt = ddjvu_format_create(DDJVU_FORMAT_GREY8, 0, NULL);
     ddjvu_format_set_row_order(fmt, /* top_to_bottom */ TRUE);
@@ -657,7 +765,8 @@ RectD DjVuEngineImpl::PageContentBox(int pageNo, RenderTarget target)
     }
 
     ddjvu_format_release(fmt);
-    ddjvu_page_release(page);
+    LeaveCriticalSection(&gDjVuContext.lock);
+    DropPage(cp);
 
     return pageRc;
 }
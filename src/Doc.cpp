@@ -265,6 +265,8 @@ size_t Doc::GetHtmlDataSize()
 ImageData *Doc::GetCoverImage()
 {
     switch (type) {
+    case Doc_Epub:
+        return epubDoc->GetCoverImage();
     case Doc_Fb2:
         return fb2Doc->GetCoverImage();
     case Doc_Mobi:
@@ -282,7 +284,7 @@ Doc Doc::CreateFromFile(const WCHAR *filePath)
     else if (Fb2Doc::IsSupportedFile(filePath))
         doc = Doc(Fb2Doc::CreateFromFile(filePath));
     else if (MobiDoc::IsSupportedFile(filePath))
-        doc = Doc(MobiDoc::CreateFromFile(filePath));
+        doc = Doc(MobiDoc::CreateFromFileLazy(filePath));
 
     // if failed to load and more specific error message hasn't been
     // set above, set a generic error message
@@ -319,7 +321,7 @@ bool IsSupportedFile(const WCHAR *filePath, bool sniff, bool enableEbookEngines)
            );
 }
 
-BaseEngine *CreateEngine(const WCHAR *filePath, PasswordUI *pwdUI, DocType *typeOut, bool useAlternateChmEngine, bool enableEbookEngines)
+BaseEngine *CreateEngine(const WCHAR *filePath, PasswordUI *pwdUI, DocType *typeOut, bool useAlternateChmEngine, bool enableEbookEngines, bool thumbnailOnly)
 {
     CrashIf(!filePath);
 
@@ -328,7 +330,7 @@ BaseEngine *CreateEngine(const WCHAR *filePath, PasswordUI *pwdUI, DocType *type
     bool sniff = false;
 RetrySniffing:
     if (PdfEngine::IsSupportedFile(filePath, sniff) && engineType != Engine_PDF) {
-        engine = PdfEngine::CreateFromFile(filePath, pwdUI);
+        engine = PdfEngine::CreateFromFile(filePath, pwdUI, thumbnailOnly);
         engineType = Engine_PDF;
     } else if (XpsEngine::IsSupportedFile(filePath, sniff) && engineType != Engine_XPS) {
         engine = XpsEngine::CreateFromFile(filePath);
@@ -343,7 +345,7 @@ RetrySniffing:
         engine = ImageDirEngine::CreateFromFile(filePath);
         engineType = Engine_ImageDir;
     } else if (CbxEngine::IsSupportedFile(filePath, sniff) && engineType != Engine_ComicBook) {
-        engine = CbxEngine::CreateFromFile(filePath);
+        engine = CbxEngine::CreateFromFile(filePath, thumbnailOnly);
         engineType = Engine_ComicBook;
     } else if (PsEngine::IsSupportedFile(filePath, sniff) && engineType != Engine_PS) {
         engine = PsEngine::CreateFromFile(filePath);
@@ -357,7 +359,7 @@ RetrySniffing:
     } else if (!enableEbookEngines) {
         // don't try to create any of the below ebook engines
     } else if (EpubEngine::IsSupportedFile(filePath, sniff) && engineType != Engine_Epub) {
-        engine = EpubEngine::CreateFromFile(filePath);
+        engine = EpubEngine::CreateFromFile(filePath, thumbnailOnly);
         engineType = Engine_Epub;
     } else if (Fb2Engine::IsSupportedFile(filePath, sniff) && engineType != Engine_Fb2) {
         engine = Fb2Engine::CreateFromFile(filePath);
@@ -124,7 +124,8 @@ public:
 namespace EngineManager {
 
 bool IsSupportedFile(const WCHAR *filePath, bool sniff=false, bool enableEbookEngines=true);
-BaseEngine *CreateEngine(const WCHAR *filePath, PasswordUI *pwdUI=NULL, DocType *typeOut=NULL, bool useAlternateChmEngine=false, bool enableEbookEngines=true);
+// thumbnailOnly: engines may skip everything not needed for rendering the first page
+BaseEngine *CreateEngine(const WCHAR *filePath, PasswordUI *pwdUI=NULL, DocType *typeOut=NULL, bool useAlternateChmEngine=false, bool enableEbookEngines=true, bool thumbnailOnly=false);
 
 inline BaseEngine *CreateEngine(const WCHAR *filePath, bool useAlternateChmEngine) {
     return CreateEngine(filePath, NULL, NULL, useAlternateChmEngine, true);
@@ -688,6 +688,9 @@ void EbookController::SetDoc(Doc newDoc, int startReparseIdxArg)
 {
     CrashIf(!newDoc.IsEbook());
     startReparseIdx = startReparseIdxArg;
+    // lazily loaded Mobi documents must be decoded up to the last reading position
+    if (newDoc.AsMobi() && startReparseIdx > 0)
+        newDoc.AsMobi()->LoadBookHtml(startReparseIdx + 1);
     if ((size_t)startReparseIdx >= newDoc.GetHtmlDataSize())
         startReparseIdx = -1;
     CloseCurrentDocument();
@@ -225,11 +225,11 @@ const char *EPUB_ENC_NS = "http://www.w3.org/2001/04/xmlenc#";
 
 EpubDoc::EpubDoc(const WCHAR *fileName) :
     zip(fileName, Zip_Deflate), fileName(str::Dup(fileName)),
-    isNcxToc(false), isRtlDoc(false) { }
+    isNcxToc(false), isRtlDoc(false), coverImageIdx(-1) { }
 
 EpubDoc::EpubDoc(IStream *stream) :
     zip(stream, Zip_Deflate), fileName(NULL),
-    isNcxToc(false), isRtlDoc(false) { }
+    isNcxToc(false), isRtlDoc(false), coverImageIdx(-1) { }
 
 EpubDoc::~EpubDoc()
 {
@@ -279,6 +279,14 @@ bool EpubDoc::Load()
     node = parser.ParseInPlace(content);
     if (!node)
         return false;
+    // EPUB 2 cover image (EPUB 3 uses the "cover-image" property instead)
+    ScopedMem<WCHAR> coverId;
+    node = parser.FindElementByNameNS("meta", EPUB_OPF_NS);
+    for (; node && !coverId; node = parser.FindElementByNameNS("meta", EPUB_OPF_NS, node)) {
+        ScopedMem<WCHAR> name(node->GetAttribute("name"));
+        if (str::Eq(name, L"cover"))
+            coverId.Set(node->GetAttribute("content"));
+    }
     node = parser.FindElementByNameNS("manifest", EPUB_OPF_NS);
     if (!node)
         return false;
@@ -302,6 +310,10 @@ bool EpubDoc::Load()
             imgPath.Set(str::Join(contentPath, imgPath));
             if (encList.Contains(imgPath))
                 continue;
+            ScopedMem<WCHAR> imgId(node->GetAttribute("id"));
+            ScopedMem<WCHAR> properties(node->GetAttribute("properties"));
+            if (coverId && str::Eq(imgId, coverId) || properties && str::Find(properties, L"cover-image"))
+                coverImageIdx = (int)images.Count();
             // load the image lazily
             ImageData2 data = { 0 };
             data.id = str::conv::ToUtf8(imgPath);
@@ -476,6 +488,18 @@ ImageData *EpubDoc::GetImageData(const char *id, const char *pagePath)
     return NULL;
 }
 
+ImageData *EpubDoc::GetCoverImage()
+{
+    if (coverImageIdx < 0)
+        return NULL;
+    ImageData2 *img = &images.At(coverImageIdx);
+    if (!img->base.data)
+        img->base.data = zip.GetFileDataByIdx(img->idx, &img->base.len);
+    if (!img->base.data)
+        return NULL;
+    return &img->base;
+}
+
 char *EpubDoc::GetFileData(const char *relPath, const char *pagePath, size_t *lenOut)
 {
     if (!pagePath)
@@ -36,6 +36,8 @@ class EpubDoc {
     PropertyMap props;
     bool isNcxToc;
     bool isRtlDoc;
+    // index into images (or -1 if there's no cover image)
+    int coverImageIdx;
 
     bool Load();
     void ParseMetadata(const char *content);
@@ -50,6 +52,7 @@ public:
     const char *GetTextData(size_t *lenOut);
     size_t GetTextDataSize();
     ImageData *GetImageData(const char *id, const char *pagePath);
+    ImageData *GetCoverImage();
     char *GetFileData(const char *relPath, const char *pagePath, size_t *lenOut);
 
     WCHAR *GetProperty(DocumentProperty prop) const;
@@ -722,7 +722,7 @@ class EpubEngineImpl : public EbookEngine, public EpubEngine {
     friend EpubEngine;
 
 public:
-    EpubEngineImpl() : EbookEngine(), doc(NULL) { }
+    EpubEngineImpl() : EbookEngine(), doc(NULL), thumbnailOnly(false) { }
     virtual ~EpubEngineImpl() { delete doc; }
     virtual EpubEngine *Clone() {
         return fileName ? CreateFromFile(fileName) : NULL;
@@ -738,8 +738,12 @@ public:
     virtual bool HasTocTree() const { return doc->HasToc(); }
     virtual DocTocItem *GetTocTree();
 
+    virtual RenderedBitmap *GetThumbnail(SizeI size);
+
 protected:
     EpubDoc *doc;
+    // only the first page is laid out for generating thumbnails
+    bool thumbnailOnly;
 
     bool Load(const WCHAR *fileName);
     bool Load(IStream *stream);
@@ -780,7 +784,14 @@ bool EpubEngineImpl::FinishLoading()
     args.textAllocator = &allocator;
     args.measureAlgo = MeasureTextQuick;
 
-    pages = EpubFormatter(&args, doc).FormatAllPages(false);
+    if (thumbnailOnly) {
+        pages = new Vec<HtmlPage *>();
+        HtmlPage *pd = EpubFormatter(&args, doc).Next(false);
+        if (pd)
+            pages->Append(pd);
+    }
+    else
+        pages = EpubFormatter(&args, doc).FormatAllPages(false);
     if (!ExtractPageAnchors())
         return false;
 
@@ -804,6 +815,27 @@ DocTocItem *EpubEngineImpl::GetTocTree()
     return root;
 }
 
+RenderedBitmap *EpubEngineImpl::GetThumbnail(SizeI size)
+{
+    ImageData *cover = doc->GetCoverImage();
+    if (!cover)
+        return NULL;
+    Bitmap *bmp = BitmapFromData(cover->data, cover->len);
+    if (!bmp || bmp->GetWidth() < (UINT)size.dx && bmp->GetHeight() < (UINT)size.dy) {
+        delete bmp;
+        return NULL;
+    }
+
+    HBITMAP hbmp;
+    if (bmp->GetHBITMAP((ARGB)Color::White, &hbmp) != Ok) {
+        delete bmp;
+        return NULL;
+    }
+    SizeI bmpSize(bmp->GetWidth(), bmp->GetHeight());
+    delete bmp;
+    return new RenderedBitmap(hbmp, bmpSize);
+}
+
 bool EpubEngine::IsSupportedFile(const WCHAR *fileName, bool sniff)
 {
     if (sniff && dir::Exists(fileName)) {
@@ -813,9 +845,10 @@ bool EpubEngine::IsSupportedFile(const WCHAR *fileName, bool sniff)
     return EpubDoc::IsSupportedFile(fileName, sniff);
 }
 
-EpubEngine *EpubEngine::CreateFromFile(const WCHAR *fileName)
+EpubEngine *EpubEngine::CreateFromFile(const WCHAR *fileName, bool thumbnailOnly)
 {
     EpubEngineImpl *engine = new EpubEngineImpl();
+    engine->thumbnailOnly = thumbnailOnly;
     if (!engine->Load(fileName)) {
         delete engine;
         return NULL;
@@ -823,9 +856,10 @@ EpubEngine *EpubEngine::CreateFromFile(const WCHAR *fileName)
     return engine;
 }
 
-EpubEngine *EpubEngine::CreateFromStream(IStream *stream)
+EpubEngine *EpubEngine::CreateFromStream(IStream *stream, bool thumbnailOnly)
 {
     EpubEngineImpl *engine = new EpubEngineImpl();
+    engine->thumbnailOnly = thumbnailOnly;
     if (!engine->Load(stream)) {
         delete engine;
         return NULL;
@@ -1300,7 +1334,7 @@ void ChmFormatter::HandleTagPagebreak(HtmlToken *t)
         currPage->instructions.Append(DrawInstr::Anchor(attr->val, attr->valLen, bbox));
         pagePath.Set(str::DupN(attr->val, attr->valLen));
         // reset CSS style rules for the new document
-        styleRules.Reset();
+        ResetStyleRules();
     }
 }
 
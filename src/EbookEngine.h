@@ -9,8 +9,9 @@
 class EpubEngine : public virtual BaseEngine {
 public:
     static bool IsSupportedFile(const WCHAR *fileName, bool sniff=false);
-    static EpubEngine *CreateFromFile(const WCHAR *fileName);
-    static EpubEngine *CreateFromStream(IStream *stream);
+    // thumbnailOnly: only lay out the first page (and prefer the cover image)
+    static EpubEngine *CreateFromFile(const WCHAR *fileName, bool thumbnailOnly=false);
+    static EpubEngine *CreateFromStream(IStream *stream, bool thumbnailOnly=false);
 };
 
 class Fb2Engine : public virtual BaseEngine {
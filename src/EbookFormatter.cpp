@@ -15,6 +15,9 @@ HtmlFormatterArgs *CreateFormatterArgsDoc(Doc doc, int dx, int dy, PoolAllocator
     HtmlFormatterArgs *args = new HtmlFormatterArgs();
     args->htmlStr = doc.GetHtmlData(args->htmlStrLen);
     CrashIf(!args->htmlStr);
+    // lazily loaded Mobi documents are decoded while they're being formatted
+    if (doc.AsMobi())
+        args->htmlSource = doc.AsMobi();
     args->SetFontName(L"Georgia");
     args->fontSize = 12.5f;
     args->pageDx = (REAL)dx;
@@ -178,7 +181,7 @@ void EpubFormatter::HandleTagPagebreak(HtmlToken *t)
         currPage->instructions.Append(DrawInstr::Anchor(attr->val, attr->valLen, bbox));
         pagePath.Set(str::DupN(attr->val, attr->valLen));
         // reset CSS style rules for the new document
-        styleRules.Reset();
+        ResetStyleRules();
     }
 }
 
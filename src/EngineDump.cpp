@@ -311,36 +311,87 @@ void DumpData(BaseEngine *engine, bool fullDump)
     Out("</EngineDump>\n");
 }
 
-void RenderDocument(BaseEngine *engine, const WCHAR *renderPath, float zoom=1.f, bool silent=false)
+void SaveRenderedBitmap(RenderedBitmap *bmp, const WCHAR *bmpPath)
+{
+    if (str::EndsWithI(bmpPath, L".png")) {
+        Bitmap gbmp(bmp->GetBitmap(), NULL);
+        CLSID pngEncId = GetEncoderClsid(L"image/png");
+        gbmp.Save(bmpPath, &pngEncId);
+    }
+    else if (str::EndsWithI(bmpPath, L".bmp")) {
+        size_t bmpDataLen;
+        ScopedMem<char> bmpData((char *)SerializeBitmap(bmp->GetBitmap(), &bmpDataLen));
+        if (bmpData)
+            file::WriteAll(bmpPath, bmpData, bmpDataLen);
+    }
+    else { // render as TGA for all other file extensions
+        size_t tgaDataLen;
+        ScopedMem<unsigned char> tgaData(tga::SerializeBitmap(bmp->GetBitmap(), &tgaDataLen));
+        if (tgaData)
+            file::WriteAll(bmpPath, tgaData, tgaDataLen);
+    }
+}
+
+// renders a page in horizontal bands and stitches them back together
+// (the way pages are rendered when printing as image)
+RenderedBitmap *RenderBanded(BaseEngine *engine, int pageNo, float zoom, int bandDy)
+{
+    RectI full = engine->Transform(engine->PageMediabox(pageNo), pageNo, zoom, 0).Round();
+    HDC hDC = GetDC(NULL);
+    HDC hDCMem = CreateCompatibleDC(hDC);
+    HBITMAP hbmp = CreateCompatibleBitmap(hDC, full.dx, full.dy);
+    HGDIOBJ oldBmp = SelectObject(hDCMem, hbmp);
+    bool ok = hbmp != NULL;
+    for (int y = 0; y < full.dy && ok; y += bandDy) {
+        RectI band(full.x, full.y + y, full.dx, min(bandDy, full.dy - y));
+        RectD pageRect = engine->Transform(band.Convert<double>(), pageNo, zoom, 0, true);
+        RenderedBitmap *bmp = engine->RenderBitmap(pageNo, zoom, 0, &pageRect);
+        ok = bmp && bmp->StretchDIBits(hDCMem, RectI(PointI(0, y), bmp->Size()));
+        delete bmp;
+    }
+    SelectObject(hDCMem, oldBmp);
+    DeleteDC(hDCMem);
+    ReleaseDC(NULL, hDC);
+    if (!ok) {
+        DeleteObject(hbmp);
+        return NULL;
+    }
+    return new RenderedBitmap(hbmp, full.Size());
+}
+
+void RenderDocument(BaseEngine *engine, const WCHAR *renderPath, float zoom=1.f, int bandDy=0, bool silent=false)
 {
     for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
-        RenderedBitmap *bmp = engine->RenderBitmap(pageNo, zoom, 0);
+        RenderedBitmap *bmp;
+        if (bandDy > 0)
+            bmp = RenderBanded(engine, pageNo, zoom, bandDy);
+        else
+            bmp = engine->RenderBitmap(pageNo, zoom, 0);
         if (!bmp || silent) {
             delete bmp;
             continue;
         }
         ScopedMem<WCHAR> pageBmpPath(str::Format(renderPath, pageNo));
-        if (str::EndsWithI(pageBmpPath, L".png")) {
-            Bitmap gbmp(bmp->GetBitmap(), NULL);
-            CLSID pngEncId = GetEncoderClsid(L"image/png");
-            gbmp.Save(pageBmpPath, &pngEncId);
-        }
-        else if (str::EndsWithI(pageBmpPath, L".bmp")) {
-            size_t bmpDataLen;
-            ScopedMem<char> bmpData((char *)SerializeBitmap(bmp->GetBitmap(), &bmpDataLen));
-            if (bmpData)
-                file::WriteAll(pageBmpPath, bmpData, bmpDataLen);
-        }
-        else { // render as TGA for all other file extensions
-            size_t tgaDataLen;
-            ScopedMem<unsigned char> tgaData(tga::SerializeBitmap(bmp->GetBitmap(), &tgaDataLen));
-            if (tgaData)
-                file::WriteAll(pageBmpPath, tgaData, tgaDataLen);
-        }
+        SaveRenderedBitmap(bmp, pageBmpPath);
         delete bmp;
     }
 }
 
+// creates a thumbnail the same way as the Windows Explorer previewer does
+// (i.e. from an embedded thumbnail, if available, or from rendering the first page)
+void RenderThumbnail(BaseEngine *engine, const WCHAR *thumbPath, int size, bool silent=false)
+{
+    RenderedBitmap *bmp = engine->GetThumbnail(SizeI(size, size));
+    if (!bmp) {
+        RectD page = engine->Transform(engine->PageMediabox(1), 1, 1.0, 0);
+        float zoom = size / (float)max(page.dx, page.dy);
+        bmp = engine->RenderBitmap(1, zoom, 0, NULL, Target_Export);
+    }
+    if (bmp && !silent)
+        SaveRenderedBitmap(bmp, thumbPath);
+    delete bmp;
+}
+
 class PasswordHolder : public PasswordUI {
     const WCHAR *password;
 public:
@@ -362,7 +413,7 @@ int main(int argc, char **argv)
     ParseCmdLine(GetCommandLine(), argList);
     if (argList.Count() < 2) {
 Usage:
-        ErrOut("%s <filename> [-pwd <password>][-full][-render <path-%%d.tga>]\n",
+        ErrOut("%s <filename> [-pwd <password>][-full][-render <path-%%d.tga>][-thumb <path.tga>]\n",
             path::GetBaseName(argList.At(0)));
         return 2;
     }
@@ -385,6 +436,8 @@ Usage:
     WCHAR *password = NULL;
     WCHAR *renderPath = NULL;
     float renderZoom = 1.f;
+    WCHAR *thumbPath = NULL;
+    int bandDy = 0;
     bool useAlternateHandlers = false;
     bool loadOnly = false, silent = false;
     int breakAlloc = 0;
@@ -403,6 +456,12 @@ Usage:
             }
             renderPath = argList.At(++i);
         }
+        // -bands renders pages in bands of the given height (for comparing with -render)
+        else if (str::Eq(argList.At(i), L"-bands") && i + 1 < argList.Count())
+            bandDy = _wtoi(argList.At(++i));
+        // -thumb only loads what's needed for creating a thumbnail
+        else if (str::Eq(argList.At(i), L"-thumb") && i + 1 < argList.Count())
+            thumbPath = argList.At(++i);
         // -alt is for debugging alternate rendering methods
         else if (str::Eq(argList.At(i), L"-alt"))
             useAlternateHandlers = true;
@@ -439,18 +498,24 @@ Usage:
     ScopedGdiPlus gdiPlus;
     DocType engineType;
     PasswordHolder pwdUI(password);
-    BaseEngine *engine = EngineManager::CreateEngine(filePath, &pwdUI, &engineType, useChm2Engine);
+    BaseEngine *engine = EngineManager::CreateEngine(filePath, &pwdUI, &engineType, useChm2Engine, true, thumbPath != NULL);
     if (!engine) {
         ErrOut("Error: Couldn't create an engine for %s!\n", path::GetBaseName(filePath));
         return 1;
     }
+    if (thumbPath) {
+        // engines loaded for thumbnails only reliably support the first page
+        RenderThumbnail(engine, thumbPath, 256, silent);
+        delete engine;
+        return 0;
+    }
     Vec<PageAnnotation> *userAnnots = LoadFileModifications(engine->FileName());
     engine->UpdateUserAnnotations(userAnnots);
     delete userAnnots;
     if (!loadOnly)
         DumpData(engine, fullDump);
     if (renderPath)
-        RenderDocument(engine, renderPath, renderZoom, silent);
+        RenderDocument(engine, renderPath, renderZoom, bandDy, silent);
     delete engine;
 
 #ifdef DEBUG
@@ -46,6 +46,62 @@ class FileHistory {
     // owned by gGlobalPrefs->fileStates
     Vec<DisplayState *> *states;
 
+    // open addressing hash table of all states, keyed by their
+    // (case-insensitive) file path, so that Find doesn't have to
+    // compare paths against the entire history. It's rebuilt lazily
+    // whenever states are removed or renamed.
+    Vec<DisplayState *> index;
+    size_t indexedCount;
+    bool indexDirty;
+
+    static uint32_t HashPath(const WCHAR *filePath) {
+        // FNV-1a over lower-cased characters (consistent with str::EqI)
+        uint32_t hash = 2166136261;
+        for (const WCHAR *c = filePath; *c; c++) {
+            hash ^= (uint32_t)towlower(*c);
+            hash *= 16777619;
+        }
+        return hash;
+    }
+
+    size_t FindSlot(const WCHAR *filePath) const {
+        size_t mask = index.Count() - 1;
+        size_t i = HashPath(filePath) & mask;
+        for (; index.At(i) && !str::EqI(index.At(i)->filePath, filePath); i = (i + 1) & mask);
+        return i;
+    }
+
+    void AddToIndex(DisplayState *state) {
+        if (indexDirty)
+            return;
+        // keep the table at most half full
+        if ((indexedCount + 1) * 2 > index.Count()) {
+            indexDirty = true;
+            return;
+        }
+        // indexedCount also includes states without a path and
+        // duplicates (for which Find returns the first match)
+        indexedCount++;
+        if (!state->filePath)
+            return;
+        size_t slot = FindSlot(state->filePath);
+        if (!index.At(slot))
+            index.At(slot) = state;
+    }
+
+    void RebuildIndex() {
+        size_t count = 64;
+        while (count < states->Count() * 2 + 2)
+            count *= 2;
+        index.Reset();
+        index.AppendBlanks(count);
+        indexedCount = 0;
+        indexDirty = false;
+        for (size_t i = 0; i < states->Count(); i++) {
+            AddToIndex(states->At(i));
+        }
+    }
+
     // sorts the most often used files first
     static int cmpOpenCount(const void *a, const void *b) {
         DisplayState *dsA = *(DisplayState **)a;
@@ -64,7 +120,7 @@ class FileHistory {
     }
 
 public:
-    FileHistory() : states(NULL) { }
+    FileHistory() : states(NULL), indexedCount(0), indexDirty(true) { }
     ~FileHistory() { }
 
     void Clear(bool keepFavorites) {
@@ -76,10 +132,17 @@ public:
             DeleteDisplayState(states->At(i));
         }
         states->Reset();
+        indexDirty = true;
     }
 
-    void Append(DisplayState *state) { states->Append(state); }
-    void Remove(DisplayState *state) { states->Remove(state); }
+    void Append(DisplayState *state) { states->Append(state); AddToIndex(state); }
+    void Remove(DisplayState *state) { states->Remove(state); indexDirty = true; }
+
+    // use this instead of modifying state->filePath directly
+    void UpdateFilePath(DisplayState *state, const WCHAR *filePath) {
+        str::ReplacePtr(&state->filePath, filePath);
+        indexDirty = true;
+    }
 
     DisplayState *Get(size_t index) const {
         if (index < states->Count())
@@ -87,15 +150,16 @@ public:
         return NULL;
     }
 
-    DisplayState *Find(const WCHAR *filePath, size_t *idxOut=NULL) const {
-        for (size_t i = 0; i < states->Count(); i++) {
-            if (str::EqI(states->At(i)->filePath, filePath)) {
-                if (idxOut)
-                    *idxOut = i;
-                return states->At(i);
-            }
-        }
-        return NULL;
+    DisplayState *Find(const WCHAR *filePath, size_t *idxOut=NULL) {
+        if (!filePath)
+            return NULL;
+        // a mismatching count means that the history was modified behind our back
+        if (indexDirty || indexedCount != states->Count())
+            RebuildIndex();
+        DisplayState *state = index.At(FindSlot(filePath));
+        if (state && idxOut)
+            *idxOut = states->Find(state);
+        return state;
     }
 
     DisplayState *MarkFileLoaded(const WCHAR *filePath) {
@@ -107,12 +171,14 @@ public:
         if (!state) {
             state = NewDisplayState(filePath);
             state->useDefaultState = true;
+            states->InsertAt(0, state);
+            AddToIndex(state);
         }
         else {
             states->Remove(state);
             state->isMissing = false;
+            states->InsertAt(0, state);
         }
-        states->InsertAt(0, state);
         state->openCount++;
         return state;
     }
@@ -192,11 +258,15 @@ public:
             else
                 continue;
             DeleteDisplayState(state);
+            indexDirty = true;
         }
     }
 
     void UpdateStatesSource(Vec<DisplayState *> *states) {
         this->states = states;
+        index.Reset();
+        indexedCount = 0;
+        indexDirty = true;
     }
 };
 
@@ -175,7 +175,7 @@ HtmlFormatter::HtmlFormatter(HtmlFormatterArgs *args) :
     keepTagNesting(false)
 {
     currReparseIdx = args->reparseIdx;
-    htmlParser = new HtmlPullParser(args->htmlStr, args->htmlStrLen);
+    htmlParser = new HtmlPullParser(args->htmlStr, args->htmlStrLen, args->htmlSource);
     htmlParser->SetCurrPosOff(currReparseIdx);
     CrashIf(!ValidReparseIdx(currReparseIdx, htmlParser));
 
@@ -943,34 +943,89 @@ void HtmlFormatter::HandleTagPre(HtmlToken *t)
     }
 }
 
-StyleRule *HtmlFormatter::FindStyleRule(HtmlTag tag, const char *clazz, size_t clazzLen)
+static size_t HashStyleKey(HtmlTag tag, uint32_t classHash)
 {
-    uint32_t classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
-    for (size_t i = 0; i < styleRules.Count(); i++) {
-        StyleRule& rule = styleRules.At(i);
+    return (size_t)(classHash ^ ((uint32_t)tag * 2654435761U));
+}
+
+size_t StyleRuleTable::FindSlot(HtmlTag tag, uint32_t classHash) const
+{
+    CrashIf(slots.Count() == 0);
+    size_t mask = slots.Count() - 1;
+    size_t i = HashStyleKey(tag, classHash) & mask;
+    for (; slots.At(i) != 0; i = (i + 1) & mask) {
+        const StyleRule& rule = rules.At(slots.At(i) - 1);
         if (tag == rule.tag && classHash == rule.classHash)
-            return &rule;
+            break;
+    }
+    return i;
+}
+
+StyleRule *StyleRuleTable::Find(HtmlTag tag, uint32_t classHash)
+{
+    if (0 == rules.Count())
+        return NULL;
+    size_t ix = slots.At(FindSlot(tag, classHash));
+    return ix != 0 ? &rules.At(ix - 1) : NULL;
+}
+
+StyleRule *StyleRuleTable::Add(StyleRule& rule)
+{
+    rules.Append(rule);
+    // keep the table at most half full
+    if (rules.Count() * 2 > slots.Count()) {
+        size_t count = max(slots.Count() * 2, (size_t)32);
+        slots.Reset();
+        slots.AppendBlanks(count);
+        for (size_t i = 0; i < rules.Count(); i++) {
+            slots.At(FindSlot(rules.At(i).tag, rules.At(i).classHash)) = i + 1;
+        }
+    }
+    else {
+        slots.At(FindSlot(rule.tag, rule.classHash)) = rules.Count();
     }
-    return NULL;
+    return &rules.Last();
+}
+
+void HtmlFormatter::ResetStyleRules()
+{
+    styleRules.Reset();
+    computedStyles.Reset();
+}
+
+StyleRule *HtmlFormatter::FindStyleRule(HtmlTag tag, const char *clazz, size_t clazzLen)
+{
+    uint32_t classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
+    return styleRules.Find(tag, classHash);
 }
 
 StyleRule HtmlFormatter::ComputeStyleRule(HtmlToken *t)
 {
-    StyleRule rule;
-    // get style rules ordered by specificity
-    StyleRule *prevRule = FindStyleRule(Tag_Body, NULL, 0);
-    if (prevRule) rule.Merge(*prevRule);
-    prevRule = FindStyleRule(Tag_Any, NULL, 0);
-    if (prevRule) rule.Merge(*prevRule);
-    prevRule = FindStyleRule(t->tag, NULL, 0);
-    if (prevRule) rule.Merge(*prevRule);
     // TODO: support multiple class names
     AttrInfo *attr = t->GetAttrByName("class");
-    if (attr) {
-        prevRule = FindStyleRule(Tag_Any, attr->val, attr->valLen);
+    uint32_t classHash = attr ? MurmurHash2(attr->val, attr->valLen) : 0;
+    StyleRule *cached = computedStyles.Find(t->tag, classHash);
+    StyleRule rule;
+    if (cached) {
+        rule = *cached;
+    }
+    else {
+        // get style rules ordered by specificity
+        StyleRule *prevRule = styleRules.Find(Tag_Body, 0);
+        if (prevRule) rule.Merge(*prevRule);
+        prevRule = styleRules.Find(Tag_Any, 0);
         if (prevRule) rule.Merge(*prevRule);
-        prevRule = FindStyleRule(t->tag, attr->val, attr->valLen);
+        prevRule = styleRules.Find(t->tag, 0);
         if (prevRule) rule.Merge(*prevRule);
+        if (attr) {
+            prevRule = styleRules.Find(Tag_Any, classHash);
+            if (prevRule) rule.Merge(*prevRule);
+            prevRule = styleRules.Find(t->tag, classHash);
+            if (prevRule) rule.Merge(*prevRule);
+        }
+        rule.tag = t->tag;
+        rule.classHash = classHash;
+        computedStyles.Add(rule);
     }
     attr = t->GetAttrByName("style");
     if (attr) {
@@ -982,6 +1037,8 @@ StyleRule HtmlFormatter::ComputeStyleRule(HtmlToken *t)
 
 void HtmlFormatter::ParseStyleSheet(const char *data, size_t len)
 {
+    // the cascade has to be recomputed for the new rules
+    computedStyles.Reset();
     CssPullParser parser(data, len);
     while (parser.NextRule()) {
         StyleRule rule = StyleRule::Parse(&parser);
@@ -996,7 +1053,7 @@ void HtmlFormatter::ParseStyleSheet(const char *data, size_t len)
             else {
                 rule.tag = sel->tag;
                 rule.classHash = sel->clazz ? MurmurHash2(sel->clazz, sel->clazzLen) : 0;
-                styleRules.Append(rule);
+                styleRules.Add(rule);
             }
         }
     }
@@ -82,6 +82,22 @@ struct StyleRule {
     static StyleRule Parse(const char *s, size_t len);
 };
 
+// style rules hashed by tag and class (using open addressing)
+class StyleRuleTable {
+    Vec<StyleRule>  rules;
+    // index+1 into rules or 0 for empty slots
+    Vec<size_t>     slots;
+
+    size_t FindSlot(HtmlTag tag, uint32_t classHash) const;
+
+public:
+    StyleRule *Find(HtmlTag tag, uint32_t classHash);
+    // rule.tag and rule.classHash must be set and not yet be in the table
+    StyleRule *Add(StyleRule& rule);
+    void Reset() { rules.Reset(); slots.Reset(); }
+    size_t Count() const { return rules.Count(); }
+};
+
 struct DrawStyle {
     Font *font;
     AlignAttr align;
@@ -101,12 +117,14 @@ public:
     int             reparseIdx;
 };
 
+class HtmlDataSource;
+
 // just to pack args to HtmlFormatter
 class HtmlFormatterArgs {
 public:
     HtmlFormatterArgs() :
       pageDx(0), pageDy(0), fontName(NULL), fontSize(0),
-      textAllocator(NULL), htmlStr(0), htmlStrLen(0),
+      textAllocator(NULL), htmlStr(0), htmlStrLen(0), htmlSource(NULL),
       reparseIdx(0), measureAlgo(NULL)
     { }
 
@@ -137,6 +155,8 @@ public:
 
     const char *    htmlStr;
     size_t          htmlStrLen;
+    // if set, htmlStr is extended (in place) by htmlSource while formatting
+    HtmlDataSource *htmlSource;
 
     // we start parsing from htmlStr + reparseIdx
     int             reparseIdx;
@@ -202,6 +222,7 @@ protected:
     void  RevertStyleChange();
 
     void  ParseStyleSheet(const char *data, size_t len);
+    void  ResetStyleRules();
     StyleRule *FindStyleRule(HtmlTag tag, const char *clazz, size_t clazzLen);
     StyleRule ComputeStyleRule(HtmlToken *t);
 
@@ -241,7 +262,10 @@ protected:
     Vec<HtmlTag>        tagNesting;
     bool                keepTagNesting;
     // set from CSS and to be checked by the individual tag handlers
-    Vec<StyleRule>      styleRules;
+    StyleRuleTable      styleRules;
+    // cascaded style rules (from styleRules) for each combination
+    // of tag and class that has been seen since styleRules last changed
+    StyleRuleTable      computedStyles;
 
     // isntructions for the current line
     Vec<DrawInstr>      currLineInstr;
@@ -5,6 +5,7 @@
 #include "ImagesEngine.h"
 
 #include "FileUtil.h"
+#include "FzImgReader.h"
 using namespace Gdiplus;
 #include "GdiPlusUtil.h"
 #include "HtmlPullParser.h"
@@ -595,13 +596,11 @@ ImageDirEngine *ImageDirEngine::CreateFromFile(const WCHAR *fileName)
 
 ///// CbxEngine handles comic book files (either .cbz or .cbr) /////
 
-class CbxEngineImpl : public ImagesEngine, public CbxEngine, public json::ValueVisitor {
+class CbxEngineImpl : public ImagesEngine, public CbxEngine {
     friend CbxEngine;
 
 public:
-    CbxEngineImpl() : cbzFile(NULL) {
-        InitializeCriticalSection(&fileAccess);
-    }
+    CbxEngineImpl() : cbzFile(NULL), thumbnailOnly(false) { }
     virtual ~CbxEngineImpl();
 
     virtual CbxEngine *Clone() {
@@ -616,6 +615,7 @@ public:
         return NULL;
     }
     virtual RectD PageMediabox(int pageNo);
+    virtual RenderedBitmap *GetThumbnail(SizeI size);
 
     virtual WCHAR *GetProperty(DocumentProperty prop);
 
@@ -624,14 +624,15 @@ public:
     // TODO: return win::GetHwndDpi(HWND_DESKTOP) instead?
     virtual float GetFileDPI() const { return 96.0f; }
 
-    // json::ValueVisitor
-    virtual bool Visit(const char *path, const char *value, json::DataType type);
-
 protected:
     bool LoadCbzFile(const WCHAR *fileName);
     bool LoadCbzStream(IStream *stream);
     bool FinishLoadingCbz();
     void ParseComicInfoXml(const char *xmlData);
+    void ParseComicBookInfo(const char *jsonData);
+    void AddPublicationYear(int year);
+    void AddPublicationMonth(int month);
+    void AddAuthor(WCHAR *author);
     bool LoadCbrFile(const WCHAR *fileName);
 
     virtual Bitmap *LoadImage(int pageNo);
@@ -646,20 +647,19 @@ protected:
     ScopedMem<WCHAR> propModDate;
     ScopedMem<WCHAR> propCreator;
     ScopedMem<WCHAR> propSummary;
-    // temporary state needed for extracting metadata
-    ScopedMem<WCHAR> propAuthorTmp;
 
     // used for lazily loading page images (only supported for .cbz files)
-    CRITICAL_SECTION fileAccess;
+    // note: ZipFile allows concurrent extraction, so no locking is needed
     ZipFile *cbzFile;
     Vec<size_t> fileIdxs;
+
+    // metadata isn't needed for generating thumbnails
+    bool thumbnailOnly;
 };
 
 CbxEngineImpl::~CbxEngineImpl()
 {
     delete cbzFile;
-
-    DeleteCriticalSection(&fileAccess);
 }
 
 RectD CbxEngineImpl::PageMediabox(int pageNo)
@@ -683,6 +683,38 @@ RectD CbxEngineImpl::PageMediabox(int pageNo)
     return mediaboxes.At(pageNo - 1);
 }
 
+// JPEG images can be decoded at 1/2, 1/4 or 1/8 of their size, which is
+// considerably faster than decoding them at full size and then scaling them down
+RenderedBitmap *CbxEngineImpl::GetThumbnail(SizeI size)
+{
+    if (!cbzFile || pages.At(0))
+        return NULL;
+
+    size_t len;
+    ScopedMem<char> bmpData(GetImageData(1, len));
+    if (!bmpData || !str::StartsWith(bmpData.Get(), "\xFF\xD8"))
+        return NULL;
+
+    Size imgSize = BitmapSizeFromData(bmpData, len);
+    int scaleDown = 0;
+    while (scaleDown < 3 && ((imgSize.Width >> (scaleDown + 1)) >= size.dx ||
+                             (imgSize.Height >> (scaleDown + 1)) >= size.dy)) {
+        scaleDown++;
+    }
+    if (0 == scaleDown)
+        return NULL;
+
+    HBITMAP hbmp;
+    Bitmap *bmp = fitz::ImageFromData(bmpData, len, scaleDown);
+    if (!bmp || bmp->GetHBITMAP((ARGB)Color::White, &hbmp) != Ok) {
+        delete bmp;
+        return NULL;
+    }
+    SizeI bmpSize(bmp->GetWidth(), bmp->GetHeight());
+    delete bmp;
+    return new RenderedBitmap(hbmp, bmpSize);
+}
+
 Bitmap *CbxEngineImpl::LoadImage(int pageNo)
 {
     assert(1 <= pageNo && pageNo <= PageCount());
@@ -747,12 +779,14 @@ bool CbxEngineImpl::FinishLoadingCbz()
     }
     assert(allFileNames.Count() == cbzFile->GetFileCount());
 
-    ScopedMem<char> metadata(cbzFile->GetFileDataByName(L"ComicInfo.xml"));
-    if (metadata)
-        ParseComicInfoXml(metadata);
-    metadata.Set(cbzFile->GetComment());
-    if (metadata)
-        json::Parse(metadata, this);
+    if (!thumbnailOnly) {
+        ScopedMem<char> metadata(cbzFile->GetFileDataByName(L"ComicInfo.xml"));
+        if (metadata)
+            ParseComicInfoXml(metadata);
+        metadata.Set(cbzFile->GetComment());
+        if (metadata)
+            ParseComicBookInfo(metadata);
+    }
 
     Vec<const WCHAR *> pageFileNames;
     for (const WCHAR **fn = allFileNames.IterStart(); fn; fn = allFileNames.IterNext()) {
@@ -794,72 +828,88 @@ void CbxEngineImpl::ParseComicInfoXml(const char *xmlData)
         if (tok->NameIs("Title")) {
             ScopedMem<char> value(GetTextContent(parser));
             if (value)
-                Visit("/ComicBookInfo/1.0/title", value, json::Type_String);
+                propTitle.Set(str::conv::FromUtf8(value));
         }
         else if (tok->NameIs("Year")) {
             ScopedMem<char> value(GetTextContent(parser));
             if (value)
-                Visit("/ComicBookInfo/1.0/publicationYear", value, json::Type_Number);
+                AddPublicationYear(atoi(value));
         }
         else if (tok->NameIs("Month")) {
             ScopedMem<char> value(GetTextContent(parser));
             if (value)
-                Visit("/ComicBookInfo/1.0/publicationMonth", value, json::Type_Number);
+                AddPublicationMonth(atoi(value));
         }
         else if (tok->NameIs("Summary")) {
             ScopedMem<char> value(GetTextContent(parser));
             if (value)
-                Visit("/X-summary", value, json::Type_String);
-        }
-        else if (tok->NameIs("Writer")) {
-            ScopedMem<char> value(GetTextContent(parser));
-            if (value) {
-                Visit("/ComicBookInfo/1.0/credits[0]/person", value, json::Type_String);
-                Visit("/ComicBookInfo/1.0/credits[0]/primary", "true", json::Type_Bool);
-            }
+                propSummary.Set(str::conv::FromUtf8(value));
         }
-        else if (tok->NameIs("Penciller")) {
+        else if (tok->NameIs("Writer") || tok->NameIs("Penciller")) {
             ScopedMem<char> value(GetTextContent(parser));
-            if (value) {
-                Visit("/ComicBookInfo/1.0/credits[1]/person", value, json::Type_String);
-                Visit("/ComicBookInfo/1.0/credits[1]/primary", "true", json::Type_Bool);
-            }
+            if (value)
+                AddAuthor(str::conv::FromUtf8(value));
         }
     }
 }
 
+static WCHAR *GetJsonValue(json::Token *tok)
+{
+    ScopedMem<char> value(tok->GetValue());
+    return str::conv::FromUtf8(value);
+}
+
 // extract ComicBookInfo metadata
 // cf. http://code.google.com/p/comicbookinfo/
-bool CbxEngineImpl::Visit(const char *path, const char *value, json::DataType type)
+void CbxEngineImpl::ParseComicBookInfo(const char *jsonData)
 {
-    if (json::Type_String == type && str::Eq(path, "/ComicBookInfo/1.0/title"))
-        propTitle.Set(str::conv::FromUtf8(value));
-    else if (json::Type_Number == type && str::Eq(path, "/ComicBookInfo/1.0/publicationYear"))
-        propDate.Set(str::Format(L"%s/%d", propDate ? propDate : L"", atoi(value)));
-    else if (json::Type_Number == type && str::Eq(path, "/ComicBookInfo/1.0/publicationMonth"))
-        propDate.Set(str::Format(L"%d%s", atoi(value), propDate ? propDate : L""));
-    else if (json::Type_String == type && str::Eq(path, "/appID"))
-        propCreator.Set(str::conv::FromUtf8(value));
-    else if (json::Type_String == type && str::Eq(path, "/lastModified"))
-        propModDate.Set(str::conv::FromUtf8(value));
-    else if (json::Type_String == type && str::Eq(path, "/X-summary"))
-        propSummary.Set(str::conv::FromUtf8(value));
-    else if (str::StartsWith(path, "/ComicBookInfo/1.0/credits[")) {
-        int idx = -1;
-        const char *prop = str::Parse(path, "/ComicBookInfo/1.0/credits[%d]/", &idx);
-        if (prop) {
-            if (json::Type_String == type && str::Eq(prop, "person"))
-                propAuthorTmp.Set(str::conv::FromUtf8(value));
-            else if (json::Type_Bool == type && str::Eq(prop, "primary") &&
-                propAuthorTmp && !propAuthors.Contains(propAuthorTmp)) {
-                propAuthors.Append(propAuthorTmp.StealData());
-            }
+    json::PullParser parser(jsonData, str::Len(jsonData));
+    ScopedMem<WCHAR> author;
+    json::Token *tok;
+    while ((tok = parser.Next()) != NULL) {
+        if (json::Type_String == tok->type && parser.PathIs("/ComicBookInfo/1.0/title"))
+            propTitle.Set(GetJsonValue(tok));
+        else if (json::Type_Number == tok->type && parser.PathIs("/ComicBookInfo/1.0/publicationYear"))
+            AddPublicationYear(atoi(ScopedMem<char>(tok->GetValue())));
+        else if (json::Type_Number == tok->type && parser.PathIs("/ComicBookInfo/1.0/publicationMonth"))
+            AddPublicationMonth(atoi(ScopedMem<char>(tok->GetValue())));
+        else if (json::Type_String == tok->type && parser.PathIs("/appID"))
+            propCreator.Set(GetJsonValue(tok));
+        else if (json::Type_String == tok->type && parser.PathIs("/lastModified"))
+            propModDate.Set(GetJsonValue(tok));
+        else if (json::Type_String == tok->type && parser.PathIs("/X-summary"))
+            propSummary.Set(GetJsonValue(tok));
+        else if (json::Type_String == tok->type && parser.PathIs("/ComicBookInfo/1.0/credits[*]/person"))
+            author.Set(GetJsonValue(tok));
+        else if (json::Type_Bool == tok->type && parser.PathIs("/ComicBookInfo/1.0/credits[*]/primary") && author)
+            AddAuthor(author.StealData());
+        else
+            continue;
+        // stop parsing once we have all desired information
+        if (propTitle && propAuthors.Count() > 0 && propCreator &&
+            propDate && str::FindChar(propDate, '/') > propDate) {
+            break;
         }
-        return true;
     }
-    // stop parsing once we have all desired information
-    return !propTitle || propAuthors.Count() == 0 || !propCreator ||
-           !propDate || str::FindChar(propDate, '/') <= propDate;
+}
+
+void CbxEngineImpl::AddPublicationYear(int year)
+{
+    propDate.Set(str::Format(L"%s/%d", propDate ? propDate : L"", year));
+}
+
+void CbxEngineImpl::AddPublicationMonth(int month)
+{
+    propDate.Set(str::Format(L"%d%s", month, propDate ? propDate : L""));
+}
+
+// takes ownership of author
+void CbxEngineImpl::AddAuthor(WCHAR *author)
+{
+    if (!propAuthors.Contains(author))
+        propAuthors.Append(author);
+    else
+        free(author);
 }
 
 WCHAR *CbxEngineImpl::GetProperty(DocumentProperty prop)
@@ -1021,10 +1071,8 @@ bool CbxEngineImpl::LoadCbrFile(const WCHAR *file)
 
 char *CbxEngineImpl::GetImageData(int pageNo, size_t& len)
 {
-    if (cbzFile) {
-        ScopedCritSec scope(&fileAccess);
+    if (cbzFile)
         return cbzFile->GetFileDataByIdx(fileIdxs.At(pageNo - 1), &len);
-    }
     return NULL;
 }
 
@@ -1042,10 +1090,11 @@ bool CbxEngine::IsSupportedFile(const WCHAR *fileName, bool sniff)
            str::EndsWithI(fileName, L".rar");
 }
 
-CbxEngine *CbxEngine::CreateFromFile(const WCHAR *fileName)
+CbxEngine *CbxEngine::CreateFromFile(const WCHAR *fileName, bool thumbnailOnly)
 {
     assert(IsSupportedFile(fileName) || IsSupportedFile(fileName, true));
     CbxEngineImpl *engine = new CbxEngineImpl();
+    engine->thumbnailOnly = thumbnailOnly;
     bool ok = false;
     if (str::EndsWithI(fileName, L".cbz") || str::EndsWithI(fileName, L".zip") ||
         file::StartsWith(fileName, "PK\x03\x04")) {
@@ -1068,9 +1117,10 @@ CbxEngine *CbxEngine::CreateFromFile(const WCHAR *fileName)
     return engine;
 }
 
-CbxEngine *CbxEngine::CreateFromStream(IStream *stream)
+CbxEngine *CbxEngine::CreateFromStream(IStream *stream, bool thumbnailOnly)
 {
     CbxEngineImpl *engine = new CbxEngineImpl();
+    engine->thumbnailOnly = thumbnailOnly;
     // TODO: UnRAR doesn't support reading from arbitrary data streams
     if (!engine->LoadCbzStream(stream)) {
         delete engine;
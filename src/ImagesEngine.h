@@ -22,8 +22,9 @@ public:
 class CbxEngine : public virtual BaseEngine {
 public:
     static bool IsSupportedFile(const WCHAR *fileName, bool sniff=false);
-    static CbxEngine *CreateFromFile(const WCHAR *fileName);
-    static CbxEngine *CreateFromStream(IStream *stream);
+    // thumbnailOnly: skip loading metadata (only supported for .cbz files)
+    static CbxEngine *CreateFromFile(const WCHAR *fileName, bool thumbnailOnly=false);
+    static CbxEngine *CreateFromStream(IStream *stream, bool thumbnailOnly=false);
 };
 
 #endif
@@ -10,6 +10,7 @@
 using namespace Gdiplus;
 #include "GdiPlusUtil.h"
 #include "PalmDbReader.h"
+#include "ThreadUtil.h"
 #include "DebugLog.h"
 
 // Parse mobi format http://wiki.mobileread.com/wiki/MOBI
@@ -187,6 +188,13 @@ STATIC_ASSERT(kCdicHeaderLen == sizeof(CdicHeader), validCdicHeader);
 
 #define kCdicsMax 32
 
+// the expansion of a phrase which refers to other phrases
+struct HuffDicPhrase {
+    // 1 + offset into HuffDicDecompressor::phraseData, 0 if not expanded yet
+    uint32      start;
+    uint32      len;
+};
+
 class HuffDicDecompressor
 {
     uint32      cacheTable[kCacheItemCount];
@@ -201,8 +209,19 @@ class HuffDicDecompressor
 
     Vec<uint32> recursionGuard;
 
+    // phrases are usually used many times, so each one is only
+    // expanded once (allocated lazily, one entry per code)
+    HuffDicPhrase * phrases[kCdicsMax];
+    str::Str<char>  phraseData;
+
+    HuffDicPhrase *GetPhrase(uint16 dict, uint32 code);
+
 public:
     HuffDicDecompressor();
+    // copies the tables but not the expanded phrases,
+    // so that the copy can be used on a different thread
+    HuffDicDecompressor(const HuffDicDecompressor& other);
+    ~HuffDicDecompressor();
 
     bool SetHuffData(uint8 *huffData, size_t huffDataLen);
     bool AddCdicData(uint8 *cdicData, uint32 cdicDataLen);
@@ -210,7 +229,36 @@ public:
     bool DecodeOne(uint32 code, str::Str<char>& dst);
 };
 
-HuffDicDecompressor::HuffDicDecompressor() : codeLength(0), dictsCount(0) { }
+HuffDicDecompressor::HuffDicDecompressor() : codeLength(0), dictsCount(0)
+{
+    ZeroMemory(phrases, sizeof(phrases));
+}
+
+HuffDicDecompressor::HuffDicDecompressor(const HuffDicDecompressor& other) :
+    codeLength(other.codeLength), dictsCount(other.dictsCount)
+{
+    memcpy(cacheTable, other.cacheTable, sizeof(cacheTable));
+    memcpy(baseTable, other.baseTable, sizeof(baseTable));
+    memcpy(dicts, other.dicts, sizeof(dicts));
+    memcpy(dictSize, other.dictSize, sizeof(dictSize));
+    ZeroMemory(phrases, sizeof(phrases));
+}
+
+HuffDicDecompressor::~HuffDicDecompressor()
+{
+    for (size_t i = 0; i < dictsCount; i++) {
+        free(phrases[i]);
+    }
+}
+
+HuffDicPhrase *HuffDicDecompressor::GetPhrase(uint16 dict, uint32 code)
+{
+    if (!phrases[dict])
+        phrases[dict] = AllocArray<HuffDicPhrase>((size_t)1 << codeLength);
+    if (!phrases[dict])
+        return NULL;
+    return &phrases[dict][code];
+}
 
 bool HuffDicDecompressor::DecodeOne(uint32 code, str::Str<char>& dst)
 {
@@ -234,14 +282,25 @@ bool HuffDicDecompressor::DecodeOne(uint32 code, str::Str<char>& dst)
     }
 
     if (!(symLen & 0x8000)) {
+        HuffDicPhrase *phrase = GetPhrase(dict, code);
+        if (phrase && phrase->start) {
+            dst.Append(phraseData.Get() + phrase->start - 1, phrase->len);
+            return true;
+        }
         if (recursionGuard.Contains(code)) {
             lf("infinite recursion");
             return false;
         }
         recursionGuard.Push(code);
+        size_t start = dst.Size();
         if (!Decompress(p, symLen, dst))
             return false;
         recursionGuard.Pop();
+        if (phrase) {
+            phrase->start = (uint32)phraseData.Size() + 1;
+            phrase->len = (uint32)(dst.Size() - start);
+            phraseData.Append(dst.Get() + start, phrase->len);
+        }
     } else {
         symLen &= 0x7fff;
         if (symLen > 127) {
@@ -460,8 +519,10 @@ MobiDoc::MobiDoc(const WCHAR *filePath) :
     fileName(str::Dup(filePath)), pdbReader(NULL),
     docType(Pdb_Unknown), docRecCount(0), compressionType(0), docUncompressedSize(0),
     doc(NULL), multibyte(false), trailersCount(0), imageFirstRec(0), coverImageRec(0),
-    imagesCount(0), images(NULL), huffDic(NULL), textEncoding(CP_UTF8)
+    imagesCount(0), images(NULL), huffDic(NULL), textEncoding(CP_UTF8),
+    lazyText(NULL), lazyTextLen(0), lazyTextCap(0), nextDocRec(0)
 {
+    InitializeCriticalSection(&lazyAccess);
 }
 
 MobiDoc::~MobiDoc()
@@ -470,10 +531,12 @@ MobiDoc::~MobiDoc()
     free(images);
     delete huffDic;
     delete doc;
+    free(lazyText);
     delete pdbReader;
     for (size_t i = 0; i < props.Count(); i++) {
         free(props.At(i).value);
     }
+    DeleteCriticalSection(&lazyAccess);
 }
 
 bool MobiDoc::ParseHeader()
@@ -769,7 +832,7 @@ static size_t GetRealRecordSize(uint8 *recData, size_t recLen, size_t trailersCo
 
 // Load a given record of a document into strOut, uncompressing if necessary.
 // Returns false if error.
-bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut)
+bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut, HuffDicDecompressor *huffDic)
 {
     size_t recSize;
     const char *recData = pdbReader->GetRecord(recNo, &recSize);
@@ -800,17 +863,145 @@ bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut)
     return false;
 }
 
-bool MobiDoc::LoadDocument()
+// decodes a range of records into a buffer of its own, using
+// its own copy of the HuffDic decompressor (if any)
+class MobiDecodeThread : public ThreadBase {
+public:
+    MobiDoc *           mb;
+    size_t              firstRec;
+    size_t              lastRec;
+    HuffDicDecompressor *huffDic;
+    str::Str<char>      text;
+    bool                ok;
+
+    MobiDecodeThread(MobiDoc *mb, size_t firstRec, size_t lastRec, HuffDicDecompressor *huffDic) :
+        ThreadBase("MobiDecodeThread"), mb(mb), firstRec(firstRec), lastRec(lastRec),
+        huffDic(huffDic), ok(false) { }
+    virtual ~MobiDecodeThread() { delete huffDic; }
+
+    virtual void Run() {
+        for (size_t i = firstRec; i <= lastRec; i++) {
+            if (!mb->LoadDocRecordIntoBuffer(i, text, huffDic))
+                return;
+        }
+        ok = true;
+    }
+};
+
+#define kMinRecordsPerThread 16
+#define kMaxDecodeThreads    4
+
+// Decompressing is what takes most of the time for larger documents, so
+// the records are split into ranges that are decoded in parallel and then
+// concatenated in order
+bool MobiDoc::LoadDocRecords(bool parallel)
+{
+    size_t threadsCount = 1;
+    if (parallel && compressionType != COMPRESSION_NONE) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        threadsCount = min(min((size_t)si.dwNumberOfProcessors, (size_t)kMaxDecodeThreads),
+                           docRecCount / kMinRecordsPerThread);
+    }
+    if (threadsCount <= 1) {
+        for (size_t i = 1; i <= docRecCount; i++) {
+            if (!LoadDocRecordIntoBuffer(i, *doc, huffDic))
+                return false;
+        }
+        return true;
+    }
+
+    Vec<MobiDecodeThread *> threads;
+    size_t firstRec = 1;
+    for (size_t i = 0; i < threadsCount; i++) {
+        size_t lastRec = docRecCount * (i + 1) / threadsCount;
+        HuffDicDecompressor *threadHuffDic = huffDic ? new HuffDicDecompressor(*huffDic) : NULL;
+        MobiDecodeThread *thread = new MobiDecodeThread(this, firstRec, lastRec, threadHuffDic);
+        thread->Start();
+        threads.Append(thread);
+        firstRec = lastRec + 1;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < threads.Count(); i++) {
+        MobiDecodeThread *thread = threads.At(i);
+        thread->Join();
+        if (!ok)
+            continue;
+        if (thread->ok) {
+            doc->Append(thread->text.Get(), thread->text.Size());
+            continue;
+        }
+        // the thread failed to start or to decode a record, so decode the range
+        // again on this thread (which will fail at the same record, if any)
+        for (size_t rec = thread->firstRec; rec <= thread->lastRec && ok; rec++) {
+            ok = LoadDocRecordIntoBuffer(rec, *doc, huffDic);
+        }
+    }
+    DeleteVecMembers(threads);
+    return ok;
+}
+
+// text records decode to at most maxRecSize bytes, which is usually 4096
+// (lazily decoded text is cut off if the records exceed this on average)
+#define kDocRecSizeMax 4096
+
+// Decodes the next text record of a lazily loaded document and appends it
+// to lazyText, cleaning it up the same way LoadDocument does for all records
+bool MobiDoc::LoadNextDocRecord()
+{
+    str::Str<char> text(kDocRecSizeMax);
+    if (!LoadDocRecordIntoBuffer(nextDocRec, text, huffDic))
+        return false;
+    nextDocRec++;
+    char *s = text.Get(), *end = s + text.Size();
+    while ((s = (char *)memchr(s, '\0', end - s)) != NULL) {
+        *s = ' ';
+    }
+    if (textEncoding != CP_UTF8) {
+        char *textUtf8 = str::ToMultiByte(text.Get(), textEncoding, CP_UTF8);
+        if (textUtf8) {
+            text.Reset();
+            text.AppendAndFree(textUtf8);
+        }
+    }
+    if (text.Size() > lazyTextCap - lazyTextLen) {
+        lf("text records decode to more text than expected");
+        return false;
+    }
+    memcpy(lazyText + lazyTextLen, text.Get(), text.Size() + 1);
+    lazyTextLen += text.Size();
+    return true;
+}
+
+bool MobiDoc::LoadDocument(bool parallelDecode, bool lazy)
 {
     if (!ParseHeader())
         return false;
 
+    // text in a multi-byte code page can only be converted as a whole
+    // (characters might be split between records)
+    CPINFO cpInfo;
+    if (lazy && (CP_UTF8 == textEncoding || GetCPInfo(textEncoding, &cpInfo) && 1 == cpInfo.MaxCharSize)) {
+        // converting from a code page to UTF-8 can triple the text's size
+        // (only the memory actually used by decoded text is touched)
+        lazyTextCap = max(docUncompressedSize, docRecCount * kDocRecSizeMax);
+        if (textEncoding != CP_UTF8)
+            lazyTextCap *= 3;
+        lazyText = (char *)malloc(lazyTextCap + 1);
+        if (lazyText) {
+            lazyText[0] = '\0';
+            nextDocRec = 1;
+            // decode the first record right away so that broken
+            // documents fail to load as they do without lazy loading
+            return 0 == docRecCount || LoadNextDocRecord();
+        }
+    }
+
     assert(!doc);
     doc = new str::Str<char>(docUncompressedSize);
-    for (size_t i = 1; i <= docRecCount; i++) {
-        if (!LoadDocRecordIntoBuffer(i, *doc))
-            return false;
-    }
+    if (!LoadDocRecords(parallelDecode))
+        return false;
     // replace unexpected \0 with spaces
     // cf. https://code.google.com/p/sumatrapdf/issues/detail?id=2529
     char *s = doc->Get(), *end = s + doc->Size();
@@ -829,10 +1020,38 @@ bool MobiDoc::LoadDocument()
 
 char *MobiDoc::GetBookHtmlData(size_t& lenOut) const
 {
+    if (lazyText) {
+        lenOut = lazyTextLen;
+        return lazyText;
+    }
     lenOut = doc->Size();
     return doc->Get();
 }
 
+size_t MobiDoc::GetBookHtmlSize() const
+{
+    return lazyText ? lazyTextLen : doc->Size();
+}
+
+size_t MobiDoc::LoadBookHtml(size_t minSize)
+{
+    // text can be decoded from several threads (e.g. from the UI
+    // thread in EbookController::SetDoc and from formatting threads)
+    ScopedCritSec scope(&lazyAccess);
+    while (lazyText && lazyTextLen < minSize && nextDocRec <= docRecCount) {
+        if (!LoadNextDocRecord()) {
+            // the text ends before the first broken record
+            nextDocRec = docRecCount + 1;
+        }
+    }
+    return GetBookHtmlSize();
+}
+
+size_t MobiDoc::LoadMore()
+{
+    return LoadBookHtml(GetBookHtmlSize() + 1);
+}
+
 WCHAR *MobiDoc::GetProperty(DocumentProperty prop)
 {
     for (size_t i = 0; i < props.Count(); i++) {
@@ -856,10 +1075,20 @@ bool MobiDoc::IsSupportedFile(const WCHAR *fileName, bool sniff)
            str::EndsWithI(fileName, L".prc");
 }
 
-MobiDoc *MobiDoc::CreateFromFile(const WCHAR *fileName)
+MobiDoc *MobiDoc::CreateFromFile(const WCHAR *fileName, bool parallelDecode)
+{
+    MobiDoc *mb = new MobiDoc(fileName);
+    if (!mb->LoadDocument(parallelDecode)) {
+        delete mb;
+        return NULL;
+    }
+    return mb;
+}
+
+MobiDoc *MobiDoc::CreateFromFileLazy(const WCHAR *fileName)
 {
     MobiDoc *mb = new MobiDoc(fileName);
-    if (!mb->LoadDocument()) {
+    if (!mb->LoadDocument(true, true)) {
         delete mb;
         return NULL;
     }
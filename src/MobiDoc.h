@@ -5,6 +5,7 @@
 #define MobiDoc_h
 
 #include "EbookBase.h"
+#include "HtmlPullParser.h"
 
 class PdbReader;
 class HuffDicDecompressor;
@@ -12,7 +13,7 @@ struct ImageData;
 
 enum PdbDocType { Pdb_Unknown, Pdb_Mobipocket, Pdb_PalmDoc, Pdb_TealDoc };
 
-class MobiDoc
+class MobiDoc : public HtmlDataSource
 {
     WCHAR *             fileName;
 
@@ -39,15 +40,28 @@ class MobiDoc
     };
     Vec<Metadata>       props;
 
+    // for documents loaded with CreateFromFileLazy, text records are only
+    // decoded once more text is needed and are appended to lazyText, which
+    // is allocated at its maximum size so that it never moves
+    char *              lazyText;
+    size_t              lazyTextLen;
+    size_t              lazyTextCap;
+    size_t              nextDocRec;
+    CRITICAL_SECTION    lazyAccess;
+
     MobiDoc(const WCHAR *filePath);
 
     bool    ParseHeader();
-    bool    LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut);
+    bool    LoadDocRecordIntoBuffer(size_t recNo, str::Str<char>& strOut, HuffDicDecompressor *huffDic);
+    bool    LoadDocRecords(bool parallel);
     void    LoadImages();
     bool    LoadImage(size_t imageNo);
-    bool    LoadDocument();
+    bool    LoadNextDocRecord();
+    bool    LoadDocument(bool parallelDecode, bool lazy=false);
     bool    DecodeExthHeader(const char *data, size_t dataLen);
 
+    friend class MobiDecodeThread;
+
 public:
     str::Str<char> *    doc;
 
@@ -55,8 +69,13 @@ public:
 
     ~MobiDoc();
 
+    // for lazily loaded documents, this is only the text decoded so far
     char *              GetBookHtmlData(size_t& lenOut) const;
-    size_t              GetBookHtmlSize() const { return doc->Size(); }
+    size_t              GetBookHtmlSize() const;
+    // decodes text records until at least minSize bytes of text are
+    // available (or all records have been decoded); returns the text's size
+    size_t              LoadBookHtml(size_t minSize);
+    virtual size_t      LoadMore();
     ImageData *         GetCoverImage();
     ImageData *         GetImage(size_t imgRecIndex) const;
     const WCHAR *       GetFileName() const { return fileName; }
@@ -64,7 +83,12 @@ public:
     PdbDocType          GetDocType() const { return docType; }
 
     static bool         IsSupportedFile(const WCHAR *fileName, bool sniff=false);
-    static MobiDoc *    CreateFromFile(const WCHAR *fileName);
+    // parallelDecode=false is for testing that decoding records
+    // on several threads produces the same document
+    static MobiDoc *    CreateFromFile(const WCHAR *fileName, bool parallelDecode=true);
+    // text is only decoded as it's needed (cf. LoadBookHtml and LoadMore), so
+    // that formatting can start after decoding the first few records
+    static MobiDoc *    CreateFromFileLazy(const WCHAR *fileName);
 };
 
 // for testing MobiFormatter
@@ -29,6 +29,8 @@ extern "C" {
 
 // maximum amount of memory that MuPDF should use per fz_context store
 #define MAX_CONTEXT_MEMORY  (256 * 1024 * 1024)
+// text extraction mostly just needs to cache fonts
+#define MAX_TEXT_CONTEXT_MEMORY (32 * 1024 * 1024)
 
 // when set, always uses GDI+ for rendering (else GDI+ is only used for
 // zoom levels above 4000% and for rendering directly into an HDC)
@@ -204,6 +206,17 @@ fz_stream *fz_open_file2(fz_context *ctx, const WCHAR *filePath)
 
 unsigned char *fz_extract_stream_data(fz_stream *stream, size_t *cbCount)
 {
+    int dataLen;
+    unsigned char *streamData = fz_stream_data(stream, &dataLen);
+    if (streamData) {
+        unsigned char *data = (unsigned char *)memdup(streamData, dataLen);
+        if (!data)
+            fz_throw(stream->ctx, FZ_ERROR_GENERIC, "OOM in fz_extract_stream_data");
+        if (cbCount)
+            *cbCount = dataLen;
+        return data;
+    }
+
     fz_seek(stream, 0, 2);
     int fileLen = fz_tell(stream);
     fz_seek(stream, 0, 0);
@@ -222,9 +235,23 @@ unsigned char *fz_extract_stream_data(fz_stream *stream, size_t *cbCount)
     return data;
 }
 
+// saves the data of memory backed (e.g. mapped) streams without copying it first
+bool fz_write_stream_data(fz_stream *stream, const WCHAR *filePath)
+{
+    int dataLen;
+    unsigned char *data = fz_stream_data(stream, &dataLen);
+    return data && file::WriteAll(filePath, data, dataLen);
+}
+
 void fz_stream_fingerprint(fz_stream *file, unsigned char digest[16])
 {
     int fileLen = -1;
+    unsigned char *fileData = fz_stream_data(file, &fileLen);
+    if (fileData) {
+        CalcMD5Digest(fileData, fileLen, digest);
+        return;
+    }
+
     fz_buffer *buffer = NULL;
 
     fz_try(file->ctx) {
@@ -1147,6 +1174,8 @@ pdf_load_page_objs(pdf_document *doc, pdf_obj **page_objs)
 
 struct PdfPageRun {
     pdf_page *page;
+    // either Target_View or Target_Print (which might show different optional content)
+    RenderTarget target;
     fz_display_list *list;
     size_t size_est;
     bool req_t3_fonts;
@@ -1154,8 +1183,8 @@ struct PdfPageRun {
     size_t clip_path_len;
     int refs;
 
-    PdfPageRun(pdf_page *page, fz_display_list *list, ListInspectionData& data) :
-        page(page), list(list), size_est(data.mem_estimate), req_t3_fonts(data.req_t3_fonts),
+    PdfPageRun(pdf_page *page, RenderTarget target, fz_display_list *list, ListInspectionData& data) :
+        page(page), target(target), list(list), size_est(data.mem_estimate), req_t3_fonts(data.req_t3_fonts),
         path_len(data.path_len), clip_path_len(data.clip_path_len), refs(1) { }
 };
 
@@ -1169,7 +1198,7 @@ class PdfEngineImpl : public PdfEngine {
     friend PdfImage;
 
 public:
-    PdfEngineImpl();
+    PdfEngineImpl(unsigned int maxContextMemory=MAX_CONTEXT_MEMORY);
     virtual ~PdfEngineImpl();
     virtual PdfEngineImpl *Clone();
 
@@ -1190,6 +1219,7 @@ public:
                          RectD *pageRect=NULL, RenderTarget target=Target_View, AbortCookie **cookie_out=NULL) {
         return RenderPage(hDC, GetPdfPage(pageNo), screenRect, NULL, zoom, rotation, pageRect, target, cookie_out);
     }
+    virtual RenderedBitmap *GetThumbnail(SizeI size);
 
     virtual PointD Transform(PointD pt, int pageNo, float zoom, int rotation, bool inverse=false);
     virtual RectD Transform(RectD rect, int pageNo, float zoom, int rotation, bool inverse=false);
@@ -1237,6 +1267,10 @@ protected:
     WCHAR *_fileName;
     char *_decryptionKey;
     bool isProtected;
+    // only the first page is loaded (for generating thumbnails)
+    bool thumbnailOnly;
+    // objects loaded for extracting a page's text are released afterwards
+    bool textOnly;
 
     // make sure to never ask for pagesAccess in an ctxAccess
     // protected critical section in order to avoid deadlocks
@@ -1268,13 +1302,13 @@ protected:
     bool            RenderPage(HDC hDC, pdf_page *page, RectI screenRect,
                                const fz_matrix *ctm, float zoom, int rotation,
                                RectD *pageRect, RenderTarget target, AbortCookie **cookie_out);
-    bool            PreferGdiPlusDevice(pdf_page *page, float zoom, fz_rect clip);
+    bool            PreferGdiPlusDevice(pdf_page *page, float zoom, fz_rect clip, RenderTarget target);
     WCHAR         * ExtractPageText(pdf_page *page, WCHAR *lineSep, RectI **coords_out=NULL,
                                     RenderTarget target=Target_View, bool cacheRun=false);
 
     Vec<PdfPageRun*>runCache; // ordered most recently used first
-    PdfPageRun    * CreatePageRun(pdf_page *page, fz_display_list *list);
-    PdfPageRun    * GetPageRun(pdf_page *page, bool tryOnly=false);
+    PdfPageRun    * CreatePageRun(pdf_page *page, RenderTarget target, fz_display_list *list);
+    PdfPageRun    * GetPageRun(pdf_page *page, bool tryOnly=false, RenderTarget target=Target_View);
     bool            RunPage(pdf_page *page, fz_device *dev, const fz_matrix *ctm,
                             RenderTarget target=Target_View,
                             const fz_rect *cliprect=NULL, bool cacheRun=true,
@@ -1377,10 +1411,10 @@ public:
     }
 };
 
-PdfEngineImpl::PdfEngineImpl() : _fileName(NULL), _doc(NULL),
+PdfEngineImpl::PdfEngineImpl(unsigned int maxContextMemory) : _fileName(NULL), _doc(NULL),
     _pages(NULL), _pageObjs(NULL), _mediaboxes(NULL), _info(NULL),
     outline(NULL), attachments(NULL), _pagelabels(NULL),
-    _decryptionKey(NULL), isProtected(false),
+    _decryptionKey(NULL), isProtected(false), thumbnailOnly(false), textOnly(false),
     pageAnnots(NULL), imageRects(NULL)
 {
     InitializeCriticalSection(&pagesAccess);
@@ -1389,7 +1423,7 @@ PdfEngineImpl::PdfEngineImpl() : _fileName(NULL), _doc(NULL),
     fz_locks_ctx.user = &ctxAccess;
     fz_locks_ctx.lock = fz_lock_context_cs;
     fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(NULL, &fz_locks_ctx, MAX_CONTEXT_MEMORY);
+    ctx = fz_new_context(NULL, &fz_locks_ctx, maxContextMemory);
 
     if (ctx)
         pdf_install_load_system_font_funcs(ctx);
@@ -1690,28 +1724,24 @@ bool PdfEngineImpl::FinishLoading()
 
     ScopedCritSec scope(&ctxAccess);
 
+    if (thumbnailOnly) {
+        // don't walk the entire page tree and skip everything
+        // which isn't needed for rendering the first page
+        fz_try(ctx) {
+            _pageObjs[0] = pdf_keep_obj(pdf_lookup_page_obj(_doc, 0));
+        }
+        fz_catch(ctx) {
+            return false;
+        }
+        return true;
+    }
+
     fz_try(ctx) {
         pdf_load_page_objs(_doc, _pageObjs);
     }
     fz_catch(ctx) {
         fz_warn(ctx, "Couldn't load all page objects");
     }
-    fz_try(ctx) {
-        outline = pdf_load_outline(_doc);
-    }
-    fz_catch(ctx) {
-        // ignore errors from pdf_load_outline()
-        // this information is not critical and checking the
-        // error might prevent loading some pdfs that would
-        // otherwise get displayed
-        fz_warn(ctx, "Couldn't load outline");
-    }
-    fz_try(ctx) {
-        attachments = pdf_loadattachments(_doc);
-    }
-    fz_catch(ctx) {
-        fz_warn(ctx, "Couldn't load attachments");
-    }
     fz_try(ctx) {
         // keep a copy of the Info dictionary, as accessing the original
         // isn't thread safe and we don't want to block for this when
@@ -1745,6 +1775,30 @@ bool PdfEngineImpl::FinishLoading()
         pdf_drop_obj(_info);
         _info = NULL;
     }
+
+    if (textOnly) {
+        // keep everything loaded so far, but release all objects
+        // loaded for extracting a page's text afterwards
+        pdf_mark_xref(_doc);
+        return true;
+    }
+
+    fz_try(ctx) {
+        outline = pdf_load_outline(_doc);
+    }
+    fz_catch(ctx) {
+        // ignore errors from pdf_load_outline()
+        // this information is not critical and checking the
+        // error might prevent loading some pdfs that would
+        // otherwise get displayed
+        fz_warn(ctx, "Couldn't load outline");
+    }
+    fz_try(ctx) {
+        attachments = pdf_loadattachments(_doc);
+    }
+    fz_catch(ctx) {
+        fz_warn(ctx, "Couldn't load attachments");
+    }
     fz_try(ctx) {
         pdf_obj *pagelabels = pdf_dict_getp(pdf_trailer(_doc), "Root/PageLabels");
         if (pagelabels)
@@ -1849,8 +1903,10 @@ pdf_page *PdfEngineImpl::GetPdfPage(int pageNo, bool failIfBusy)
         fz_try(ctx) {
             page = pdf_load_page_by_obj(_doc, pageNo - 1, _pageObjs[pageNo-1]);
             _pages[pageNo-1] = page;
-            LinkifyPageText(page);
-            pageAnnots[pageNo-1] = ProcessPageAnnotations(page);
+            if (!thumbnailOnly) {
+                LinkifyPageText(page);
+                pageAnnots[pageNo-1] = ProcessPageAnnotations(page);
+            }
         }
         fz_catch(ctx) { }
     }
@@ -1866,7 +1922,7 @@ int PdfEngineImpl::GetPageNo(pdf_page *page)
     return 0;
 }
 
-PdfPageRun *PdfEngineImpl::CreatePageRun(pdf_page *page, fz_display_list *list)
+PdfPageRun *PdfEngineImpl::CreatePageRun(pdf_page *page, RenderTarget target, fz_display_list *list)
 {
     Vec<FitzImagePos> positions;
     ListInspectionData data(positions);
@@ -1880,9 +1936,9 @@ PdfPageRun *PdfEngineImpl::CreatePageRun(pdf_page *page, fz_display_list *list)
     fz_catch(ctx) { }
     fz_free_device(dev);
 
-    // save the image rectangles for this page
+    // save the image rectangles for this page (as displayed)
     int pageNo = GetPageNo(page);
-    if (!imageRects[pageNo-1] && positions.Count() > 0) {
+    if (Target_View == target && !imageRects[pageNo-1] && positions.Count() > 0) {
         // the list of page image rectangles is terminated with a null-rectangle
         fz_rect *rects = AllocArray<fz_rect>(positions.Count() + 1);
         if (rects) {
@@ -1893,17 +1949,18 @@ PdfPageRun *PdfEngineImpl::CreatePageRun(pdf_page *page, fz_display_list *list)
         }
     }
 
-    return new PdfPageRun(page, list, data);
+    return new PdfPageRun(page, target, list, data);
 }
 
-PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly)
+PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly, RenderTarget target)
 {
     PdfPageRun *result = NULL;
+    CrashIf(target != Target_View && target != Target_Print);
 
     ScopedCritSec scope(&pagesAccess);
 
     for (size_t i = 0; i < runCache.Count(); i++) {
-        if (runCache.At(i)->page == page) {
+        if (runCache.At(i)->page == page && runCache.At(i)->target == target) {
             result = runCache.At(i);
             break;
         }
@@ -1925,6 +1982,7 @@ PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly)
 
         ScopedCritSec scope2(&ctxAccess);
 
+        char *targetName = target == Target_Print ? "Print" : "View";
         fz_display_list *list = NULL;
         fz_device *dev = NULL;
         fz_var(list);
@@ -1932,7 +1990,7 @@ PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly)
         fz_try(ctx) {
             list = fz_new_display_list(ctx);
             dev = fz_new_list_device(ctx, list);
-            pdf_run_page(_doc, page, dev, &fz_identity, NULL);
+            pdf_run_page_with_usage(_doc, page, dev, &fz_identity, targetName, NULL);
         }
         fz_catch(ctx) {
             fz_drop_display_list(ctx, list);
@@ -1941,7 +1999,7 @@ PdfPageRun *PdfEngineImpl::GetPageRun(pdf_page *page, bool tryOnly)
         fz_free_device(dev);
 
         if (list) {
-            result = CreatePageRun(page, list);
+            result = CreatePageRun(page, target, list);
             runCache.InsertAt(0, result);
         }
     }
@@ -1960,8 +2018,10 @@ bool PdfEngineImpl::RunPage(pdf_page *page, fz_device *dev, const fz_matrix *ctm
 {
     bool ok = true;
 
+    // printing as image renders a page in several bands, all of which
+    // should replay the same display list instead of reinterpreting the page
     PdfPageRun *run;
-    if (Target_View == target && (run = GetPageRun(page, !cacheRun)) != NULL) {
+    if ((Target_View == target || Target_Print == target) && (run = GetPageRun(page, !cacheRun, target)) != NULL) {
         EnterCriticalSection(&ctxAccess);
         Vec<PageAnnotation> pageAnnots = fz_get_user_page_annots(userAnnots, GetPageNo(page));
         fz_try(ctx) {
@@ -2171,9 +2231,10 @@ bool PdfEngineImpl::RenderPage(HDC hDC, pdf_page *page, RectI screenRect, const
 }
 
 // various heuristics for deciding when to use dev_gdiplus instead of fitz/draw
-bool PdfEngineImpl::PreferGdiPlusDevice(pdf_page *page, float zoom, fz_rect clip)
+bool PdfEngineImpl::PreferGdiPlusDevice(pdf_page *page, float zoom, fz_rect clip, RenderTarget target)
 {
-    PdfPageRun *run = GetPageRun(page);
+    // inspect the same display list that RunPage will use
+    PdfPageRun *run = GetPageRun(page, false, Target_Print == target ? Target_Print : Target_View);
     if (!run)
         return false;
 
@@ -2217,7 +2278,7 @@ RenderedBitmap *PdfEngineImpl::RenderBitmap(int pageNo, float zoom, int rotation
     fz_irect bbox;
     fz_round_rect(&bbox, fz_transform_rect(&r, &ctm));
 
-    if (PreferGdiPlusDevice(page, zoom, pRect) != gDebugGdiPlusDevice) {
+    if (PreferGdiPlusDevice(page, zoom, pRect, target) != gDebugGdiPlusDevice) {
         int w = bbox.x1 - bbox.x0, h = bbox.y1 - bbox.y0;
         fz_matrix trans;
         fz_concat(&ctm, &ctm, fz_translate(&trans, (float)-bbox.x0, (float)-bbox.y0));
@@ -2470,6 +2531,44 @@ RenderedBitmap *PdfEngineImpl::GetPageImage(int pageNo, RectD rect, size_t image
     return bmp;
 }
 
+// uses the page's /Thumb image, if it's large enough
+RenderedBitmap *PdfEngineImpl::GetThumbnail(SizeI size)
+{
+    pdf_obj *pageObj = _pageObjs ? _pageObjs[0] : NULL;
+    if (!pageObj)
+        return NULL;
+
+    ScopedCritSec scope(&ctxAccess);
+
+    fz_image *image = NULL;
+    fz_pixmap *pixmap = NULL;
+    fz_var(image);
+    fz_var(pixmap);
+    fz_try(ctx) {
+        pdf_obj *thumb = pdf_dict_gets(pageObj, "Thumb");
+        // thumbnails aren't rotated along with the page
+        bool isRotated = pdf_to_int(pdf_lookup_inherited_page_item(_doc, pageObj, "Rotate")) % 360 != 0;
+        if (pdf_is_stream(_doc, pdf_to_num(thumb), pdf_to_gen(thumb)) && !isRotated) {
+            image = pdf_load_image(_doc, thumb);
+            if (image->w >= size.dx || image->h >= size.dy)
+                pixmap = fz_new_pixmap_from_image(ctx, image, image->w, image->h);
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_image(ctx, image);
+    }
+    fz_catch(ctx) {
+        fz_warn(ctx, "Couldn't load the page thumbnail");
+    }
+    if (!pixmap)
+        return NULL;
+
+    RenderedBitmap *bmp = new_rendered_fz_pixmap(ctx, pixmap);
+    fz_drop_pixmap(ctx, pixmap);
+
+    return bmp;
+}
+
 WCHAR *PdfEngineImpl::ExtractPageText(pdf_page *page, WCHAR *lineSep, RectI **coords_out, RenderTarget target, bool cacheRun)
 {
     if (!page)
@@ -2495,7 +2594,10 @@ WCHAR *PdfEngineImpl::ExtractPageText(pdf_page *page, WCHAR *lineSep, RectI **co
     }
     LeaveCriticalSection(&ctxAccess);
 
-    if (!cacheRun)
+    // in text-only mode, objects are released in ExtractPageText after the
+    // page has been freed (FZ_NO_CACHE would permanently keep the objects
+    // loaded along with the page)
+    if (!cacheRun && !textOnly)
         fz_enable_device_hints(dev, FZ_NO_CACHE);
 
     // use an infinite rectangle as bounds (instead of pdf_bound_page) to ensure that
@@ -2534,6 +2636,8 @@ WCHAR *PdfEngineImpl::ExtractPageText(int pageNo, WCHAR *lineSep, RectI **coords
 
     EnterCriticalSection(&ctxAccess);
     pdf_free_page(_doc, page);
+    if (textOnly)
+        pdf_clear_xref_to_mark(_doc);
     LeaveCriticalSection(&ctxAccess);
 
     return result;
@@ -2822,6 +2926,14 @@ unsigned char *PdfEngineImpl::GetFileData(size_t *cbCount)
 
 bool PdfEngineImpl::SaveFileAs(const WCHAR *copyFileName)
 {
+    bool saved;
+    {
+        ScopedCritSec scope(&ctxAccess);
+        saved = fz_write_stream_data(_doc->file, copyFileName);
+    }
+    if (saved)
+        return SaveUserAnnots(copyFileName);
+
     size_t dataLen;
     ScopedMem<unsigned char> data(GetFileData(&dataLen));
     if (data) {
@@ -3254,9 +3366,11 @@ bool PdfEngine::IsSupportedFile(const WCHAR *fileName, bool sniff)
     return str::EndsWithI(fileName, L".pdf") || findEmbedMarks(fileName);
 }
 
-PdfEngine *PdfEngine::CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI)
+PdfEngine *PdfEngine::CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI, bool thumbnailOnly)
 {
     PdfEngineImpl *engine = new PdfEngineImpl();
+    if (engine)
+        engine->thumbnailOnly = thumbnailOnly;
     if (!engine || !fileName || !engine->Load(fileName, pwdUI)) {
         delete engine;
         return NULL;
@@ -3264,9 +3378,10 @@ PdfEngine *PdfEngine::CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI)
     return engine;
 }
 
-PdfEngine *PdfEngine::CreateFromStream(IStream *stream, PasswordUI *pwdUI)
+PdfEngine *PdfEngine::CreateFromStream(IStream *stream, PasswordUI *pwdUI, bool thumbnailOnly)
 {
     PdfEngineImpl *engine = new PdfEngineImpl();
+    engine->thumbnailOnly = thumbnailOnly;
     if (!engine->Load(stream, pwdUI)) {
         delete engine;
         return NULL;
@@ -3274,6 +3389,17 @@ PdfEngine *PdfEngine::CreateFromStream(IStream *stream, PasswordUI *pwdUI)
     return engine;
 }
 
+PdfEngine *PdfEngine::CreateForTextExtraction(IStream *stream)
+{
+    PdfEngineImpl *engine = new PdfEngineImpl(MAX_TEXT_CONTEXT_MEMORY);
+    engine->textOnly = true;
+    if (!engine->Load(stream)) {
+        delete engine;
+        return NULL;
+    }
+    return engine;
+}
+
 ///// XPS-specific extensions to Fitz/MuXPS /////
 
 extern "C" {
@@ -4242,6 +4368,12 @@ unsigned char *XpsEngineImpl::GetFileData(size_t *cbCount)
 
 bool XpsEngineImpl::SaveFileAs(const WCHAR *copyFileName)
 {
+    {
+        ScopedCritSec scope(&ctxAccess);
+        if (fz_write_stream_data(_doc->file, copyFileName))
+            return true;
+    }
+
     size_t dataLen;
     ScopedMem<unsigned char> data(GetFileData(&dataLen));
     if (data) {
@@ -15,8 +15,14 @@ public:
 class PdfEngine : public BaseEngine {
 public:
     static bool IsSupportedFile(const WCHAR *fileName, bool sniff=false);
-    static PdfEngine *CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI=NULL);
-    static PdfEngine *CreateFromStream(IStream *stream, PasswordUI *pwdUI=NULL);
+    // thumbnailOnly: only load what's needed for rendering the first page
+    // (no outline, attachments, properties, page labels or links)
+    static PdfEngine *CreateFromFile(const WCHAR *fileName, PasswordUI *pwdUI=NULL, bool thumbnailOnly=false);
+    static PdfEngine *CreateFromStream(IStream *stream, PasswordUI *pwdUI=NULL, bool thumbnailOnly=false);
+    // for extracting text page by page (e.g. for indexing) in bounded memory:
+    // only loads document properties and releases all per-page resources
+    // after ExtractPageText (nothing else is guaranteed to work)
+    static PdfEngine *CreateForTextExtraction(IStream *stream);
 };
 
 class XpsEngine : public BaseEngine {
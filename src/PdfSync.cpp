@@ -4,8 +4,10 @@
 #include "BaseUtil.h"
 #include "PdfSync.h"
 
+#include "Dict.h"
 #include "FileUtil.h"
 #include "PdfEngine.h"
+#include "PdfSyncIndex.h"
 
 #include "synctex_parser.h"
 
@@ -23,44 +25,33 @@
 #define SYNCTEX_EXTENSION       L".synctex"
 #define SYNCTEXGZ_EXTENSION     L".synctex.gz"
 
-struct PdfsyncFileIndex {
-    size_t start, end; // first and one-after-last index of lines associated with a file
-};
-
-struct PdfsyncLine {
-    UINT record; // index for mapping line(s) to point(s)
-    size_t file; // index into srcfiles
-    UINT line, column;
-};
-
-struct PdfsyncPoint {
-    UINT record; // index for mapping point(s) to line(s)
-    UINT page, x, y;
-};
+// parsed .pdfsync files at least this large are cached (if a cache path is provided)
+#define PDFSYNC_CACHE_MIN_SIZE  (1 << 20)
 
 // Synchronizer based on .pdfsync file generated with the pdfsync tex package
-class Pdfsync : public Synchronizer
+class Pdfsync : public Synchronizer, private PdfsyncIndex
 {
 public:
-    Pdfsync(const WCHAR* syncfilename, PdfEngine *engine) :
-        Synchronizer(syncfilename), engine(engine)
+    Pdfsync(const WCHAR* syncfilename, PdfEngine *engine, const WCHAR *cachePath) :
+        Synchronizer(syncfilename), engine(engine), cachePath(str::Dup(cachePath)), srcfileIds(NULL)
     {
         assert(str::EndsWithI(syncfilename, PDFSYNC_EXTENSION));
     }
+    virtual ~Pdfsync() { delete srcfileIds; }
 
     virtual int DocToSource(UINT pageNo, PointI pt, ScopedMem<WCHAR>& filename, UINT *line, UINT *col);
     virtual int SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT *page, Vec<RectI>& rects);
 
 private:
     int RebuildIndex();
+    int ParseSyncFile();
+    void BuildSourceFileIds();
+    size_t FindSourceFile(const WCHAR* srcfilepath);
     UINT SourceToRecord(const WCHAR* srcfilename, UINT line, UINT col, Vec<size_t>& records);
 
     PdfEngine *engine;          // needed for converting between coordinate systems
-    WStrVec srcfiles;           // source file names
-    Vec<PdfsyncLine> lines;     // record-to-line mapping
-    Vec<PdfsyncPoint> points;   // record-to-point mapping
-    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
-    Vec<size_t> sheetIndex;     // start of entries for a sheet in <points>
+    ScopedMem<WCHAR> cachePath; // where to cache the parsed data (NULL if it mustn't be cached)
+    dict::MapWStrToInt *srcfileIds; // normalized source file name to first index into <srcfiles>
 };
 
 // Synchronizer based on .synctex file generated with SyncTex
@@ -128,7 +119,7 @@ WCHAR * Synchronizer::PrependDir(const WCHAR* filename) const
 // Create a Synchronizer object for a PDF file.
 // It creates either a SyncTex or PdfSync object
 // based on the synchronization file found in the folder containing the PDF file.
-int Synchronizer::Create(const WCHAR *pdffilename, PdfEngine *engine, Synchronizer **sync)
+int Synchronizer::Create(const WCHAR *pdffilename, PdfEngine *engine, Synchronizer **sync, const WCHAR *cachePath)
 {
     if (!sync || !engine)
         return PDFSYNCERR_INVALID_ARGUMENT;
@@ -142,7 +133,7 @@ int Synchronizer::Create(const WCHAR *pdffilename, PdfEngine *engine, Synchroniz
     // Check if a PDFSYNC file is present
     ScopedMem<WCHAR> syncFile(str::Join(baseName, PDFSYNC_EXTENSION));
     if (file::Exists(syncFile)) {
-        *sync = new Pdfsync(syncFile, engine);
+        *sync = new Pdfsync(syncFile, engine, cachePath);
         return *sync ? PDFSYNCERR_SUCCESS : PDFSYNCERR_OUTOFMEMORY;
     }
 
@@ -200,7 +191,7 @@ static char *Advance0Line(char *line, char *end)
 }
 
 // see http://itexmac.sourceforge.net/pdfsync.html for the specification
-int Pdfsync::RebuildIndex()
+int Pdfsync::ParseSyncFile()
 {
     size_t len;
     ScopedMem<char> data(file::ReadAll(syncfilepath, &len));
@@ -318,6 +309,53 @@ int Pdfsync::RebuildIndex()
     fileIndex.At(0).end = lines.Count();
     assert(filestack.Count() == 1);
 
+    return PDFSYNCERR_SUCCESS;
+}
+
+static WCHAR *NormalizeSourcePath(const WCHAR *filepath)
+{
+    WCHAR *normalized = path::Normalize(filepath);
+    if (normalized)
+        str::ToLower(normalized);
+    return normalized;
+}
+
+void Pdfsync::BuildSourceFileIds()
+{
+    delete srcfileIds;
+    srcfileIds = new dict::MapWStrToInt(64);
+    for (size_t i = 0; i < srcfiles.Count(); i++) {
+        ScopedMem<WCHAR> normalized(NormalizeSourcePath(srcfiles.At(i)));
+        int prevIx;
+        // only the first entry for a file is used (as for a linear search)
+        if (normalized)
+            srcfileIds->Insert(normalized, (int)i, &prevIx);
+    }
+}
+
+int Pdfsync::RebuildIndex()
+{
+    // reparsing a large .pdfsync file takes a while, so for such files the parsed
+    // data is cached (as long as the file's size and modification time don't change)
+    struct _stat stamp;
+    bool useCache = cachePath && _wstat(syncfilepath, &stamp) == 0 && stamp.st_size >= PDFSYNC_CACHE_MIN_SIZE;
+    PdfsyncCacheKey key = { 0 };
+    if (useCache) {
+        key.fileSize = stamp.st_size;
+        key.modTime = stamp.st_mtime;
+        key.pageCount = engine->PageCount();
+    }
+
+    if (!useCache || !LoadCache(cachePath, key)) {
+        int res = ParseSyncFile();
+        if (res != PDFSYNCERR_SUCCESS)
+            return res;
+        BuildLookupIndices();
+        if (useCache)
+            SaveCache(cachePath, key);
+    }
+    BuildSourceFileIds();
+
     return Synchronizer::RebuildIndex();
 }
 
@@ -390,6 +428,22 @@ int Pdfsync::DocToSource(UINT pageNo, PointI pt, ScopedMem<WCHAR>& filename, UIN
     return PDFSYNCERR_SUCCESS;
 }
 
+// returns the index of the first entry for a source file in <srcfiles>
+// or srcfiles.Count() if the file isn't known
+size_t Pdfsync::FindSourceFile(const WCHAR* srcfilepath)
+{
+    ScopedMem<WCHAR> normalized(NormalizeSourcePath(srcfilepath));
+    int isrc;
+    if (normalized && srcfileIds->Get(normalized, &isrc))
+        return (size_t)isrc;
+    // the path might still refer to a known file (e.g. through a short path name)
+    for (size_t i = 0; i < srcfiles.Count(); i++) {
+        if (path::IsSame(srcfilepath, srcfiles.At(i)))
+            return i;
+    }
+    return srcfiles.Count();
+}
+
 // Find a record corresponding to the given source file, line number and optionally column number.
 // (at the moment the column parameter is ignored)
 //
@@ -415,34 +469,15 @@ UINT Pdfsync::SourceToRecord(const WCHAR* srcfilename, UINT line, UINT col, Vec<
         return PDFSYNCERR_OUTOFMEMORY;
 
     // find the source file entry
-    size_t isrc;
-    for (isrc = 0; isrc < srcfiles.Count(); isrc++)
-        if (path::IsSame(srcfilepath, srcfiles.At(isrc)))
-            break;
+    size_t isrc = FindSourceFile(srcfilepath);
     if (isrc == srcfiles.Count())
         return PDFSYNCERR_UNKNOWN_SOURCEFILE;
 
     if (fileIndex.At(isrc).start == fileIndex.At(isrc).end)
         return PDFSYNCERR_NORECORD_IN_SOURCEFILE; // there is not any record declaration for that particular source file
 
-    // look for sections belonging to the specified file
-    // starting with the first section that is declared within the scope of the file.
-    UINT min_distance = EPSILON_LINE; // distance to the closest record
-    size_t lineIx = (size_t)-1; // closest record-line index
-
-    for (size_t isec = fileIndex.At(isrc).start; isec < fileIndex.At(isrc).end; isec++) {
-        // does this section belong to the desired file?
-        if (lines.At(isec).file != isrc)
-            continue;
-
-        UINT d = abs((int)lines.At(isec).line - (int)line);
-        if (d < min_distance) {
-            min_distance = d;
-            lineIx = isec;
-            if (0 == d)
-                break; // We have found a record for the requested line!
-        }
-    }
+    // find the closest line (within EPSILON_LINE) among the lines declared for the file
+    size_t lineIx = FindClosestLine(isrc, line, EPSILON_LINE);
     if (lineIx == (size_t)-1)
         return PDFSYNCERR_NORECORD_FOR_THATLINE;
 
@@ -453,6 +488,12 @@ UINT Pdfsync::SourceToRecord(const WCHAR* srcfilename, UINT line, UINT col, Vec<
     return PDFSYNCERR_SUCCESS;
 }
 
+static int cmpPointIndices(const void *a, const void *b)
+{
+    size_t ia = *(const size_t *)a, ib = *(const size_t *)b;
+    return ia < ib ? -1 : ia > ib ? 1 : 0;
+}
+
 int Pdfsync::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT *page, Vec<RectI> &rects)
 {
     if (IsIndexDiscarded())
@@ -468,9 +509,18 @@ int Pdfsync::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT *pa
 
     // records have been found for the desired source position:
     // we now find the page and positions in the PDF corresponding to these found records
+    Vec<size_t> found_points;
+    for (size_t j = 0; j < found_records.Count(); j++) {
+        FindRecordPoints((UINT)found_records.At(j), found_points);
+    }
+    // the points must be handled in the order in which they were declared
+    found_points.Sort(cmpPointIndices);
+
     UINT firstPage = UINT_MAX;
-    for (size_t i = 0; i < points.Count(); i++) {
-        if (!found_records.Contains(points.At(i).record))
+    for (size_t j = 0; j < found_points.Count(); j++) {
+        size_t i = found_points.At(j);
+        // a record could have been found more than once
+        if (j > 0 && found_points.At(j - 1) == i)
             continue;
         if (firstPage != UINT_MAX && firstPage != points.At(i).page)
             continue;
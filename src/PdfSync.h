@@ -56,7 +56,8 @@ protected:
     ScopedMem<WCHAR> syncfilepath;  // path to the synchronization file
 
 public:
-    static int Create(const WCHAR *pdffilename, PdfEngine *engine, Synchronizer **sync);
+    // cachePath is where parsed .pdfsync data may be cached (NULL for never caching it)
+    static int Create(const WCHAR *pdffilename, PdfEngine *engine, Synchronizer **sync, const WCHAR *cachePath=NULL);
 };
 
 #endif
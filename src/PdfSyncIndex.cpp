@@ -0,0 +1,248 @@
+/* Copyright 2014 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "BaseUtil.h"
+#include "PdfSyncIndex.h"
+
+#include "FileUtil.h"
+
+#define PDFSYNC_CACHE_MAGIC     "PsIx"
+#define PDFSYNC_CACHE_VERSION   (1 + sizeof(size_t))
+
+void PdfsyncIndex::Reset()
+{
+    srcfiles.Reset();
+    lines.Reset();
+    points.Reset();
+    fileIndex.Reset();
+    sheetIndex.Reset();
+    lineRefs.Reset();
+    fileLineRefs.Reset();
+    recordPoints.Reset();
+}
+
+static int cmpLineRefs(const void *a, const void *b)
+{
+    const PdfsyncLineRef *ra = (const PdfsyncLineRef *)a, *rb = (const PdfsyncLineRef *)b;
+    if (ra->file != rb->file)
+        return ra->file < rb->file ? -1 : 1;
+    if (ra->line != rb->line)
+        return ra->line < rb->line ? -1 : 1;
+    return ra->lineIx < rb->lineIx ? -1 : ra->lineIx > rb->lineIx ? 1 : 0;
+}
+
+// qsort doesn't allow passing the points to the comparison function,
+// so the record is packed together with the index for sorting
+struct PdfsyncPointRef {
+    UINT record;
+    size_t pointIx;
+};
+
+static int cmpPointRefs(const void *a, const void *b)
+{
+    const PdfsyncPointRef *ra = (const PdfsyncPointRef *)a, *rb = (const PdfsyncPointRef *)b;
+    if (ra->record != rb->record)
+        return ra->record < rb->record ? -1 : 1;
+    return ra->pointIx < rb->pointIx ? -1 : ra->pointIx > rb->pointIx ? 1 : 0;
+}
+
+// builds the indices which allow binary searches instead
+// of scanning all lines and points for every query
+void PdfsyncIndex::BuildLookupIndices()
+{
+    // only lines within the range of their file are considered
+    lineRefs.Reset();
+    for (size_t i = 0; i < lines.Count(); i++) {
+        size_t file = lines.At(i).file;
+        if (fileIndex.At(file).start <= i && i < fileIndex.At(file).end) {
+            PdfsyncLineRef ref = { file, lines.At(i).line, i };
+            lineRefs.Append(ref);
+        }
+    }
+    qsort(lineRefs.LendData(), lineRefs.Count(), sizeof(PdfsyncLineRef), cmpLineRefs);
+    fileLineRefs.Reset();
+    for (size_t file = 0, i = 0; file <= srcfiles.Count(); file++) {
+        for (; i < lineRefs.Count() && lineRefs.At(i).file < file; i++);
+        fileLineRefs.Append(i);
+    }
+
+    Vec<PdfsyncPointRef> pointRefs(points.Count());
+    for (size_t i = 0; i < points.Count(); i++) {
+        PdfsyncPointRef ref = { points.At(i).record, i };
+        pointRefs.Append(ref);
+    }
+    qsort(pointRefs.LendData(), pointRefs.Count(), sizeof(PdfsyncPointRef), cmpPointRefs);
+    recordPoints.Reset();
+    for (size_t i = 0; i < pointRefs.Count(); i++) {
+        recordPoints.Append(pointRefs.At(i).pointIx);
+    }
+}
+
+// in case of a tie, the first declared line is preferred
+size_t PdfsyncIndex::FindClosestLine(size_t file, UINT line, UINT maxDistance) const
+{
+    size_t lineIx = (size_t)-1;
+    size_t first = fileLineRefs.At(file), end = fileLineRefs.At(file + 1);
+    // binary search for the first entry for a line >= line
+    size_t lo = first, hi = end;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lineRefs.At(mid).line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    UINT minDistance = maxDistance;
+    if (lo < end && lineRefs.At(lo).line - line < minDistance) {
+        minDistance = lineRefs.At(lo).line - line;
+        lineIx = lineRefs.At(lo).lineIx;
+    }
+    if (lo > first && line - lineRefs.At(lo - 1).line <= minDistance &&
+        line - lineRefs.At(lo - 1).line < maxDistance) {
+        UINT d = line - lineRefs.At(lo - 1).line;
+        // move to the first declared entry for that line
+        UINT prevLine = lineRefs.At(lo - 1).line;
+        for (lo--; lo > first && lineRefs.At(lo - 1).line == prevLine; lo--);
+        if (d < minDistance || lineRefs.At(lo).lineIx < lineIx)
+            lineIx = lineRefs.At(lo).lineIx;
+    }
+    return lineIx;
+}
+
+void PdfsyncIndex::FindRecordPoints(UINT record, Vec<size_t>& pointIxs) const
+{
+    size_t lo = 0, hi = recordPoints.Count();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (points.At(recordPoints.At(mid)).record < record)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < recordPoints.Count() && points.At(recordPoints.At(lo)).record == record; lo++) {
+        pointIxs.Append(recordPoints.At(lo));
+    }
+}
+
+struct PdfsyncCacheHeader {
+    char magic[4];
+    UINT version;
+    int64 fileSize;
+    int64 modTime;
+    UINT pageCount;
+    UINT srcfilesCount;
+    size_t linesCount, pointsCount, fileIndexCount, sheetIndexCount;
+};
+
+class PdfsyncCacheReader {
+    const char *data, *end;
+public:
+    PdfsyncCacheReader(const char *data, size_t len) : data(data), end(data + len) { }
+    const char *Read(size_t len) {
+        if (len > (size_t)(end - data))
+            return NULL;
+        data += len;
+        return data - len;
+    }
+    template <typename T>
+    bool ReadVec(Vec<T>& vec, size_t count) {
+        if (count > (size_t)(end - data) / sizeof(T))
+            return false;
+        vec.Append((const T *)Read(count * sizeof(T)), count);
+        return true;
+    }
+    bool AtEnd() const { return data == end; }
+};
+
+static bool ReadCache(PdfsyncIndex& idx, const char *data, size_t len, const PdfsyncCacheKey& key)
+{
+    PdfsyncCacheReader r(data, len);
+    const PdfsyncCacheHeader *hdr = (const PdfsyncCacheHeader *)r.Read(sizeof(PdfsyncCacheHeader));
+    if (!hdr || !str::EqN(hdr->magic, PDFSYNC_CACHE_MAGIC, 4) || hdr->version != PDFSYNC_CACHE_VERSION ||
+        hdr->fileSize != key.fileSize || hdr->modTime != key.modTime ||
+        hdr->pageCount != key.pageCount || 0 == hdr->srcfilesCount) {
+        return false;
+    }
+
+    for (UINT i = 0; i < hdr->srcfilesCount; i++) {
+        const char *nameLenData = r.Read(sizeof(UINT));
+        if (!nameLenData)
+            return false;
+        UINT nameLen;
+        memcpy(&nameLen, nameLenData, sizeof(UINT));
+        const char *name = nameLen < len ? r.Read(nameLen * sizeof(WCHAR)) : NULL;
+        if (!name)
+            return false;
+        WCHAR *nameW = AllocArray<WCHAR>(nameLen + 1);
+        if (!nameW)
+            return false;
+        memcpy(nameW, name, nameLen * sizeof(WCHAR));
+        idx.srcfiles.Append(nameW);
+    }
+    if (!r.ReadVec(idx.lines, hdr->linesCount) || !r.ReadVec(idx.points, hdr->pointsCount) ||
+        !r.ReadVec(idx.fileIndex, hdr->fileIndexCount) || !r.ReadVec(idx.sheetIndex, hdr->sheetIndexCount) ||
+        !r.AtEnd()) {
+        return false;
+    }
+    // make sure that the data can be trusted as much as freshly parsed data
+    if (idx.fileIndex.Count() != idx.srcfiles.Count() || idx.sheetIndex.Count() == 0)
+        return false;
+    for (size_t i = 0; i < idx.lines.Count(); i++) {
+        if (idx.lines.At(i).file >= idx.srcfiles.Count())
+            return false;
+    }
+    for (size_t i = 0; i < idx.fileIndex.Count(); i++) {
+        if (idx.fileIndex.At(i).start > idx.fileIndex.At(i).end || idx.fileIndex.At(i).end > idx.lines.Count())
+            return false;
+    }
+    for (size_t i = 0; i < idx.sheetIndex.Count(); i++) {
+        if (idx.sheetIndex.At(i) > idx.points.Count())
+            return false;
+    }
+    return true;
+}
+
+bool PdfsyncIndex::LoadCache(const WCHAR *cachePath, const PdfsyncCacheKey& key)
+{
+    size_t len;
+    ScopedMem<char> data(file::ReadAll(cachePath, &len));
+    if (!data)
+        return false;
+    Reset();
+    if (!ReadCache(*this, data, len, key)) {
+        Reset();
+        return false;
+    }
+    BuildLookupIndices();
+    return true;
+}
+
+bool PdfsyncIndex::SaveCache(const WCHAR *cachePath, const PdfsyncCacheKey& key) const
+{
+    PdfsyncCacheHeader hdr = { 0 };
+    memcpy(hdr.magic, PDFSYNC_CACHE_MAGIC, 4);
+    hdr.version = PDFSYNC_CACHE_VERSION;
+    hdr.fileSize = key.fileSize;
+    hdr.modTime = key.modTime;
+    hdr.pageCount = key.pageCount;
+    hdr.srcfilesCount = (UINT)srcfiles.Count();
+    hdr.linesCount = lines.Count();
+    hdr.pointsCount = points.Count();
+    hdr.fileIndexCount = fileIndex.Count();
+    hdr.sheetIndexCount = sheetIndex.Count();
+
+    str::Str<char> data;
+    data.Append((const char *)&hdr, sizeof(hdr));
+    for (size_t i = 0; i < srcfiles.Count(); i++) {
+        UINT nameLen = (UINT)str::Len(srcfiles.At(i));
+        data.Append((const char *)&nameLen, sizeof(nameLen));
+        data.Append((const char *)srcfiles.At(i), nameLen * sizeof(WCHAR));
+    }
+    data.Append((const char *)lines.LendData(), lines.Count() * sizeof(PdfsyncLine));
+    data.Append((const char *)points.LendData(), points.Count() * sizeof(PdfsyncPoint));
+    data.Append((const char *)fileIndex.LendData(), fileIndex.Count() * sizeof(PdfsyncFileIndex));
+    data.Append((const char *)sheetIndex.LendData(), sheetIndex.Count() * sizeof(size_t));
+
+    ScopedMem<WCHAR> cacheDir(path::GetDir(cachePath));
+    return dir::Create(cacheDir) && file::WriteAll(cachePath, data.Get(), data.Size());
+}
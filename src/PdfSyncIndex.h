@@ -0,0 +1,65 @@
+/* Copyright 2014 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+// parsed content of a .pdfsync file and the lookup indices derived from it
+
+#ifndef PdfSyncIndex_h
+#define PdfSyncIndex_h
+
+struct PdfsyncFileIndex {
+    size_t start, end; // first and one-after-last index of lines associated with a file
+};
+
+struct PdfsyncLine {
+    UINT record; // index for mapping line(s) to point(s)
+    size_t file; // index into srcfiles
+    UINT line, column;
+};
+
+struct PdfsyncPoint {
+    UINT record; // index for mapping point(s) to line(s)
+    UINT page, x, y;
+};
+
+// entry of an index into <lines> sorted by file, line number and declaration order
+struct PdfsyncLineRef {
+    size_t file;
+    UINT line;
+    size_t lineIx;
+};
+
+// identifies the state of the .pdfsync file (and document) that cached data was parsed from
+struct PdfsyncCacheKey {
+    int64 fileSize;
+    int64 modTime;
+    UINT pageCount;
+};
+
+// this doesn't depend on an engine, so that it can be tested on its own
+class PdfsyncIndex
+{
+public:
+    WStrVec srcfiles;           // source file names
+    Vec<PdfsyncLine> lines;     // record-to-line mapping
+    Vec<PdfsyncPoint> points;   // record-to-point mapping
+    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
+    Vec<size_t> sheetIndex;     // start of entries for a sheet in <points>
+
+    // the following lookup indices are derived from the above data
+    Vec<PdfsyncLineRef> lineRefs;   // lines of all files, ordered by file and line number
+    Vec<size_t> fileLineRefs;       // start of entries for a file in <lineRefs>
+    Vec<size_t> recordPoints;       // indices into <points> ordered by record
+
+    void    Reset();
+    void    BuildLookupIndices();
+    // returns the index into <lines> of the line closest to <line> (less than
+    // maxDistance apart) declared for <file> or (size_t)-1 if there's none
+    size_t  FindClosestLine(size_t file, UINT line, UINT maxDistance) const;
+    // appends the indices into <points> of all points for <record> in declaration order
+    void    FindRecordPoints(UINT record, Vec<size_t>& pointIxs) const;
+
+    // loading fails if the cached data wasn't saved for the same key
+    bool    LoadCache(const WCHAR *cachePath, const PdfsyncCacheKey& key);
+    bool    SaveCache(const WCHAR *cachePath, const PdfsyncCacheKey& key) const;
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include "Selection.h"
 #include "SumatraDialogs.h"
 #include "SumatraPDF.h"
+#include "ThreadUtil.h"
 #include "Translations.h"
 #include "UITask.h"
 #include "WindowInfo.h"
@@ -100,6 +101,151 @@ static RectD BoundSelectionOnPage(const Vec<SelectionOnPage>& sel, int pageNo)
     return bounds;
 }
 
+// describes where (a part of) a document page is to be printed
+struct PrintPageLayout {
+    int pageNo;
+    float zoom;
+    int rotation;
+    // the part of the page to print (only used if isPartial is set)
+    RectD pageRect;
+    bool isPartial;
+    // top-left corner relative to the printable area (and the area
+    // to be passed to BaseEngine::RenderPage)
+    RectI target;
+    // whether this layout starts a new printer page
+    bool newSheet;
+};
+
+// when printing as image, pages are rendered in horizontal bands at full
+// resolution so that the memory needed doesn't depend on the page size
+#define PRINT_BAND_MAX_BYTES    (8 * 1024 * 1024)
+// maximum number of rendered bands waiting to be sent to the printer
+#define PRINT_BANDS_QUEUED      2
+
+struct PrintBand {
+    size_t layoutIdx;
+    // whether this is the first band of its layout
+    bool isFirst;
+    // where to draw the band (NULL if rendering failed)
+    RectI target;
+    RenderedBitmap *bmp;
+};
+
+// renders the bands for all layouts in order on a separate thread, so that
+// the next band (or page) can be rendered while the current one is spooled
+class PrintBandRenderer : public ThreadBase {
+    BaseEngine& engine;
+    Vec<PrintPageLayout>& layouts;
+    ProgressUpdateUI *progressUI;
+    AbortCookieManager *abortCookie;
+
+    CRITICAL_SECTION queueAccess;
+    Vec<PrintBand> queue;
+    HANDLE bandsFree, bandsReady;
+
+    bool WasCanceled() {
+        return WasCancelRequested() || progressUI && progressUI->WasCanceled();
+    }
+
+    void Push(PrintBand& band) {
+        WaitForSingleObject(bandsFree, INFINITE);
+        ScopedCritSec scope(&queueAccess);
+        queue.Append(band);
+        ReleaseSemaphore(bandsReady, 1, NULL);
+    }
+
+    void RenderBands(size_t layoutIdx) {
+        PrintPageLayout& layout = layouts.At(layoutIdx);
+        RectD pageRect = layout.isPartial ? layout.pageRect : engine.PageMediabox(layout.pageNo);
+        RectI full = engine.Transform(pageRect, layout.pageNo, layout.zoom, layout.rotation).Round();
+        int bandDy = max(PRINT_BAND_MAX_BYTES / (4 * max(full.dx, 1)), 1);
+
+        PrintBand band = { layoutIdx, true, RectI(), NULL };
+        for (int y = 0; y < full.dy && !WasCanceled(); ) {
+            RectI bandRect(full.x, full.y + y, full.dx, min(bandDy, full.dy - y));
+            RectD bandPageRect = engine.Transform(bandRect.Convert<double>(), layout.pageNo, layout.zoom, layout.rotation, true);
+            if (layout.isPartial)
+                bandPageRect = bandPageRect.Intersect(pageRect);
+            band.bmp = engine.RenderBitmap(layout.pageNo, layout.zoom, layout.rotation, &bandPageRect, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
+            if (abortCookie)
+                abortCookie->Clear();
+            if (!band.bmp && bandDy > 16 && !WasCanceled()) {
+                // try again with less memory
+                bandDy /= 2;
+                continue;
+            }
+            // RenderBitmap rounds the band's page rectangle on its own, so the bitmap
+            // might be a pixel larger or smaller than requested; stretching it to the
+            // band's exact size keeps consecutive bands from overlapping or leaving gaps
+            if (band.bmp)
+                band.target = RectI(layout.target.x, layout.target.y + y, full.dx, bandRect.dy);
+            Push(band);
+            band.isFirst = false;
+            y += bandRect.dy;
+        }
+        // make sure that each layout produces at least one band
+        if (band.isFirst) {
+            band.bmp = NULL;
+            Push(band);
+        }
+    }
+
+public:
+    PrintBandRenderer(BaseEngine& engine, Vec<PrintPageLayout>& layouts, ProgressUpdateUI *progressUI, AbortCookieManager *abortCookie) :
+        ThreadBase("PrintBandRenderer"), engine(engine), layouts(layouts),
+        progressUI(progressUI), abortCookie(abortCookie) {
+        InitializeCriticalSection(&queueAccess);
+        bandsFree = CreateSemaphore(NULL, PRINT_BANDS_QUEUED, PRINT_BANDS_QUEUED, NULL);
+        bandsReady = CreateSemaphore(NULL, 0, PRINT_BANDS_QUEUED, NULL);
+    }
+    virtual ~PrintBandRenderer() {
+        for (size_t i = 0; i < queue.Count(); i++) {
+            delete queue.At(i).bmp;
+        }
+        CloseHandle(bandsFree);
+        CloseHandle(bandsReady);
+        DeleteCriticalSection(&queueAccess);
+    }
+
+    virtual void Run() {
+        for (size_t i = 0; i < layouts.Count() && !WasCanceled(); i++) {
+            RenderBands(i);
+        }
+        // signal that all bands have been rendered
+        PrintBand done = { layouts.Count(), false, RectI(), NULL };
+        Push(done);
+    }
+
+    // blocks until the next band is available, returns false after the last band
+    // (the caller must delete band.bmp)
+    bool NextBand(PrintBand& band) {
+        WaitForSingleObject(bandsReady, INFINITE);
+        EnterCriticalSection(&queueAccess);
+        band = queue.At(0);
+        queue.RemoveAt(0);
+        LeaveCriticalSection(&queueAccess);
+        ReleaseSemaphore(bandsFree, 1, NULL);
+        return band.layoutIdx < layouts.Count();
+    }
+
+    // the remaining bands must still be consumed through NextBand
+    void Cancel() {
+        RequestCancel();
+        if (abortCookie)
+            abortCookie->Abort();
+    }
+};
+
+// ends the current printer page, returns false if printing has been aborted
+static bool EndSheet(HDC hdc, ProgressUpdateUI *progressUI)
+{
+    if (EndPage(hdc) <= 0 || progressUI && progressUI->WasCanceled()) {
+        AbortDoc(hdc);
+        return false;
+    }
+    return true;
+}
+
 static bool PrintToDevice(const PrintData& pd, ProgressUpdateUI *progressUI=NULL, AbortCookieManager *abortCookie=NULL)
 {
     AssertCrash(pd.engine);
@@ -166,17 +312,16 @@ static bool PrintToDevice(const PrintData& pd, ProgressUpdateUI *progressUI=NULL
     if (pd.devMode && (pd.devMode.Get()->dmFields & DM_ORIENTATION))
         bPrintPortrait = DMORIENT_PORTRAIT == pd.devMode.Get()->dmOrientation;
 
+    // determine where to print what before printing anything, so that
+    // rendering can run ahead of spooling when printing as image
+    Vec<PrintPageLayout> layouts;
+
     if (pd.sel.Count() > 0) {
         for (int pageNo = 1; pageNo <= engine.PageCount(); pageNo++) {
             RectD bounds = BoundSelectionOnPage(pd.sel, pageNo);
             if (bounds.IsEmpty())
                 continue;
 
-            if (progressUI)
-                progressUI->UpdateProgress(current, total);
-
-            StartPage(hdc);
-
             geomutil::SizeT<float> bSize = bounds.Size().Convert<float>();
             float zoom = min((float)printable.dx / bSize.dx,
                              (float)printable.dy / bSize.dy);
@@ -187,6 +332,7 @@ static bool PrintToDevice(const PrintData& pd, ProgressUpdateUI *progressUI=NULL
             else if (PrintScaleNone == pd.advData.scale)
                 zoom = dpiFactor;
 
+            bool newSheet = true;
             for (size_t i = 0; i < pd.sel.Count(); i++) {
                 if (pd.sel.At(i).pageNo != pageNo)
                     continue;
@@ -199,140 +345,131 @@ static bool PrintToDevice(const PrintData& pd, ProgressUpdateUI *progressUI=NULL
                     offset.y += (int)(printable.dy - bSize.dy * zoom) / 2;
                 }
 
-                bool ok = false;
-                if (!pd.advData.asImage) {
-                    RectI rc(offset.x, offset.y, (int)(clipRegion->dx * zoom), (int)(clipRegion->dy * zoom));
-                    ok = engine.RenderPage(hdc, rc, pd.sel.At(i).pageNo, zoom, pd.rotation, clipRegion, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
-                    if (abortCookie)
-                        abortCookie->Clear();
-                }
-                else {
-                    short shrink = 1;
-                    do {
-                        RenderedBitmap *bmp = engine.RenderBitmap(pd.sel.At(i).pageNo, zoom / shrink, pd.rotation, clipRegion, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
-                        if (abortCookie)
-                            abortCookie->Clear();
-                        if (bmp && bmp->GetBitmap()) {
-                            RectI rc(offset.x, offset.y, bmp->Size().dx * shrink, bmp->Size().dy * shrink);
-                            ok = bmp->StretchDIBits(hdc, rc);
-                        }
-                        delete bmp;
-                        shrink *= 2;
-                    } while (!ok && shrink < 32 && !(progressUI && progressUI->WasCanceled()));
-                }
-            }
-            // TODO: abort if !ok?
-
-            if (EndPage(hdc) <= 0 || progressUI && progressUI->WasCanceled()) {
-                AbortDoc(hdc);
-                return false;
+                PrintPageLayout layout = { pageNo, zoom, pd.rotation, *clipRegion, true,
+                    RectI(offset.x, offset.y, (int)(clipRegion->dx * zoom), (int)(clipRegion->dy * zoom)), newSheet };
+                layouts.Append(layout);
+                newSheet = false;
             }
-            current++;
         }
-
-        EndDoc(hdc);
-        return false;
     }
+    else {
+        // print all the pages the user requested
+        for (size_t i = 0; i < pd.ranges.Count(); i++) {
+            int dir = pd.ranges.At(i).nFromPage > pd.ranges.At(i).nToPage ? -1 : 1;
+            for (DWORD pageNo = pd.ranges.At(i).nFromPage; pageNo != pd.ranges.At(i).nToPage + dir; pageNo += dir) {
+                if ((PrintRangeEven == pd.advData.range && pageNo % 2 != 0) ||
+                    (PrintRangeOdd == pd.advData.range && pageNo % 2 == 0))
+                    continue;
 
-    // print all the pages the user requested
-    for (size_t i = 0; i < pd.ranges.Count(); i++) {
-        int dir = pd.ranges.At(i).nFromPage > pd.ranges.At(i).nToPage ? -1 : 1;
-        for (DWORD pageNo = pd.ranges.At(i).nFromPage; pageNo != pd.ranges.At(i).nToPage + dir; pageNo += dir) {
-            if ((PrintRangeEven == pd.advData.range && pageNo % 2 != 0) ||
-                (PrintRangeOdd == pd.advData.range && pageNo % 2 == 0))
-                continue;
-            if (progressUI)
-                progressUI->UpdateProgress(current, total);
+                geomutil::SizeT<float> pSize = engine.PageMediabox(pageNo).Size().Convert<float>();
+                int rotation = 0;
+                // Turn the document by 90 deg if it isn't in portrait mode
+                if (pSize.dx > pSize.dy) {
+                    rotation += 90;
+                    Swap(pSize.dx, pSize.dy);
+                }
+                // make sure not to print upside-down
+                rotation = (rotation % 180) == 0 ? 0 : 270;
+                // finally turn the page by (another) 90 deg in landscape mode
+                if (!bPrintPortrait) {
+                    rotation = (rotation + 90) % 360;
+                    Swap(pSize.dx, pSize.dy);
+                }
 
-            StartPage(hdc);
+                // dpiFactor means no physical zoom
+                float zoom = dpiFactor;
+                // offset of the top-left corner of the page from the printable area
+                // (negative values move the page into the left/top margins, etc.);
+                // offset adjustments are needed because the GDI coordinate system
+                // starts at the corner of the printable area and we rather want to
+                // center the page on the physical paper (except for PrintScaleNone
+                // where the page starts at the very top left of the physical paper so
+                // that printing forms/labels of varying size remains reliably possible)
+                PointI offset(-printable.x, -printable.y);
 
-            geomutil::SizeT<float> pSize = engine.PageMediabox(pageNo).Size().Convert<float>();
-            int rotation = 0;
-            // Turn the document by 90 deg if it isn't in portrait mode
-            if (pSize.dx > pSize.dy) {
-                rotation += 90;
-                Swap(pSize.dx, pSize.dy);
-            }
-            // make sure not to print upside-down
-            rotation = (rotation % 180) == 0 ? 0 : 270;
-            // finally turn the page by (another) 90 deg in landscape mode
-            if (!bPrintPortrait) {
-                rotation = (rotation + 90) % 360;
-                Swap(pSize.dx, pSize.dy);
-            }
+                if (pd.advData.scale != PrintScaleNone) {
+                    // make sure to fit all content into the printable area when scaling
+                    // and the whole document page on the physical paper
+                    RectD rect = engine.PageContentBox(pageNo, Target_Print);
+                    geomutil::RectT<float> cbox = engine.Transform(rect, pageNo, 1.0, rotation).Convert<float>();
+                    zoom = min((float)printable.dx / cbox.dx,
+                           min((float)printable.dy / cbox.dy,
+                           min((float)paperSize.dx / pSize.dx,
+                               (float)paperSize.dy / pSize.dy)));
+                    // use the correct zoom values, if the page fits otherwise
+                    // and the user didn't ask for anything else (default setting)
+                    if (PrintScaleShrink == pd.advData.scale && dpiFactor < zoom)
+                        zoom = dpiFactor;
+                    // center the page on the physical paper
+                    offset.x += (int)(paperSize.dx - pSize.dx * zoom) / 2;
+                    offset.y += (int)(paperSize.dy - pSize.dy * zoom) / 2;
+                    // make sure that no content lies in the non-printable paper margins
+                    geomutil::RectT<float> onPaper(printable.x + offset.x + cbox.x * zoom,
+                                                   printable.y + offset.y + cbox.y * zoom,
+                                                   cbox.dx * zoom, cbox.dy * zoom);
+                    if (onPaper.x < printable.x)
+                        offset.x += (int)(printable.x - onPaper.x);
+                    else if (onPaper.BR().x > printable.BR().x)
+                        offset.x -= (int)(onPaper.BR().x - printable.BR().x);
+                    if (onPaper.y < printable.y)
+                        offset.y += (int)(printable.y - onPaper.y);
+                    else if (onPaper.BR().y > printable.BR().y)
+                        offset.y -= (int)(onPaper.BR().y - printable.BR().y);
+                }
 
-            // dpiFactor means no physical zoom
-            float zoom = dpiFactor;
-            // offset of the top-left corner of the page from the printable area
-            // (negative values move the page into the left/top margins, etc.);
-            // offset adjustments are needed because the GDI coordinate system
-            // starts at the corner of the printable area and we rather want to
-            // center the page on the physical paper (except for PrintScaleNone
-            // where the page starts at the very top left of the physical paper so
-            // that printing forms/labels of varying size remains reliably possible)
-            PointI offset(-printable.x, -printable.y);
-
-            if (pd.advData.scale != PrintScaleNone) {
-                // make sure to fit all content into the printable area when scaling
-                // and the whole document page on the physical paper
-                RectD rect = engine.PageContentBox(pageNo, Target_Print);
-                geomutil::RectT<float> cbox = engine.Transform(rect, pageNo, 1.0, rotation).Convert<float>();
-                zoom = min((float)printable.dx / cbox.dx,
-                       min((float)printable.dy / cbox.dy,
-                       min((float)paperSize.dx / pSize.dx,
-                           (float)paperSize.dy / pSize.dy)));
-                // use the correct zoom values, if the page fits otherwise
-                // and the user didn't ask for anything else (default setting)
-                if (PrintScaleShrink == pd.advData.scale && dpiFactor < zoom)
-                    zoom = dpiFactor;
-                // center the page on the physical paper
-                offset.x += (int)(paperSize.dx - pSize.dx * zoom) / 2;
-                offset.y += (int)(paperSize.dy - pSize.dy * zoom) / 2;
-                // make sure that no content lies in the non-printable paper margins
-                geomutil::RectT<float> onPaper(printable.x + offset.x + cbox.x * zoom,
-                                               printable.y + offset.y + cbox.y * zoom,
-                                               cbox.dx * zoom, cbox.dy * zoom);
-                if (onPaper.x < printable.x)
-                    offset.x += (int)(printable.x - onPaper.x);
-                else if (onPaper.BR().x > printable.BR().x)
-                    offset.x -= (int)(onPaper.BR().x - printable.BR().x);
-                if (onPaper.y < printable.y)
-                    offset.y += (int)(printable.y - onPaper.y);
-                else if (onPaper.BR().y > printable.BR().y)
-                    offset.y -= (int)(onPaper.BR().y - printable.BR().y);
+                PrintPageLayout layout = { pageNo, zoom, rotation, RectD(), false,
+                    RectI::FromXY(offset.x, offset.y, paperSize.dx, paperSize.dy), true };
+                layouts.Append(layout);
             }
+        }
+    }
 
-            bool ok = false;
-            if (!pd.advData.asImage) {
-                RectI rc = RectI::FromXY(offset.x, offset.y, paperSize.dx, paperSize.dy);
-                ok = engine.RenderPage(hdc, rc, pageNo, zoom, rotation, NULL, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
-                if (abortCookie)
-                    abortCookie->Clear();
+    if (!pd.advData.asImage) {
+        for (size_t i = 0; i < layouts.Count(); i++) {
+            PrintPageLayout& layout = layouts.At(i);
+            if (layout.newSheet) {
+                if (i > 0 && !EndSheet(hdc, progressUI))
+                    return false;
+                if (progressUI)
+                    progressUI->UpdateProgress(current++, total);
+                StartPage(hdc);
             }
-            else {
-                short shrink = 1;
-                do {
-                    RenderedBitmap *bmp = engine.RenderBitmap(pageNo, zoom / shrink, rotation, NULL, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
-                    if (abortCookie)
-                        abortCookie->Clear();
-                    if (bmp && bmp->GetBitmap()) {
-                        RectI rc(offset.x, offset.y, bmp->Size().dx * shrink, bmp->Size().dy * shrink);
-                        ok = bmp->StretchDIBits(hdc, rc);
-                    }
-                    delete bmp;
-                    shrink *= 2;
-                } while (!ok && shrink < 32 && !(progressUI && progressUI->WasCanceled()));
-            }
-            // TODO: abort if !ok?
-
-            if (EndPage(hdc) <= 0 || progressUI && progressUI->WasCanceled()) {
-                AbortDoc(hdc);
-                return false;
+            engine.RenderPage(hdc, layout.target, layout.pageNo, layout.zoom, layout.rotation,
+                              layout.isPartial ? &layout.pageRect : NULL, Target_Print, abortCookie ? &abortCookie->cookie : NULL);
+            if (abortCookie)
+                abortCookie->Clear();
+            // TODO: abort if rendering failed?
+        }
+    }
+    else {
+        PrintBandRenderer renderer(engine, layouts, progressUI, abortCookie);
+        renderer.Start();
+        bool aborted = false;
+        PrintBand band;
+        while (renderer.NextBand(band)) {
+            if (!aborted && band.isFirst && layouts.At(band.layoutIdx).newSheet) {
+                if (band.layoutIdx > 0 && !EndSheet(hdc, progressUI)) {
+                    aborted = true;
+                    renderer.Cancel();
+                }
+                else {
+                    if (progressUI)
+                        progressUI->UpdateProgress(current++, total);
+                    StartPage(hdc);
+                }
             }
-            current++;
+            if (!aborted && band.bmp)
+                band.bmp->StretchDIBits(hdc, band.target);
+            // TODO: abort if rendering failed?
+            delete band.bmp;
         }
+        renderer.Join();
+        if (aborted)
+            return false;
     }
 
+    if (layouts.Count() > 0 && !EndSheet(hdc, progressUI))
+        return false;
     EndDoc(hdc);
     return true;
 }
@@ -389,8 +389,9 @@ bool OnInverseSearch(WindowInfo *win, int x, int y)
     // On double-clicking error message will be shown to the user
     // if the PDF does not have a synchronization file
     if (!win->pdfsync) {
+        ScopedMem<WCHAR> cachePath(GetPdfsyncCachePath(win->loadedFilePath));
         int err = Synchronizer::Create(win->loadedFilePath,
-            static_cast<PdfEngine *>(win->dm->engine), &win->pdfsync);
+            static_cast<PdfEngine *>(win->dm->engine), &win->pdfsync, cachePath);
         if (err == PDFSYNCERR_SYNCFILE_NOTFOUND) {
             // We used to warn that "No synchronization file found" at this
             // point if gGlobalPrefs->enableTeXEnhancements is set; we no longer
@@ -745,7 +745,7 @@ void DrawStartPage(WindowInfo& win, HDC hdc, FileHistory& fileHistory, COLORREF
 }
 
 // TODO: create in TEMP directory instead?
-static WCHAR *GetThumbnailPath(const WCHAR *filePath)
+WCHAR *GetCacheFilePath(const WCHAR *filePath, const WCHAR *ext)
 {
     // create a fingerprint of a (normalized) path for the file name
     // I'd have liked to also include the file's last modification time
@@ -768,41 +768,52 @@ static WCHAR *GetThumbnailPath(const WCHAR *filePath)
         return NULL;
     ScopedMem<WCHAR> fname(str::conv::FromAnsi(fingerPrint));
 
-    return str::Format(L"%s\\%s.png", thumbsPath, fname);
+    return str::Format(L"%s\\%s.%s", thumbsPath, fname, ext);
+}
+
+static WCHAR *GetThumbnailPath(const WCHAR *filePath)
+{
+    return GetCacheFilePath(filePath, L"png");
 }
 
-// removes thumbnails that don't belong to any frequently used item in file history
+// removes thumbnails (and cached .pdfsync data) that don't belong
+// to any frequently used item in file history
 void CleanUpThumbnailCache(FileHistory& fileHistory)
 {
     ScopedMem<WCHAR> thumbsPath(AppGenDataFilename(THUMBNAILS_DIR_NAME));
     if (!thumbsPath)
         return;
-    ScopedMem<WCHAR> pattern(path::Join(thumbsPath, L"*.png"));
+    const WCHAR *exts[] = { L"png", L"pdfsync" };
 
     WStrVec files;
     WIN32_FIND_DATA fdata;
 
-    HANDLE hfind = FindFirstFile(pattern, &fdata);
-    if (INVALID_HANDLE_VALUE == hfind)
-        return;
-    do {
-        if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-            files.Append(str::Dup(fdata.cFileName));
-    } while (FindNextFile(hfind, &fdata));
-    FindClose(hfind);
+    for (size_t i = 0; i < dimof(exts); i++) {
+        ScopedMem<WCHAR> pattern(str::Format(L"%s\\*.%s", thumbsPath, exts[i]));
+        HANDLE hfind = FindFirstFile(pattern, &fdata);
+        if (INVALID_HANDLE_VALUE == hfind)
+            continue;
+        do {
+            if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                files.Append(str::Dup(fdata.cFileName));
+        } while (FindNextFile(hfind, &fdata));
+        FindClose(hfind);
+    }
 
     Vec<DisplayState *> list;
     fileHistory.GetFrequencyOrder(list);
     for (size_t i = 0; i < list.Count() && i < FILE_HISTORY_MAX_FREQUENT * 2; i++) {
-        ScopedMem<WCHAR> bmpPath(GetThumbnailPath(list.At(i)->filePath));
-        if (!bmpPath)
-            continue;
-        int idx = files.Find(path::GetBaseName(bmpPath));
-        if (idx != -1) {
-            CrashIf(idx < 0 || files.Count() <= (size_t)idx);
-            WCHAR *fileName = files.At(idx);
-            files.RemoveAt(idx);
-            free(fileName);
+        for (size_t j = 0; j < dimof(exts); j++) {
+            ScopedMem<WCHAR> cachePath(GetCacheFilePath(list.At(i)->filePath, exts[j]));
+            if (!cachePath)
+                continue;
+            int idx = files.Find(path::GetBaseName(cachePath));
+            if (idx != -1) {
+                CrashIf(idx < 0 || files.Count() <= (size_t)idx);
+                WCHAR *fileName = files.At(idx);
+                files.RemoveAt(idx);
+                free(fileName);
+            }
         }
     }
 
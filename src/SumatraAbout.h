@@ -24,6 +24,8 @@ const WCHAR *GetStaticLink(Vec<StaticLinkInfo>& linkInfo, int x, int y, StaticLi
 #define THUMBNAIL_DY        150
 
 void    DrawStartPage(WindowInfo& win, HDC hdc, FileHistory& fileHistory, COLORREF textColor, COLORREF backgroundColor);
+// path of a file in the thumbnail cache directory belonging to the given document
+WCHAR * GetCacheFilePath(const WCHAR *filePath, const WCHAR *ext);
 void    CleanUpThumbnailCache(FileHistory& fileHistory);
 bool    HasThumbnail(DisplayState& ds);
 void    SaveThumbnail(DisplayState& ds);
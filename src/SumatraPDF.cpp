@@ -809,6 +809,16 @@ bool ShouldSaveThumbnail(DisplayState& ds)
     return true;
 }
 
+// the parsed data of large .pdfsync files is cached next to the thumbnails;
+// as it contains the paths of the document's sources, it's only cached if
+// we're allowed to leave traces of opened documents on disk
+WCHAR *GetPdfsyncCachePath(const WCHAR *filePath)
+{
+    if (!HasPermission(Perm_SavePreferences | Perm_DiskAccess) || !gGlobalPrefs->rememberOpenedFiles)
+        return NULL;
+    return GetCacheFilePath(filePath, L"pdfsync");
+}
+
 static void CreateThumbnailForFile(WindowInfo& win, DisplayState& ds)
 {
     if (!ShouldSaveThumbnail(ds))
@@ -1055,8 +1065,9 @@ static bool LoadDocIntoWindow(LoadArgs& args, PasswordUI *pwdUI, DisplayState *s
     win::SetText(win->hwndFrame, title);
 
     if (HasPermission(Perm_DiskAccess) && Engine_PDF == win->dm->engineType) {
+        ScopedMem<WCHAR> cachePath(GetPdfsyncCachePath(args.fileName));
         int res = Synchronizer::Create(args.fileName,
-            static_cast<PdfEngine *>(win->dm->engine), &win->pdfsync);
+            static_cast<PdfEngine *>(win->dm->engine), &win->pdfsync, cachePath);
         // expose SyncTeX in the UI
         if (PDFSYNCERR_SUCCESS == res)
             gGlobalPrefs->enableTeXEnhancements = true;
@@ -1344,7 +1355,7 @@ static void RenameFileInHistory(const WCHAR *oldPath, const WCHAR *newPath)
     }
     ds = gFileHistory.Find(oldPath);
     if (ds) {
-        str::ReplacePtr(&ds->filePath, newPath);
+        gFileHistory.UpdateFilePath(ds, newPath);
         // merge Frequently Read data, so that a file
         // doesn't accidentally vanish from there
         ds->isPinned = ds->isPinned || oldIsPinned;
@@ -122,6 +122,7 @@ void  OnMenuAbout();
 void  QuitIfNoMoreWindows();
 bool  ShouldSaveThumbnail(DisplayState& ds);
 void  SaveThumbnailForFile(const WCHAR *filePath, RenderedBitmap *bmp);
+WCHAR *GetPdfsyncCachePath(const WCHAR *filePath);
 
 COLORREF GetLogoBgColor();
 COLORREF GetAboutBgColor();
@@ -13,10 +13,14 @@
 #include "FileUtil.h"
 using namespace Gdiplus;
 #include "GdiPlusUtil.h"
+#include "HtmlParserLookup.h"
 #include "HtmlPrettyPrint.h"
+#include "HtmlPullParser.h"
+#include "JsonParser.h"
 #include "MobiDoc.h"
 #include "Mui.h"
 #include "PdfEngine.h"
+#include "ThreadUtil.h"
 #include "Timer.h"
 #include "WinUtil.h"
 #include "ZipUtil.h"
@@ -42,7 +46,10 @@ static int Usage()
     printf("  -save-html] - will save html content of mobi file\n");
     printf("  -save-images - will save images extracted from mobi files\n");
     printf("  -zip-create - creates a sample zip file that needs to be manually checked that it worked\n");
+    printf("  -zip-read file - extracts a zip file from several threads at once\n");
     printf("  -bench-md5 - compare Window's md5 vs. our code\n");
+    printf("  -bench-lookup - time tag and css property name lookups\n");
+    printf("  -bench-json - compare json::Parse vs. json::PullParser\n");
     system("pause");
     return 1;
 }
@@ -106,6 +113,97 @@ static void BenchMD5()
     free(data);
 }
 
+// tag names weighted roughly by how often they show up in ebook html,
+// plus a few names we don't know about (which have to be rejected)
+static const char *gBenchTagNames[] = {
+    "p", "p", "p", "p", "p", "p", "p", "p", "span", "span", "span", "span",
+    "a", "a", "br", "br", "div", "div", "i", "b", "em", "strong", "img",
+    "h1", "h2", "h3", "li", "td", "tr", "blockquote", "mbp:pagebreak",
+    "P", "SPAN", "Div", "font", "table", "sup", "sub", "hr", "center",
+    "guide", "reference", "dc:title", "xyz", "spam", "pp",
+};
+
+static const char *gBenchCssProps[] = {
+    "text-indent", "text-align", "margin-left", "margin-top", "font-size",
+    "font-weight", "font-style", "font-family", "margin", "padding",
+    "color", "display", "line-height", "TEXT-ALIGN", "widows", "orphans",
+};
+
+static void BenchLookup()
+{
+    const int iterations = 200000;
+    size_t tagLens[dimof(gBenchTagNames)], cssLens[dimof(gBenchCssProps)];
+    for (size_t i = 0; i < dimof(gBenchTagNames); i++)
+        tagLens[i] = str::Len(gBenchTagNames[i]);
+    for (size_t i = 0; i < dimof(gBenchCssProps); i++)
+        cssLens[i] = str::Len(gBenchCssProps[i]);
+
+    // accumulate the results so that the lookups can't be optimized away
+    int sum = 0;
+    Timer t1(true);
+    for (int n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < dimof(gBenchTagNames); i++)
+            sum += FindHtmlTag(gBenchTagNames[i], tagLens[i]);
+    }
+    double dur1 = t1.GetTimeInMs();
+
+    Timer t2(true);
+    for (int n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < dimof(gBenchCssProps); i++)
+            sum += FindCssProp(gBenchCssProps[i], cssLens[i]);
+    }
+    double dur2 = t2.GetTimeInMs();
+
+    double count1 = (double)iterations * dimof(gBenchTagNames);
+    double count2 = (double)iterations * dimof(gBenchCssProps);
+    printf("FindHtmlTag: %f ms (%f ns per lookup)\n", dur1, dur1 * 1000000 / count1);
+    printf("FindCssProp: %f ms (%f ns per lookup)\n", dur2, dur2 * 1000000 / count2);
+    printf("(checksum: %d)\n", sum);
+}
+
+class JsonCountingVisitor : public json::ValueVisitor {
+public:
+    size_t count;
+    JsonCountingVisitor() : count(0) { }
+    virtual bool Visit(const char *path, const char *value, json::DataType type) {
+        count++;
+        return true;
+    }
+};
+
+static void BenchJson()
+{
+    // generate a few MB of ComicBookInfo-like data
+    str::Str<char> data;
+    data.Append("{ \"items\": [\n");
+    for (int i = 0; i < 40000; i++) {
+        data.AppendFmt("%s{ \"title\": \"Item \\u00e4 %d\", \"year\": %d, \"rating\": %d.%de-1, "
+                       "\"credits\": [ { \"person\": \"Person %d\", \"primary\": true }, null ] }\n",
+                       i > 0 ? ", " : "", i, 1900 + i % 120, i % 5, i % 10, i);
+    }
+    data.Append("] }");
+    printf("JSON data: %d bytes\n", (int)data.Size());
+
+    JsonCountingVisitor visitor;
+    Timer t1(true);
+    bool ok1 = json::Parse(data.Get(), &visitor);
+    double dur1 = t1.GetTimeInMs();
+
+    size_t count = 0, matches = 0;
+    Timer t2(true);
+    json::PullParser parser(data.Get(), data.Size());
+    for (json::Token *tok; (tok = parser.Next()) != NULL; ) {
+        count++;
+        if (parser.PathIs("/items[*]/credits[*]/person"))
+            matches++;
+    }
+    bool ok2 = !parser.IsError();
+    double dur2 = t2.GetTimeInMs();
+
+    printf("json::Parse:      %f ms (%d values, ok: %d)\n", dur1, (int)visitor.count, ok1);
+    printf("json::PullParser: %f ms (%d values, %d matches, ok: %d)\n", dur2, (int)count, (int)matches, ok2);
+}
+
 static void MobiSaveHtml(const WCHAR *filePathBase, MobiDoc *mb)
 {
     CrashAlwaysIf(!gSaveHtml);
@@ -140,34 +238,128 @@ static void MobiSaveImages(const WCHAR *filePathBase, MobiDoc *mb)
     }
 }
 
-// This loads and layouts a given mobi file. Used for profiling layout process.
-static void MobiLayout(MobiDoc *mobiDoc)
+static Vec<HtmlPage*> *MobiFormatAllPages(MobiDoc *mobiDoc, PoolAllocator *textAllocator)
 {
-    PoolAllocator textAllocator;
-
     HtmlFormatterArgs args;
     args.pageDx = 640;
     args.pageDy = 480;
     args.SetFontName(L"Tahoma");
     args.fontSize = 12;
     args.htmlStr = mobiDoc->GetBookHtmlData(args.htmlStrLen);
-    args.textAllocator = &textAllocator;
+    args.htmlSource = mobiDoc;
+    args.textAllocator = textAllocator;
 
     MobiFormatter mf(&args, mobiDoc);
-    Vec<HtmlPage*> *pages = mf.FormatAllPages();
+    return mf.FormatAllPages();
+}
+
+// This loads and layouts a given mobi file. Used for profiling layout process.
+static void MobiLayout(MobiDoc *mobiDoc)
+{
+    PoolAllocator textAllocator;
+    Vec<HtmlPage*> *pages = MobiFormatAllPages(mobiDoc, &textAllocator);
     DeleteVecMembers<HtmlPage*>(*pages);
     delete pages;
 }
 
+// Decoding the text records in parallel must produce exactly
+// the same html as decoding them one after another
+static void MobiCompareDecoding(const WCHAR *filePath, MobiDoc *mobiDoc, double parallelMs)
+{
+    Timer t(true);
+    MobiDoc *seqDoc = MobiDoc::CreateFromFile(filePath, false);
+    double sequentialMs = t.GetTimeInMs();
+    if (!seqDoc) {
+        printf(" error: failed to parse the file without parallel decoding\n");
+        return;
+    }
+    size_t len, seqLen;
+    const char *html = mobiDoc->GetBookHtmlData(len);
+    const char *seqHtml = seqDoc->GetBookHtmlData(seqLen);
+    if (len != seqLen || memcmp(html, seqHtml, len) != 0)
+        printf(" error: parallel and sequential decoding differ\n");
+    wprintf(L"Spent %.2f ms loading (%.2f ms without parallel decoding) %s\n", parallelMs, sequentialMs, filePath);
+    delete seqDoc;
+}
+
+static bool MobiLayoutsEqual(Vec<HtmlPage*> *pages1, Vec<HtmlPage*> *pages2)
+{
+    if (pages1->Count() != pages2->Count())
+        return false;
+    for (size_t i = 0; i < pages1->Count(); i++) {
+        HtmlPage *p1 = pages1->At(i), *p2 = pages2->At(i);
+        if (p1->reparseIdx != p2->reparseIdx || p1->instructions.Count() != p2->instructions.Count())
+            return false;
+    }
+    return true;
+}
+
+// Decoding the text records only as the html is being parsed must produce
+// exactly the same html (and the same layout) as decoding them all at once
+static void MobiCompareLazyDecoding(const WCHAR *filePath, MobiDoc *mobiDoc)
+{
+    Timer t(true);
+    MobiDoc *lazyDoc = MobiDoc::CreateFromFileLazy(filePath);
+    double lazyMs = t.GetTimeInMs();
+    if (!lazyDoc) {
+        printf(" error: failed to parse the file with lazy decoding\n");
+        return;
+    }
+    size_t len, lazyLen;
+    const char *html = mobiDoc->GetBookHtmlData(len);
+    const char *lazyHtml = lazyDoc->GetBookHtmlData(lazyLen);
+    HtmlPullParser parser(html, len);
+    HtmlPullParser lazyParser(lazyHtml, lazyLen, lazyDoc);
+    for (;;) {
+        HtmlToken *tok = parser.Next();
+        HtmlToken *lazyTok = lazyParser.Next();
+        if (!tok || !lazyTok) {
+            if (tok || lazyTok)
+                printf(" error: lazily decoded html has a different number of tokens\n");
+            break;
+        }
+        if (tok->type != lazyTok->type || tok->s - html != lazyTok->s - lazyHtml ||
+            !tok->IsError() && tok->sLen != lazyTok->sLen) {
+            printf(" error: lazily decoded html is parsed differently\n");
+            break;
+        }
+    }
+    lazyHtml = lazyDoc->GetBookHtmlData(lazyLen);
+    if (len != lazyLen || memcmp(html, lazyHtml, len) != 0)
+        printf(" error: lazy and eager decoding differ\n");
+    wprintf(L"Spent %.2f ms loading with lazy decoding %s\n", lazyMs, filePath);
+    delete lazyDoc;
+
+    if (!gLayout)
+        return;
+    lazyDoc = MobiDoc::CreateFromFileLazy(filePath);
+    CrashAlwaysIf(!lazyDoc);
+    PoolAllocator textAllocator;
+    Vec<HtmlPage*> *pages = MobiFormatAllPages(mobiDoc, &textAllocator);
+    Vec<HtmlPage*> *lazyPages = MobiFormatAllPages(lazyDoc, &textAllocator);
+    if (!MobiLayoutsEqual(pages, lazyPages))
+        printf(" error: lazily decoded html is laid out differently\n");
+    DeleteVecMembers<HtmlPage*>(*pages);
+    DeleteVecMembers<HtmlPage*>(*lazyPages);
+    delete pages;
+    delete lazyPages;
+    delete lazyDoc;
+}
+
 static void MobiTestFile(const WCHAR *filePath)
 {
     wprintf(L"Testing file '%s'\n", filePath);
+    Timer t(true);
     MobiDoc *mobiDoc = MobiDoc::CreateFromFile(filePath);
+    double loadMs = t.GetTimeInMs();
     if (!mobiDoc) {
         printf(" error: failed to parse the file\n");
         return;
     }
 
+    MobiCompareDecoding(filePath, mobiDoc, loadMs);
+    MobiCompareLazyDecoding(filePath, mobiDoc);
+
     if (gLayout) {
         Timer t(true);
         MobiLayout(mobiDoc);
@@ -253,6 +445,82 @@ void ZipCreateTest()
     delete zc;
 }
 
+class ZipReadThread : public ThreadBase {
+    ZipFile *zip;
+    Vec<char *> *expected;
+    Vec<size_t> *expectedLen;
+    size_t offset;
+
+public:
+    int errors;
+
+    ZipReadThread(ZipFile *zip, Vec<char *> *expected, Vec<size_t> *expectedLen, size_t offset) :
+        zip(zip), expected(expected), expectedLen(expectedLen), offset(offset), errors(0) { }
+    virtual ~ZipReadThread() { }
+
+    virtual void Run() {
+        size_t count = zip->GetFileCount();
+        for (int round = 0; round < 10; round++) {
+            // every thread starts at a different file
+            for (size_t i = 0; i < count; i++) {
+                size_t idx = (i + offset) % count;
+                size_t len = 0;
+                ScopedMem<char> data(zip->GetFileDataByIdx(idx, &len));
+                char *exp = expected->At(idx);
+                if (!data != !exp || data && (len != expectedLen->At(idx) || memcmp(data, exp, len) != 0))
+                    errors++;
+            }
+        }
+    }
+};
+
+// Extracting files concurrently must produce exactly the same data
+// as extracting them one after the other
+static void ZipReadTest(const WCHAR *zipPath)
+{
+    ZipFile zip(zipPath);
+    size_t count = zip.GetFileCount();
+    if (0 == count) {
+        wprintf(L"ZipReadTest(): no files in %s\n", zipPath);
+        return;
+    }
+
+    int errors = 0;
+    for (size_t i = 0; i < count; i++) {
+        const WCHAR *name = zip.GetFileName(i);
+        if (!str::EqI(zip.GetFileName(zip.GetFileIndex(name)), name))
+            errors++;
+    }
+
+    Vec<char *> data;
+    Vec<size_t> lens;
+    Timer t1(true);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = 0;
+        data.Append(zip.GetFileDataByIdx(i, &len));
+        lens.Append(len);
+    }
+    double sequentialMs = t1.GetTimeInMs();
+
+    ZipReadThread *threads[4];
+    Timer t2(true);
+    for (size_t i = 0; i < dimof(threads); i++) {
+        threads[i] = new ZipReadThread(&zip, &data, &lens, i * count / dimof(threads));
+        threads[i]->Start();
+    }
+    for (size_t i = 0; i < dimof(threads); i++) {
+        threads[i]->Join();
+        errors += threads[i]->errors;
+        delete threads[i];
+    }
+    double parallelMs = t2.GetTimeInMs();
+
+    FreeVecMembers(data);
+    if (errors > 0)
+        printf(" error: %d mismatches\n", errors);
+    wprintf(L"Extracted %d files in %.2f ms (%d threads: %.2f ms for 10 rounds) %s\n", (int)count, sequentialMs, (int)dimof(threads), parallelMs, zipPath);
+}
+
 int TesterMain()
 {
     RedirectIOToConsole();
@@ -290,9 +558,21 @@ int TesterMain()
         } else if (str::Eq(argv[i], L"-zip-create")) {
             ZipCreateTest();
             ++i;
+        } else if (str::Eq(argv[i], L"-zip-read")) {
+            ++i;
+            if (i == argv.Count())
+                return Usage();
+            ZipReadTest(argv[i]);
+            ++i;
         } else if (str::Eq(argv[i], L"-bench-md5")) {
             BenchMD5();
             ++i;
+        } else if (str::Eq(argv[i], L"-bench-lookup")) {
+            BenchLookup();
+            ++i;
+        } else if (str::Eq(argv[i], L"-bench-json")) {
+            BenchJson();
+            ++i;
         } else {
             // unknown argument
             return Usage();
@@ -4,6 +4,7 @@
 #include "BaseUtil.h"
 #include "AppUtil.h"
 #include "FileUtil.h"
+#include "PdfSyncIndex.h"
 #include "WinUtil.h"
 
 // must be last due to assert() over-write
@@ -192,6 +193,133 @@ static void hexstrTest()
     utassert(ok);
 }
 
+// the original linear search through all lines declared for a file
+static size_t FindClosestLineLinear(PdfsyncIndex& idx, size_t isrc, UINT line, UINT maxDistance)
+{
+    UINT minDistance = maxDistance;
+    size_t lineIx = (size_t)-1;
+    for (size_t i = idx.fileIndex.At(isrc).start; i < idx.fileIndex.At(isrc).end; i++) {
+        if (idx.lines.At(i).file != isrc)
+            continue;
+        UINT d = abs((int)idx.lines.At(i).line - (int)line);
+        if (d < minDistance) {
+            minDistance = d;
+            lineIx = i;
+            if (0 == d)
+                break;
+        }
+    }
+    return lineIx;
+}
+
+static void PdfsyncLookupTest(PdfsyncIndex& idx)
+{
+    for (size_t isrc = 0; isrc < idx.srcfiles.Count(); isrc++) {
+        for (UINT line = 0; line < 320; line++) {
+            utassert(idx.FindClosestLine(isrc, line, 5) == FindClosestLineLinear(idx, isrc, line, 5));
+        }
+    }
+    for (UINT record = 0; record < 410; record++) {
+        Vec<size_t> found;
+        idx.FindRecordPoints(record, found);
+        size_t n = 0;
+        for (size_t i = 0; i < idx.points.Count(); i++) {
+            if (idx.points.At(i).record == record)
+                utassert(n < found.Count() && found.At(n++) == i);
+        }
+        utassert(n == found.Count());
+    }
+}
+
+static void PdfsyncIndexTest()
+{
+    // main.tex includes chapter1.tex (lines 100 to 199) and chapter2.tex (lines 300 to 349)
+    PdfsyncIndex idx;
+    idx.srcfiles.Append(str::Dup(L"C:\\thesis\\main.tex"));
+    idx.srcfiles.Append(str::Dup(L"C:\\thesis\\chapter1.tex"));
+    idx.srcfiles.Append(str::Dup(L"C:\\thesis\\chapter2.tex"));
+    PdfsyncFileIndex files[] = { { 0, 400 }, { 100, 200 }, { 300, 350 } };
+    idx.fileIndex.Append(files, dimof(files));
+    idx.sheetIndex.Append(0);
+    UINT seed = 1;
+    for (UINT i = 0; i < 400; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t file = 100 <= i && i < 200 ? 1 : 300 <= i && i < 350 ? 2 : 0;
+        // source lines repeat, so that ties between lines are tested as well
+        PdfsyncLine line = { i, file, (seed >> 16) % 300, 0 };
+        idx.lines.Append(line);
+        if (0 == i % 100)
+            idx.sheetIndex.Append(idx.points.Count());
+        PdfsyncPoint pt = { i, 1 + i / 100, (seed >> 4) % 40000, (seed >> 8) % 50000 };
+        idx.points.Append(pt);
+        // some records are mapped to a second point further down the page
+        if (0 == i % 7) {
+            pt.record = (i + 3) % 400;
+            idx.points.Append(pt);
+        }
+    }
+    idx.BuildLookupIndices();
+    PdfsyncLookupTest(idx);
+
+    ScopedMem<WCHAR> cachePath(path::GetTempPath(L"sync"));
+    utassert(cachePath);
+    if (!cachePath)
+        return;
+    PdfsyncCacheKey key = { 12345678, 1400000000, 4 };
+    utassert(idx.SaveCache(cachePath, key));
+
+    // round-trip
+    PdfsyncIndex loaded;
+    utassert(loaded.LoadCache(cachePath, key));
+    utassert(loaded.srcfiles.Count() == idx.srcfiles.Count());
+    for (size_t i = 0; i < idx.srcfiles.Count() && i < loaded.srcfiles.Count(); i++) {
+        utassert(str::Eq(loaded.srcfiles.At(i), idx.srcfiles.At(i)));
+    }
+    utassert(loaded.lines.Count() == idx.lines.Count() && memeq(loaded.lines.LendData(), idx.lines.LendData(), idx.lines.Count() * sizeof(PdfsyncLine)));
+    utassert(loaded.points.Count() == idx.points.Count() && memeq(loaded.points.LendData(), idx.points.LendData(), idx.points.Count() * sizeof(PdfsyncPoint)));
+    utassert(loaded.fileIndex.Count() == idx.fileIndex.Count() && memeq(loaded.fileIndex.LendData(), idx.fileIndex.LendData(), idx.fileIndex.Count() * sizeof(PdfsyncFileIndex)));
+    utassert(loaded.sheetIndex.Count() == idx.sheetIndex.Count() && memeq(loaded.sheetIndex.LendData(), idx.sheetIndex.LendData(), idx.sheetIndex.Count() * sizeof(size_t)));
+    PdfsyncLookupTest(loaded);
+
+    // stale cache (the sync file or the document changed)
+    PdfsyncCacheKey stale = key;
+    stale.modTime++;
+    utassert(!loaded.LoadCache(cachePath, stale));
+    utassert(0 == loaded.srcfiles.Count() && 0 == loaded.lines.Count() && 0 == loaded.lineRefs.Count());
+    stale = key;
+    stale.fileSize--;
+    utassert(!loaded.LoadCache(cachePath, stale));
+    stale = key;
+    stale.pageCount++;
+    utassert(!loaded.LoadCache(cachePath, stale));
+    utassert(loaded.LoadCache(cachePath, key));
+
+    // corrupt cache files
+    size_t len;
+    ScopedMem<char> data(file::ReadAll(cachePath, &len));
+    utassert(data && len > 0);
+    utassert(file::WriteAll(cachePath, data, len - 1));
+    utassert(!loaded.LoadCache(cachePath, key));
+    utassert(0 == loaded.srcfiles.Count() && 0 == loaded.lines.Count());
+    str::Str<char> padded;
+    padded.Append(data, len);
+    padded.Append("\0", 1);
+    utassert(file::WriteAll(cachePath, padded.Get(), padded.Size()));
+    utassert(!loaded.LoadCache(cachePath, key));
+    utassert(file::WriteAll(cachePath, data, 16));
+    utassert(!loaded.LoadCache(cachePath, key));
+    // well-formed but inconsistent data
+    idx.lines.At(17).file = idx.srcfiles.Count();
+    utassert(idx.SaveCache(cachePath, key));
+    utassert(!loaded.LoadCache(cachePath, key));
+    idx.lines.At(17).file = 0;
+    idx.fileIndex.At(2).end = idx.lines.Count() + 1;
+    utassert(idx.SaveCache(cachePath, key));
+    utassert(!loaded.LoadCache(cachePath, key));
+
+    file::Delete(cachePath);
+}
+
 void SumatraPDF_UnitTests()
 {
 #if 0
@@ -201,4 +329,5 @@ void SumatraPDF_UnitTests()
     versioncheck_test();
     UrlExtractTest();
     hexstrTest();
+    PdfsyncIndexTest();
 }
@@ -9,6 +9,8 @@
 
 VOID CEpubFilter::CleanUp()
 {
+    delete m_htmlParser;
+    m_htmlParser = NULL;
     if (m_epubDoc) {
         delete m_epubDoc;
         m_epubDoc = NULL;
@@ -54,17 +56,23 @@ static bool IsoDateParse(const WCHAR *isoDate, SYSTEMTIME *timeOut)
     // don't bother about the day of week, we won't display it anyway
 }
 
-static WCHAR *ExtractHtmlText(EpubDoc *doc)
+// extracts the text of the next section (i.e. of the next HTML file in reading order),
+// returns NULL once all sections have been extracted
+static WCHAR *ExtractHtmlText(HtmlPullParser& p)
 {
-    size_t len;
-    const char *data = doc->GetTextData(&len);
-
-    str::Str<char> text(len / 2);
-    HtmlPullParser p(data, len);
+    str::Str<char> text;
     HtmlToken *t;
     Vec<HtmlTag> tagNesting;
+    bool hasContent = false;
     while ((t = p.Next()) != NULL && !t->IsError()) {
-        if (t->IsText() && !tagNesting.Contains(Tag_Head) && !tagNesting.Contains(Tag_Script) && !tagNesting.Contains(Tag_Style)) {
+        hasContent = true;
+        if (t->IsTag() && Tag_Pagebreak == t->tag) {
+            // EpubDoc separates sections with page breaks
+            if (text.Size() > 0)
+                break;
+            tagNesting.Reset();
+        }
+        else if (t->IsText() && !tagNesting.Contains(Tag_Head) && !tagNesting.Contains(Tag_Script) && !tagNesting.Contains(Tag_Style)) {
             // trim whitespace (TODO: also normalize within text?)
             while (t->sLen > 0 && str::IsWs(t->s[0])) {
                 t->s++;
@@ -98,6 +106,8 @@ static WCHAR *ExtractHtmlText(EpubDoc *doc)
                 tagNesting.Pop();
         }
     }
+    if (!hasContent)
+        return NULL;
 
     return str::conv::FromUtf8(text.Get());
 }
@@ -147,12 +157,18 @@ HRESULT CEpubFilter::GetNextChunkValue(CChunkValue &chunkValue)
         // fall through
 
     case STATE_EPUB_CONTENT:
-        m_state = STATE_EPUB_END;
-        str.Set(ExtractHtmlText(m_epubDoc));
-        if (!str::IsEmpty(str.Get())) {
+        if (!m_htmlParser) {
+            size_t len;
+            const char *data = m_epubDoc->GetTextData(&len);
+            m_htmlParser = new HtmlPullParser(data, len);
+        }
+        for (str.Set(ExtractHtmlText(*m_htmlParser)); str; str.Set(ExtractHtmlText(*m_htmlParser))) {
+            if (str::IsEmpty(str.Get()))
+                continue;
             chunkValue.SetTextValue(PKEY_Search_Contents, str, CHUNK_TEXT);
             return S_OK;
         }
+        m_state = STATE_EPUB_END;
         // fall through
 
     case STATE_EPUB_END:
@@ -7,12 +7,13 @@
 enum EPUB_FILTER_STATE { STATE_EPUB_START, STATE_EPUB_AUTHOR, STATE_EPUB_TITLE, STATE_EPUB_DATE, STATE_EPUB_CONTENT, STATE_EPUB_END };
 
 class EpubDoc;
+class HtmlPullParser;
 
 class CEpubFilter : public CFilterBase
 {
 public:
     CEpubFilter(long *plRefCount) : CFilterBase(plRefCount),
-        m_state(STATE_EPUB_END), m_epubDoc(NULL) { }
+        m_state(STATE_EPUB_END), m_epubDoc(NULL), m_htmlParser(NULL) { }
     virtual ~CEpubFilter() { CleanUp(); }
 
     virtual HRESULT OnInit();
@@ -28,4 +29,6 @@ public:
 private:
     EPUB_FILTER_STATE m_state;
     EpubDoc *m_epubDoc;
+    // the content is returned one section at a time
+    HtmlPullParser *m_htmlParser;
 };
@@ -23,6 +23,8 @@ HRESULT CPdfFilter::OnInit()
     //       m_pStream instead of a clone - why?
 
     // load content of PDF document into a seekable stream
+    // (this keeps the whole file in memory for as long as the engine
+    // exists, so text extraction can't use less memory than the file's size)
     HRESULT res;
     size_t len;
     void *data = GetDataFromStream(m_pStream, &len, &res);
@@ -34,7 +36,7 @@ HRESULT CPdfFilter::OnInit()
     if (!stream)
         return E_FAIL;
 
-    m_pdfEngine = PdfEngine::CreateFromStream(stream);
+    m_pdfEngine = PdfEngine::CreateForTextExtraction(stream);
     if (!m_pdfEngine)
         return E_FAIL;
 
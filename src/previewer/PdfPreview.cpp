@@ -7,11 +7,18 @@
 
 IFACEMETHODIMP PreviewBase::GetThumbnail(UINT cx, HBITMAP *phbmp, WTS_ALPHATYPE *pdwAlpha)
 {
-    BaseEngine *engine = GetEngine();
+    BaseEngine *engine = GetEngine(true);
     if (!engine)
         return E_FAIL;
 
-    RectD page = engine->Transform(engine->PageMediabox(1), 1, 1.0, 0);
+    // prefer embedded thumbnails and cover images over rendering the first page
+    RenderedBitmap *bmp = engine->GetThumbnail(SizeI(cx, cx));
+    bool isEmbedded = bmp != NULL;
+    RectD page;
+    if (isEmbedded)
+        page = RectI(PointI(), bmp->Size()).Convert<double>();
+    else
+        page = engine->Transform(engine->PageMediabox(1), 1, 1.0, 0);
     float zoom = min(cx / (float)page.dx, cx / (float)page.dy) - 0.001f;
     RectI thumb = RectD(0, 0, page.dx * zoom, page.dy * zoom).Round();
 
@@ -25,14 +32,30 @@ IFACEMETHODIMP PreviewBase::GetThumbnail(UINT cx, HBITMAP *phbmp, WTS_ALPHATYPE
 
     unsigned char *bmpData = NULL;
     HBITMAP hthumb = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **)&bmpData, NULL, 0);
-    if (!hthumb)
+    if (!hthumb) {
+        delete bmp;
         return E_OUTOFMEMORY;
+    }
 
-    page = engine->Transform(thumb.Convert<double>(), 1, zoom, 0, true);
-    RenderedBitmap *bmp = engine->RenderBitmap(1, zoom, 0, &page);
+    if (!isEmbedded) {
+        page = engine->Transform(thumb.Convert<double>(), 1, zoom, 0, true);
+        bmp = engine->RenderBitmap(1, zoom, 0, &page);
+    }
 
     HDC hdc = GetDC(NULL);
-    if (bmp && GetDIBits(hdc, bmp->GetBitmap(), 0, thumb.dy, bmpData, &bmi, DIB_RGB_COLORS)) {
+    bool ok = false;
+    if (bmp && isEmbedded) {
+        // embedded images are (usually) larger than requested and must be scaled down
+        HDC hdcThumb = CreateCompatibleDC(hdc);
+        HGDIOBJ oldBmp = SelectObject(hdcThumb, hthumb);
+        ok = bmp->StretchDIBits(hdcThumb, thumb);
+        SelectObject(hdcThumb, oldBmp);
+        DeleteDC(hdcThumb);
+        GdiFlush();
+    }
+    else if (bmp)
+        ok = GetDIBits(hdc, bmp->GetBitmap(), 0, thumb.dy, bmpData, &bmi, DIB_RGB_COLORS) != 0;
+    if (ok) {
         // cf. http://msdn.microsoft.com/en-us/library/bb774612(v=VS.85).aspx
         for (int i = 0; i < thumb.dx * thumb.dy; i++)
             bmpData[4 * i + 3] = 0xFF;
@@ -305,13 +328,13 @@ IFACEMETHODIMP PreviewBase::DoPreview()
 
 #include "PdfEngine.h"
 
-BaseEngine *CPdfPreview::LoadEngine(IStream *stream)
+BaseEngine *CPdfPreview::LoadEngine(IStream *stream, bool thumbnailOnly)
 {
-    return PdfEngine::CreateFromStream(stream);
+    return PdfEngine::CreateFromStream(stream, NULL, thumbnailOnly);
 }
 
 #ifdef BUILD_XPS_PREVIEW
-BaseEngine *CXpsPreview::LoadEngine(IStream *stream)
+BaseEngine *CXpsPreview::LoadEngine(IStream *stream, bool thumbnailOnly)
 {
     return XpsEngine::CreateFromStream(stream);
 }
@@ -321,14 +344,14 @@ BaseEngine *CXpsPreview::LoadEngine(IStream *stream)
 #include "ImagesEngine.h"
 
 #ifdef BUILD_CBZ_PREVIEW
-BaseEngine *CCbzPreview::LoadEngine(IStream *stream)
+BaseEngine *CCbzPreview::LoadEngine(IStream *stream, bool thumbnailOnly)
 {
-    return CbxEngine::CreateFromStream(stream);
+    return CbxEngine::CreateFromStream(stream, thumbnailOnly);
 }
 #endif
 
 #ifdef BUILD_TGA_PREVIEW
-BaseEngine *CTgaPreview::LoadEngine(IStream *stream)
+BaseEngine *CTgaPreview::LoadEngine(IStream *stream, bool thumbnailOnly)
 {
     return ImageEngine::CreateFromStream(stream);
 }
@@ -28,7 +28,7 @@ class PreviewBase : public IThumbnailProvider, public IInitializeWithStream,
 {
 public:
     PreviewBase(long *plRefCount, const WCHAR *clsid) : m_lRef(1),
-        m_plModuleRef(plRefCount), m_pStream(NULL), m_engine(NULL),
+        m_plModuleRef(plRefCount), m_pStream(NULL), m_engine(NULL), m_thumbnailOnly(false),
         renderer(NULL), m_gdiScope(NULL), m_site(NULL), m_hwnd(NULL),
         m_hwndParent(NULL), m_clsid(clsid), m_extractCx(0) {
         InterlockedIncrement(m_plModuleRef);
@@ -209,9 +209,16 @@ public:
         return S_OK;
     }
 
-    BaseEngine *GetEngine() {
-        if (!m_engine && m_pStream)
-            m_engine = LoadEngine(m_pStream);
+    BaseEngine *GetEngine(bool thumbnailOnly=false) {
+        if (m_engine && m_thumbnailOnly && !thumbnailOnly) {
+            // an engine loaded for thumbnails can't be used for previewing
+            delete m_engine;
+            m_engine = NULL;
+        }
+        if (!m_engine && m_pStream) {
+            m_engine = LoadEngine(m_pStream, thumbnailOnly);
+            m_thumbnailOnly = thumbnailOnly;
+        }
         return m_engine;
     }
 
@@ -221,6 +228,7 @@ protected:
     long m_lRef, * m_plModuleRef;
     ScopedComPtr<IStream> m_pStream;
     BaseEngine *m_engine;
+    bool        m_thumbnailOnly;
     // engines based on ImagesEngine require GDI+ to be preloaded
     ScopedGdiPlus *m_gdiScope;
     // state for IPreviewHandler
@@ -232,7 +240,8 @@ protected:
     UINT        m_extractCx;
     FILETIME    m_dateStamp;
 
-    virtual BaseEngine *LoadEngine(IStream *stream) = 0;
+    // thumbnailOnly: the engine is only used for IThumbnailProvider::GetThumbnail
+    virtual BaseEngine *LoadEngine(IStream *stream, bool thumbnailOnly) = 0;
 };
 
 class CPdfPreview : public PreviewBase {
@@ -240,7 +249,7 @@ public:
     CPdfPreview(long *plRefCount) : PreviewBase(plRefCount, SZ_PDF_PREVIEW_CLSID) { }
 
 protected:
-    virtual BaseEngine *LoadEngine(IStream *stream);
+    virtual BaseEngine *LoadEngine(IStream *stream, bool thumbnailOnly);
 };
 
 #ifdef BUILD_XPS_PREVIEW
@@ -249,7 +258,7 @@ public:
     CXpsPreview(long *plRefCount) : PreviewBase(plRefCount, SZ_XPS_PREVIEW_CLSID) { }
 
 protected:
-    virtual BaseEngine *LoadEngine(IStream *stream);
+    virtual BaseEngine *LoadEngine(IStream *stream, bool thumbnailOnly);
 };
 #endif
 
@@ -261,7 +270,7 @@ public:
     }
 
 protected:
-    virtual BaseEngine *LoadEngine(IStream *stream);
+    virtual BaseEngine *LoadEngine(IStream *stream, bool thumbnailOnly);
 };
 #endif
 
@@ -273,7 +282,7 @@ public:
     }
 
 protected:
-    virtual BaseEngine *LoadEngine(IStream *stream);
+    virtual BaseEngine *LoadEngine(IStream *stream, bool thumbnailOnly);
 };
 #endif
 
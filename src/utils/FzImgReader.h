@@ -8,7 +8,8 @@
 
 namespace fitz {
 
-Gdiplus::Bitmap *ImageFromData(const char *data, size_t len);
+// JPEG images can be decoded at 1/2^scaleDown of their size (scaleDown 0 to 3)
+Gdiplus::Bitmap *ImageFromData(const char *data, size_t len, int scaleDown=0);
 
 }
 
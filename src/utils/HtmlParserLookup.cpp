@@ -23,143 +23,65 @@
 #define STR3i(s) (STR2i(s) | (lower((s)[2]) << 16))
 #define STR4i(s) (STR3i(s) | (lower((s)[3]) << 24))
 
+// FNV-1a step (with a seed as offset basis) for the perfect hash functions
+#define PHASH(h, c) (((h) ^ (uint8_t)(c)) * 16777619)
+
+static const uint8_t gHtmlTagG[135] = {
+    0, 0, 0, 9, 0, 0, 0, 0, 0, 0, 43, 6, 0, 0, 0, 0,
+    0, 0, 0, 0, 14, 0, 7, 0, 0, 33, 21, 35, 0, 0, 8, 0,
+    0, 0, 0, 34, 0, 35, 35, 52, 0, 10, 57, 0, 0, 0, 32, 0,
+    25, 56, 47, 16, 32, 0, 59, 19, 7, 64, 0, 0, 0, 0, 0, 0,
+    57, 0, 0, 46, 40, 0, 37, 34, 35, 0, 0, 0, 0, 60, 65, 1,
+    0, 16, 0, 10, 0, 0, 0, 0, 0, 28, 22, 23, 29, 51, 49, 63,
+    0, 0, 46, 0, 50, 30, 0, 53, 30, 49, 5, 0, 52, 0, 0, 62,
+    0, 9, 38, 58, 33, 40, 0, 51, 0, 0, 0, 34, 7, 18, 59, 0,
+    0, 42, 27, 0, 64, 42, 37
+};
+static const char *gHtmlTagNames[67] = {
+    "a", "abbr", "acronym", "area", "audio", "b", "base", "basefont",
+    "blockquote", "body", "br", "center", "code", "col", "dd", "div",
+    "dl", "dt", "em", "font", "frame", "h1", "h2", "h3",
+    "h4", "h5", "h6", "head", "hr", "html", "i", "image",
+    "img", "input", "lh", "li", "link", "mbp:pagebreak", "meta", "nav",
+    "object", "ol", "p", "pagebreak", "param", "pre", "s", "script",
+    "section", "small", "span", "strike", "strong", "style", "sub", "subtitle",
+    "sup", "svg", "table", "td", "th", "title", "tr", "tt",
+    "u", "ul", "video"
+};
+static const uint8_t gHtmlTagLens[67] = {
+    1, 4, 7, 4, 5, 1, 4, 8, 10, 4, 2, 6, 4, 3, 2, 3,
+    2, 2, 2, 4, 5, 2, 2, 2, 2, 2, 2, 4, 2, 4, 1, 5,
+    3, 5, 2, 2, 4, 13, 4, 3, 6, 2, 1, 9, 5, 3, 1, 6,
+    7, 5, 4, 6, 6, 5, 3, 8, 3, 3, 5, 2, 2, 5, 2, 2,
+    1, 2, 5
+};
+static const HtmlTag gHtmlTagValues[67] = {
+    Tag_A, Tag_Abbr, Tag_Acronym, Tag_Area, Tag_Audio,
+    Tag_B, Tag_Base, Tag_Basefont, Tag_Blockquote, Tag_Body,
+    Tag_Br, Tag_Center, Tag_Code, Tag_Col, Tag_Dd,
+    Tag_Div, Tag_Dl, Tag_Dt, Tag_Em, Tag_Font,
+    Tag_Frame, Tag_H1, Tag_H2, Tag_H3, Tag_H4,
+    Tag_H5, Tag_H6, Tag_Head, Tag_Hr, Tag_Html,
+    Tag_I, Tag_Image, Tag_Img, Tag_Input, Tag_Lh,
+    Tag_Li, Tag_Link, Tag_Mbp_Pagebreak, Tag_Meta, Tag_Nav,
+    Tag_Object, Tag_Ol, Tag_P, Tag_Pagebreak, Tag_Param,
+    Tag_Pre, Tag_S, Tag_Script, Tag_Section, Tag_Small,
+    Tag_Span, Tag_Strike, Tag_Strong, Tag_Style, Tag_Sub,
+    Tag_Subtitle, Tag_Sup, Tag_Svg, Tag_Table, Tag_Td,
+    Tag_Th, Tag_Title, Tag_Tr, Tag_Tt, Tag_U,
+    Tag_Ul, Tag_Video
+};
+
 HtmlTag FindHtmlTag(const char *name, size_t len)
 {
-    uint32_t key = 0 == len ? 0 : 1 == len ? STR1i(name) :
-                   2 == len ? STR2i(name) : 3 == len ? STR3i(name) : STR4i(name);
-    switch (key) {
-    case CS1('a'): return Tag_A;
-    case CS4('a','b','b','r'):
-        if (4 == len) return Tag_Abbr;
-        break;
-    case CS4('a','c','r','o'):
-        if (7 == len && CS3('n','y','m') == STR3i(name + 4)) return Tag_Acronym;
-        break;
-    case CS4('a','r','e','a'):
-        if (4 == len) return Tag_Area;
-        break;
-    case CS4('a','u','d','i'):
-        if (5 == len && CS1('o') == STR1i(name + 4)) return Tag_Audio;
-        break;
-    case CS1('b'): return Tag_B;
-    case CS4('b','a','s','e'):
-        if (4 == len) return Tag_Base;
-        if (8 == len && CS4('f','o','n','t') == STR4i(name + 4)) return Tag_Basefont;
-        break;
-    case CS4('b','l','o','c'):
-        if (10 == len && str::EqNI(name + 4, "kquote", 6)) return Tag_Blockquote;
-        break;
-    case CS4('b','o','d','y'):
-        if (4 == len) return Tag_Body;
-        break;
-    case CS2('b','r'): return Tag_Br;
-    case CS4('c','e','n','t'):
-        if (6 == len && CS2('e','r') == STR2i(name + 4)) return Tag_Center;
-        break;
-    case CS4('c','o','d','e'):
-        if (4 == len) return Tag_Code;
-        break;
-    case CS3('c','o','l'): return Tag_Col;
-    case CS2('d','d'): return Tag_Dd;
-    case CS3('d','i','v'): return Tag_Div;
-    case CS2('d','l'): return Tag_Dl;
-    case CS2('d','t'): return Tag_Dt;
-    case CS2('e','m'): return Tag_Em;
-    case CS4('f','o','n','t'):
-        if (4 == len) return Tag_Font;
-        break;
-    case CS4('f','r','a','m'):
-        if (5 == len && CS1('e') == STR1i(name + 4)) return Tag_Frame;
-        break;
-    case CS2('h','1'): return Tag_H1;
-    case CS2('h','2'): return Tag_H2;
-    case CS2('h','3'): return Tag_H3;
-    case CS2('h','4'): return Tag_H4;
-    case CS2('h','5'): return Tag_H5;
-    case CS2('h','6'): return Tag_H6;
-    case CS4('h','e','a','d'):
-        if (4 == len) return Tag_Head;
-        break;
-    case CS2('h','r'): return Tag_Hr;
-    case CS4('h','t','m','l'):
-        if (4 == len) return Tag_Html;
-        break;
-    case CS1('i'): return Tag_I;
-    case CS4('i','m','a','g'):
-        if (5 == len && CS1('e') == STR1i(name + 4)) return Tag_Image;
-        break;
-    case CS3('i','m','g'): return Tag_Img;
-    case CS4('i','n','p','u'):
-        if (5 == len && CS1('t') == STR1i(name + 4)) return Tag_Input;
-        break;
-    case CS2('l','h'): return Tag_Lh;
-    case CS2('l','i'): return Tag_Li;
-    case CS4('l','i','n','k'):
-        if (4 == len) return Tag_Link;
-        break;
-    case CS4('m','b','p',':'):
-        if (13 == len && str::EqNI(name + 4, "pagebreak", 9)) return Tag_Mbp_Pagebreak;
-        break;
-    case CS4('m','e','t','a'):
-        if (4 == len) return Tag_Meta;
-        break;
-    case CS3('n','a','v'): return Tag_Nav;
-    case CS4('o','b','j','e'):
-        if (6 == len && CS2('c','t') == STR2i(name + 4)) return Tag_Object;
-        break;
-    case CS2('o','l'): return Tag_Ol;
-    case CS1('p'): return Tag_P;
-    case CS4('p','a','g','e'):
-        if (9 == len && str::EqNI(name + 4, "break", 5)) return Tag_Pagebreak;
-        break;
-    case CS4('p','a','r','a'):
-        if (5 == len && CS1('m') == STR1i(name + 4)) return Tag_Param;
-        break;
-    case CS3('p','r','e'): return Tag_Pre;
-    case CS1('s'): return Tag_S;
-    case CS4('s','c','r','i'):
-        if (6 == len && CS2('p','t') == STR2i(name + 4)) return Tag_Script;
-        break;
-    case CS4('s','e','c','t'):
-        if (7 == len && CS3('i','o','n') == STR3i(name + 4)) return Tag_Section;
-        break;
-    case CS4('s','m','a','l'):
-        if (5 == len && CS1('l') == STR1i(name + 4)) return Tag_Small;
-        break;
-    case CS4('s','p','a','n'):
-        if (4 == len) return Tag_Span;
-        break;
-    case CS4('s','t','r','i'):
-        if (6 == len && CS2('k','e') == STR2i(name + 4)) return Tag_Strike;
-        break;
-    case CS4('s','t','r','o'):
-        if (6 == len && CS2('n','g') == STR2i(name + 4)) return Tag_Strong;
-        break;
-    case CS4('s','t','y','l'):
-        if (5 == len && CS1('e') == STR1i(name + 4)) return Tag_Style;
-        break;
-    case CS3('s','u','b'): return Tag_Sub;
-    case CS4('s','u','b','t'):
-        if (8 == len && CS4('i','t','l','e') == STR4i(name + 4)) return Tag_Subtitle;
-        break;
-    case CS3('s','u','p'): return Tag_Sup;
-    case CS3('s','v','g'): return Tag_Svg;
-    case CS4('t','a','b','l'):
-        if (5 == len && CS1('e') == STR1i(name + 4)) return Tag_Table;
-        break;
-    case CS2('t','d'): return Tag_Td;
-    case CS2('t','h'): return Tag_Th;
-    case CS4('t','i','t','l'):
-        if (5 == len && CS1('e') == STR1i(name + 4)) return Tag_Title;
-        break;
-    case CS2('t','r'): return Tag_Tr;
-    case CS2('t','t'): return Tag_Tt;
-    case CS1('u'): return Tag_U;
-    case CS2('u','l'): return Tag_Ul;
-    case CS4('v','i','d','e'):
-        if (5 == len && CS1('o') == STR1i(name + 4)) return Tag_Video;
-        break;
+    uint32_t h1 = 0xDAA66D13, h2 = 0x54760DA2;
+    for (size_t i = 0; i < len; i++) {
+        h1 = PHASH(h1, lower(name[i]));
+        h2 = PHASH(h2, lower(name[i]));
     }
+    unsigned int idx = (gHtmlTagG[h1 % 135] + gHtmlTagG[h2 % 135]) % 67;
+    if (len == gHtmlTagLens[idx] && str::EqNI(name, gHtmlTagNames[idx], len))
+        return gHtmlTagValues[idx];
     return Tag_NotFound;
 }
 
@@ -190,24 +112,29 @@ bool IsInlineTag(HtmlTag item)
     }
 }
 
+static const uint8_t gAlignAttrG[9] = {
+    0, 0, 0, 2, 0, 0, 0, 1, 3
+};
+static const char *gAlignAttrNames[4] = {
+    "center", "justify", "left", "right"
+};
+static const uint8_t gAlignAttrLens[4] = {
+    6, 7, 4, 5
+};
+static const AlignAttr gAlignAttrValues[4] = {
+    Align_Center, Align_Justify, Align_Left, Align_Right
+};
+
 AlignAttr FindAlignAttr(const char *name, size_t len)
 {
-    uint32_t key = 0 == len ? 0 : 1 == len ? STR1i(name) :
-                   2 == len ? STR2i(name) : 3 == len ? STR3i(name) : STR4i(name);
-    switch (key) {
-    case CS4('c','e','n','t'):
-        if (6 == len && CS2('e','r') == STR2i(name + 4)) return Align_Center;
-        break;
-    case CS4('j','u','s','t'):
-        if (7 == len && CS3('i','f','y') == STR3i(name + 4)) return Align_Justify;
-        break;
-    case CS4('l','e','f','t'):
-        if (4 == len) return Align_Left;
-        break;
-    case CS4('r','i','g','h'):
-        if (5 == len && CS1('t') == STR1i(name + 4)) return Align_Right;
-        break;
+    uint32_t h1 = 0x3C6EF362, h2 = 0xCE8A432B;
+    for (size_t i = 0; i < len; i++) {
+        h1 = PHASH(h1, lower(name[i]));
+        h2 = PHASH(h2, lower(name[i]));
     }
+    unsigned int idx = (gAlignAttrG[h1 % 9] + gAlignAttrG[h2 % 9]) % 4;
+    if (len == gAlignAttrLens[idx] && str::EqNI(name, gAlignAttrNames[idx], len))
+        return gAlignAttrValues[idx];
     return Align_NotFound;
 }
 
@@ -1283,63 +1210,40 @@ uint32_t FindHtmlEntityRune(const char *name, size_t len)
     return (uint32_t)-1;
 }
 
+static const uint8_t gCssPropG[57] = {
+    0, 0, 0, 0, 0, 0, 22, 23, 0, 0, 1, 0, 12, 18, 0, 0,
+    0, 0, 0, 4, 3, 24, 0, 6, 0, 0, 17, 4, 1, 0, 0, 11,
+    16, 0, 19, 0, 0, 24, 14, 26, 0, 0, 10, 10, 0, 0, 11, 0,
+    0, 22, 20, 13, 19, 21, 4, 0, 0
+};
+static const char *gCssPropNames[28] = {
+    "color", "display", "font", "font-family", "font-size", "font-style", "font-weight", "list-style",
+    "margin", "margin-bottom", "margin-left", "margin-right", "margin-top", "max-width", "opacity", "padding",
+    "padding-bottom", "padding-left", "padding-right", "padding-top", "page-break-after", "page-break-before", "text-align", "text-decoration",
+    "text-indent", "text-underline", "white-space", "word-wrap"
+};
+static const uint8_t gCssPropLens[28] = {
+    5, 7, 4, 11, 9, 10, 11, 10, 6, 13, 11, 12, 10, 9, 7, 7,
+    14, 12, 13, 11, 16, 17, 10, 15, 11, 14, 11, 9
+};
+static const CssProp gCssPropValues[28] = {
+    Css_Color, Css_Display, Css_Font, Css_Font_Family, Css_Font_Size,
+    Css_Font_Style, Css_Font_Weight, Css_List_Style, Css_Margin, Css_Margin_Bottom,
+    Css_Margin_Left, Css_Margin_Right, Css_Margin_Top, Css_Max_Width, Css_Opacity,
+    Css_Padding, Css_Padding_Bottom, Css_Padding_Left, Css_Padding_Right, Css_Padding_Top,
+    Css_Page_Break_After, Css_Page_Break_Before, Css_Text_Align, Css_Text_Decoration, Css_Text_Indent,
+    Css_Text_Underline, Css_White_Space, Css_Word_Wrap
+};
+
 CssProp FindCssProp(const char *name, size_t len)
 {
-    uint32_t key = 0 == len ? 0 : 1 == len ? STR1i(name) :
-                   2 == len ? STR2i(name) : 3 == len ? STR3i(name) : STR4i(name);
-    switch (key) {
-    case CS4('c','o','l','o'):
-        if (5 == len && CS1('r') == STR1i(name + 4)) return Css_Color;
-        break;
-    case CS4('d','i','s','p'):
-        if (7 == len && CS3('l','a','y') == STR3i(name + 4)) return Css_Display;
-        break;
-    case CS4('f','o','n','t'):
-        if (4 == len) return Css_Font;
-        if (11 == len && str::EqNI(name + 4, "-family", 7)) return Css_Font_Family;
-        if (9 == len && str::EqNI(name + 4, "-size", 5)) return Css_Font_Size;
-        if (10 == len && str::EqNI(name + 4, "-style", 6)) return Css_Font_Style;
-        if (11 == len && str::EqNI(name + 4, "-weight", 7)) return Css_Font_Weight;
-        break;
-    case CS4('l','i','s','t'):
-        if (10 == len && str::EqNI(name + 4, "-style", 6)) return Css_List_Style;
-        break;
-    case CS4('m','a','r','g'):
-        if (6 == len && CS2('i','n') == STR2i(name + 4)) return Css_Margin;
-        if (13 == len && str::EqNI(name + 4, "in-bottom", 9)) return Css_Margin_Bottom;
-        if (11 == len && str::EqNI(name + 4, "in-left", 7)) return Css_Margin_Left;
-        if (12 == len && str::EqNI(name + 4, "in-right", 8)) return Css_Margin_Right;
-        if (10 == len && str::EqNI(name + 4, "in-top", 6)) return Css_Margin_Top;
-        break;
-    case CS4('m','a','x','-'):
-        if (9 == len && str::EqNI(name + 4, "width", 5)) return Css_Max_Width;
-        break;
-    case CS4('o','p','a','c'):
-        if (7 == len && CS3('i','t','y') == STR3i(name + 4)) return Css_Opacity;
-        break;
-    case CS4('p','a','d','d'):
-        if (7 == len && CS3('i','n','g') == STR3i(name + 4)) return Css_Padding;
-        if (14 == len && str::EqNI(name + 4, "ing-bottom", 10)) return Css_Padding_Bottom;
-        if (12 == len && str::EqNI(name + 4, "ing-left", 8)) return Css_Padding_Left;
-        if (13 == len && str::EqNI(name + 4, "ing-right", 9)) return Css_Padding_Right;
-        if (11 == len && str::EqNI(name + 4, "ing-top", 7)) return Css_Padding_Top;
-        break;
-    case CS4('p','a','g','e'):
-        if (16 == len && str::EqNI(name + 4, "-break-after", 12)) return Css_Page_Break_After;
-        if (17 == len && str::EqNI(name + 4, "-break-before", 13)) return Css_Page_Break_Before;
-        break;
-    case CS4('t','e','x','t'):
-        if (10 == len && str::EqNI(name + 4, "-align", 6)) return Css_Text_Align;
-        if (15 == len && str::EqNI(name + 4, "-decoration", 11)) return Css_Text_Decoration;
-        if (11 == len && str::EqNI(name + 4, "-indent", 7)) return Css_Text_Indent;
-        if (14 == len && str::EqNI(name + 4, "-underline", 10)) return Css_Text_Underline;
-        break;
-    case CS4('w','h','i','t'):
-        if (11 == len && str::EqNI(name + 4, "e-space", 7)) return Css_White_Space;
-        break;
-    case CS4('w','o','r','d'):
-        if (9 == len && str::EqNI(name + 4, "-wrap", 5)) return Css_Word_Wrap;
-        break;
+    uint32_t h1 = 0x9E3779B1, h2 = 0x489E78B4;
+    for (size_t i = 0; i < len; i++) {
+        h1 = PHASH(h1, lower(name[i]));
+        h2 = PHASH(h2, lower(name[i]));
     }
+    unsigned int idx = (gCssPropG[h1 % 57] + gCssPropG[h2 % 57]) % 28;
+    if (len == gCssPropLens[idx] && str::EqNI(name, gCssPropNames[idx], len))
+        return gCssPropValues[idx];
     return Css_Unknown;
 }
@@ -4,6 +4,11 @@
 #include "BaseUtil.h"
 #include "HtmlPullParser.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAS_SSE2_SCANNER
+#endif
+
 // returns -1 if didn't find
 int HtmlEntityNameToRune(const char *name, size_t nameLen)
 {
@@ -30,11 +35,55 @@ int HtmlEntityNameToRune(const WCHAR *name, size_t nameLen)
     return FindHtmlEntityRune(asciiName, nameLen);
 }
 
-bool SkipUntil(const char*& s, const char *end, char c)
+#ifdef HAS_SSE2_SCANNER
+// SSE2 is always available on x64, for x86 it's checked at runtime
+static bool gUseSse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+// for testing that both code paths of FindFirstOf return the same results
+// returns the previous state
+bool SetHtmlScanUseSimd(bool useSimd)
 {
-    while ((s < end) && (*s != c)) {
-        ++s;
+#ifdef HAS_SSE2_SCANNER
+    bool prev = gUseSse2;
+    gUseSse2 = useSimd && IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+    return prev;
+#else
+    return false;
+#endif
+}
+
+// returns a pointer to the first occurrence of c1, c2 or c3 in [s, end) or end,
+// skipping text without those characters 16 bytes at a time (if possible)
+static const char *FindFirstOf(const char *s, const char *end, char c1, char c2, char c3)
+{
+#ifdef HAS_SSE2_SCANNER
+    if (gUseSse2) {
+        __m128i m1 = _mm_set1_epi8(c1), m2 = _mm_set1_epi8(c2), m3 = _mm_set1_epi8(c3);
+        for (; end - s >= 16; s += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+            __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, m1), _mm_cmpeq_epi8(chunk, m2)),
+                                         _mm_cmpeq_epi8(chunk, m3));
+            int mask = _mm_movemask_epi8(found);
+            if (mask != 0) {
+                unsigned long idx;
+                _BitScanForward(&idx, (unsigned long)mask);
+                return s + idx;
+            }
+        }
     }
+#endif
+    for (; s < end; s++) {
+        if (*s == c1 || *s == c2 || *s == c3)
+            return s;
+    }
+    return end;
+}
+
+bool SkipUntil(const char*& s, const char *end, char c)
+{
+    if (s < end)
+        s = FindFirstOf(s, end, c, c, c);
     return *s == c;
 }
 
@@ -42,6 +91,9 @@ bool SkipUntil(const char*& s, const char *end, char *term)
 {
     size_t len = str::Len(term);
     for (; s < end; s++) {
+        s = FindFirstOf(s, end, term[0], term[0], term[0]);
+        if (s == end)
+            break;
         if (s + len <= end && str::StartsWith(s, term))
             return true;
     }
@@ -348,6 +400,9 @@ NoNextAttr:
 static bool SkipUntilTagEnd(const char*& s, const char *end)
 {
     while (s < end) {
+        s = FindFirstOf(s, end, '>', '\'', '"');
+        if (s == end)
+            break;
         char c = *s++;
         if ('>' == c) {
             --s;
@@ -364,6 +419,31 @@ static bool SkipUntilTagEnd(const char*& s, const char *end)
 
 // Returns next part of html or NULL if finished
 HtmlToken *HtmlPullParser::Next()
+{
+    if (!source)
+        return ParseNext();
+
+    for (;;) {
+        const char *tokenStart = currPos;
+        HtmlToken *t = ParseNext();
+        // a token is complete if it's a tag or if it's text which ends before
+        // the end of the data (i.e. at the next tag). Everything else (no token,
+        // an unclosed tag or text ending at the end) might continue in data
+        // which hasn't been provided yet
+        if (t && (t->IsTag() || t->IsError() && HtmlToken::InvalidTag == t->error ||
+                  t->IsText() && currPos < end)) {
+            return t;
+        }
+        size_t newLen = source->LoadMore();
+        if (newLen <= len)
+            return t;
+        len = newLen;
+        end = start + len;
+        currPos = tokenStart;
+    }
+}
+
+HtmlToken *HtmlPullParser::ParseNext()
 {
     if (currPos >= end)
         return NULL;
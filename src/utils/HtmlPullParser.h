@@ -69,6 +69,17 @@ protected:
     AttrInfo         attrInfo;
 };
 
+/* Provides the html for an HtmlPullParser piece by piece (e.g. when the html
+is only decompressed as it's being parsed). The data must never move, as the
+parser and its tokens point into it, and it must be zero-terminated. */
+class HtmlDataSource {
+public:
+    virtual ~HtmlDataSource() { }
+    // makes more data available and returns the new length of the data
+    // (which doesn't change once all the data has been provided)
+    virtual size_t LoadMore() = 0;
+};
+
 /* A very simple pull html parser. Call Next() to get the next HtmlToken,
 which can be one one of 3 tag types or error. If a tag has attributes,
 the caller has to parse them out (using HtmlToken::NextAttr()) */
@@ -81,9 +92,16 @@ class HtmlPullParser {
 
     HtmlToken      currToken;
 
+    // if set, the data only ends once source doesn't provide any more
+    HtmlDataSource *source;
+
+    HtmlToken *  ParseNext();
+
 public:
-    HtmlPullParser(const char *s, size_t len) : currPos(s), end(s + len), start(s), len(len) { }
-    HtmlPullParser(const char *s, const char *end) : currPos(s), end(end), start(s), len(end - s) { }
+    HtmlPullParser(const char *s, size_t len, HtmlDataSource *source=NULL) :
+        currPos(s), end(s + len), start(s), len(len), source(source) { }
+    HtmlPullParser(const char *s, const char *end) :
+        currPos(s), end(end), start(s), len(end - s), source(NULL) { }
 
     void         SetCurrPosOff(ptrdiff_t off) { currPos = start + off; }
     size_t       Len()   const { return len;   }
@@ -97,6 +115,7 @@ bool        SkipNonWs(const char*& s, const char *end);
 bool        SkipUntil(const char*& s, const char *end, char c);
 bool        SkipUntil(const char*& s, const char *end, char *term);
 bool        IsSpaceOnly(const char *s, const char *end);
+bool        SetHtmlScanUseSimd(bool useSimd);
 
 int         HtmlEntityNameToRune(const char *name, size_t nameLen);
 int         HtmlEntityNameToRune(const WCHAR *name, size_t nameLen);
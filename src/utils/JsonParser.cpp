@@ -31,6 +31,54 @@ public:
 
 static const char *ParseValue(ParseArgs& args, const char *data);
 
+static inline int HexValue(char c)
+{
+    if (str::IsDigit(c))
+        return c - '0';
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+    if ('A' <= c && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// decodes the escape sequence following a backslash at data into buf
+// (which must be able to hold at least 5 bytes) and returns the position
+// after the sequence or NULL for invalid sequences
+// end may be NULL for zero-terminated data
+static const char *DecodeEscape(const char *data, const char *end, char *buf, size_t& bufLen)
+{
+    if (end && data >= end)
+        return NULL;
+    bufLen = 1;
+    switch (*data) {
+        case '"': case '\\': case '/':
+            buf[0] = *data;
+            return data + 1;
+        case 'b': buf[0] = '\b'; return data + 1;
+        case 'f': buf[0] = '\f'; return data + 1;
+        case 'n': buf[0] = '\n'; return data + 1;
+        case 'r': buf[0] = '\r'; return data + 1;
+        case 't': buf[0] = '\t'; return data + 1;
+        case 'u':
+            break;
+        default:
+            return NULL;
+    }
+    int i = 0;
+    for (int k = 1; k <= 4; k++) {
+        int digit = !end || data + k < end ? HexValue(data[k]) : -1;
+        if (digit < 0)
+            return NULL;
+        i = (i << 4) | digit;
+    }
+    if (0 == i)
+        return NULL;
+    wchar_t c = (wchar_t)i;
+    bufLen = WideCharToMultiByte(CP_UTF8, 0, &c, 1, buf, 4, NULL, NULL);
+    return data + 5;
+}
+
 static const char *ExtractString(str::Str<char>& string, const char *data)
 {
     while (*++data) {
@@ -40,30 +88,13 @@ static const char *ExtractString(str::Str<char>& string, const char *data)
             string.Append(*data);
             continue;
         }
-        // parse escape sequence
-        int i;
-        switch (*++data) {
-            case '"': case '\\': case '/':
-                string.Append(*data);
-                break;
-            case 'b': string.Append('\b'); break;
-            case 'f': string.Append('\f'); break;
-            case 'n': string.Append('\n'); break;
-            case 'r': string.Append('\r'); break;
-            case 't': string.Append('\t'); break;
-            case 'u':
-                if (str::Parse(data + 1, "%4x", &i) && 0 < i && i < 0x10000) {
-                    char buf[5] = { 0 };
-                    wchar_t c = (wchar_t)i;
-                    WideCharToMultiByte(CP_UTF8, 0, &c, 1, buf, dimof(buf), NULL, NULL);
-                    string.Append(buf);
-                    data += 4;
-                    break;
-                }
-                return NULL;
-            default:
-                return NULL;
-        }
+        char buf[5];
+        size_t bufLen;
+        data = DecodeEscape(data + 1, NULL, buf, bufLen);
+        if (!data)
+            return NULL;
+        string.Append(buf, bufLen);
+        data--;
     }
     return NULL;
 }
@@ -97,7 +128,7 @@ static const char *ParseNumber(ParseArgs& args, const char *data)
         data++;
         if ('+' == *data || '-' == *data)
             data++;
-        data = SkipDigits(data + 1);
+        data = SkipDigits(data);
     }
     // validity check
     if (!str::IsDigit(*(data - 1)) || str::IsDigit(*data))
@@ -210,4 +241,269 @@ bool Parse(const char *data, ValueVisitor *visitor)
     return args.canceled || !*SkipWS(end);
 }
 
+char *Token::GetValue() const
+{
+    if (type != Type_String || !hasEscapes)
+        return str::DupN(s, sLen);
+    str::Str<char> value(sLen);
+    const char *end = s + sLen;
+    for (const char *c = s; c < end; ) {
+        if (*c != '\\') {
+            value.Append(*c++);
+            continue;
+        }
+        char buf[5];
+        size_t bufLen;
+        c = DecodeEscape(c + 1, end, buf, bufLen);
+        CrashIf(!c); // validated by PullParser
+        if (!c)
+            break;
+        value.Append(buf, bufLen);
+    }
+    return value.StealData();
+}
+
+PullParser::PullParser(const char *data, size_t len) :
+    curr(data), end(data + len), depth(0), state(Expect_Value)
+{
+    if (len >= 3 && str::StartsWith(data, UTF8_BOM))
+        curr += 3;
+}
+
+// scans a string starting at the quotation mark at curr
+bool PullParser::ScanString(const char *& s, size_t& sLen, bool& hasEscapes)
+{
+    s = ++curr;
+    hasEscapes = false;
+    for (; curr < end && *curr && *curr != '"'; curr++) {
+        if ('\\' != *curr)
+            continue;
+        char buf[5];
+        size_t bufLen;
+        const char *next = DecodeEscape(curr + 1, end, buf, bufLen);
+        if (!next)
+            return false;
+        curr = next - 1;
+        hasEscapes = true;
+    }
+    if (curr == end || *curr != '"')
+        return false;
+    sLen = curr - s;
+    curr++;
+    return true;
+}
+
+// same validation as ParseNumber
+bool PullParser::ScanNumber()
+{
+    const char *start = curr;
+    if (curr < end && '-' == *curr)
+        curr++;
+    if (curr < end && '0' == *curr)
+        curr++;
+    else if (curr < end && str::IsDigit(*curr))
+        for (curr++; curr < end && str::IsDigit(*curr); curr++);
+    else
+        return false;
+    if (curr < end && '.' == *curr)
+        for (curr++; curr < end && str::IsDigit(*curr); curr++);
+    if (curr < end && ('e' == *curr || 'E' == *curr)) {
+        curr++;
+        if (curr < end && ('+' == *curr || '-' == *curr))
+            curr++;
+        for (; curr < end && str::IsDigit(*curr); curr++);
+    }
+    if (!str::IsDigit(*(curr - 1)) || (curr < end && str::IsDigit(*curr)))
+        return false;
+    tok.type = Type_Number;
+    tok.s = start;
+    tok.sLen = curr - start;
+    tok.hasEscapes = false;
+    return true;
+}
+
+bool PullParser::ScanKeyword(const char *keyword, DataType type)
+{
+    size_t len = str::Len(keyword);
+    if ((size_t)(end - curr) < len || !str::EqN(curr, keyword, len))
+        return false;
+    tok.type = type;
+    tok.s = curr;
+    tok.sLen = len;
+    tok.hasEscapes = false;
+    curr += len;
+    return true;
+}
+
+Token *PullParser::Next()
+{
+    for (;;) {
+        while (curr < end && str::IsWs(*curr))
+            curr++;
+        char c = curr < end ? *curr : '\0';
+
+        switch (state) {
+        case Expect_FirstValue:
+            if (']' == c) {
+                curr++;
+                depth--;
+                state = Expect_Separator;
+                continue;
+            }
+            // fall through
+        case Expect_Value:
+            if ('{' == c || '[' == c) {
+                if (depth == dimof(stack))
+                    break;
+                Segment& seg = stack[depth++];
+                seg.isArray = '[' == c;
+                seg.idx = 0;
+                seg.key = NULL;
+                seg.keyLen = 0;
+                seg.keyHasEscapes = false;
+                state = seg.isArray ? Expect_FirstValue : Expect_FirstKey;
+                curr++;
+                continue;
+            }
+            if ('"' == c) {
+                if (!ScanString(tok.s, tok.sLen, tok.hasEscapes))
+                    break;
+                tok.type = Type_String;
+            }
+            else if (str::IsDigit(c) || '-' == c) {
+                if (!ScanNumber())
+                    break;
+            }
+            else if (!('t' == c && ScanKeyword("true", Type_Bool)) &&
+                     !('f' == c && ScanKeyword("false", Type_Bool)) &&
+                     !('n' == c && ScanKeyword("null", Type_Null))) {
+                break;
+            }
+            state = Expect_Separator;
+            return &tok;
+
+        case Expect_FirstKey:
+            if ('}' == c) {
+                curr++;
+                depth--;
+                state = Expect_Separator;
+                continue;
+            }
+            // fall through
+        case Expect_Key: {
+            Segment& seg = stack[depth - 1];
+            if (c != '"' || !ScanString(seg.key, seg.keyLen, seg.keyHasEscapes))
+                break;
+            while (curr < end && str::IsWs(*curr))
+                curr++;
+            if (curr == end || *curr != ':')
+                break;
+            curr++;
+            state = Expect_Value;
+            continue;
+        }
+
+        case Expect_Separator:
+            if (0 == depth) {
+                if (curr < end && *curr)
+                    break;
+                state = Finished;
+                return NULL;
+            }
+            if (',' == c) {
+                curr++;
+                if (stack[depth - 1].isArray) {
+                    stack[depth - 1].idx++;
+                    state = Expect_Value;
+                }
+                else
+                    state = Expect_Key;
+                continue;
+            }
+            if ((stack[depth - 1].isArray ? ']' : '}') == c) {
+                curr++;
+                depth--;
+                continue;
+            }
+            break;
+
+        case Finished:
+        case Failed:
+            return NULL;
+        }
+
+        state = Failed;
+        return NULL;
+    }
+}
+
+// matches the (potentially escaped) key of an object against the start of path
+static bool MatchKey(const char *key, size_t keyLen, bool hasEscapes, const char *& path)
+{
+    if (!hasEscapes) {
+        if (!str::EqN(path, key, keyLen))
+            return false;
+        path += keyLen;
+        return true;
+    }
+    const char *end = key + keyLen;
+    for (const char *c = key; c < end; ) {
+        if (*c != '\\') {
+            if (*path++ != *c++)
+                return false;
+            continue;
+        }
+        char buf[5];
+        size_t bufLen;
+        c = DecodeEscape(c + 1, end, buf, bufLen);
+        if (!c || !str::EqN(path, buf, bufLen))
+            return false;
+        path += bufLen;
+    }
+    return true;
+}
+
+bool PullParser::PathIs(const char *path) const
+{
+    for (size_t i = 0; i < depth; i++) {
+        const Segment& seg = stack[i];
+        if (!seg.isArray) {
+            if (*path++ != '/' || !MatchKey(seg.key, seg.keyLen, seg.keyHasEscapes, path))
+                return false;
+            continue;
+        }
+        if (*path++ != '[')
+            return false;
+        if ('*' == *path)
+            path++;
+        else {
+            if (!str::IsDigit(*path))
+                return false;
+            int idx = 0;
+            for (; str::IsDigit(*path); path++) {
+                idx = idx * 10 + (*path - '0');
+            }
+            if (idx != seg.idx)
+                return false;
+        }
+        if (*path++ != ']')
+            return false;
+    }
+    return !*path;
+}
+
+void PullParser::GetPath(str::Str<char>& path) const
+{
+    for (size_t i = 0; i < depth; i++) {
+        const Segment& seg = stack[i];
+        if (seg.isArray) {
+            path.AppendFmt("[%d]", seg.idx);
+            continue;
+        }
+        path.Append('/');
+        Token key = { Type_String, seg.key, seg.keyLen, seg.keyHasEscapes };
+        path.AppendAndFree(key.GetValue());
+    }
+}
+
 }
@@ -29,6 +29,73 @@ public:
 // returns false on error
 bool Parse(const char *data, ValueVisitor *visitor);
 
+// pull parser alternative which doesn't allocate any memory: Next() returns
+// a token for every primitive data value (in the same order as they'd be
+// passed to ValueVisitor::Visit) and PathIs matches the path to that value
+// without having to build it, e.g. for the data above
+
+// json::PullParser parser(data, str::Len(data));
+// for (json::Token *tok; (tok = parser.Next()) != NULL; ) {
+//     if (json::Type_String == tok->type && parser.PathIs("/key[*]/name"))
+//         ...;
+// }
+
+struct Token {
+    DataType type;
+    // the value's string representation inside the parsed data
+    // (for strings without the quotation marks and with escape
+    // sequences only resolved by GetValue)
+    const char *s;
+    size_t sLen;
+    bool hasEscapes;
+
+    // returns the same value as passed to ValueVisitor::Visit
+    // caller must free() the result
+    char *GetValue() const;
+};
+
+class PullParser {
+    struct Segment {
+        bool isArray;
+        int idx;
+        // raw object key (for objects)
+        const char *key;
+        size_t keyLen;
+        bool keyHasEscapes;
+    };
+
+    enum State {
+        Expect_Value, Expect_FirstValue, Expect_Key, Expect_FirstKey,
+        Expect_Separator, Finished, Failed
+    };
+
+    const char *curr;
+    const char *end;
+    // deeper nested data is treated as invalid
+    Segment stack[64];
+    size_t depth;
+    State state;
+    Token tok;
+
+    bool ScanString(const char *& s, size_t& sLen, bool& hasEscapes);
+    bool ScanNumber();
+    bool ScanKeyword(const char *keyword, DataType type);
+
+public:
+    // data must be UTF-8 encoded, but doesn't have to be NULL-terminated
+    PullParser(const char *data, size_t len);
+
+    // returns NULL at the end of the data or on error
+    Token *Next();
+    bool IsError() const { return Failed == state; }
+
+    // matches the path to the current token (same format as for ValueVisitor)
+    // "[*]" can be used to match any array index
+    bool PathIs(const char *path) const;
+    // appends the path to the current token to path
+    void GetPath(str::Str<char>& path) const;
+};
+
 }
 
 #endif
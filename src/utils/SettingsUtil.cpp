@@ -436,6 +436,256 @@ void FreeStruct(const StructInfo *info, void *strct)
     free(strct);
 }
 
+// Binary snapshots contain the same data as the text serialization but can be
+// read back without parsing. Each struct starts with its field count and a hash
+// of its field names and types so that a snapshot written for different metadata
+// is rejected (fields beyond a shorter field count are set to their defaults,
+// the same as for a text file which doesn't contain them).
+
+static uint32_t GetStructSignature(const StructInfo *info, size_t fieldCount)
+{
+    uint32_t hash = 2166136261;
+    const char *fieldName = info->fieldNames;
+    for (size_t i = 0; i < fieldCount; i++, fieldName += str::Len(fieldName) + 1) {
+        for (const char *c = fieldName; *c; c++)
+            hash = (hash ^ (uint8_t)*c) * 16777619;
+        hash = (hash ^ (0x80 | info->fields[i].type)) * 16777619;
+    }
+    return hash;
+}
+
+template <typename T>
+static void AppendBin(str::Str<char>& out, T value)
+{
+    out.Append((const char *)&value, sizeof(value));
+}
+
+static void SerializeStructBinRec(str::Str<char>& out, const StructInfo *info, const void *data)
+{
+    const uint8_t *base = (const uint8_t *)data;
+    AppendBin(out, info->fieldCount);
+    AppendBin(out, GetStructSignature(info, info->fieldCount));
+    for (size_t i = 0; i < info->fieldCount; i++) {
+        const FieldInfo& field = info->fields[i];
+        const uint8_t *fieldPtr = base + field.offset;
+        switch (field.type) {
+        case Type_Struct: case Type_Prerelease: case Type_Compact:
+#if !(defined(SVN_PRE_RELEASE_VER) || defined(DEBUG))
+            // not written out to text either, so it'll have to be reset to the defaults
+            if (Type_Prerelease == field.type) {
+                AppendBin(out, (uint8_t)0);
+                break;
+            }
+#endif
+            AppendBin(out, (uint8_t)1);
+            SerializeStructBinRec(out, GetSubstruct(field), fieldPtr);
+            break;
+        case Type_Array: {
+            Vec<void *> *array = *(Vec<void *> **)fieldPtr;
+            AppendBin(out, (uint32_t)(array ? array->Count() : 0));
+            for (size_t j = 0; array && j < array->Count(); j++) {
+                SerializeStructBinRec(out, GetSubstruct(field), array->At(j));
+            }
+            break;
+        }
+        case Type_Comment:
+            break;
+        case Type_Bool:
+            AppendBin(out, (uint8_t)(*(bool *)fieldPtr ? 1 : 0));
+            break;
+        case Type_Int: case Type_Color:
+            AppendBin(out, *(int32_t *)fieldPtr);
+            break;
+        case Type_Float: {
+            // round the same way as the text serialization does
+            float value = *(float *)fieldPtr;
+            str::Parse(ScopedMem<char>(str::Format("%g", value)), "%f", &value);
+            AppendBin(out, value);
+            break;
+        }
+        case Type_String: {
+            const WCHAR *s = *(const WCHAR **)fieldPtr;
+            AppendBin(out, (uint32_t)(s ? str::Len(s) : (size_t)-1));
+            if (s)
+                out.Append((const char *)s, str::Len(s) * sizeof(WCHAR));
+            break;
+        }
+        case Type_Utf8String: {
+            const char *s = *(const char **)fieldPtr;
+            AppendBin(out, (uint32_t)(s ? str::Len(s) : (size_t)-1));
+            if (s)
+                out.Append(s, str::Len(s));
+            break;
+        }
+        case Type_ColorArray: case Type_FloatArray: case Type_IntArray: {
+            Vec<int> *vec = *(Vec<int> **)fieldPtr;
+            AppendBin(out, (uint32_t)vec->Count());
+            for (size_t j = 0; j < vec->Count(); j++) {
+                if (Type_FloatArray == field.type) {
+                    float value = *(float *)&vec->At(j);
+                    str::Parse(ScopedMem<char>(str::Format("%g", value)), "%f", &value);
+                    AppendBin(out, value);
+                }
+                else
+                    AppendBin(out, (int32_t)vec->At(j));
+            }
+            break;
+        }
+        default:
+            CrashIf(true);
+        }
+    }
+}
+
+// resets a field to its default value (as if it were missing from a text file)
+static void SetFieldDefault(const FieldInfo& field, uint8_t *base)
+{
+    uint8_t *fieldPtr = base + field.offset;
+    if (Type_Struct == field.type || Type_Prerelease == field.type) {
+        DeserializeStructRec(GetSubstruct(field), NULL, fieldPtr, true);
+    }
+    else if (Type_Array == field.type) {
+        FreeArray(*(Vec<void *> **)fieldPtr, field);
+        *(Vec<void *> **)fieldPtr = new Vec<void *>();
+    }
+    else if (field.type != Type_Comment) {
+        DeserializeField(field, base, NULL);
+    }
+}
+
+class BinReader {
+    const uint8_t *curr, *end;
+
+public:
+    BinReader(const char *data, size_t len) : curr((const uint8_t *)data), end((const uint8_t *)data + len) { }
+
+    bool Read(void *dst, size_t len) {
+        if ((size_t)(end - curr) < len)
+            return false;
+        memcpy(dst, curr, len);
+        curr += len;
+        return true;
+    }
+    template <typename T>
+    bool Read(T *value) { return Read(value, sizeof(T)); }
+    size_t Left() const { return end - curr; }
+};
+
+static bool DeserializeStructBinRec(const StructInfo *info, BinReader& r, uint8_t *base)
+{
+    uint16_t fieldCount;
+    uint32_t signature;
+    if (!r.Read(&fieldCount) || fieldCount > info->fieldCount)
+        return false;
+    if (!r.Read(&signature) || signature != GetStructSignature(info, fieldCount))
+        return false;
+
+    for (size_t i = 0; i < info->fieldCount; i++) {
+        const FieldInfo& field = info->fields[i];
+        uint8_t *fieldPtr = base + field.offset;
+        uint8_t flag;
+        uint32_t count;
+        if (i >= fieldCount) {
+            SetFieldDefault(field, base);
+            continue;
+        }
+        switch (field.type) {
+        case Type_Struct: case Type_Prerelease: case Type_Compact:
+            if (!r.Read(&flag))
+                return false;
+            if (!flag)
+                SetFieldDefault(field, base);
+            else if (!DeserializeStructBinRec(GetSubstruct(field), r, fieldPtr))
+                return false;
+            break;
+        case Type_Array:
+            // every struct takes up at least six bytes
+            if (!r.Read(&count) || count > r.Left() / 6)
+                return false;
+            FreeArray(*(Vec<void *> **)fieldPtr, field);
+            *(Vec<void *> **)fieldPtr = new Vec<void *>();
+            for (uint32_t j = 0; j < count; j++) {
+                uint8_t *item = AllocArray<uint8_t>(GetSubstruct(field)->structSize);
+                (*(Vec<void *> **)fieldPtr)->Append(item);
+                if (!DeserializeStructBinRec(GetSubstruct(field), r, item))
+                    return false;
+            }
+            break;
+        case Type_Comment:
+            break;
+        case Type_Bool:
+            if (!r.Read(&flag))
+                return false;
+            *(bool *)fieldPtr = flag != 0;
+            break;
+        case Type_Int: case Type_Color: case Type_Float:
+            if (!r.Read(fieldPtr, 4))
+                return false;
+            break;
+        case Type_String:
+            free(*(WCHAR **)fieldPtr);
+            *(WCHAR **)fieldPtr = NULL;
+            if (!r.Read(&count))
+                return false;
+            if (count != (uint32_t)-1) {
+                if (count > r.Left() / sizeof(WCHAR))
+                    return false;
+                *(WCHAR **)fieldPtr = AllocArray<WCHAR>(count + 1);
+                if (!*(WCHAR **)fieldPtr || !r.Read(*(WCHAR **)fieldPtr, count * sizeof(WCHAR)))
+                    return false;
+            }
+            break;
+        case Type_Utf8String:
+            free(*(char **)fieldPtr);
+            *(char **)fieldPtr = NULL;
+            if (!r.Read(&count))
+                return false;
+            if (count != (uint32_t)-1) {
+                if (count > r.Left())
+                    return false;
+                *(char **)fieldPtr = AllocArray<char>(count + 1);
+                if (!*(char **)fieldPtr || !r.Read(*(char **)fieldPtr, count))
+                    return false;
+            }
+            break;
+        case Type_ColorArray: case Type_FloatArray: case Type_IntArray:
+            delete *(Vec<int> **)fieldPtr;
+            *(Vec<int> **)fieldPtr = new Vec<int>();
+            if (!r.Read(&count) || count > r.Left() / 4)
+                return false;
+            if (count > 0 && !r.Read((*(Vec<int> **)fieldPtr)->AppendBlanks(count), count * 4))
+                return false;
+            break;
+        default:
+            CrashIf(true);
+            return false;
+        }
+    }
+    return true;
+}
+
+char *SerializeStructBin(const StructInfo *info, const void *strct, size_t *sizeOut)
+{
+    str::Str<char> out;
+    SerializeStructBinRec(out, info, strct);
+    if (sizeOut)
+        *sizeOut = out.Size();
+    return out.StealData();
+}
+
+void *DeserializeStructBin(const StructInfo *info, const char *data, size_t dataLen)
+{
+    if (!data)
+        return NULL;
+    uint8_t *base = AllocArray<uint8_t>(info->structSize);
+    BinReader r(data, dataLen);
+    if (!base || !DeserializeStructBinRec(info, r, base) || r.Left() > 0) {
+        FreeStruct(info, base);
+        return NULL;
+    }
+    return base;
+}
+
 // TODO: keep Benc deserialization for at least three minor releases (ideally at least a year)
 
 #include "BencUtil.h"
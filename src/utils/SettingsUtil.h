@@ -53,6 +53,11 @@ char *SerializeStruct(const StructInfo *info, const void *strct, const char *pre
 void *DeserializeStruct(const StructInfo *info, const char *data, void *strct=NULL);
 void FreeStruct(const StructInfo *info, void *strct);
 
+// binary snapshots are only meant for caching the result of DeserializeStruct
+// (DeserializeStructBin returns NULL for truncated data or if the metadata changed)
+char *SerializeStructBin(const StructInfo *info, const void *strct, size_t *sizeOut=NULL);
+void *DeserializeStructBin(const StructInfo *info, const char *data, size_t dataLen);
+
 // Benc doesn't need compact serialization, so allow to use Type_Compact for custom deserialization
 class BencDict;
 typedef bool (* CompactCallback)(BencDict *dict, const FieldInfo *field, const char *fieldName, uint8_t *fieldPtr);
@@ -456,13 +456,46 @@ class WStrList {
     struct Item {
         WCHAR *string;
         uint32_t hash;
+        // 1 + index of the previous item in the same bucket (0 ends the chain)
+        size_t next;
 
-        Item(WCHAR *string=NULL, uint32_t hash=0) : string(string), hash(hash) { }
+        Item(WCHAR *string=NULL, uint32_t hash=0) : string(string), hash(hash), next(0) { }
     };
 
     Vec<Item> items;
     size_t count;
     Allocator *allocator;
+    // hash index over items: 1 + index of the item last appended to a bucket
+    // (the number of buckets is always a power of two)
+    Vec<size_t> buckets;
+
+    void Rehash() {
+        size_t size = 16;
+        while (size < count * 2)
+            size *= 2;
+        buckets.Reset();
+        buckets.AppendBlanks(size);
+        Item *item = items.LendData();
+        for (size_t i = 0; i < count; i++) {
+            size_t *bucket = &buckets.At(item[i].hash & (size - 1));
+            item[i].next = *bucket;
+            *bucket = i + 1;
+        }
+    }
+
+    // returns the smallest index >= startAt which matches str
+    template <bool caseSensitive>
+    int FindHashed(const WCHAR *str, size_t startAt) const {
+        uint32_t hash = GetQuickHashI(str);
+        Item *item = items.LendData();
+        int found = -1;
+        // chains run from the most recently appended item backwards
+        for (size_t i = count > 0 ? buckets.At(hash & (buckets.Count() - 1)) : 0; i > startAt; i = item[i - 1].next) {
+            if (item[i - 1].hash == hash && (caseSensitive ? str::Eq(item[i - 1].string, str) : str::EqI(item[i - 1].string, str)))
+                found = (int)(i - 1);
+        }
+        return found;
+    }
 
     // variation of MurmurHash2 which deals with strings that are
     // mostly ASCII and should be treated case independently
@@ -480,7 +513,7 @@ class WStrList {
 
 public:
     WStrList(size_t capHint=0, Allocator *allocator=NULL) :
-        items(capHint, allocator), count(0), allocator(allocator) { }
+        items(capHint, allocator), count(0), allocator(allocator), buckets(0, allocator) { }
 
     ~WStrList() {
         for (Item *item = items.IterStart(); item; item = items.IterNext()) {
@@ -500,26 +533,22 @@ public:
     void Append(WCHAR *str) {
         items.Append(Item(str, GetQuickHashI(str)));
         count++;
+        if (count > buckets.Count() / 2) {
+            Rehash();
+            return;
+        }
+        size_t *bucket = &buckets.At(items.At(count - 1).hash & (buckets.Count() - 1));
+        items.At(count - 1).next = *bucket;
+        *bucket = count;
     }
 
+    // Find and FindI don't modify the list and can be called concurrently
     int Find(const WCHAR *str, size_t startAt=0) const {
-        uint32_t hash = GetQuickHashI(str);
-        Item *item = items.LendData();
-        for (size_t i = startAt; i < count; i++) {
-            if (item[i].hash == hash && str::Eq(item[i].string, str))
-                return (int)i;
-        }
-        return -1;
+        return FindHashed<true>(str, startAt);
     }
 
     int FindI(const WCHAR *str, size_t startAt=0) const {
-        uint32_t hash = GetQuickHashI(str);
-        Item *item = items.LendData();
-        for (size_t i = startAt; i < count; i++) {
-            if (item[i].hash == hash && str::EqI(item[i].string, str))
-                return (int)i;
-        }
-        return -1;
+        return FindHashed<false>(str, startAt);
     }
 
     bool Contains(const WCHAR *str) const {
@@ -15,8 +15,10 @@
 
 ZipFile::ZipFile(const WCHAR *path, ZipMethod method, Allocator *allocator) :
     filenames(0, allocator), fileinfo(0, allocator), filepos(0, allocator),
-    allocator(allocator), commentLen(0)
+    allocator(allocator), commentLen(0), filePath(str::Dup(path))
 {
+    InitializeCriticalSection(&ufAccess);
+    InitializeCriticalSection(&readersAccess);
     zlib_filefunc64_def ffunc;
     fill_win32_filefunc64(&ffunc);
     uf = unzOpen2_64(path, &ffunc);
@@ -28,18 +30,73 @@ ZipFile::ZipFile(IStream *stream, ZipMethod method, Allocator *allocator) :
     filenames(0, allocator), fileinfo(0, allocator), filepos(0, allocator),
     allocator(allocator), commentLen(0)
 {
+    InitializeCriticalSection(&ufAccess);
+    InitializeCriticalSection(&readersAccess);
     zlib_filefunc64_def ffunc;
     fill_win32s_filefunc64(&ffunc);
     uf = unzOpen2_64(stream, &ffunc);
-    if (uf)
+    if (uf) {
+        stream->AddRef();
+        fileStream = stream;
         ExtractFilenames(method);
+    }
 }
 
 ZipFile::~ZipFile()
 {
-    if (!uf)
+    for (size_t i = 0; i < idleReaders.Count(); i++) {
+        unzClose(idleReaders.At(i));
+    }
+    if (uf)
+        unzClose(uf);
+    DeleteCriticalSection(&readersAccess);
+    DeleteCriticalSection(&ufAccess);
+}
+
+// opens another handle to the archive with its own file position
+unzFile ZipFile::OpenReader()
+{
+    zlib_filefunc64_def ffunc;
+    if (filePath) {
+        fill_win32_filefunc64(&ffunc);
+        return unzOpen2_64(filePath, &ffunc);
+    }
+    ScopedComPtr<IStream> stream;
+    if (!fileStream || FAILED(fileStream->Clone(&stream)))
+        return NULL;
+    fill_win32s_filefunc64(&ffunc);
+    return unzOpen2_64(stream, &ffunc);
+}
+
+unzFile ZipFile::AcquireReader()
+{
+    // in the common single-threaded case, this is all it takes
+    if (TryEnterCriticalSection(&ufAccess))
+        return uf;
+
+    unzFile reader = NULL;
+    EnterCriticalSection(&readersAccess);
+    if (idleReaders.Count() > 0)
+        reader = idleReaders.Pop();
+    LeaveCriticalSection(&readersAccess);
+    if (!reader)
+        reader = OpenReader();
+    if (reader)
+        return reader;
+
+    // the stream can't be cloned, so wait for uf to become available
+    EnterCriticalSection(&ufAccess);
+    return uf;
+}
+
+void ZipFile::ReleaseReader(unzFile reader)
+{
+    if (reader == uf) {
+        LeaveCriticalSection(&ufAccess);
         return;
-    unzClose(uf);
+    }
+    ScopedCritSec scope(&readersAccess);
+    idleReaders.Append(reader);
 }
 
 // cf. http://www.pkware.com/documents/casestudies/APPNOTE.TXT Appendix D
@@ -113,18 +170,27 @@ char *ZipFile::GetFileDataByIdx(size_t fileindex, size_t *len)
     if (fileindex >= filenames.Count())
         return NULL;
 
+    unzFile reader = AcquireReader();
+    char *result = ReadFileData(reader, fileindex, len);
+    ReleaseReader(reader);
+    return result;
+}
+
+char *ZipFile::ReadFileData(unzFile reader, size_t fileindex, size_t *len)
+{
     int err = -1;
-    if (filepos.At(fileindex).num_of_file != INVALID_ZIP_FILE_POS)
-        err = unzGoToFilePos64(uf, &filepos.At(fileindex));
+    unz64_file_pos fpos = filepos.At(fileindex);
+    if (fpos.num_of_file != INVALID_ZIP_FILE_POS)
+        err = unzGoToFilePos64(reader, &fpos);
     if (err != UNZ_OK) {
         char fileNameA[MAX_PATH];
         UINT cp = (fileinfo.At(fileindex).flag & (1 << 11)) ? CP_UTF8 : CP_ZIP;
         str::conv::ToCodePageBuf(fileNameA, dimof(fileNameA), filenames.At(fileindex), cp);
-        err = unzLocateFile(uf, fileNameA, 0);
+        err = unzLocateFile(reader, fileNameA, 0);
     }
     if (err != UNZ_OK)
         return NULL;
-    err = unzOpenCurrentFilePassword(uf, NULL);
+    err = unzOpenCurrentFilePassword(reader, NULL);
     if (err != UNZ_OK)
         return NULL;
 
@@ -133,13 +199,13 @@ char *ZipFile::GetFileDataByIdx(size_t fileindex, size_t *len)
     if (len2 != fileinfo.At(fileindex).uncompressed_size ||
         len2 + sizeof(WCHAR) < sizeof(WCHAR) ||
         len2 / 1024 > fileinfo.At(fileindex).compressed_size) {
-        unzCloseCurrentFile(uf);
+        unzCloseCurrentFile(reader);
         return NULL;
     }
 
     char *result = (char *)Allocator::Alloc(allocator, len2 + sizeof(WCHAR));
     if (result) {
-        unsigned int readBytes = unzReadCurrentFile(uf, result, len2);
+        unsigned int readBytes = unzReadCurrentFile(reader, result, len2);
         // zero-terminate for convenience
         result[len2] = result[len2 + 1] = '\0';
         if (readBytes != len2) {
@@ -151,7 +217,7 @@ char *ZipFile::GetFileDataByIdx(size_t fileindex, size_t *len)
         }
     }
 
-    err = unzCloseCurrentFile(uf);
+    err = unzCloseCurrentFile(reader);
     if (err != UNZ_OK) {
         // CRC mismatch, file content is likely damaged
         Allocator::Free(allocator, result);
@@ -185,6 +251,7 @@ char *ZipFile::GetComment(size_t *len)
     char *comment = (char *)Allocator::Alloc(allocator, commentLen + 1);
     if (!comment)
         return NULL;
+    ScopedCritSec scope(&ufAccess);
     int read = unzGetGlobalComment(uf, comment, commentLen);
     if (read <= 0) {
         Allocator::Free(allocator, comment);
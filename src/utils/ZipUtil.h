@@ -8,6 +8,9 @@
 
 enum ZipMethod { Zip_Any=-1, Zip_None=0, Zip_Deflate=8, Zip_Deflate64=9, Zip_Bzip=12 };
 
+// GetFileData* and GetFileTime may be called from several threads at once
+// (provided that the allocator is thread-safe): extraction uses independent
+// handles to the archive so that files are inflated concurrently
 class ZipFile {
     unzFile uf;
     Allocator *allocator;
@@ -16,7 +19,19 @@ class ZipFile {
     Vec<unz64_file_pos> filepos;
     uLong commentLen;
 
+    // uf is used by whoever holds ufAccess, other threads
+    // get one of idleReaders (or open another one)
+    CRITICAL_SECTION ufAccess;
+    CRITICAL_SECTION readersAccess;
+    Vec<unzFile> idleReaders;
+    ScopedMem<WCHAR> filePath;
+    ScopedComPtr<IStream> fileStream;
+
     void ExtractFilenames(ZipMethod method=Zip_Any);
+    unzFile OpenReader();
+    unzFile AcquireReader();
+    void ReleaseReader(unzFile reader);
+    char *ReadFileData(unzFile reader, size_t fileindex, size_t *len);
 
 public:
     ZipFile(const WCHAR *path, ZipMethod method=Zip_Any, Allocator *allocator=NULL);
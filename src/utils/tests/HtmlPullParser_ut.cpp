@@ -123,6 +123,108 @@ static void Test03()
     utassert(!t);
 }
 
+// the SSE2 scanner must produce exactly the same tokens as the scalar code
+static void CompareSimdTokens(const char *s, size_t len)
+{
+    bool prev = SetHtmlScanUseSimd(true);
+    HtmlPullParser parser1(s, len);
+    SetHtmlScanUseSimd(false);
+    HtmlPullParser parser2(s, len);
+    for (;;) {
+        SetHtmlScanUseSimd(true);
+        HtmlToken *t1 = parser1.Next();
+        SetHtmlScanUseSimd(false);
+        HtmlToken *t2 = parser2.Next();
+        utassert(!t1 == !t2);
+        if (!t1 || !t2)
+            break;
+        utassert(t1->type == t2->type && t1->s == t2->s);
+        if (t1->IsError())
+            utassert(t1->error == t2->error);
+        else
+            utassert(t1->sLen == t2->sLen);
+    }
+    SetHtmlScanUseSimd(prev);
+}
+
+static void Test04()
+{
+    const char *chars = "<<>>/'\"=!-?& \nab";
+    size_t charsLen = str::Len(chars);
+    char buf[200];
+    // simple deterministic pseudo-random generator
+    unsigned int seed = 1;
+    for (int i = 0; i < 2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t len = (seed >> 16) % (dimof(buf) - 1);
+        for (size_t j = 0; j < len; j++) {
+            seed = seed * 1103515245 + 12345;
+            unsigned int r = seed >> 16;
+            // mostly plain text, so that whole 16 byte chunks get skipped
+            buf[j] = r % 4 != 0 ? 'a' + r % 26 : chars[r / 4 % charsLen];
+        }
+        buf[len] = '\0';
+        CompareSimdTokens(buf, len);
+    }
+}
+
+// provides the data of a string chunkSize bytes at a time
+class ChunkedHtmlSource : public HtmlDataSource {
+    size_t len, loaded, chunkSize;
+
+public:
+    ChunkedHtmlSource(size_t len, size_t chunkSize) : len(len), loaded(0), chunkSize(chunkSize) { }
+    virtual size_t LoadMore() {
+        loaded = min(loaded + chunkSize, len);
+        return loaded;
+    }
+};
+
+// parsing data piece by piece must produce exactly the same tokens
+// as parsing all of it at once, no matter where the pieces end
+static void CompareChunkedTokens(const char *s, size_t len, size_t chunkSize)
+{
+    ChunkedHtmlSource source(len, chunkSize);
+    HtmlPullParser parser1(s, len);
+    HtmlPullParser parser2(s, 0, &source);
+    for (;;) {
+        HtmlToken *t1 = parser1.Next();
+        HtmlToken *t2 = parser2.Next();
+        utassert(!t1 == !t2);
+        if (!t1 || !t2)
+            break;
+        utassert(t1->type == t2->type && t1->s == t2->s);
+        if (t1->IsError())
+            utassert(t1->error == t2->error);
+        else
+            utassert(t1->sLen == t2->sLen);
+    }
+    utassert(parser2.Len() == len);
+}
+
+static void Test05()
+{
+    const char *s = "<p a1='>' foo=bar />text<!-- < skip > --> more text </b><?xml?>< a><br/>&amp;</></p ";
+    for (size_t chunkSize = 1; chunkSize <= 8; chunkSize++) {
+        CompareChunkedTokens(s, str::Len(s), chunkSize);
+    }
+
+    const char *chars = "<<>>/'\"=!-?& \nab";
+    size_t charsLen = str::Len(chars);
+    char buf[200];
+    unsigned int seed = 1;
+    for (int i = 0; i < 500; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t len = (seed >> 16) % (dimof(buf) - 1);
+        for (size_t j = 0; j < len; j++) {
+            seed = seed * 1103515245 + 12345;
+            buf[j] = chars[(seed >> 16) % charsLen];
+        }
+        buf[len] = '\0';
+        CompareChunkedTokens(buf, len, 1 + i % 5);
+    }
+}
+
 void HtmlPullParser_UnitTests()
 {
     Test00("<p a1='>' foo=bar />", HtmlToken::EmptyElementTag);
@@ -134,4 +236,6 @@ void HtmlPullParser_UnitTests()
     Test01();
     Test02();
     Test03();
+    Test04();
+    Test05();
 }
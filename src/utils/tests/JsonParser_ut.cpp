@@ -38,6 +38,72 @@ public:
     }
 };
 
+// collects all values for comparing json::Parse and json::PullParser
+class JsonCollector : public json::ValueVisitor {
+public:
+    str::Str<char> values;
+
+    virtual bool Visit(const char *path, const char *value, json::DataType type) {
+        values.AppendFmt("%d %s = %s\n", type, path, value);
+        return true;
+    }
+};
+
+static void JsonPullCompare(const char *json)
+{
+    JsonCollector collector;
+    bool ok = json::Parse(json, &collector);
+
+    str::Str<char> values;
+    json::PullParser parser(json, str::Len(json));
+    for (json::Token *tok; (tok = parser.Next()) != NULL; ) {
+        values.AppendFmt("%d ", tok->type);
+        parser.GetPath(values);
+        values.Append(" = ");
+        values.AppendAndFree(tok->GetValue());
+        values.Append("\n");
+    }
+    utassert(ok == !parser.IsError());
+    utassert(str::Eq(collector.values.Get(), values.Get()));
+}
+
+static void JsonPullTest(const char **jsonData, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        JsonPullCompare(jsonData[i]);
+    }
+
+    const char *json = "{\"a\\/b\": [1, { \"c\\u0064\": \"x\" }], \"e\": null}";
+    json::PullParser parser(json, str::Len(json));
+    json::Token *tok = parser.Next();
+    utassert(tok && json::Type_Number == tok->type && 1 == tok->sLen && '1' == *tok->s);
+    utassert(parser.PathIs("/a/b[0]") && parser.PathIs("/a/b[*]"));
+    utassert(!parser.PathIs("/a/b[1]") && !parser.PathIs("/a/b") && !parser.PathIs("/a\\/b[0]") && !parser.PathIs(""));
+    tok = parser.Next();
+    utassert(tok && json::Type_String == tok->type && str::EqN(tok->s, "x", tok->sLen));
+    utassert(parser.PathIs("/a/b[1]/cd") && parser.PathIs("/a/b[*]/cd") && !parser.PathIs("/a/b[1]/c"));
+    tok = parser.Next();
+    utassert(tok && json::Type_Null == tok->type && parser.PathIs("/e"));
+    utassert(!parser.Next() && !parser.IsError());
+
+    // the data doesn't have to be zero-terminated
+    json::PullParser parser2("[1, 23]45", 7);
+    utassert(parser2.Next() && parser2.PathIs("[0]"));
+    tok = parser2.Next();
+    utassert(tok && 2 == tok->sLen && parser2.PathIs("[1]"));
+    utassert(!parser2.Next() && !parser2.IsError());
+    json::PullParser parser3("\"abc\"", 3);
+    utassert(!parser3.Next() && parser3.IsError());
+
+    // nesting is limited
+    str::Str<char> deep;
+    for (int i = 0; i < 100; i++) {
+        deep.Append('[');
+    }
+    json::PullParser parser4(deep.Get(), deep.Size());
+    utassert(!parser4.Next() && parser4.IsError());
+}
+
 void JsonTest()
 {
     static const struct {
@@ -133,4 +199,18 @@ void JsonTest()
 }";
     JsonVerifier sampleVerifier(testData, dimof(testData));
     utassert(json::Parse(jsonSample, &sampleVerifier));
+
+    Vec<const char *> pullData;
+    for (size_t i = 0; i < dimof(validJsonData); i++) {
+        pullData.Append(validJsonData[i].json);
+    }
+    for (size_t i = 0; i < dimof(invalidJsonData); i++) {
+        pullData.Append(invalidJsonData[i].json);
+    }
+    for (size_t i = 0; i < dimof(invalidJson); i++) {
+        pullData.Append(invalidJson[i]);
+    }
+    pullData.Append(jsonSample);
+    pullData.Append(UTF8_BOM "{ \"\\u00e4\\/\\\"\" : [ [], {}, [[1], {\"\": -0.5e+3}] ] } ");
+    JsonPullTest(pullData.LendData(), pullData.Count());
 }
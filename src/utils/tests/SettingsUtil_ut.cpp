@@ -74,6 +74,80 @@ static const FieldInfo gSutStructFields[] = {
 };
 static const StructInfo gSutStructInfo = { sizeof(SutStruct), 15, gSutStructFields, "\0Boolean\0Color\0FloatingPoint\0Integer\0String\0NullString\0EscapedString\0Utf8String\0NullUtf8String\0EscapedUtf8String\0IntArray\0Point\0\0SutStructItems" };
 
+static void SutCompareVec(Vec<int> *v1, Vec<int> *v2)
+{
+    utassert(v1 && v2 && v1->Count() == v2->Count());
+    for (size_t i = 0; v1 && v2 && i < v1->Count() && i < v2->Count(); i++) {
+        utassert(v1->At(i) == v2->At(i));
+    }
+}
+
+static void SutCompareStructs(SutStruct *d1, SutStruct *d2)
+{
+    utassert(d1->boolean == d2->boolean && d1->color == d2->color);
+    utassert(d1->floatingPoint == d2->floatingPoint && d1->integer == d2->integer);
+    utassert(str::Eq(d1->string, d2->string) && str::Eq(d1->nullString, d2->nullString));
+    utassert(str::Eq(d1->escapedString, d2->escapedString));
+    utassert(str::Eq(d1->utf8String, d2->utf8String) && str::Eq(d1->nullUtf8String, d2->nullUtf8String));
+    utassert(str::Eq(d1->escapedUtf8String, d2->escapedUtf8String));
+    SutCompareVec(d1->intArray, d2->intArray);
+    utassert(d1->point == d2->point);
+    utassert(d1->sutStructItems->Count() == d2->sutStructItems->Count());
+    for (size_t i = 0; i < d1->sutStructItems->Count() && i < d2->sutStructItems->Count(); i++) {
+        SutStructItem *item1 = d1->sutStructItems->At(i), *item2 = d2->sutStructItems->At(i);
+        utassert(item1->compactPoint == item2->compactPoint);
+        SutCompareVec((Vec<int> *)item1->floatArray, (Vec<int> *)item2->floatArray);
+        utassert(item1->nested.point == item2->nested.point);
+        SutCompareVec((Vec<int> *)item1->nested.colorArray, (Vec<int> *)item2->nested.colorArray);
+    }
+}
+
+static void SettingsUtilBinTest(const char *serialized)
+{
+    // a binary snapshot must deserialize to the same values as the text it was created from
+    SutStruct *data = (SutStruct *)DeserializeStruct(&gSutStructInfo, serialized);
+    size_t binSize;
+    ScopedMem<char> bin(SerializeStructBin(&gSutStructInfo, data, &binSize));
+    SutStruct *binData = (SutStruct *)DeserializeStructBin(&gSutStructInfo, bin, binSize);
+    utassert(binData);
+    if (binData) {
+        SutCompareStructs(data, binData);
+        ScopedMem<char> reserialized(SerializeStruct(&gSutStructInfo, binData, serialized));
+        utassert(str::Eq(serialized, reserialized));
+    }
+    FreeStruct(&gSutStructInfo, binData);
+
+    // truncated snapshots and snapshots for different metadata are rejected
+    utassert(!DeserializeStructBin(&gSutStructInfo, bin, binSize - 1));
+    utassert(!DeserializeStructBin(&gSutStructInfo, bin, 0));
+    utassert(!DeserializeStructBin(&gSutStructItemInfo, bin, binSize));
+
+    // fields missing from a snapshot are reset to their defaults (as for text)
+    StructInfo shortInfo = gSutStructInfo;
+    shortInfo.fieldCount = 5;
+    bin.Set(SerializeStructBin(&shortInfo, data, &binSize));
+    binData = (SutStruct *)DeserializeStructBin(&gSutStructInfo, bin, binSize);
+    SutStruct *textData = (SutStruct *)DeserializeStruct(&gSutStructInfo, ScopedMem<char>(SerializeStruct(&shortInfo, data)));
+    utassert(binData && textData);
+    if (binData && textData) {
+        SutCompareStructs(textData, binData);
+        utassert(-1234567890 == binData->integer && str::Eq(binData->string, L"String"));
+    }
+    FreeStruct(&gSutStructInfo, binData);
+    FreeStruct(&gSutStructInfo, textData);
+    FreeStruct(&gSutStructInfo, data);
+
+    // default values (including NULL strings and empty arrays)
+    data = (SutStruct *)DeserializeStruct(&gSutStructInfo, NULL);
+    bin.Set(SerializeStructBin(&gSutStructInfo, data, &binSize));
+    binData = (SutStruct *)DeserializeStructBin(&gSutStructInfo, bin, binSize);
+    utassert(binData && !binData->nullString && !binData->nullUtf8String);
+    if (binData)
+        SutCompareStructs(data, binData);
+    FreeStruct(&gSutStructInfo, binData);
+    FreeStruct(&gSutStructInfo, data);
+}
+
 void SettingsUtilTest()
 {
     static const char *serialized = UTF8_BOM "# This file will be overwritten - modify at your own risk!\r\n\r\n\
@@ -167,4 +241,6 @@ Key = Value";
     utassert(PointI(111, 222) == data->point);
     utassert(data->sutStructItems && 0 == data->sutStructItems->Count());
     FreeStruct(&gSutStructInfo, data);
+
+    SettingsUtilBinTest(serialized);
 }
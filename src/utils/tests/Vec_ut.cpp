@@ -79,6 +79,23 @@ static void StrListTest()
     utassert(l.Find(L"One") == 2);
     utassert(l.FindI(L"One") == 0);
     utassert(l.Find(L"Two") == -1);
+    utassert(l.FindI(L"one", 1) == 2);
+    utassert(l.FindI(L"one", 3) == -1);
+
+    // enough items for the hash index to grow a few times
+    WStrList m;
+    for (int i = 0; i < 1000; i++) {
+        m.Append(str::Format(L"Images/Page%d.jpg", i % 500));
+    }
+    utassert(m.Count() == 1000);
+    for (int i = 0; i < 500; i++) {
+        ScopedMem<WCHAR> lower(str::Format(L"images/page%d.JPG", i));
+        utassert(m.FindI(lower) == i);
+        utassert(m.FindI(lower, i + 1) == i + 500);
+        utassert(m.Find(lower) == -1);
+        utassert(m.Find(m.At(i)) == i);
+    }
+    utassert(m.FindI(L"Images/Page500.jpg") == -1);
 }
 
 static size_t VecTestAppendFmt()